@@ -2,6 +2,8 @@ package com.os.imageprocessor;
 
 import android.graphics.Bitmap;
 
+import java.nio.ByteBuffer;
+
 public class JniBridge {
     static {
         System.loadLibrary("core_native_image_processor");
@@ -13,13 +15,291 @@ public class JniBridge {
 
     public static native boolean BlurImage(Bitmap bitmap, int radius, int sigma, boolean optimizeNeon);
 
+    /**
+     * border: 0 = clamp, 1 = reflect, 2 = wrap, 3 = constant black. Every pixel is filtered.
+     */
+    public static native boolean BlurImageBorder(Bitmap bitmap, int radius, int sigma, int border,
+                                                 boolean optimizeNeon);
+
     public static native boolean Embross(Bitmap bitmap, boolean optimizeNeon);
 
     public static native boolean Sharpen(Bitmap bitmap, boolean optimizeNeon);
 
+    /**
+     * border: 0 = clamp, 1 = reflect, 2 = wrap, 3 = constant black. Every pixel is filtered.
+     */
+    public static native boolean SharpenBorder(Bitmap bitmap, int border, boolean optimizeNeon);
+
     public static native boolean EdgeDetection(Bitmap bitmap, boolean optimizeNeon);
 
+    /**
+     * Median of the (2 radius + 1) square window per channel, radius up to 127.
+     */
+    public static native boolean MedianFilter(Bitmap bitmap, int radius, boolean optimizeNeon);
+
+    /**
+     * Edge preserving smoothing. sigmaSpatial is in pixels, sigmaRange in luminance levels (0 - 255).
+     */
+    public static native boolean BilateralFilter(Bitmap bitmap, float sigmaSpatial, float sigmaRange,
+                                                 boolean optimizeNeon);
+
+    /**
+     * Canny edges of the luminance, white on black. Thresholds are sobel magnitudes (0 - 255).
+     */
+    public static native boolean CannyEdgeDetection(Bitmap bitmap, int lowThreshold, int highThreshold,
+                                                    boolean optimizeNeon);
+
+    /**
+     * Canny edges of a single 8 bit plane, e.g. the camera Y plane. edges receives width * height bytes,
+     * 255 on an edge and 0 elsewhere. Returns false when the size or stride is invalid or an array is
+     * too small for it.
+     */
+    public static native boolean cannyPlane(byte[] plane, int width, int height, int stride, byte[] edges,
+                                            int lowThreshold, int highThreshold, boolean optimizeNeon);
+
+    /**
+     * Packed 4:2:0 copy of the bitmap, out holds width * height luma bytes followed by the chroma.
+     * layout: 0 = I420, 1 = NV12, 2 = NV21. matrix: 0 = BT.601, 1 = BT.709.
+     */
+    public static native boolean rgbaToYuv(Bitmap bitmap, byte[] out, int layout, int matrix, boolean fullRange,
+                                           boolean optimizeNeon);
+
+    /**
+     * Same conversion written into direct buffers with arbitrary strides, e.g. the planes of a MediaCodec input
+     * image. A chroma pixel stride of 2 with interleaved u / v buffers gives NV12 or NV21.
+     */
+    public static native boolean rgbaToYuvPlanes(Bitmap bitmap, ByteBuffer yPlane, int yRowStride, ByteBuffer uPlane,
+                                                 int uRowStride, ByteBuffer vPlane, int vRowStride,
+                                                 int chromaPixelStride, int matrix, boolean fullRange,
+                                                 boolean optimizeNeon);
+
+    /**
+     * magnitudeMode: 0 = |gx| + |gy|, 1 = alpha max beta min, 2 = exact sqrt.
+     * direction is optional, width * height bytes receiving the quantised gradient direction (0..3).
+     */
+    public static native boolean EdgeDetectionWithMode(Bitmap bitmap, int magnitudeMode, byte[] direction,
+                                                       boolean optimizeNeon);
+
+    /**
+     * ops holds PROCESS_TYPE ordinals applied in order, the image is converted to planar only once.
+     */
+    public static native boolean ApplyFilterChain(Bitmap bitmap, int[] ops, int radius, int sigma,
+                                                  boolean optimizeNeon);
+
+    /**
+     * ApplyFilterChain from src into dst, both ARGB_8888 of the same size. src is only read, so no
+     * copy of it is needed; dst can come from a pool and be reused for every frame.
+     */
+    public static native boolean ApplyFilterChainTo(Bitmap src, Bitmap dst, int[] ops, int radius, int sigma,
+                                                    boolean optimizeNeon);
+
+    /**
+     * Receives the result of an async call, on a native worker thread.
+     */
+    public interface CompletionCallback {
+        void onComplete(boolean success);
+    }
+
+    /**
+     * ApplyFilterChain on the native workers, returning at once. callback runs on a worker when the
+     * bitmap has been written; false when the bitmap is invalid and nothing was queued. The bitmap
+     * must not be touched until then.
+     */
+    public static native boolean ApplyFilterChainAsync(Bitmap bitmap, int[] ops, int radius, int sigma,
+                                                       boolean optimizeNeon,
+                                                       CompletionCallback callback);
+
     public static native void convert_yuv_rgba(byte[] yPixels, byte[] vPixels, byte[] uPixels, Bitmap outBitmap,
                                                int width, int height, int yStride, int dstStride,
                                                int uRowStride, int vRowStride, int uPixelStride, int vPixelStride, boolean optimizeNeon);
+
+    /**
+     * Change tracker for width x height frames, 0 when the size is not positive or the threshold is negative.
+     */
+    public static native long createFrameTracker(int width, int height, int threshold);
+
+    public static native void releaseFrameTracker(long handle);
+
+    public static native void convert_yuv_rgba_incremental(long handle, byte[] yPixels, byte[] vPixels, byte[] uPixels,
+                                                           Bitmap outBitmap, int yStride, int dstStride,
+                                                           int uRowStride, int vRowStride, int uPixelStride,
+                                                           int vPixelStride, boolean optimizeNeon);
+
+    /**
+     * Incremental conversion into rgbaBitmap followed by the ops chain into outBitmap, re-filtering only the rows
+     * that read a changed row. Pass the same two bitmaps and ops on every frame.
+     */
+    public static native boolean convert_filter_incremental(long handle, byte[] yPixels, byte[] vPixels,
+                                                            byte[] uPixels, Bitmap rgbaBitmap, Bitmap outBitmap,
+                                                            int yStride, int uRowStride, int vRowStride,
+                                                            int uPixelStride, int vPixelStride, int[] ops,
+                                                            int radius, int sigma, boolean optimizeNeon);
+
+    public static native void invalidateFrameTracker(long handle);
+
+    public static native float getSkippedFraction(long handle, boolean lastFrameOnly);
+
+    /**
+     * Denoiser for width x height frames, 0 when the size or frame count is not positive or the threshold is
+     * negative.
+     */
+    public static native long createTemporalDenoiser(int width, int height, int frames, int threshold);
+
+    public static native void releaseTemporalDenoiser(long handle);
+
+    /**
+     * Denoises the planes in place against the earlier frames of the denoiser's window. Returns false when the
+     * strides or plane lengths do not cover a frame of the denoiser's size.
+     */
+    public static native boolean denoise_yuv(long handle, byte[] yPixels, byte[] vPixels, byte[] uPixels,
+                                             int yStride, int uRowStride, int vRowStride, int uPixelStride,
+                                             int vPixelStride, boolean optimizeNeon);
+
+    public static native void resetTemporalDenoiser(long handle);
+
+    /**
+     * Loads the tuned kernel plans saved in directory, false when missing or measured on another cpu.
+     */
+    public static native boolean loadTuningProfile(String directory);
+
+    /**
+     * Benchmarks every kernel across thread counts, grain sizes and scalar vs NEON, keeps the fastest
+     * plan and saves it to directory. Takes up to a few seconds, do not run other filters meanwhile.
+     */
+    public static native boolean calibrateKernels(String directory, int iterations);
+
+    /**
+     * policy: 0 = all cores, 1 = performance cores only, 2 = all but one core reserved for the camera thread.
+     * Applies to the filters started afterwards.
+     */
+    public static native void setAffinityPolicy(int policy);
+
+    /**
+     * Lane (0 preview, 1 batch) of the native work started from the calling thread. Returns the
+     * previous lane so it can be restored.
+     */
+    public static native int setTaskPriority(int priority);
+
+    /**
+     * Nice value the native workers use while running tasks of the lane.
+     */
+    public static native void setLaneNice(int priority, int nice);
+
+    /**
+     * Five floats per lane, preview first: queue depth, peak depth, tasks started, mean and max
+     * wait in microseconds. reset starts a new measuring window afterwards.
+     */
+    public static native float[] getLaneStats(boolean reset);
+
+    /**
+     * Records kernel and row slice timings from now on. False when the library was built
+     * without IP_ENABLE_TRACING.
+     */
+    public static native boolean setTracingEnabled(boolean enabled);
+
+    /**
+     * Writes the recorded events as Chrome trace JSON, for Perfetto or chrome://tracing.
+     */
+    public static native boolean dumpTrace(String path);
+
+    /**
+     * Pushes empty tasks through the old mutex queue and the lock free pool queue at 4, 8, 12 and 16
+     * threads. Five floats per thread count: threads, mutex ns/task, lock free ns/task, mutex latency
+     * and lock free latency in microseconds.
+     */
+    public static native float[] benchmarkDispatch(int tasks);
+
+    /**
+     * Pins the calling thread to the core left free by the reserve camera core policy.
+     */
+    public static native boolean pinCameraThread();
+
+    /**
+     * Controller for a frame budget of targetFrameMs, 0 when the target is not positive.
+     */
+    public static native long createQualityController(float targetFrameMs);
+
+    public static native void releaseQualityController(long handle);
+
+    public static native void setQualityTarget(long handle, float targetFrameMs);
+
+    /**
+     * stage: 0 = convert, 1 = downsample, 2 = filter, 3 = output. Time is added to the current frame.
+     */
+    public static native void recordQualityStage(long handle, int stage, float ms);
+
+    /**
+     * Applies the PROCESS_TYPE ordinal op at the quality the controller currently allows and ends the frame.
+     */
+    public static native boolean processWithQuality(long handle, Bitmap bitmap, int op, int radius, int sigma,
+                                                    boolean optimizeNeon);
+
+    /**
+     * level, scale, radius factor, thread cap, frame time ema, then the ema of the 4 stages in ms. null for a 0
+     * handle.
+     */
+    public static native float[] getQualityState(long handle);
+
+    /**
+     * histogram receives 4 * 256 counts (R, G, B, luma), stats 4 * 4 values (min, max, mean, variance per channel).
+     */
+    public static native boolean computeHistogram(Bitmap bitmap, int[] histogram, float[] stats, boolean optimizeNeon);
+
+    /**
+     * Histogram of a single 8 bit plane, e.g. the camera Y plane. histogram holds 256 counts, stats min, max, mean,
+     * variance. Returns false when the size or stride does not fit plane or an output array is too small.
+     */
+    public static native boolean computePlaneHistogram(byte[] plane, int width, int height, int stride,
+                                                       int[] histogram, float[] stats, boolean optimizeNeon);
+
+    /**
+     * clipFraction of the pixels saturate at each end of every channel.
+     */
+    public static native boolean AutoLevels(Bitmap bitmap, float clipFraction, boolean optimizeNeon);
+
+    public static native boolean EqualizeHistogram(Bitmap bitmap, boolean optimizeNeon);
+
+    /**
+     * clipLimit is the allowed bin height as a multiple of the mean bin height, 2 to 4 are typical.
+     */
+    public static native boolean Clahe(Bitmap bitmap, int tilesX, int tilesY, float clipLimit, boolean optimizeNeon);
+
+    /**
+     * Enhances a single 8 bit plane in place. mode: 0 = auto levels (param is the clip fraction), 1 = equalise,
+     * 2 = CLAHE with 8 x 8 tiles (param is the clip limit). Returns false when the size or stride does not fit plane.
+     */
+    public static native boolean enhancePlane(byte[] plane, int width, int height, int stride, int mode, float param,
+                                              boolean optimizeNeon);
+
+    /**
+     * Box blur of a (2 radius + 1) square window, the time does not grow with the radius.
+     */
+    public static native boolean BoxBlur(Bitmap bitmap, int radius, boolean optimizeNeon);
+
+    /**
+     * Black and white output, white where the luminance is above the window mean minus offset.
+     */
+    public static native boolean AdaptiveThreshold(Bitmap bitmap, int radius, int offset, boolean optimizeNeon);
+
+    /**
+     * Normalises the local standard deviation of the luminance, strength in [0, 1].
+     */
+    public static native boolean LocalContrast(Bitmap bitmap, int radius, float strength, boolean optimizeNeon);
+
+    /**
+     * op: 0 = erode, 1 = dilate, 2 = open, 3 = close with a (2 radiusX + 1) x (2 radiusY + 1) rectangle.
+     * lumaOnly filters the luminance and writes gray, otherwise R, G and B are filtered separately.
+     */
+    public static native boolean Morphology(Bitmap bitmap, int op, int radiusX, int radiusY, boolean lumaOnly,
+                                            boolean optimizeNeon);
+
+    /**
+     * Session fixed to the geometry of bitmap and to the chain of PROCESS_TYPE ordinals, 0 when either is invalid
+     * or ops is empty. processSession returns false for a bitmap whose width, height, stride or config differ.
+     */
+    public static native long createSession(Bitmap bitmap, int[] ops, int radius, int sigma, boolean optimizeNeon);
+
+    public static native void releaseSession(long handle);
+
+    public static native boolean processSession(long handle, Bitmap bitmap);
 }
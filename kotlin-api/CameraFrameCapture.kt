@@ -42,6 +42,8 @@ class CameraFrameCapture : AppCompatActivity() {
     private lateinit var uArray: ByteArray
     private lateinit var vArray: ByteArray
     private var firstRun = true
+    // ring of the last frames for the temporal denoise, owned by the camera executor
+    private var denoiserHandle = 0L
 
     private var avgTimeMs = 0.0
     private var initialized = false
@@ -69,6 +71,13 @@ class CameraFrameCapture : AppCompatActivity() {
 
     override fun onDestroy() {
         super.onDestroy()
+        // released on the executor so a frame still in flight finishes with it first
+        cameraExecutor.execute {
+            if (denoiserHandle != 0L) {
+                JniBridge.releaseTemporalDenoiser(denoiserHandle)
+                denoiserHandle = 0L
+            }
+        }
         cameraExecutor.shutdown()
     }
 
@@ -124,6 +133,7 @@ class CameraFrameCapture : AppCompatActivity() {
             yArray = ByteArray(yBuffer.remaining())
             uArray = ByteArray(uBuffer.remaining())
             vArray = ByteArray(vBuffer.remaining())
+            denoiserHandle = JniBridge.createTemporalDenoiser(w, h, 4, 16)
             firstRun = false
         }
 
@@ -137,6 +147,20 @@ class CameraFrameCapture : AppCompatActivity() {
         }
 
         val start = System.nanoTime()
+        if (denoiserHandle != 0L) {
+            JniBridge.denoise_yuv(
+                denoiserHandle,
+                yArray,
+                vArray,
+                uArray,
+                yStride,
+                uRowStride,
+                vRowStride,
+                uPixelStride,
+                vPixelStride,
+                switchNeon.isChecked
+            )
+        }
         JniBridge.convert_yuv_rgba(
             yArray,
             vArray,
@@ -2,10 +2,17 @@ package com.os.imageprocessor
 
 import android.content.Context
 import android.graphics.Bitmap
+import android.media.Image
 import android.util.Log
 import android.widget.ImageView
 import android.widget.Toast
+import java.io.File
+import kotlin.coroutines.AbstractCoroutineContextElement
+import kotlin.coroutines.CoroutineContext
+import kotlin.coroutines.resume
 import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.ThreadContextElement
+import kotlinx.coroutines.suspendCancellableCoroutine
 import kotlinx.coroutines.withContext
 
 class NativeImageProcessor {
@@ -16,9 +23,108 @@ class NativeImageProcessor {
             Blur,
             SHARPEN,
             EMBOSS,
-            SOBEL_EDGE
+            SOBEL_EDGE,
+            MEDIAN
         }
 
+        enum class AFFINITY_POLICY(val nativeValue: Int) {
+            ALL_CORES(0),
+            PERFORMANCE_CORES(1),
+            RESERVE_CAMERA_CORE(2)
+        }
+
+        enum class TASK_PRIORITY(val nativeValue: Int) {
+            PREVIEW(0),
+            BATCH(1)
+        }
+
+        enum class MORPH_OP(val nativeValue: Int) {
+            ERODE(0),
+            DILATE(1),
+            OPEN(2),
+            CLOSE(3)
+        }
+
+        enum class EDGE_MAGNITUDE(val nativeValue: Int) {
+            L1(0),
+            ALPHA_MAX_BETA_MIN(1),
+            EXACT(2)
+        }
+
+        /**
+         * Picks the per device thread count, row grain and backend of every kernel. The plan is
+         * loaded from the app files dir when it was measured on this cpu, otherwise the kernels
+         * are benchmarked once and the result is saved. Call before the first processing call.
+         */
+        suspend fun autoTune(
+            context: Context,
+            force: Boolean = false,
+            iterations: Int = 3
+        ): Boolean = withContext(Dispatchers.Default) {
+            val directory = context.filesDir.absolutePath
+            if (!force && JniBridge.loadTuningProfile(directory)) return@withContext true
+            JniBridge.calibrateKernels(directory, iterations)
+        }
+
+        /** Chooses which cores the native worker threads run on, see [AFFINITY_POLICY]. */
+        fun setAffinityPolicy(policy: AFFINITY_POLICY) =
+            JniBridge.setAffinityPolicy(policy.nativeValue)
+
+        /**
+         * Call from the camera / analyzer thread together with
+         * [AFFINITY_POLICY.RESERVE_CAMERA_CORE] so it keeps a performance core to itself.
+         */
+        fun pinCurrentThreadAsCamera(): Boolean = JniBridge.pinCameraThread()
+
+        /**
+         * Nice value of the native workers while they run work of [priority]. Defaults are -4
+         * for preview and 10 for batch, Android's display and background priorities.
+         */
+        fun setLaneNice(priority: TASK_PRIORITY, nice: Int) =
+            JniBridge.setLaneNice(priority.nativeValue, nice)
+
+        /** Queue depth and wait times of the native worker lanes, preview first. */
+        fun laneStats(reset: Boolean = false): List<LaneStatistics> {
+            val values = JniBridge.getLaneStats(reset)
+            return TASK_PRIORITY.values().map {
+                val base = it.nativeValue * 5
+                LaneStatistics(
+                    it,
+                    values[base].toInt(),
+                    values[base + 1].toInt(),
+                    values[base + 2].toLong(),
+                    values[base + 3],
+                    values[base + 4]
+                )
+            }
+        }
+
+        /**
+         * Starts or stops recording which worker ran which rows of every kernel. Returns false
+         * when the native library was built without IP_ENABLE_TRACING.
+         */
+        fun setTracing(enabled: Boolean): Boolean = JniBridge.setTracingEnabled(enabled)
+
+        /**
+         * Writes the recorded trace to the app files dir. Open the file in Perfetto or
+         * chrome://tracing. Returns null when nothing could be written.
+         */
+        suspend fun dumpTrace(context: Context): File? = withContext(Dispatchers.IO) {
+            val file = File(context.filesDir, "native_trace.json")
+            if (JniBridge.dumpTrace(file.absolutePath)) file else null
+        }
+
+        /**
+         * Compares the lock free task queue of the native pool with the mutex queue it
+         * replaced. Takes a few seconds, keep it off the preview path.
+         */
+        suspend fun benchmarkDispatch(tasks: Int = 200_000): List<DispatchBenchmarkResult> =
+            withContext(Dispatchers.Default) {
+                JniBridge.benchmarkDispatch(tasks).toList().chunked(5).map {
+                    DispatchBenchmarkResult(it[0].toInt(), it[1], it[2], it[3], it[4])
+                }
+            }
+
         suspend fun processImage(
             context: Context,
             bitmap: Bitmap,
@@ -42,6 +148,7 @@ class NativeImageProcessor {
                 PROCESS_TYPE.SHARPEN -> JniBridge.Sharpen(mutable, optimizeNeon)
                 PROCESS_TYPE.EMBOSS -> JniBridge.Embross(mutable, optimizeNeon)
                 PROCESS_TYPE.SOBEL_EDGE -> JniBridge.EdgeDetection(mutable, optimizeNeon)
+                PROCESS_TYPE.MEDIAN -> JniBridge.MedianFilter(mutable, radius, optimizeNeon)
             }
             val end = System.nanoTime()
             val processTime = (end - start) / 1_000_000.0f
@@ -51,6 +158,380 @@ class NativeImageProcessor {
             return@withContext mutable
         }
 
+        /**
+         * Applies [processes] one after the other. Prefer this over repeated [processImage] calls,
+         * the NEON path keeps the image in planar form between the filters.
+         */
+        suspend fun processChain(
+            context: Context,
+            bitmap: Bitmap,
+            processes: List<PROCESS_TYPE>,
+            optimizeNeon: Boolean,
+            radius: Int = 3,
+            sigma: Int = 5
+        ): Bitmap = withContext(Dispatchers.Default) {
+            val mutable = bitmap.copy(Bitmap.Config.ARGB_8888, true)
+            val ops = IntArray(processes.size) { processes[it].ordinal }
+            val start = System.nanoTime()
+            val result = JniBridge.ApplyFilterChain(mutable, ops, radius, sigma, optimizeNeon)
+            val end = System.nanoTime()
+            val processTime = (end - start) / 1_000_000.0f
+            Log.v("LOGV", "Chain Process Time ${"%.2f".format(processTime)}")
+            if (!result) Toast.makeText(context, "Image processing Failed", Toast.LENGTH_LONG)
+                .show()
+            return@withContext mutable
+        }
+
+        /**
+         * Writes [processes] applied to [src] into [dst] without copying [src] first. [dst] must
+         * be a mutable ARGB_8888 bitmap of the same size, e.g. from a [BitmapPool].
+         */
+        suspend fun processInto(
+            src: Bitmap,
+            dst: Bitmap,
+            processes: List<PROCESS_TYPE>,
+            optimizeNeon: Boolean,
+            radius: Int = 3,
+            sigma: Int = 5
+        ): Boolean = withContext(Dispatchers.Default) {
+            val ops = IntArray(processes.size) { processes[it].ordinal }
+            JniBridge.ApplyFilterChainTo(src, dst, ops, radius, sigma, optimizeNeon)
+        }
+
+        /**
+         * [processChain] on [bitmap] itself, which must be mutable ARGB_8888; nothing is copied.
+         */
+        suspend fun processInPlace(
+            bitmap: Bitmap,
+            processes: List<PROCESS_TYPE>,
+            optimizeNeon: Boolean,
+            radius: Int = 3,
+            sigma: Int = 5
+        ): Boolean = withContext(Dispatchers.Default) {
+            val ops = IntArray(processes.size) { processes[it].ordinal }
+            JniBridge.ApplyFilterChain(bitmap, ops, radius, sigma, optimizeNeon)
+        }
+
+        /**
+         * [processChain] with the output taken from [pool] instead of a fresh copy of [bitmap].
+         * Hand the result back with [BitmapPool.release] once it is no longer shown. Returns
+         * null when processing failed.
+         */
+        suspend fun processPooled(
+            bitmap: Bitmap,
+            processes: List<PROCESS_TYPE>,
+            pool: BitmapPool,
+            optimizeNeon: Boolean,
+            radius: Int = 3,
+            sigma: Int = 5
+        ): Bitmap? {
+            val dst = pool.acquire(bitmap.width, bitmap.height)
+            if (processInto(bitmap, dst, processes, optimizeNeon, radius, sigma)) return dst
+            pool.release(dst)
+            return null
+        }
+
+        /**
+         * [processChain] without holding a dispatcher thread while the filters run: the chain
+         * is queued on the native workers and the coroutine resumes from their completion
+         * callback, so many images can be in flight on a small dispatcher. Runs on the lane of
+         * [NativeTaskPriority]. Returns null when processing failed. Cancelling only stops the
+         * wait, the native side still finishes writing its private copy.
+         */
+        suspend fun processChainAsync(
+            bitmap: Bitmap,
+            processes: List<PROCESS_TYPE>,
+            optimizeNeon: Boolean,
+            radius: Int = 3,
+            sigma: Int = 5
+        ): Bitmap? {
+            val mutable = withContext(Dispatchers.Default) {
+                bitmap.copy(Bitmap.Config.ARGB_8888, true)
+            }
+            val ops = IntArray(processes.size) { processes[it].ordinal }
+            val processed = suspendCancellableCoroutine<Boolean> { continuation ->
+                val queued = JniBridge.ApplyFilterChainAsync(
+                    mutable, ops, radius, sigma, optimizeNeon,
+                    JniBridge.CompletionCallback { success -> continuation.resume(success) }
+                )
+                if (!queued) continuation.resume(false)
+            }
+            return if (processed) mutable else null
+        }
+
+        /**
+         * Integer luminance sobel. When [direction] is given it must hold width * height bytes
+         * and receives the quantised gradient direction (0 = 0deg, 1 = 45deg, 2 = 90deg, 3 = 135deg).
+         */
+        suspend fun detectEdges(
+            bitmap: Bitmap,
+            magnitude: EDGE_MAGNITUDE,
+            optimizeNeon: Boolean,
+            direction: ByteArray? = null
+        ): Boolean = withContext(Dispatchers.Default) {
+            JniBridge.EdgeDetectionWithMode(bitmap, magnitude.nativeValue, direction, optimizeNeon)
+        }
+
+        enum class PLANE_ENHANCEMENT(val nativeValue: Int) {
+            AUTO_LEVELS(0),
+            EQUALIZE(1),
+            CLAHE(2)
+        }
+
+        suspend fun analyze(
+            bitmap: Bitmap,
+            optimizeNeon: Boolean
+        ): ImageStatistics? = withContext(Dispatchers.Default) {
+            val histogram = IntArray(4 * 256)
+            val stats = FloatArray(4 * 4)
+            if (!JniBridge.computeHistogram(bitmap, histogram, stats, optimizeNeon)) {
+                return@withContext null
+            }
+            ImageStatistics(
+                List(4) { c -> histogram.copyOfRange(c * 256, (c + 1) * 256) },
+                List(4) { c -> ChannelStatistics.from(stats, c) }
+            )
+        }
+
+        /**
+         * Histogram and statistics of a single 8 bit plane such as the camera Y plane. Returns
+         * null when the size does not fit [plane].
+         */
+        suspend fun analyzePlane(
+            plane: ByteArray,
+            width: Int,
+            height: Int,
+            stride: Int,
+            optimizeNeon: Boolean
+        ): Pair<IntArray, ChannelStatistics>? = withContext(Dispatchers.Default) {
+            val histogram = IntArray(256)
+            val stats = FloatArray(4)
+            val computed = JniBridge.computePlaneHistogram(
+                plane, width, height, stride, histogram, stats, optimizeNeon
+            )
+            if (computed) Pair(histogram, ChannelStatistics.from(stats, 0)) else null
+        }
+
+        /** Stretches every channel, [clipFraction] of the pixels saturate at each end. */
+        suspend fun autoLevels(
+            bitmap: Bitmap,
+            optimizeNeon: Boolean,
+            clipFraction: Float = 0.005f
+        ): Boolean = withContext(Dispatchers.Default) {
+            JniBridge.AutoLevels(bitmap, clipFraction, optimizeNeon)
+        }
+
+        suspend fun equalize(
+            bitmap: Bitmap,
+            optimizeNeon: Boolean
+        ): Boolean = withContext(Dispatchers.Default) {
+            JniBridge.EqualizeHistogram(bitmap, optimizeNeon)
+        }
+
+        suspend fun clahe(
+            bitmap: Bitmap,
+            optimizeNeon: Boolean,
+            tilesX: Int = 8,
+            tilesY: Int = 8,
+            clipLimit: Float = 2.5f
+        ): Boolean = withContext(Dispatchers.Default) {
+            JniBridge.Clahe(bitmap, tilesX, tilesY, clipLimit, optimizeNeon)
+        }
+
+        /**
+         * Enhances a Y plane in place before conversion. [param] is the clip fraction for
+         * [PLANE_ENHANCEMENT.AUTO_LEVELS] and the clip limit for [PLANE_ENHANCEMENT.CLAHE].
+         * Returns false when the size does not fit [plane].
+         */
+        suspend fun enhancePlane(
+            plane: ByteArray,
+            width: Int,
+            height: Int,
+            stride: Int,
+            mode: PLANE_ENHANCEMENT,
+            optimizeNeon: Boolean,
+            param: Float = if (mode == PLANE_ENHANCEMENT.CLAHE) 2.5f else 0.005f
+        ): Boolean = withContext(Dispatchers.Default) {
+            JniBridge.enhancePlane(
+                plane, width, height, stride, mode.nativeValue, param, optimizeNeon
+            )
+        }
+
+        /**
+         * Smooths flat areas such as skin while keeping edges. The time does not grow with
+         * [sigmaSpatial]; a smaller [sigmaRange] preserves weaker edges.
+         */
+        suspend fun bilateral(
+            bitmap: Bitmap,
+            optimizeNeon: Boolean,
+            sigmaSpatial: Float = 16f,
+            sigmaRange: Float = 24f
+        ): Boolean = withContext(Dispatchers.Default) {
+            JniBridge.BilateralFilter(bitmap, sigmaSpatial, sigmaRange, optimizeNeon)
+        }
+
+        /**
+         * Thin, connected edges (Canny). Weak edges above [lowThreshold] survive only when they
+         * connect to a strong edge above [highThreshold].
+         */
+        suspend fun cannyEdges(
+            bitmap: Bitmap,
+            optimizeNeon: Boolean,
+            lowThreshold: Int = 40,
+            highThreshold: Int = 100
+        ): Boolean = withContext(Dispatchers.Default) {
+            JniBridge.CannyEdgeDetection(bitmap, lowThreshold, highThreshold, optimizeNeon)
+        }
+
+        /**
+         * Canny edges of a Y plane, 255 on an edge and 0 elsewhere, width * height bytes.
+         * Returns null when the size does not fit [plane].
+         */
+        suspend fun cannyPlane(
+            plane: ByteArray,
+            width: Int,
+            height: Int,
+            stride: Int,
+            optimizeNeon: Boolean,
+            lowThreshold: Int = 40,
+            highThreshold: Int = 100
+        ): ByteArray? = withContext(Dispatchers.Default) {
+            if (width <= 0 || height <= 0) return@withContext null
+            val edges = ByteArray(width * height)
+            val detected = JniBridge.cannyPlane(
+                plane, width, height, stride, edges, lowThreshold, highThreshold, optimizeNeon
+            )
+            if (detected) edges else null
+        }
+
+        enum class YUV_LAYOUT(val nativeValue: Int) {
+            I420(0),
+            NV12(1),
+            NV21(2)
+        }
+
+        enum class YUV_MATRIX(val nativeValue: Int) {
+            BT601(0),
+            BT709(1)
+        }
+
+        /**
+         * Packed 4:2:0 copy of [bitmap] for an encoder, luma first then the chroma of [layout].
+         * Limited range unless [fullRange]. Returns null when the conversion failed.
+         */
+        suspend fun toYuv(
+            bitmap: Bitmap,
+            layout: YUV_LAYOUT,
+            optimizeNeon: Boolean,
+            matrix: YUV_MATRIX = YUV_MATRIX.BT601,
+            fullRange: Boolean = false
+        ): ByteArray? = withContext(Dispatchers.Default) {
+            val chromaSize = ((bitmap.width + 1) / 2) * ((bitmap.height + 1) / 2)
+            val out = ByteArray(bitmap.width * bitmap.height + 2 * chromaSize)
+            val converted = JniBridge.rgbaToYuv(
+                bitmap, out, layout.nativeValue, matrix.nativeValue, fullRange, optimizeNeon
+            )
+            if (converted) out else null
+        }
+
+        /**
+         * Writes [bitmap] straight into a YUV_420_888 [image], e.g. from
+         * MediaCodec.getInputImage, whatever its row and pixel strides.
+         */
+        suspend fun writeYuvImage(
+            bitmap: Bitmap,
+            image: Image,
+            optimizeNeon: Boolean,
+            matrix: YUV_MATRIX = YUV_MATRIX.BT601,
+            fullRange: Boolean = false
+        ): Boolean = withContext(Dispatchers.Default) {
+            val planes = image.planes
+            JniBridge.rgbaToYuvPlanes(
+                bitmap,
+                planes[0].buffer, planes[0].rowStride,
+                planes[1].buffer, planes[1].rowStride,
+                planes[2].buffer, planes[2].rowStride,
+                planes[1].pixelStride, matrix.nativeValue, fullRange, optimizeNeon
+            )
+        }
+
+        enum class BORDER_MODE(val nativeValue: Int) {
+            CLAMP(0),
+            REFLECT(1),
+            WRAP(2),
+            CONSTANT(3)
+        }
+
+        /**
+         * Gaussian blur of every pixel of [bitmap] in place, the samples outside the image are
+         * read through [border]. [BORDER_MODE.CONSTANT] pads with black.
+         */
+        suspend fun blur(
+            bitmap: Bitmap,
+            optimizeNeon: Boolean,
+            radius: Int = 3,
+            sigma: Int = 5,
+            border: BORDER_MODE = BORDER_MODE.CLAMP
+        ): Boolean = withContext(Dispatchers.Default) {
+            JniBridge.BlurImageBorder(bitmap, radius, sigma, border.nativeValue, optimizeNeon)
+        }
+
+        /** Sharpens every pixel of [bitmap] in place, see [blur] for [border]. */
+        suspend fun sharpen(
+            bitmap: Bitmap,
+            optimizeNeon: Boolean,
+            border: BORDER_MODE = BORDER_MODE.CLAMP
+        ): Boolean = withContext(Dispatchers.Default) {
+            JniBridge.SharpenBorder(bitmap, border.nativeValue, optimizeNeon)
+        }
+
+        /** Box blur whose cost does not depend on [radius]. */
+        suspend fun boxBlur(
+            bitmap: Bitmap,
+            radius: Int,
+            optimizeNeon: Boolean
+        ): Boolean = withContext(Dispatchers.Default) {
+            JniBridge.BoxBlur(bitmap, radius, optimizeNeon)
+        }
+
+        /**
+         * Binarises the bitmap against the mean of the surrounding window, robust to uneven
+         * lighting of document scans. A positive [offset] keeps paper texture from turning
+         * black.
+         */
+        suspend fun adaptiveThreshold(
+            bitmap: Bitmap,
+            optimizeNeon: Boolean,
+            radius: Int = 15,
+            offset: Int = 10
+        ): Boolean = withContext(Dispatchers.Default) {
+            JniBridge.AdaptiveThreshold(bitmap, radius, offset, optimizeNeon)
+        }
+
+        suspend fun localContrast(
+            bitmap: Bitmap,
+            optimizeNeon: Boolean,
+            radius: Int = 24,
+            strength: Float = 0.5f
+        ): Boolean = withContext(Dispatchers.Default) {
+            JniBridge.LocalContrast(bitmap, radius, strength, optimizeNeon)
+        }
+
+        /**
+         * Rectangular erosion / dilation, the cost does not depend on the radius. With
+         * [lumaOnly] the bitmap is turned into filtered gray, e.g. to clean up document scans.
+         */
+        suspend fun morphology(
+            bitmap: Bitmap,
+            op: MORPH_OP,
+            optimizeNeon: Boolean,
+            radiusX: Int = 1,
+            radiusY: Int = radiusX,
+            lumaOnly: Boolean = false
+        ): Boolean = withContext(Dispatchers.Default) {
+            JniBridge.Morphology(bitmap, op.nativeValue, radiusX, radiusY, lumaOnly, optimizeNeon)
+        }
+
         suspend fun convertYuvToRGBA(
             yPixels: ByteArray,
             vPixels: ByteArray,
@@ -83,4 +564,371 @@ class NativeImageProcessor {
             )
         }
     }
-}
\ No newline at end of file
+}
+
+/**
+ * Converts camera frames incrementally: only the tiles whose luma changed by more than
+ * [threshold] (mean absolute difference per pixel) are converted again, everything else keeps
+ * the previous content of the output bitmap. Always pass the same output bitmap.
+ */
+class IncrementalYuvConverter(
+    val width: Int,
+    val height: Int,
+    threshold: Int = 4
+) : AutoCloseable {
+    private var handle: Long = JniBridge.createFrameTracker(width, height, threshold)
+
+    /** False when the tracker could not be created, e.g. for a non positive size. */
+    val isValid: Boolean get() = handle != 0L
+
+    suspend fun convert(
+        yPixels: ByteArray,
+        vPixels: ByteArray,
+        uPixels: ByteArray,
+        outBitmap: Bitmap,
+        yStride: Int,
+        dstStride: Int,
+        uRowStride: Int,
+        vRowStride: Int,
+        uPixelStride: Int,
+        vPixelStride: Int,
+        optimizeNeon: Boolean
+    ) = withContext(Dispatchers.Default) {
+        JniBridge.convert_yuv_rgba_incremental(
+            handle,
+            yPixels,
+            vPixels,
+            uPixels,
+            outBitmap,
+            yStride,
+            dstStride,
+            uRowStride,
+            vRowStride,
+            uPixelStride,
+            vPixelStride,
+            optimizeNeon
+        )
+    }
+
+    /**
+     * Converts into [rgbaBitmap] like [convert] and then runs [processes] into [outBitmap],
+     * re-filtering only the rows whose neighbourhood changed. Keep both bitmaps and the chain
+     * the same from frame to frame, [invalidate] after changing any of them.
+     */
+    suspend fun convertAndFilter(
+        yPixels: ByteArray,
+        vPixels: ByteArray,
+        uPixels: ByteArray,
+        rgbaBitmap: Bitmap,
+        outBitmap: Bitmap,
+        yStride: Int,
+        uRowStride: Int,
+        vRowStride: Int,
+        uPixelStride: Int,
+        vPixelStride: Int,
+        processes: List<NativeImageProcessor.Companion.PROCESS_TYPE>,
+        radius: Int,
+        sigma: Int,
+        optimizeNeon: Boolean
+    ): Boolean = withContext(Dispatchers.Default) {
+        val ops = IntArray(processes.size) { processes[it].ordinal }
+        JniBridge.convert_filter_incremental(
+            handle,
+            yPixels,
+            vPixels,
+            uPixels,
+            rgbaBitmap,
+            outBitmap,
+            yStride,
+            uRowStride,
+            vRowStride,
+            uPixelStride,
+            vPixelStride,
+            ops,
+            radius,
+            sigma,
+            optimizeNeon
+        )
+    }
+
+    /** Forces a full conversion on the next frame, e.g. after switching the output bitmap. */
+    fun invalidate() = JniBridge.invalidateFrameTracker(handle)
+
+    /** Fraction of tiles skipped, for the last frame or averaged over all frames. */
+    fun skippedFraction(lastFrameOnly: Boolean = true): Float =
+        JniBridge.getSkippedFraction(handle, lastFrameOnly)
+
+    override fun close() {
+        if (handle != 0L) {
+            JniBridge.releaseFrameTracker(handle)
+            handle = 0L
+        }
+    }
+}
+
+/**
+ * Temporal denoise for camera frames: every sample is averaged with the same sample of the
+ * last [frames] - 1 frames, weighted by how close they are, so static areas lose their noise
+ * while differences above [threshold] are treated as motion and keep the current frame. The
+ * planes are changed in place, call it before converting them.
+ */
+class TemporalDenoiser(
+    val width: Int,
+    val height: Int,
+    frames: Int = 4,
+    threshold: Int = 16
+) : AutoCloseable {
+    private var handle: Long = JniBridge.createTemporalDenoiser(width, height, frames, threshold)
+
+    /** False when the denoiser could not be created, e.g. for a non positive size. */
+    val isValid: Boolean get() = handle != 0L
+
+    /** Returns false when the planes do not cover a width x height frame. */
+    suspend fun denoise(
+        yPixels: ByteArray,
+        vPixels: ByteArray,
+        uPixels: ByteArray,
+        yStride: Int,
+        uRowStride: Int,
+        vRowStride: Int,
+        uPixelStride: Int,
+        vPixelStride: Int,
+        optimizeNeon: Boolean
+    ): Boolean = withContext(Dispatchers.Default) {
+        handle != 0L && JniBridge.denoise_yuv(
+            handle,
+            yPixels,
+            vPixels,
+            uPixels,
+            yStride,
+            uRowStride,
+            vRowStride,
+            uPixelStride,
+            vPixelStride,
+            optimizeNeon
+        )
+    }
+
+    /** Drops the earlier frames, e.g. after switching cameras. */
+    fun reset() = JniBridge.resetTemporalDenoiser(handle)
+
+    override fun close() {
+        if (handle != 0L) {
+            JniBridge.releaseTemporalDenoiser(handle)
+            handle = 0L
+        }
+    }
+}
+
+data class ChannelStatistics(
+    val min: Int,
+    val max: Int,
+    val mean: Float,
+    val variance: Float
+) {
+    companion object {
+        internal fun from(stats: FloatArray, channel: Int) = ChannelStatistics(
+            stats[channel * 4].toInt(),
+            stats[channel * 4 + 1].toInt(),
+            stats[channel * 4 + 2],
+            stats[channel * 4 + 3]
+        )
+    }
+}
+
+/** Histograms and statistics in R, G, B, luma order. */
+data class ImageStatistics(
+    val histograms: List<IntArray>,
+    val channels: List<ChannelStatistics>
+)
+
+data class QualityState(
+    val level: Int,
+    val scale: Float,
+    val radiusFactor: Float,
+    val threadCap: Int,
+    val frameTimeMs: Float,
+    val convertMs: Float,
+    val downsampleMs: Float,
+    val filterMs: Float,
+    val outputMs: Float
+)
+
+data class LaneStatistics(
+    val priority: NativeImageProcessor.Companion.TASK_PRIORITY,
+    val depth: Int,
+    val peakDepth: Int,
+    val tasks: Long,
+    val meanWaitUs: Float,
+    val maxWaitUs: Float
+)
+
+/**
+ * Runs the native work of a coroutine on a scheduling lane, on whichever thread it resumes.
+ * Wrap gallery and export jobs in `withContext(NativeTaskPriority.BATCH) { ... }` so live
+ * preview frames always go first; everything else stays on the preview lane.
+ */
+class NativeTaskPriority(
+    val priority: NativeImageProcessor.Companion.TASK_PRIORITY
+) : AbstractCoroutineContextElement(Key), ThreadContextElement<Int> {
+    companion object Key : CoroutineContext.Key<NativeTaskPriority> {
+        val PREVIEW = NativeTaskPriority(NativeImageProcessor.Companion.TASK_PRIORITY.PREVIEW)
+        val BATCH = NativeTaskPriority(NativeImageProcessor.Companion.TASK_PRIORITY.BATCH)
+    }
+
+    override fun updateThreadContext(context: CoroutineContext): Int =
+        JniBridge.setTaskPriority(priority.nativeValue)
+
+    override fun restoreThreadContext(context: CoroutineContext, oldState: Int) {
+        JniBridge.setTaskPriority(oldState)
+    }
+}
+
+data class DispatchBenchmarkResult(
+    val threads: Int,
+    val mutexNsPerTask: Float,
+    val lockFreeNsPerTask: Float,
+    val mutexLatencyUs: Float,
+    val lockFreeLatencyUs: Float
+)
+
+/**
+ * Keeps live preview processing inside [targetFrameMs]. Each frame is timed per stage and the
+ * native controller lowers resolution, blur radius or thread count when the average frame time
+ * runs over the budget, and raises them again once there is headroom. Frames must not be
+ * processed concurrently.
+ */
+class AdaptivePreviewProcessor(targetFrameMs: Float) : AutoCloseable {
+    private var handle: Long = JniBridge.createQualityController(targetFrameMs)
+
+    fun setTarget(targetFrameMs: Float) = JniBridge.setQualityTarget(handle, targetFrameMs)
+
+    /** Adds the camera frame conversion time to the current frame, call before [process]. */
+    fun recordConvertTime(ms: Float) = JniBridge.recordQualityStage(handle, 0, ms)
+
+    suspend fun process(
+        bitmap: Bitmap,
+        process: NativeImageProcessor.Companion.PROCESS_TYPE,
+        optimizeNeon: Boolean,
+        radius: Int = 3,
+        sigma: Int = 5
+    ): Boolean = withContext(Dispatchers.Default) {
+        JniBridge.processWithQuality(handle, bitmap, process.ordinal, radius, sigma, optimizeNeon)
+    }
+
+    /** Null when the controller could not be created, e.g. for a non positive target. */
+    fun state(): QualityState? {
+        val s = JniBridge.getQualityState(handle) ?: return null
+        return QualityState(
+            s[0].toInt(), s[1], s[2], s[3].toInt(), s[4], s[5], s[6], s[7], s[8]
+        )
+    }
+
+    override fun close() {
+        if (handle != 0L) {
+            JniBridge.releaseQualityController(handle)
+            handle = 0L
+        }
+    }
+}
+
+/**
+ * Mutable bitmaps kept for reuse, keyed by width, height and config, so live processing does
+ * not allocate a frame per call. At most [maxBytes] of idle bitmaps are kept; the oldest are
+ * dropped first. Safe to use from several threads.
+ */
+class BitmapPool(private val maxBytes: Long) {
+    private data class Key(val width: Int, val height: Int, val config: Bitmap.Config)
+
+    private val free = LinkedHashMap<Key, ArrayDeque<Bitmap>>()
+    private var freeBytes = 0L
+
+    @Synchronized
+    fun acquire(width: Int, height: Int, config: Bitmap.Config = Bitmap.Config.ARGB_8888): Bitmap {
+        val bitmaps = free[Key(width, height, config)]
+        val bitmap = bitmaps?.removeLastOrNull()
+        if (bitmap != null) {
+            freeBytes -= bitmap.allocationByteCount
+            return bitmap
+        }
+        return Bitmap.createBitmap(width, height, config)
+    }
+
+    /** Returns [bitmap] to the pool; the caller must not use it afterwards. */
+    @Synchronized
+    fun release(bitmap: Bitmap) {
+        if (bitmap.isRecycled || !bitmap.isMutable) return
+        val config = bitmap.config ?: return
+        val key = Key(bitmap.width, bitmap.height, config)
+        // re-inserted so the keys stay ordered by last use
+        val bitmaps = free.remove(key) ?: ArrayDeque()
+        bitmaps.addLast(bitmap)
+        free[key] = bitmaps
+        freeBytes += bitmap.allocationByteCount
+        trim()
+    }
+
+    @Synchronized
+    fun clear() {
+        free.values.forEach { bitmaps -> bitmaps.forEach { it.recycle() } }
+        free.clear()
+        freeBytes = 0L
+    }
+
+    private fun trim() {
+        val keys = free.keys.iterator()
+        while (freeBytes > maxBytes && keys.hasNext()) {
+            val bitmaps = free.getValue(keys.next())
+            while (freeBytes > maxBytes && bitmaps.isNotEmpty()) {
+                val oldest = bitmaps.removeFirst()
+                freeBytes -= oldest.allocationByteCount
+                oldest.recycle()
+            }
+            if (bitmaps.isEmpty()) keys.remove()
+        }
+    }
+}
+
+/**
+ * Processing chain for the per frame path. The bitmap checks, blur kernel, scratch planes and
+ * thread count are set up once, [process] only runs the filters. Frames must match the width,
+ * height and config of [template]. [process] and [close] may be called from different threads.
+ */
+class NativeSession(
+    template: Bitmap,
+    processes: List<NativeImageProcessor.Companion.PROCESS_TYPE>,
+    optimizeNeon: Boolean,
+    radius: Int = 3,
+    sigma: Int = 5
+) : AutoCloseable {
+    val width = template.width
+    val height = template.height
+    private val config = template.config
+
+    // close() waits for a running process() instead of freeing the session under it
+    private val lock = Any()
+    private var handle: Long = if (processes.isEmpty()) 0L else JniBridge.createSession(
+        template, IntArray(processes.size) { processes[it].ordinal }, radius, sigma, optimizeNeon
+    )
+
+    /** False when the session could not be created, e.g. for a non ARGB_8888 template. */
+    val isValid: Boolean get() = synchronized(lock) { handle != 0L }
+
+    suspend fun process(bitmap: Bitmap): Boolean = withContext(Dispatchers.Default) {
+        if (bitmap.width != width || bitmap.height != height || bitmap.config != config) {
+            return@withContext false
+        }
+        synchronized(lock) {
+            handle != 0L && JniBridge.processSession(handle, bitmap)
+        }
+    }
+
+    override fun close() {
+        synchronized(lock) {
+            if (handle != 0L) {
+                JniBridge.releaseSession(handle)
+                handle = 0L
+            }
+        }
+    }
+}
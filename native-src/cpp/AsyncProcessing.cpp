@@ -0,0 +1,37 @@
+//
+// Awaitable versions of the filters and the YUV conversion for host C++ callers.
+//
+#include "AsyncProcessing.h"
+
+#ifdef IP_HAS_COROUTINES
+
+namespace ip {
+    AsyncTask<bool> filter_async(FilterOp op, uint8_t *pixels, AndroidBitmapInfo info, int radius,
+                                 float sigma, bool isNeon, TaskPriority priority) {
+        // the shared pointer keeps the pool of this task alive across a policy change
+        std::shared_ptr<ThreadPool> pool = ThreadPool::shared();
+        co_await resume_on(*pool, priority);
+        co_return ImageProcessor::apply_filter_chain(pixels, info, &op, 1, radius, sigma, isNeon);
+    }
+
+    AsyncTask<bool> filter_chain_async(std::vector<FilterOp> ops, uint8_t *pixels,
+                                       AndroidBitmapInfo info, int radius, float sigma,
+                                       bool isNeon, TaskPriority priority) {
+        std::shared_ptr<ThreadPool> pool = ThreadPool::shared();
+        co_await resume_on(*pool, priority);
+        co_return ImageProcessor::apply_filter_chain(pixels, info, ops.data(), ops.size(), radius,
+                                                     sigma, isNeon);
+    }
+
+    AsyncTask<void> convert_yuv_rgba_async(YuvPlanes src, uint8_t *dst, size_t width,
+                                           size_t height, size_t dstStride, bool isNeon,
+                                           TaskPriority priority) {
+        std::shared_ptr<ThreadPool> pool = ThreadPool::shared();
+        co_await resume_on(*pool, priority);
+        ImageProcessor::convert_yuv_rgba(src.y, src.u, src.v, dst, width, height, src.yStride,
+                                         dstStride, src.uStride, src.vStride,
+                                         src.chromaPixelStride, src.chromaPixelStride, isNeon);
+    }
+}
+
+#endif
@@ -0,0 +1,304 @@
+//
+// Per device tuning of thread count, row grain and backend for the image kernels.
+//
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <set>
+#include <thread>
+#include <vector>
+#include <android/log.h>
+#include "AutoTuner.h"
+#include "ImageProcessor.h"
+#include "ImageProcessorSIMD.h"
+#include "LuminanceSIMD.h"
+#include "ThreadPool.h"
+#include "CpuTopology.h"
+
+#define LOG_TAG "core_native_image"
+#define LOG_INFO(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOG_ERROR(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+namespace ip {
+    static const char *kernel_name(TunedKernel kernel) {
+        switch (kernel) {
+            case TunedKernel::GRAY:
+                return "gray";
+            case TunedKernel::NEGATIVE:
+                return "negative";
+            case TunedKernel::BLUR:
+                return "blur";
+            case TunedKernel::SHARPEN:
+                return "sharpen";
+            case TunedKernel::EMBOSS:
+                return "emboss";
+            case TunedKernel::SOBEL_EDGE:
+                return "sobel";
+            case TunedKernel::YUV_RGBA:
+                return "yuv_rgba";
+            default:
+                return "unknown";
+        }
+    }
+
+    AutoTuner &AutoTuner::instance() {
+        static AutoTuner tuner;
+        return tuner;
+    }
+
+    uint32_t AutoTuner::default_threads() {
+        // one worker per core the affinity policy leaves to the pool
+        auto threads = static_cast<uint32_t>(
+                CpuTopology::instance().allowed_cores(ThreadPool::affinity_policy()).size());
+        return std::max<uint32_t>(1, threads);
+    }
+
+    KernelPlan AutoTuner::plan(TunedKernel kernel) const {
+        KernelPlan plan;
+        {
+            std::lock_guard<std::mutex> lock{m_mutex};
+            plan = m_plans[static_cast<size_t>(kernel)];
+        }
+        if (plan.threads == 0) plan.threads = default_threads();
+        return plan;
+    }
+
+    void AutoTuner::set_plan(TunedKernel kernel, const KernelPlan &plan) {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_plans[static_cast<size_t>(kernel)] = plan;
+    }
+
+    void AutoTuner::reset() {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_plans.fill(KernelPlan{});
+        m_tuned = false;
+    }
+
+    bool AutoTuner::is_tuned() const {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        return m_tuned;
+    }
+
+    std::string AutoTuner::cpu_model() {
+        std::ifstream cpuinfo{"/proc/cpuinfo"};
+        std::string line;
+        std::string hardware;
+        std::string modelName;
+        std::set<std::string> parts;
+        auto value_of = [](const std::string &l) -> std::string {
+            size_t colon = l.find(':');
+            if (colon == std::string::npos) return "";
+            size_t start = l.find_first_not_of(" \t", colon + 1);
+            return start == std::string::npos ? "" : l.substr(start);
+        };
+        while (std::getline(cpuinfo, line)) {
+            if (line.rfind("Hardware", 0) == 0) {
+                hardware = value_of(line);
+            } else if (line.rfind("model name", 0) == 0 && modelName.empty()) {
+                modelName = value_of(line);
+            } else if (line.rfind("CPU part", 0) == 0) {
+                // big.LITTLE SoCs list one part number per cluster type
+                parts.insert(value_of(line));
+            }
+        }
+        std::ostringstream model;
+        model << (hardware.empty() ? modelName : hardware);
+        for (const std::string &part: parts) model << " " << part;
+        model << " x" << std::thread::hardware_concurrency();
+        return model.str();
+    }
+
+    double AutoTuner::bench(TunedKernel kernel, bool simd, uint8_t *src, uint8_t *dst,
+                            size_t width, size_t height, size_t stride, int iterations) {
+        AndroidBitmapInfo info{};
+        info.width = static_cast<uint32_t>(width);
+        info.height = static_cast<uint32_t>(height);
+        info.stride = static_cast<uint32_t>(stride);
+        info.format = ANDROID_BITMAP_FORMAT_RGBA_8888;
+        // the synthetic frame doubles as an I420 source for the yuv conversion
+        uint8_t *yPlane = src;
+        uint8_t *uPlane = src + width * height;
+        uint8_t *vPlane = uPlane + (width / 2) * (height / 2);
+
+        double best = 1e30;
+        for (int i = 0; i < iterations; i++) {
+            auto start = std::chrono::steady_clock::now();
+            switch (kernel) {
+                case TunedKernel::GRAY:
+                    if (simd) {
+                        ImageProcessorSIMD::gray_scale_neon_simd(src, dst, width, height, stride);
+                    } else {
+                        ImageProcessor::gray_scale_scalar(src, dst, info);
+                    }
+                    break;
+                case TunedKernel::NEGATIVE:
+                    if (simd) {
+                        ImageProcessorSIMD::negative_neon_simd(src, dst, width, height, stride);
+                    } else {
+                        ImageProcessor::negative_scalar(src, dst, info);
+                    }
+                    break;
+                case TunedKernel::BLUR:
+                    if (simd) {
+                        ImageProcessorSIMD::blur_neon_simd_float(src, dst, width, height, stride,
+                                                                 3, 5);
+                    } else {
+                        ImageProcessor::gaussian_blur_scalar(src, dst, info, 3, 5);
+                    }
+                    break;
+                case TunedKernel::SHARPEN:
+                    if (simd) {
+                        ImageProcessorSIMD::sharp_neon_simd(src, dst, width, height, stride);
+                    } else {
+                        ImageProcessor::sharpen_scalar(src, dst, info);
+                    }
+                    break;
+                case TunedKernel::EMBOSS:
+                    if (simd) {
+                        LuminanceSIMD::emboss_luma_neon(src, dst, width, height, stride);
+                    } else {
+                        ImageProcessor::emboss_scalar(src, dst, info);
+                    }
+                    break;
+                case TunedKernel::SOBEL_EDGE:
+                    if (simd) {
+                        LuminanceSIMD::sobel_luma_neon(src, dst, width, height, stride,
+                                                       GradientMagnitude::ALPHA_MAX_BETA_MIN);
+                    } else {
+                        LuminanceSIMD::sobel_luma_scalar(src, dst, width, height, stride,
+                                                         GradientMagnitude::ALPHA_MAX_BETA_MIN);
+                    }
+                    break;
+                case TunedKernel::YUV_RGBA:
+                    if (simd) {
+                        ImageProcessorSIMD::convert_yuv_rgba_neon(yPlane, uPlane, vPlane, dst,
+                                                                  height, width, width, stride,
+                                                                  width / 2, width / 2, 1, 1);
+                    } else {
+                        ImageProcessor::convert_yuv_rgba_scalar(yPlane, vPlane, uPlane, dst,
+                                                                width, height, width, stride,
+                                                                width / 2, width / 2, 1, 1);
+                    }
+                    break;
+                default:
+                    return best;
+            }
+            auto end = std::chrono::steady_clock::now();
+            best = std::min(best,
+                            std::chrono::duration<double, std::milli>(end - start).count());
+        }
+        return best;
+    }
+
+    void AutoTuner::calibrate(int iterations) {
+        if (iterations < 1) iterations = 1;
+        // a VGA frame keeps the whole sweep well below a second on current devices
+        const size_t width = 640;
+        const size_t height = 480;
+        const size_t stride = width * 4;
+        // the NEON kernels process whole vectors, the extra row absorbs their overrun
+        std::vector<uint8_t> src(stride * (height + 1));
+        std::vector<uint8_t> dst(stride * (height + 1));
+        uint32_t seed = 0x12345678u;
+        for (uint8_t &p: src) {
+            seed = seed * 1664525u + 1013904223u;
+            p = static_cast<uint8_t>(seed >> 24);
+        }
+
+        auto hardwareThreads = static_cast<uint32_t>(
+                CpuTopology::instance().allowed_cores(ThreadPool::affinity_policy()).size());
+        std::vector<uint32_t> threadCounts;
+        for (uint32_t t = 1; t < hardwareThreads; t *= 2) threadCounts.push_back(t);
+        threadCounts.push_back(hardwareThreads);
+        const uint32_t grains[] = {0, 4, 16, 64};
+        bool neon = ImageProcessorSIMD::device_support_neon();
+
+        for (int k = 0; k < static_cast<int>(TunedKernel::COUNT); k++) {
+            auto kernel = static_cast<TunedKernel>(k);
+            KernelPlan best{};
+            double bestMs = 1e30;
+            if (neon) {
+                for (uint32_t threads: threadCounts) {
+                    for (uint32_t grain: grains) {
+                        // the kernels read the plan while running, so try it in place
+                        KernelPlan candidate{threads, grain, true};
+                        set_plan(kernel, candidate);
+                        double ms = bench(kernel, true, src.data(), dst.data(), width, height,
+                                          stride, iterations);
+                        if (ms < bestMs) {
+                            bestMs = ms;
+                            best = candidate;
+                        }
+                    }
+                }
+            }
+            // the scalar paths are single threaded, one measurement is enough
+            double scalarMs = bench(kernel, false, src.data(), dst.data(), width, height, stride,
+                                    iterations);
+            if (scalarMs < bestMs) {
+                bestMs = scalarMs;
+                best = KernelPlan{0, 0, false};
+            }
+            set_plan(kernel, best);
+            LOG_INFO("Tuned %s: threads %u grain %u simd %d (%.3f ms)", kernel_name(kernel),
+                     best.threads, best.grainRows, best.useSimd ? 1 : 0, bestMs);
+        }
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_tuned = true;
+    }
+
+    std::string AutoTuner::profile_path(const std::string &directory) {
+        return directory + "/ip_tuning.profile";
+    }
+
+    bool AutoTuner::save_profile(const std::string &directory) const {
+        std::ofstream out{profile_path(directory), std::ios::trunc};
+        if (!out) {
+            LOG_ERROR("Failed to open the tuning profile for writing");
+            return false;
+        }
+        out << "cpu=" << cpu_model() << "\n";
+        std::lock_guard<std::mutex> lock{m_mutex};
+        for (int k = 0; k < static_cast<int>(TunedKernel::COUNT); k++) {
+            const KernelPlan &p = m_plans[k];
+            out << kernel_name(static_cast<TunedKernel>(k)) << " " << p.threads << " "
+                << p.grainRows << " " << (p.useSimd ? 1 : 0) << "\n";
+        }
+        return static_cast<bool>(out);
+    }
+
+    bool AutoTuner::load_profile(const std::string &directory) {
+        std::ifstream in{profile_path(directory)};
+        if (!in) return false;
+        std::string line;
+        if (!std::getline(in, line) || line != "cpu=" + cpu_model()) {
+            // restored from a backup of another device, or the SoC changed
+            LOG_INFO("Tuning profile belongs to a different cpu, ignoring it");
+            return false;
+        }
+        std::array<KernelPlan, static_cast<size_t>(TunedKernel::COUNT)> plans{};
+        std::array<bool, static_cast<size_t>(TunedKernel::COUNT)> seen{};
+        while (std::getline(in, line)) {
+            std::istringstream fields{line};
+            std::string name;
+            uint32_t threads = 0;
+            uint32_t grain = 0;
+            int simd = 1;
+            if (!(fields >> name >> threads >> grain >> simd)) continue;
+            for (int k = 0; k < static_cast<int>(TunedKernel::COUNT); k++) {
+                if (name == kernel_name(static_cast<TunedKernel>(k))) {
+                    plans[k] = KernelPlan{threads, grain, simd != 0};
+                    seen[k] = true;
+                }
+            }
+        }
+        for (bool s: seen) {
+            if (!s) return false;
+        }
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_plans = plans;
+        m_tuned = true;
+        return true;
+    }
+}
@@ -0,0 +1,236 @@
+//
+// Edge preserving smoothing with a bilateral grid (splat, blur, slice).
+//
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include "BilateralGrid.h"
+#include "LuminanceSIMD.h"
+#include "ThreadPool.h"
+#include "AutoTuner.h"
+
+namespace ip {
+    static const float BLUR_TAPS[5] = {1.0f / 16, 4.0f / 16, 6.0f / 16, 4.0f / 16, 1.0f / 16};
+
+    // nearest cell of a pixel coordinate or luminance, padding included
+    static inline size_t cell_of(float v, float inv) {
+        return (size_t) (v * inv + 0.5f) + GridShape::PADDING;
+    }
+
+    GridShape::GridShape(size_t imageWidth, size_t imageHeight, float sigmaSpatial,
+                         float sigmaRange) {
+        invRange = 1.0f / std::min(255.0f, std::max(1.0f, sigmaRange));
+        depth = cell_of(255.0f, invRange) + 1 + PADDING;
+        // a small sigmaSpatial on a large image would allocate gigabytes, so the cells are
+        // widened until the grid fits. Ends at a few cells per axis, well below MAX_CELLS.
+        float spatial = std::max(1.0f, sigmaSpatial);
+        while (true) {
+            invSpatial = 1.0f / spatial;
+            width = cell_of((float) (imageWidth - 1), invSpatial) + 1 + PADDING;
+            height = cell_of((float) (imageHeight - 1), invSpatial) + 1 + PADDING;
+            if (cells() <= MAX_CELLS) break;
+            spatial *= 1.25f;
+        }
+    }
+
+    static inline uint32_t load_pixel(const uint8_t *p) {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    // Every pixel adds {R, G, B, 1} to its nearest cell. The grid rows are split between the
+    // workers, so no two of them ever write the same cell.
+    template<bool USE_NEON>
+    void BilateralGrid::splat(const uint8_t *src, const uint8_t *luma, size_t width,
+                              size_t height, size_t stride, const GridShape &shape,
+                              float *grid) {
+        IP_TRACE_KERNEL("BilateralGrid::splat", shape.height, height * stride + width * height);
+        std::vector<size_t> cellX(width);
+        for (size_t x = 0; x < width; x++) cellX[x] = cell_of((float) x, shape.invSpatial);
+        auto splat_rows = [&](size_t gStart, size_t gEnd) -> void {
+            for (size_t y = 0; y < height; y++) {
+                size_t gy = cell_of((float) y, shape.invSpatial);
+                if (gy < gStart || gy >= gEnd) continue;
+                const uint8_t *row = src + y * stride;
+                const uint8_t *l = luma + y * width;
+                for (size_t x = 0; x < width; x++) {
+                    float *cell = grid + shape.index(cellX[x], gy, cell_of(l[x], shape.invRange));
+                    if (USE_NEON) {
+                        uint8x8_t bytes = vreinterpret_u8_u32(vdup_n_u32(load_pixel(row + x * 4)));
+                        uint32x4_t px = vmovl_u16(vget_low_u16(vmovl_u8(bytes)));
+                        float32x4_t v = vsetq_lane_f32(1.0f, vcvtq_f32_u32(px), 3);
+                        vst1q_f32(cell, vaddq_f32(vld1q_f32(cell), v));
+                    } else {
+                        cell[0] += row[x * 4];
+                        cell[1] += row[x * 4 + 1];
+                        cell[2] += row[x * 4 + 2];
+                        cell[3] += 1.0f;
+                    }
+                }
+            }
+        };
+        if (USE_NEON) {
+            ThreadPool::for_each_rows(0, shape.height, AutoTuner::default_threads(), 0,
+                                      splat_rows);
+        } else {
+            splat_rows(0, shape.height);
+        }
+    }
+
+    template<bool USE_NEON>
+    void BilateralGrid::blur_axis(const float *in, float *out, const GridShape &shape,
+                                  int axis) {
+        IP_TRACE_KERNEL("BilateralGrid::blur_axis", shape.height,
+                        2 * shape.width * shape.height * shape.depth * 4 * sizeof(float));
+        const size_t steps[3] = {4, shape.depth * 4, shape.width * shape.depth * 4};
+        const size_t step = steps[axis];
+        const size_t lengths[3] = {shape.depth, shape.width, shape.height};
+        const size_t n = lengths[axis];
+        auto blur_rows = [&](size_t gStart, size_t gEnd) -> void {
+            for (size_t gy = gStart; gy < gEnd; gy++) {
+                for (size_t gx = 0; gx < shape.width; gx++) {
+                    for (size_t gz = 0; gz < shape.depth; gz++) {
+                        const size_t coords[3] = {gz, gx, gy};
+                        size_t i = coords[axis];
+                        size_t idx = shape.index(gx, gy, gz);
+                        // taps outside the grid read empty cells, they are simply skipped
+                        size_t kBegin = i >= 2 ? 0 : 2 - i;
+                        size_t kEnd = std::min((size_t) 5, n + 2 - i);
+                        if (USE_NEON) {
+                            float32x4_t acc = vdupq_n_f32(0.0f);
+                            for (size_t k = kBegin; k < kEnd; k++) {
+                                acc = vmlaq_n_f32(acc, vld1q_f32(in + idx + k * step - 2 * step),
+                                                  BLUR_TAPS[k]);
+                            }
+                            vst1q_f32(out + idx, acc);
+                        } else {
+                            float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+                            for (size_t k = kBegin; k < kEnd; k++) {
+                                const float *tap = in + idx + k * step - 2 * step;
+                                for (int c = 0; c < 4; c++) acc[c] += tap[c] * BLUR_TAPS[k];
+                            }
+                            memcpy(out + idx, acc, sizeof(acc));
+                        }
+                    }
+                }
+            }
+        };
+        // every output row only reads the input buffer, so the rows split for all three axes
+        if (USE_NEON) {
+            ThreadPool::for_each_rows(0, shape.height, AutoTuner::default_threads(), 0,
+                                      blur_rows);
+        } else {
+            blur_rows(0, shape.height);
+        }
+    }
+
+    // Trilinear interpolation of the blurred grid at the pixel's (x, y, luminance), the colour
+    // is the interpolated sum divided by the interpolated weight.
+    template<bool USE_NEON>
+    void BilateralGrid::slice(const uint8_t *src, const uint8_t *luma, uint8_t *dst,
+                              size_t width, size_t height, size_t stride,
+                              const GridShape &shape, const float *grid) {
+        IP_TRACE_KERNEL("BilateralGrid::slice", height, 2 * height * stride);
+        const auto pad = (float) GridShape::PADDING;
+        const size_t dz = 4;
+        const size_t dx = shape.depth * 4;
+        const size_t dy = shape.width * shape.depth * 4;
+        auto slice_rows = [&](size_t yStart, size_t yEnd) -> void {
+            for (size_t y = yStart; y < yEnd; y++) {
+                const uint8_t *in = src + y * stride;
+                uint8_t *out = dst + y * stride;
+                const uint8_t *l = luma + y * width;
+                float fy = (float) y * shape.invSpatial + pad;
+                auto gy = (size_t) fy;
+                float wy = fy - (float) gy;
+                for (size_t x = 0; x < width; x++) {
+                    float fx = (float) x * shape.invSpatial + pad;
+                    float fz = (float) l[x] * shape.invRange + pad;
+                    auto gx = (size_t) fx;
+                    auto gz = (size_t) fz;
+                    float wx = fx - (float) gx;
+                    float wz = fz - (float) gz;
+                    const float *c = grid + shape.index(gx, gy, gz);
+                    const float weights[8] = {
+                            (1 - wx) * (1 - wy) * (1 - wz), (1 - wx) * (1 - wy) * wz,
+                            wx * (1 - wy) * (1 - wz), wx * (1 - wy) * wz,
+                            (1 - wx) * wy * (1 - wz), (1 - wx) * wy * wz,
+                            wx * wy * (1 - wz), wx * wy * wz};
+                    const size_t offsets[8] = {0, dz, dx, dx + dz, dy, dy + dz, dy + dx,
+                                               dy + dx + dz};
+                    uint8_t alpha = in[x * 4 + 3];
+                    if (USE_NEON) {
+                        float32x4_t acc = vdupq_n_f32(0.0f);
+                        for (int k = 0; k < 8; k++) {
+                            acc = vmlaq_n_f32(acc, vld1q_f32(c + offsets[k]), weights[k]);
+                        }
+                        float weight = vgetq_lane_f32(acc, 3);
+                        if (weight <= 1e-6f) continue;
+                        float32x4_t colour = vmulq_n_f32(acc, 1.0f / weight);
+                        uint16x4_t c16 = vqmovn_u32(vcvtnq_u32_f32(colour));
+                        uint8x8_t c8 = vqmovn_u16(vcombine_u16(c16, c16));
+                        vst1_lane_u32(reinterpret_cast<uint32_t *>(out + x * 4),
+                                      vreinterpret_u32_u8(c8), 0);
+                    } else {
+                        float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+                        for (int k = 0; k < 8; k++) {
+                            for (int ch = 0; ch < 4; ch++) {
+                                acc[ch] += c[offsets[k] + ch] * weights[k];
+                            }
+                        }
+                        if (acc[3] <= 1e-6f) continue;
+                        for (int ch = 0; ch < 3; ch++) {
+                            float v = acc[ch] / acc[3] + 0.5f;
+                            out[x * 4 + ch] = (uint8_t) std::min(255.0f, std::max(0.0f, v));
+                        }
+                    }
+                    out[x * 4 + 3] = alpha;
+                }
+            }
+        };
+        if (USE_NEON) {
+            ThreadPool::for_each_rows(0, height, AutoTuner::default_threads(), 0, slice_rows);
+        } else {
+            slice_rows(0, height);
+        }
+    }
+
+    template<bool USE_NEON>
+    void BilateralGrid::run(const uint8_t *src, uint8_t *dst, size_t width, size_t height,
+                            size_t stride, float sigmaSpatial, float sigmaRange) {
+        if (width == 0 || height == 0) return;
+        std::vector<uint8_t> luma(width * height);
+        if (USE_NEON) {
+            LuminanceSIMD::rgba_to_luma_neon(src, width, height, stride, luma.data(), width);
+        } else {
+            LuminanceSIMD::rgba_to_luma_scalar(src, width, height, stride, luma.data(), width);
+        }
+        GridShape shape{width, height, sigmaSpatial, sigmaRange};
+        std::vector<float> grid(shape.cells() * 4, 0.0f);
+        std::vector<float> blurred(grid.size(), 0.0f);
+        splat<USE_NEON>(src, luma.data(), width, height, stride, shape, grid.data());
+        blur_axis<USE_NEON>(grid.data(), blurred.data(), shape, 0);
+        blur_axis<USE_NEON>(blurred.data(), grid.data(), shape, 1);
+        blur_axis<USE_NEON>(grid.data(), blurred.data(), shape, 2);
+        if (src != dst) {
+            // pixels whose cells received no weight keep their colour
+            for (size_t y = 0; y < height; y++) {
+                memcpy(dst + y * stride, src + y * stride, width * 4);
+            }
+        }
+        slice<USE_NEON>(src, luma.data(), dst, width, height, stride, shape, blurred.data());
+    }
+
+    void BilateralGrid::bilateral_rgba_neon(const uint8_t *src, uint8_t *dst, size_t width,
+                                            size_t height, size_t stride, float sigmaSpatial,
+                                            float sigmaRange) {
+        run<true>(src, dst, width, height, stride, sigmaSpatial, sigmaRange);
+    }
+
+    void BilateralGrid::bilateral_rgba_scalar(const uint8_t *src, uint8_t *dst, size_t width,
+                                              size_t height, size_t stride, float sigmaSpatial,
+                                              float sigmaRange) {
+        run<false>(src, dst, width, height, stride, sigmaSpatial, sigmaRange);
+    }
+}
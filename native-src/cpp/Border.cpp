@@ -0,0 +1,47 @@
+//
+// Border handling for the neighbourhood filters: halo padded row copies and whole vector
+// stores, so the edges run through the same NEON code as the interior.
+//
+#include <algorithm>
+#include "Border.h"
+
+namespace ip {
+    void HaloRows::build(const uint8_t *src, size_t width, size_t height, size_t stride,
+                         size_t bytesPerPixel, long yBegin, long yEnd, size_t halo,
+                         BorderMode mode, uint8_t constant, size_t minWidth) {
+        m_halo = halo;
+        m_bytesPerPixel = bytesPerPixel;
+        m_first = yBegin - (long) halo;
+        size_t paddedWidth = std::max(width, minWidth) + 2 * halo;
+        m_rowBytes = align_up(paddedWidth * bytesPerPixel);
+        size_t rows = (size_t) (yEnd - yBegin) + 2 * halo;
+        m_data.assign(rows * m_rowBytes, 0);
+
+        for (size_t r = 0; r < rows; r++) {
+            uint8_t *padded = m_data.data() + r * m_rowBytes;
+            long sy = border_index(m_first + (long) r, (long) height, mode);
+            if (sy < 0) {
+                memset(padded, constant, (width + 2 * halo) * bytesPerPixel);
+                continue;
+            }
+            const uint8_t *in = src + sy * stride;
+            memcpy(padded + halo * bytesPerPixel, in, width * bytesPerPixel);
+            for (size_t i = 0; i < halo; i++) {
+                long left = border_index((long) i - (long) halo, (long) width, mode);
+                long right = border_index((long) (width + i), (long) width, mode);
+                uint8_t *leftOut = padded + i * bytesPerPixel;
+                uint8_t *rightOut = padded + (halo + width + i) * bytesPerPixel;
+                if (left < 0) {
+                    memset(leftOut, constant, bytesPerPixel);
+                } else {
+                    memcpy(leftOut, in + left * bytesPerPixel, bytesPerPixel);
+                }
+                if (right < 0) {
+                    memset(rightOut, constant, bytesPerPixel);
+                } else {
+                    memcpy(rightOut, in + right * bytesPerPixel, bytesPerPixel);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,364 @@
+//
+// Canny edge detector on a single channel plane, built on the luminance sobel kernels.
+//
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include "CannyEdge.h"
+#include "ThreadPool.h"
+#include "AutoTuner.h"
+
+namespace ip {
+    // Row of the binomial vertical pass with two replicated columns on each side, so the
+    // horizontal pass reads t[x - 2 .. x + 2] for every x without branches.
+    static void vertical_binomial_row(const uint8_t *const rows[5], uint16_t *t, size_t width,
+                                      bool useNeon) {
+        uint16_t *out = t + 2;
+        size_t x = 0;
+        if (useNeon) {
+            for (; x + 8 <= width; x += 8) {
+                uint16x8_t acc = vaddl_u8(vld1_u8(rows[0] + x), vld1_u8(rows[4] + x));
+                acc = vmlaq_n_u16(acc, vaddl_u8(vld1_u8(rows[1] + x), vld1_u8(rows[3] + x)), 4);
+                acc = vmlal_u8(acc, vld1_u8(rows[2] + x), vdup_n_u8(6));
+                vst1q_u16(out + x, acc);
+            }
+        }
+        for (; x < width; x++) {
+            out[x] = (uint16_t) (rows[0][x] + rows[4][x] + 4 * (rows[1][x] + rows[3][x]) +
+                                 6 * rows[2][x]);
+        }
+        t[0] = t[1] = out[0];
+        t[width + 2] = t[width + 3] = out[width - 1];
+    }
+
+    template<bool USE_NEON>
+    static void gaussian_5x5_rows(const uint8_t *src, size_t width, size_t height, size_t stride,
+                                  uint8_t *dst, size_t yStart, size_t yEnd) {
+        std::vector<uint16_t> t(width + 4);
+        for (size_t y = yStart; y < yEnd; y++) {
+            const uint8_t *rows[5];
+            for (int k = 0; k < 5; k++) {
+                long yy = std::min(std::max((long) y + k - 2, 0L), (long) height - 1);
+                rows[k] = src + yy * stride;
+            }
+            vertical_binomial_row(rows, t.data(), width, USE_NEON);
+            const uint16_t *c = t.data() + 2;
+            uint8_t *out = dst + y * width;
+            size_t x = 0;
+            if (USE_NEON) {
+                // 16 * 4080 still fits 16 bits
+                for (; x + 8 <= width; x += 8) {
+                    uint16x8_t acc = vaddq_u16(vld1q_u16(c + x - 2), vld1q_u16(c + x + 2));
+                    acc = vmlaq_n_u16(acc, vaddq_u16(vld1q_u16(c + x - 1), vld1q_u16(c + x + 1)),
+                                      4);
+                    acc = vmlaq_n_u16(acc, vld1q_u16(c + x), 6);
+                    vst1_u8(out + x, vrshrn_n_u16(acc, 8));
+                }
+            }
+            for (; x < width; x++) {
+                uint32_t acc = c[x - 2] + c[x + 2] + 4 * (c[x - 1] + c[x + 1]) + 6 * c[x];
+                out[x] = (uint8_t) ((acc + 128) >> 8);
+            }
+        }
+    }
+
+    void CannyEdge::gaussian_5x5_neon(const uint8_t *src, size_t width, size_t height,
+                                      size_t stride, uint8_t *dst) {
+        IP_TRACE_KERNEL("CannyEdge::gaussian_5x5", height, 2 * height * stride);
+        ThreadPool::for_each_rows(0, height, AutoTuner::default_threads(), 0,
+                                  [&](size_t yStart, size_t yEnd) -> void {
+            gaussian_5x5_rows<true>(src, width, height, stride, dst, yStart, yEnd);
+        });
+    }
+
+    void CannyEdge::gaussian_5x5_scalar(const uint8_t *src, size_t width, size_t height,
+                                        size_t stride, uint8_t *dst) {
+        gaussian_5x5_rows<false>(src, width, height, stride, dst, 0, height);
+    }
+
+    // The first neighbour has to be beaten, the second only matched: a plateau of equal
+    // magnitudes across the edge then still leaves exactly one pixel.
+    void CannyEdge::non_max_suppression_row_neon(const uint8_t *top, const uint8_t *mid,
+                                                 const uint8_t *bottom, const uint8_t *direction,
+                                                 uint8_t *out, size_t width, uint8_t low,
+                                                 uint8_t high) {
+        if (width < 3) return;
+        const uint8x16_t lowV = vdupq_n_u8(low);
+        const uint8x16_t highV = vdupq_n_u8(high);
+        const uint8x16_t weakV = vdupq_n_u8(WEAK_EDGE);
+        const uint8x16_t strongV = vdupq_n_u8(STRONG_EDGE);
+        size_t x = 1;
+        for (; x + 16 <= width - 1; x += 16) {
+            uint8x16_t m = vld1q_u8(mid + x);
+            uint8x16_t d = vld1q_u8(direction + x);
+            uint8x16_t is0 = vceqq_u8(d, vdupq_n_u8(DIRECTION_0));
+            uint8x16_t is45 = vceqq_u8(d, vdupq_n_u8(DIRECTION_45));
+            uint8x16_t is90 = vceqq_u8(d, vdupq_n_u8(DIRECTION_90));
+            uint8x16_t n1 = vbslq_u8(is0, vld1q_u8(mid + x - 1),
+                                     vbslq_u8(is45, vld1q_u8(top + x - 1),
+                                              vbslq_u8(is90, vld1q_u8(top + x),
+                                                       vld1q_u8(top + x + 1))));
+            uint8x16_t n2 = vbslq_u8(is0, vld1q_u8(mid + x + 1),
+                                     vbslq_u8(is45, vld1q_u8(bottom + x + 1),
+                                              vbslq_u8(is90, vld1q_u8(bottom + x),
+                                                       vld1q_u8(bottom + x - 1))));
+            uint8x16_t keep = vandq_u8(vcgtq_u8(m, n1), vcgeq_u8(m, n2));
+            uint8x16_t cls = vbslq_u8(vcgeq_u8(m, highV), strongV,
+                                      vandq_u8(vcgeq_u8(m, lowV), weakV));
+            vst1q_u8(out + x, vandq_u8(cls, keep));
+        }
+        if (x < width - 1) {
+            non_max_suppression_row_scalar(top + x - 1, mid + x - 1, bottom + x - 1,
+                                           direction + x - 1, out + x - 1, width - x + 1, low,
+                                           high);
+        }
+    }
+
+    void CannyEdge::non_max_suppression_row_scalar(const uint8_t *top, const uint8_t *mid,
+                                                   const uint8_t *bottom,
+                                                   const uint8_t *direction, uint8_t *out,
+                                                   size_t width, uint8_t low, uint8_t high) {
+        for (size_t x = 1; x + 1 < width; x++) {
+            uint8_t n1, n2;
+            switch (direction[x]) {
+                case DIRECTION_0:
+                    n1 = mid[x - 1];
+                    n2 = mid[x + 1];
+                    break;
+                case DIRECTION_45:
+                    n1 = top[x - 1];
+                    n2 = bottom[x + 1];
+                    break;
+                case DIRECTION_90:
+                    n1 = top[x];
+                    n2 = bottom[x];
+                    break;
+                default:
+                    n1 = top[x + 1];
+                    n2 = bottom[x - 1];
+                    break;
+            }
+            uint8_t m = mid[x];
+            if (m > n1 && m >= n2 && m >= low) {
+                out[x] = m >= high ? STRONG_EDGE : WEAK_EDGE;
+            } else {
+                out[x] = NOT_EDGE;
+            }
+        }
+    }
+
+    // path halving, read only callers use find_root instead
+    static uint32_t find_compress(uint32_t *parent, uint32_t i) {
+        while (parent[i] != i) {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    }
+
+    static uint32_t find_root(const uint32_t *parent, uint32_t i) {
+        while (parent[i] != i) i = parent[i];
+        return i;
+    }
+
+    // the smaller index becomes the root, the strong flag is carried over to it
+    static void unite(uint32_t *parent, uint8_t *strong, uint32_t a, uint32_t b) {
+        a = find_compress(parent, a);
+        b = find_compress(parent, b);
+        if (a == b) return;
+        if (b < a) std::swap(a, b);
+        parent[b] = a;
+        strong[a] |= strong[b];
+    }
+
+    void CannyEdge::hysteresis(const uint8_t *classes, size_t width, size_t height,
+                               uint8_t *edges, size_t edgesStride, bool parallel) {
+        IP_TRACE_KERNEL("CannyEdge::hysteresis", height, width * height + height * edgesStride);
+        std::vector<uint32_t> parent(width * height);
+        std::vector<uint8_t> strong(width * height, 0);
+        uint32_t threads = parallel ? AutoTuner::default_threads() : 1;
+        size_t strips = std::max<size_t>(1, std::min<size_t>(threads, height));
+        size_t stripRows = (height + strips - 1) / strips;
+
+        // labels only link pixels of the same strip, so the strips never touch shared entries
+        auto label_strip = [&](size_t y0, size_t y1) -> void {
+            for (size_t y = y0; y < y1; y++) {
+                for (size_t x = 0; x < width; x++) {
+                    auto idx = (uint32_t) (y * width + x);
+                    if (classes[idx] == NOT_EDGE) continue;
+                    parent[idx] = idx;
+                    strong[idx] = classes[idx] == STRONG_EDGE ? 1 : 0;
+                    if (x > 0 && classes[idx - 1] != NOT_EDGE) {
+                        unite(parent.data(), strong.data(), idx, idx - 1);
+                    }
+                    if (y == y0) continue;
+                    auto up = (uint32_t) (idx - width);
+                    for (long dx = -1; dx <= 1; dx++) {
+                        if ((x == 0 && dx < 0) || (x + 1 == width && dx > 0)) continue;
+                        if (classes[up + dx] != NOT_EDGE) {
+                            unite(parent.data(), strong.data(), idx, (uint32_t) (up + dx));
+                        }
+                    }
+                }
+            }
+        };
+        ThreadPool::for_each_rows(0, strips, threads, 1, [&](size_t sStart, size_t sEnd) -> void {
+            for (size_t s = sStart; s < sEnd; s++) {
+                label_strip(s * stripRows, std::min(height, (s + 1) * stripRows));
+            }
+        });
+
+        // join the strips along the first row of every strip but the first
+        for (size_t s = 1; s < strips; s++) {
+            size_t y = s * stripRows;
+            if (y >= height) break;
+            for (size_t x = 0; x < width; x++) {
+                auto idx = (uint32_t) (y * width + x);
+                if (classes[idx] == NOT_EDGE) continue;
+                auto up = (uint32_t) (idx - width);
+                for (long dx = -1; dx <= 1; dx++) {
+                    if ((x == 0 && dx < 0) || (x + 1 == width && dx > 0)) continue;
+                    if (classes[up + dx] != NOT_EDGE) {
+                        unite(parent.data(), strong.data(), idx, (uint32_t) (up + dx));
+                    }
+                }
+            }
+        }
+
+        auto write_rows = [&](size_t yStart, size_t yEnd) -> void {
+            for (size_t y = yStart; y < yEnd; y++) {
+                uint8_t *out = edges + y * edgesStride;
+                for (size_t x = 0; x < width; x++) {
+                    auto idx = (uint32_t) (y * width + x);
+                    bool edge = classes[idx] != NOT_EDGE &&
+                                strong[find_root(parent.data(), idx)] != 0;
+                    out[x] = edge ? 255 : 0;
+                }
+            }
+        };
+        if (parallel) {
+            ThreadPool::for_each_rows(0, height, threads, 0, write_rows);
+        } else {
+            write_rows(0, height);
+        }
+    }
+
+    template<bool USE_NEON>
+    void CannyEdge::detect(const uint8_t *src, size_t width, size_t height, size_t stride,
+                           uint8_t *edges, size_t edgesStride, int lowThreshold,
+                           int highThreshold, bool preBlur, GradientMagnitude mode) {
+        IP_TRACE_KERNEL("CannyEdge::detect", height, height * stride + height * edgesStride);
+        if (width == 0 || height == 0) return;
+        if (width < 3 || height < 3) {
+            for (size_t y = 0; y < height; y++) memset(edges + y * edgesStride, 0, width);
+            return;
+        }
+        auto low = (uint8_t) std::min(std::max(lowThreshold, 1), 255);
+        auto high = (uint8_t) std::min(std::max(highThreshold, (int) low), 255);
+
+        std::vector<uint8_t> blurred;
+        const uint8_t *plane = src;
+        size_t planeStride = stride;
+        if (preBlur) {
+            blurred.resize(width * height);
+            if (USE_NEON) {
+                gaussian_5x5_neon(src, width, height, stride, blurred.data());
+            } else {
+                gaussian_5x5_scalar(src, width, height, stride, blurred.data());
+            }
+            plane = blurred.data();
+            planeStride = width;
+        }
+
+        // sobel magnitude and direction, the border rows and columns stay 0
+        std::vector<uint8_t> magnitude(width * height, 0);
+        std::vector<uint8_t> direction(width * height, DIRECTION_0);
+        auto gradient_rows = [&](size_t yStart, size_t yEnd) -> void {
+            std::vector<int16_t> vs(width), vd(width);
+            for (size_t y = std::max<size_t>(yStart, 1); y < std::min(yEnd, height - 1); y++) {
+                const uint8_t *top = plane + (y - 1) * planeStride;
+                const uint8_t *mid = top + planeStride;
+                const uint8_t *bottom = mid + planeStride;
+                uint8_t *mag = magnitude.data() + y * width;
+                uint8_t *dir = direction.data() + y * width;
+                if (USE_NEON) {
+                    LuminanceSIMD::sobel_vertical_row_neon(top, mid, bottom, vs.data(),
+                                                           vd.data(), width);
+                    LuminanceSIMD::sobel_row_neon(vs.data(), vd.data(), mag, dir, width, mode);
+                } else {
+                    LuminanceSIMD::sobel_vertical_row_scalar(top, mid, bottom, vs.data(),
+                                                             vd.data(), width);
+                    LuminanceSIMD::sobel_row_scalar(vs.data(), vd.data(), mag, dir, width, mode);
+                }
+            }
+        };
+
+        // the magnitude border is 0, so the border pixels are never kept
+        std::vector<uint8_t> classes(width * height, NOT_EDGE);
+        auto suppression_rows = [&](size_t yStart, size_t yEnd) -> void {
+            for (size_t y = std::max<size_t>(yStart, 1); y < std::min(yEnd, height - 1); y++) {
+                const uint8_t *mid = magnitude.data() + y * width;
+                if (USE_NEON) {
+                    non_max_suppression_row_neon(mid - width, mid, mid + width,
+                                                 direction.data() + y * width,
+                                                 classes.data() + y * width, width, low, high);
+                } else {
+                    non_max_suppression_row_scalar(mid - width, mid, mid + width,
+                                                   direction.data() + y * width,
+                                                   classes.data() + y * width, width, low,
+                                                   high);
+                }
+            }
+        };
+        if (USE_NEON) {
+            uint32_t threads = AutoTuner::default_threads();
+            ThreadPool::for_each_rows(0, height, threads, 0, gradient_rows);
+            ThreadPool::for_each_rows(0, height, threads, 0, suppression_rows);
+        } else {
+            gradient_rows(0, height);
+            suppression_rows(0, height);
+        }
+        hysteresis(classes.data(), width, height, edges, edgesStride, USE_NEON);
+    }
+
+    void CannyEdge::detect_plane_neon(const uint8_t *src, size_t width, size_t height,
+                                      size_t stride, uint8_t *edges, size_t edgesStride,
+                                      int lowThreshold, int highThreshold, bool preBlur,
+                                      GradientMagnitude mode) {
+        detect<true>(src, width, height, stride, edges, edgesStride, lowThreshold,
+                     highThreshold, preBlur, mode);
+    }
+
+    void CannyEdge::detect_plane_scalar(const uint8_t *src, size_t width, size_t height,
+                                        size_t stride, uint8_t *edges, size_t edgesStride,
+                                        int lowThreshold, int highThreshold, bool preBlur,
+                                        GradientMagnitude mode) {
+        detect<false>(src, width, height, stride, edges, edgesStride, lowThreshold,
+                      highThreshold, preBlur, mode);
+    }
+
+    void CannyEdge::detect_rgba(uint8_t *pixels, size_t width, size_t height, size_t stride,
+                                int lowThreshold, int highThreshold, bool useNeon) {
+        std::vector<uint8_t> luma(width * height);
+        std::vector<uint8_t> edges(width * height);
+        if (useNeon) {
+            LuminanceSIMD::rgba_to_luma_neon(pixels, width, height, stride, luma.data(), width);
+            detect_plane_neon(luma.data(), width, height, width, edges.data(), width,
+                              lowThreshold, highThreshold);
+        } else {
+            LuminanceSIMD::rgba_to_luma_scalar(pixels, width, height, stride, luma.data(), width);
+            detect_plane_scalar(luma.data(), width, height, width, edges.data(), width,
+                                lowThreshold, highThreshold);
+        }
+        for (size_t y = 0; y < height; y++) {
+            uint8_t *row = pixels + y * stride;
+            if (useNeon) {
+                LuminanceSIMD::store_luma_row_rgba_neon(edges.data() + y * width, row, row,
+                                                        width);
+            } else {
+                LuminanceSIMD::store_luma_row_rgba_scalar(edges.data() + y * width, row, row,
+                                                          width);
+            }
+        }
+    }
+}
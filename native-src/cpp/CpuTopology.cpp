@@ -0,0 +1,131 @@
+//
+// CPU cores and their relative speed read from /sys/devices/system/cpu, used to place the
+// worker threads on big.LITTLE devices.
+//
+#include <sched.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <algorithm>
+#include "CpuTopology.h"
+
+namespace ip {
+    CpuTopology::CpuTopology() {
+        std::vector<int> ids = parse_cpu_list("/sys/devices/system/cpu/online");
+        if (ids.empty()) {
+            unsigned count = std::max(1u, std::thread::hardware_concurrency());
+            for (unsigned i = 0; i < count; i++) ids.push_back(static_cast<int>(i));
+        }
+        uint32_t fastest = 0;
+        for (int id: ids) {
+            CpuCore core;
+            core.id = id;
+            core.maxFreqKhz = read_max_freq(id);
+            fastest = std::max(fastest, core.maxFreqKhz);
+            m_cores.push_back(core);
+        }
+        for (CpuCore &core: m_cores) {
+            if (fastest > 0 && core.maxFreqKhz > 0) {
+                core.relativeSpeed = (float) core.maxFreqKhz / (float) fastest;
+            }
+        }
+        // the last of the fastest cores, usually the prime core of the big cluster
+        if (m_cores.size() > 1) {
+            for (const CpuCore &core: m_cores) {
+                if (core.maxFreqKhz == fastest) m_reservedCore = core.id;
+            }
+        }
+    }
+
+    const CpuTopology &CpuTopology::instance() {
+        static CpuTopology topology;
+        return topology;
+    }
+
+    std::vector<int> CpuTopology::parse_cpu_list(const char *path) {
+        // kernel cpu lists look like "0-3,6,8-11"
+        std::vector<int> ids;
+        FILE *file = fopen(path, "r");
+        if (file == nullptr) return ids;
+        char buffer[256] = {0};
+        if (fgets(buffer, sizeof(buffer), file) != nullptr) {
+            const char *p = buffer;
+            while (*p != '\0' && *p != '\n') {
+                char *end = nullptr;
+                long first = strtol(p, &end, 10);
+                if (end == p) break;
+                long last = first;
+                p = end;
+                if (*p == '-') {
+                    last = strtol(p + 1, &end, 10);
+                    p = end;
+                }
+                for (long id = first; id <= last; id++) ids.push_back(static_cast<int>(id));
+                if (*p == ',') p++;
+            }
+        }
+        fclose(file);
+        return ids;
+    }
+
+    uint32_t CpuTopology::read_max_freq(int cpu) {
+        std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) +
+                           "/cpufreq/cpuinfo_max_freq";
+        FILE *file = fopen(path.c_str(), "r");
+        if (file == nullptr) return 0;
+        unsigned long freq = 0;
+        if (fscanf(file, "%lu", &freq) != 1) freq = 0;
+        fclose(file);
+        return static_cast<uint32_t>(freq);
+    }
+
+    bool CpuTopology::is_heterogeneous() const {
+        for (const CpuCore &core: m_cores) {
+            if (core.maxFreqKhz != m_cores.front().maxFreqKhz) return true;
+        }
+        return false;
+    }
+
+    std::vector<CpuCore> CpuTopology::allowed_cores(AffinityPolicy policy) const {
+        std::vector<CpuCore> allowed;
+        uint32_t slowest = m_cores.front().maxFreqKhz;
+        for (const CpuCore &core: m_cores) slowest = std::min(slowest, core.maxFreqKhz);
+
+        for (const CpuCore &core: m_cores) {
+            switch (policy) {
+                case AffinityPolicy::PERFORMANCE_CORES:
+                    if (is_heterogeneous() && core.maxFreqKhz == slowest) continue;
+                    break;
+                case AffinityPolicy::RESERVE_CAMERA_CORE:
+                    if (core.id == m_reservedCore) continue;
+                    break;
+                case AffinityPolicy::ALL_CORES:
+                default:
+                    break;
+            }
+            allowed.push_back(core);
+        }
+        if (allowed.empty()) allowed = m_cores;
+        std::stable_sort(allowed.begin(), allowed.end(),
+                         [](const CpuCore &a, const CpuCore &b) -> bool {
+                             return a.maxFreqKhz > b.maxFreqKhz;
+                         });
+        return allowed;
+    }
+
+    bool CpuTopology::pin_current_thread(int cpu) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        // pid 0 applies the mask to the calling thread only
+        return sched_setaffinity(0, sizeof(set), &set) == 0;
+    }
+
+    bool CpuTopology::pin_current_thread(const std::vector<CpuCore> &cores) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (const CpuCore &core: cores) CPU_SET(core.id, &set);
+        return sched_setaffinity(0, sizeof(set), &set) == 0;
+    }
+}
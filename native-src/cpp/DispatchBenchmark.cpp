@@ -0,0 +1,155 @@
+//
+// Measures task dispatch of the thread pool queue against the mutex queue it replaced.
+//
+#include <android/log.h>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include "DispatchBenchmark.h"
+#include "TaskQueue.h"
+
+#define LOG_TAG "core_native_image"
+#define LOG_INFO(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+
+namespace ip {
+    namespace {
+        using Clock = std::chrono::steady_clock;
+
+        // the queue ThreadPool used before the lock free ring, kept as the baseline
+        class LockedQueue {
+        private:
+            std::queue<std::function<void()>> m_tasks{};
+            std::mutex m_mutex;
+            std::condition_variable m_cv;
+            bool m_stop = false;
+
+        public:
+            using Item = std::function<void()>;
+
+            void push(Item task) {
+                {
+                    std::lock_guard<std::mutex> lock{m_mutex};
+                    m_tasks.push(std::move(task));
+                }
+                m_cv.notify_one();
+            }
+
+            bool pop(Item &task) {
+                std::unique_lock<std::mutex> lock{m_mutex};
+                m_cv.wait(lock, [this]() -> bool { return m_stop || !m_tasks.empty(); });
+                if (m_tasks.empty()) return false;
+                task = std::move(m_tasks.front());
+                m_tasks.pop();
+                return true;
+            }
+
+            void stop() {
+                {
+                    std::lock_guard<std::mutex> lock{m_mutex};
+                    m_stop = true;
+                }
+                m_cv.notify_all();
+            }
+        };
+
+        // same spin then park protocol as ThreadPool::worker_loop
+        class LockFreeQueue {
+        private:
+            MpmcQueue<Task> m_tasks{1024};
+            Parker m_parker{};
+            std::atomic<bool> m_stop{false};
+
+        public:
+            using Item = Task;
+
+            void push(Item task) {
+                while (!m_tasks.try_push(std::move(task))) std::this_thread::yield();
+                m_parker.notify_one();
+            }
+
+            bool pop(Item &task) {
+                while (true) {
+                    for (int spin = 0, rounds = spin_rounds(); spin < rounds; spin++) {
+                        if (m_tasks.try_pop(task)) return true;
+                        cpu_relax();
+                    }
+                    uint32_t epoch = m_parker.prepare_wait();
+                    if (m_tasks.try_pop(task)) return true;
+                    if (m_stop.load(std::memory_order_acquire)) return false;
+                    m_parker.wait(epoch);
+                }
+            }
+
+            void stop() {
+                m_stop.store(true, std::memory_order_release);
+                m_parker.notify_all();
+            }
+        };
+
+        thread_local uint64_t t_latencyNs = 0;
+
+        template<typename Queue>
+        void measure(uint32_t threads, size_t tasks, double &nsPerTask, double &latencyUs) {
+            using Item = typename Queue::Item;
+            Queue queue;
+            std::atomic<uint64_t> latencyNs{0};
+            std::vector<std::thread> workers;
+            std::vector<std::thread> producers;
+            size_t perProducer = tasks / threads;
+
+            Clock::time_point start = Clock::now();
+            for (uint32_t t = 0; t < threads; t++) {
+                workers.emplace_back([&queue, &latencyNs]() -> void {
+                    t_latencyNs = 0;
+                    Item task;
+                    while (queue.pop(task)) {
+                        task();
+                        task = Item();
+                    }
+                    latencyNs.fetch_add(t_latencyNs, std::memory_order_relaxed);
+                });
+            }
+            for (uint32_t t = 0; t < threads; t++) {
+                producers.emplace_back([&queue, perProducer]() -> void {
+                    for (size_t i = 0; i < perProducer; i++) {
+                        Clock::time_point pushed = Clock::now();
+                        queue.push(Item([pushed]() -> void {
+                            t_latencyNs += static_cast<uint64_t>(
+                                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                            Clock::now() - pushed).count());
+                        }));
+                    }
+                });
+            }
+            for (std::thread &producer: producers) producer.join();
+            queue.stop();
+            for (std::thread &worker: workers) worker.join();
+            double elapsedNs = std::chrono::duration<double, std::nano>(
+                    Clock::now() - start).count();
+
+            size_t total = perProducer * threads;
+            nsPerTask = elapsedNs / (double) total;
+            latencyUs = (double) latencyNs.load() / (double) total / 1000.0;
+        }
+    }
+
+    std::vector<DispatchResult> DispatchBenchmark::run(size_t tasks) {
+        std::vector<DispatchResult> results;
+        for (uint32_t threads: {4u, 8u, 12u, 16u}) {
+            DispatchResult result;
+            result.threads = threads;
+            measure<LockedQueue>(threads, tasks, result.lockedNsPerTask,
+                                 result.lockedLatencyUs);
+            measure<LockFreeQueue>(threads, tasks, result.lockFreeNsPerTask,
+                                   result.lockFreeLatencyUs);
+            LOG_INFO("Dispatch %u threads: mutex %.1f ns/task %.2f us latency, "
+                     "lock free %.1f ns/task %.2f us latency", threads, result.lockedNsPerTask,
+                     result.lockedLatencyUs, result.lockFreeNsPerTask, result.lockFreeLatencyUs);
+            results.push_back(result);
+        }
+        return results;
+    }
+}
@@ -0,0 +1,202 @@
+//
+// Incremental processing for mostly static camera frames (tripod, document scanning).
+//
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <arm_neon.h>
+#include "FrameChangeTracker.h"
+#include "ImageProcessor.h"
+#include "ImageProcessorSIMD.h"
+#include "ThreadPool.h"
+#include "AutoTuner.h"
+
+namespace ip {
+    FrameChangeTracker::FrameChangeTracker(size_t width, size_t height, uint32_t threshold,
+                                           size_t tileWidth, size_t tileHeight)
+            : m_width(width), m_height(height), m_threshold(threshold) {
+        // tiles have to start on even rows and columns so the 4:2:0 chroma stays aligned
+        m_tileWidth = (tileWidth + 15) & ~static_cast<size_t>(15);
+        m_tileHeight = (tileHeight + 1) & ~static_cast<size_t>(1);
+        m_tilesX = (width + m_tileWidth - 1) / m_tileWidth;
+        m_tilesY = (height + m_tileHeight - 1) / m_tileHeight;
+        m_referenceY.resize(width * height);
+        m_dirtyTiles.assign(m_tilesX * m_tilesY, 1);
+        m_dirtyRows.assign(height, 1);
+        m_refilterRows.assign(height, 0);
+    }
+
+    uint32_t FrameChangeTracker::block_sad_neon(const uint8_t *a, size_t aStride,
+                                                const uint8_t *b, size_t bStride,
+                                                size_t width, size_t height) {
+        uint32_t sad = 0;
+        for (size_t y = 0; y < height; y++) {
+            const uint8_t *aRow = a + y * aStride;
+            const uint8_t *bRow = b + y * bStride;
+            uint16x8_t acc = vdupq_n_u16(0);
+            size_t x = 0;
+            for (; x + 16 <= width; x += 16) {
+                uint8x16_t diff = vabdq_u8(vld1q_u8(aRow + x), vld1q_u8(bRow + x));
+                acc = vpadalq_u8(acc, diff);
+            }
+            sad += vaddlvq_u16(acc);
+            for (; x < width; x++) {
+                sad += std::abs((int) aRow[x] - (int) bRow[x]);
+            }
+        }
+        return sad;
+    }
+
+    uint32_t FrameChangeTracker::block_sad_scalar(const uint8_t *a, size_t aStride,
+                                                  const uint8_t *b, size_t bStride,
+                                                  size_t width, size_t height) {
+        uint32_t sad = 0;
+        for (size_t y = 0; y < height; y++) {
+            for (size_t x = 0; x < width; x++) {
+                sad += std::abs((int) a[y * aStride + x] - (int) b[y * bStride + x]);
+            }
+        }
+        return sad;
+    }
+
+    void FrameChangeTracker::convert_yuv_rgba_incremental(const uint8_t *yPixel,
+                                                          const uint8_t *uPix,
+                                                          const uint8_t *vPix, uint8_t *dstRGBA,
+                                                          size_t yStride, size_t yDstStride,
+                                                          size_t uRowStride, size_t vRowStride,
+                                                          size_t uPixelStride,
+                                                          size_t vPixelStride, bool useNeon) {
+        IP_TRACE_KERNEL("FrameChangeTracker::convert_incremental", m_tilesY,
+                        m_height * (yStride + yDstStride));
+        bool fullFrame = !m_hasReference;
+        std::atomic<size_t> skipped{0};
+
+        ThreadPool::for_each_rows(0, m_tilesY, AutoTuner::default_threads(), 0,
+                                  [&](size_t tyStart, size_t tyEnd) -> void {
+            for (size_t ty = tyStart; ty < tyEnd; ty++) {
+                size_t y0 = ty * m_tileHeight;
+                size_t y1 = std::min(y0 + m_tileHeight, m_height);
+                uint8_t *dirty = m_dirtyTiles.data() + ty * m_tilesX;
+                bool anyDirty = false;
+
+                for (size_t tx = 0; tx < m_tilesX; tx++) {
+                    size_t x0 = tx * m_tileWidth;
+                    size_t x1 = std::min(x0 + m_tileWidth, m_width);
+                    bool changed = fullFrame;
+                    if (!changed) {
+                        const uint8_t *cur = yPixel + y0 * yStride + x0;
+                        const uint8_t *ref = m_referenceY.data() + y0 * m_width + x0;
+                        uint32_t sad = useNeon
+                                       ? block_sad_neon(cur, yStride, ref, m_width,
+                                                        x1 - x0, y1 - y0)
+                                       : block_sad_scalar(cur, yStride, ref, m_width,
+                                                          x1 - x0, y1 - y0);
+                        changed = sad > m_threshold * (uint32_t) ((x1 - x0) * (y1 - y0));
+                    }
+                    dirty[tx] = changed ? 1 : 0;
+                    anyDirty |= changed;
+                    if (!changed) skipped.fetch_add(1, std::memory_order_relaxed);
+                }
+
+                for (size_t y = y0; y < y1; y++) {
+                    m_dirtyRows[y] = anyDirty ? 1 : 0;
+                }
+                if (!anyDirty) continue;
+
+                // converting horizontal runs of dirty tiles so the vector loop stays long
+                size_t tx = 0;
+                while (tx < m_tilesX) {
+                    if (!dirty[tx]) {
+                        tx++;
+                        continue;
+                    }
+                    size_t runStart = tx;
+                    while (tx < m_tilesX && dirty[tx]) tx++;
+                    size_t x0 = runStart * m_tileWidth;
+                    size_t x1 = std::min(tx * m_tileWidth, m_width);
+
+                    for (size_t y = y0; y < y1; y++) {
+                        const uint8_t *yRow = yPixel + y * yStride;
+                        const uint8_t *uRow = uPix + (y >> 1) * uRowStride;
+                        const uint8_t *vRow = vPix + (y >> 1) * vRowStride;
+                        uint8_t *dstRow = dstRGBA + y * yDstStride;
+                        if (useNeon) {
+                            ImageProcessorSIMD::convert_yuv_rgba_row_neon(yRow, uRow, vRow,
+                                                                          dstRow, x0, x1,
+                                                                          m_width,
+                                                                          uPixelStride,
+                                                                          vPixelStride);
+                        } else {
+                            ImageProcessor::convert_yuv_rgba_scalar(yRow, vRow, uRow,
+                                                                    dstRow, x1, 1, 0, 0, 0,
+                                                                    0, uPixelStride,
+                                                                    vPixelStride, (int) x0);
+                        }
+                        memcpy(m_referenceY.data() + y * m_width + x0, yRow + x0, x1 - x0);
+                    }
+                }
+            }
+        });
+        finish_frame(skipped.load());
+    }
+
+    void FrameChangeTracker::finish_frame(size_t skippedTiles) {
+        size_t total = m_tilesX * m_tilesY;
+        m_hasReference = true;
+        m_stats.framesProcessed++;
+        m_stats.tilesTotal += total;
+        m_stats.tilesSkipped += skippedTiles;
+        m_stats.lastSkippedFraction = total == 0 ? 0.0f : (float) skippedTiles / (float) total;
+    }
+
+    size_t FrameChangeTracker::mark_refilter_rows(size_t halo, BorderMode border) {
+        std::fill(m_refilterRows.begin(), m_refilterRows.end(), 0);
+        long height = (long) m_height;
+        size_t y = 0;
+        while (y < m_height) {
+            if (!m_dirtyRows[y]) {
+                y++;
+                continue;
+            }
+            size_t runStart = y;
+            while (y < m_height && m_dirtyRows[y]) y++;
+            for (long out = (long) runStart - (long) halo; out < (long) (y + halo); out++) {
+                long row = out;
+                // clamp and reflect read rows no further away than the halo, only a wrapping
+                // border reaches the output rows at the opposite edge
+                if (row < 0 || row >= height) {
+                    if (border != BorderMode::WRAP) continue;
+                    row = border_index(row, height, border);
+                }
+                m_refilterRows[row] = 1;
+            }
+        }
+        return (size_t) std::count(m_refilterRows.begin(), m_refilterRows.end(), 1);
+    }
+
+    bool FrameChangeTracker::touches_border_halo(size_t halo) const {
+        size_t edge = std::min(halo, m_height);
+        for (size_t y = 0; y < edge; y++) {
+            if (m_refilterRows[y] || m_refilterRows[m_height - 1 - y]) return true;
+        }
+        return false;
+    }
+
+    uint8_t *FrameChangeTracker::build_band(const uint8_t *src, size_t stride, size_t first,
+                                            size_t rows, size_t halo, BorderMode border,
+                                            uint8_t constant) {
+        size_t bandRows = rows + 2 * halo;
+        if (m_band.size() < bandRows * stride) m_band.resize(bandRows * stride);
+        for (size_t i = 0; i < bandRows; i++) {
+            long y = border_index((long) (first + i) - (long) halo, (long) m_height, border);
+            uint8_t *row = m_band.data() + i * stride;
+            if (y < 0) {
+                memset(row, constant, stride);
+            } else {
+                memcpy(row, src + (size_t) y * stride, stride);
+            }
+        }
+        return m_band.data();
+    }
+}
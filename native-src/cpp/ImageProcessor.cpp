@@ -1,10 +1,21 @@
 
 #include <android/log.h>
 #include<chrono>
+#include <cmath>
+#include <limits>
+#include <thread>
 
 #include "ImageProcessor.h"
 #include "ImageProcessorSIMD.h"
 #include "Utility.h"
+#include "FrameChangeTracker.h"
+#include "TemporalDenoiser.h"
+#include "ThreadPool.h"
+#include "CpuTopology.h"
+#include "QualityController.h"
+#include "NativeSession.h"
+#include "Tracing.h"
+#include "DispatchBenchmark.h"
 
 
 #define LOG_TAG "core_native_image"
@@ -12,6 +23,11 @@
 #define LOG_ERROR(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
 
 namespace ip {
+    bool ImageProcessor::use_neon(bool isNeon, TunedKernel kernel) {
+        return isNeon && ImageProcessorSIMD::device_support_neon() &&
+               AutoTuner::instance().plan(kernel).useSimd;
+    }
+
     bool ImageProcessor::GrayScale(JNIEnv *env, jobject bitmap, bool isNeon) {
         AndroidBitmapInfo bitmapInfo;
         void *pixels = nullptr;
@@ -30,15 +46,13 @@ namespace ip {
             LOG_ERROR("Locking the android bit map pixels failed");
             return false;
         }
-        if (ImageProcessorSIMD::device_support_neon() && isNeon) {
+        if (use_neon(isNeon, TunedKernel::GRAY)) {
             LOG_INFO("Device Support NEON");
-            uint8_t *outData = new uint8_t[bitmapInfo.height * bitmapInfo.width * 4];
+            // a per pixel map, so it runs in place without a copy of the frame
             ImageProcessorSIMD::gray_scale_neon_simd(reinterpret_cast<uint8_t *>(pixels),
-                                                     outData,
+                                                     reinterpret_cast<uint8_t *>(pixels),
                                                      bitmapInfo.width, bitmapInfo.height,
                                                      bitmapInfo.stride);
-            memcpy(pixels, outData, bitmapInfo.height * bitmapInfo.width * 4);
-            delete[] outData;
         } else {
             gray_scale_scalar(pixels, bitmapInfo);
         }
@@ -46,16 +60,20 @@ namespace ip {
         return true;
     }
 
-    void ImageProcessor::gray_scale_scalar(void *pixels, AndroidBitmapInfo &bitmapInfo) {
+    void ImageProcessor::gray_scale_scalar(const void *src, void *dst,
+                                           AndroidBitmapInfo &bitmapInfo) {
         const int width = bitmapInfo.width;
         const int height = bitmapInfo.height;
         const int stride = bitmapInfo.stride;
 
-        uint8_t *base = reinterpret_cast<uint8_t *>(pixels);
+        const uint8_t *srcBase = reinterpret_cast<const uint8_t *>(src);
+        uint8_t *base = reinterpret_cast<uint8_t *>(dst);
         for (int y = 0; y < height; y++) {
+            const uint32_t *srcRow =
+                    reinterpret_cast<const uint32_t *>(srcBase + (size_t) y * (size_t) stride);
             uint32_t *row = reinterpret_cast<uint32_t *>(base + (size_t) y * (size_t) stride);
             for (int x = 0; x < width; x++) {
-                uint32_t color = row[x];
+                uint32_t color = srcRow[x];
                 // The bit map is RGBA_8888 so each entry is 32 bits and can be extracted for 8 bits each
                 uint8_t a = (color >> 24) & 0xFF;
                 uint8_t b = (color >> 16) & 0xFF;
@@ -90,13 +108,12 @@ namespace ip {
             return false;
         }
 
-        if (ImageProcessorSIMD::device_support_neon() && isNeon) {
+        if (use_neon(isNeon, TunedKernel::NEGATIVE)) {
             LOG_INFO("Device Support NEON");
-            uint8_t *outData = new uint8_t[bitmapInfo.width * bitmapInfo.height * 4];
-            ImageProcessorSIMD::negative_neon_simd(reinterpret_cast<uint8_t *>(pixels), outData,
-                                                   bitmapInfo.height * bitmapInfo.width);
-            memcpy(pixels, outData, bitmapInfo.width * bitmapInfo.height * 4);
-            delete[] outData;
+            ImageProcessorSIMD::negative_neon_simd(reinterpret_cast<uint8_t *>(pixels),
+                                                   reinterpret_cast<uint8_t *>(pixels),
+                                                   bitmapInfo.width, bitmapInfo.height,
+                                                   bitmapInfo.stride);
         } else {
             negative_scalar(pixels, bitmapInfo);
         }
@@ -104,16 +121,20 @@ namespace ip {
         return true;
     }
 
-    void ImageProcessor::negative_scalar(void *pixels, AndroidBitmapInfo &bitmapInfo) {
+    void ImageProcessor::negative_scalar(const void *src, void *dst,
+                                         AndroidBitmapInfo &bitmapInfo) {
         int width = bitmapInfo.width;
         int height = bitmapInfo.height;
         int stride = bitmapInfo.stride;
 
-        uint8_t *base = reinterpret_cast<uint8_t *>(pixels);
+        const uint8_t *srcBase = reinterpret_cast<const uint8_t *>(src);
+        uint8_t *base = reinterpret_cast<uint8_t *>(dst);
         for (int y = 0; y < height; y++) {
+            const uint32_t *srcRow =
+                    reinterpret_cast<const uint32_t *>(srcBase + (size_t) y * (size_t) stride);
             uint32_t *row = reinterpret_cast<uint32_t *>(base + (size_t) y * (size_t) stride);
             for (int x = 0; x < width; x++) {
-                uint32_t color = row[x];
+                uint32_t color = srcRow[x];
                 uint8_t a = (color >> 24) & 0xFF;
                 uint8_t b = (color >> 16) & 0xFF;
                 uint8_t g = (color >> 8) & 0xFf;
@@ -128,7 +149,8 @@ namespace ip {
     }
 
     bool
-    ImageProcessor::BlurImage(JNIEnv *env, jobject bitmap, int radius, float sigma, bool isNeon) {
+    ImageProcessor::BlurImage(JNIEnv *env, jobject bitmap, int radius, float sigma, bool isNeon,
+                              BorderMode border) {
         AndroidBitmapInfo bitmapInfo;
         void *pixels = nullptr;
         if (AndroidBitmap_getInfo(env, bitmap, &bitmapInfo) < 0) {
@@ -144,18 +166,15 @@ namespace ip {
             return false;
         }
 
-        if (ImageProcessorSIMD::device_support_neon() && isNeon) {
-            uint8_t *dst = new uint8_t[bitmapInfo.width * bitmapInfo.height * 4];
-            uint8_t *safeSrc = new uint8_t[bitmapInfo.width * bitmapInfo.height * 4];
-            memcpy(safeSrc, pixels, bitmapInfo.width * bitmapInfo.height * 4);
-            ImageProcessorSIMD::blur_neon_simd_float(safeSrc, dst,
+        if (use_neon(isNeon, TunedKernel::BLUR)) {
+            AlignedBytes dst(bitmapInfo.height * bitmapInfo.stride);
+            ImageProcessorSIMD::blur_neon_simd_float(reinterpret_cast<uint8_t *>(pixels),
+                                                     dst.data(),
                                                      bitmapInfo.width, bitmapInfo.height,
-                                                     bitmapInfo.stride, radius, sigma);
-            memcpy(pixels, dst, bitmapInfo.height * bitmapInfo.width * 4);
-            delete[] dst;
-            delete[] safeSrc;
+                                                     bitmapInfo.stride, radius, sigma, border);
+            memcpy(pixels, dst.data(), dst.size());
         } else {
-            gaussian_blur_scalar(pixels, bitmapInfo, radius, sigma);
+            gaussian_blur_scalar(pixels, bitmapInfo, radius, sigma, border);
         }
         AndroidBitmap_unlockPixels(env, bitmap);
 
@@ -163,24 +182,35 @@ namespace ip {
     }
 
     void
-    ImageProcessor::gaussian_blur_scalar(void *pixels, AndroidBitmapInfo &bitmapInfo, int radius,
-                                         float sigma) {
-        uint32_t *src = reinterpret_cast<uint32_t *>(pixels);
+    ImageProcessor::gaussian_blur_scalar(const void *srcPixels, void *dstPixels,
+                                         AndroidBitmapInfo &bitmapInfo, int radius, float sigma,
+                                         BorderMode border) {
+        const uint32_t *src = reinterpret_cast<const uint32_t *>(srcPixels);
         uint32_t width = bitmapInfo.width;
         uint32_t height = bitmapInfo.height;
         uint32_t stride = bitmapInfo.stride / 4;
 
 
         std::vector<std::vector<float>> kernel = Utility::generate_gaussian_kernel(radius, sigma);
-        std::vector<uint32_t> output(width * height);
+        // a separate destination is written directly, in place needs a copy of the frame
+        bool inPlace = srcPixels == dstPixels;
+        std::vector<uint32_t> scratch(inPlace ? height * stride : 0);
+        uint32_t *output = inPlace ? scratch.data() : reinterpret_cast<uint32_t *>(dstPixels);
+        std::vector<long> columns(width + 2 * radius);
+        for (int x = -radius; x < (int) width + radius; x++) {
+            columns[x + radius] = border_index(x, width, border);
+        }
 
-        for (int y = radius; y < height - radius; y++) {
-            for (int x = radius; x < width - radius; x++) {
+        for (int y = 0; y < (int) height; y++) {
+            for (int x = 0; x < (int) width; x++) {
                 float r = 0, g = 0, b = 0.0f;
                 for (int ky = -radius; ky <= radius; ky++) {
+                    long sy = border_index(y + ky, height, border);
                     for (int kx = -radius; kx <= radius; kx++) {
                         float weight = kernel[ky + radius][kx + radius];
-                        uint32_t color = src[(y + ky) * stride + (x + kx)];
+                        long sx = columns[x + kx + radius];
+                        // the constant border is black
+                        uint32_t color = (sy < 0 || sx < 0) ? 0 : src[sy * stride + sx];
                         b += (float) ((color >> 16) & 0xFF) * weight;
                         g += (float) ((color >> 8) & 0xFF) * weight;
                         r += (float) (color & 0xFF) * weight;
@@ -193,10 +223,10 @@ namespace ip {
             }
         }
 
-        memcpy(src, output.data(), height * width * sizeof(uint32_t));
+        if (inPlace) memcpy(dstPixels, output, height * stride * sizeof(uint32_t));
     }
 
-    bool ImageProcessor::SharpenImage(JNIEnv *env, jobject bitmap, bool isNeon) {
+    bool ImageProcessor::SharpenImage(JNIEnv *env, jobject bitmap, bool isNeon, BorderMode border) {
         AndroidBitmapInfo bitmapInfo;
         void *pixels = nullptr;
         if (AndroidBitmap_getInfo(env, bitmap, &bitmapInfo) < 0) {
@@ -207,23 +237,24 @@ namespace ip {
             LOG_ERROR("Failed to lock the bitmap pixels");
             return false;
         }
-        if (ImageProcessorSIMD::device_support_neon() && isNeon) {
-            uint8_t *outData = new uint8_t[bitmapInfo.height * bitmapInfo.width * 4];
-            ImageProcessorSIMD::sharp_neon_simd(reinterpret_cast<uint8_t *>(pixels), outData,
+        if (use_neon(isNeon, TunedKernel::SHARPEN)) {
+            AlignedBytes outData(bitmapInfo.height * bitmapInfo.stride);
+            ImageProcessorSIMD::sharp_neon_simd(reinterpret_cast<uint8_t *>(pixels),
+                                                outData.data(),
                                                 bitmapInfo.width, bitmapInfo.height,
-                                                bitmapInfo.stride);
-            memcpy(pixels, outData, bitmapInfo.width * bitmapInfo.height * 4);
-            delete[] outData;
+                                                bitmapInfo.stride, border);
+            memcpy(pixels, outData.data(), outData.size());
         } else {
-            sharpen_scalar(pixels, bitmapInfo);
+            sharpen_scalar(pixels, bitmapInfo, border);
         }
         AndroidBitmap_unlockPixels(env, bitmap);
         return true;
     }
 
 
-    void ImageProcessor::sharpen_scalar(void *pixels, AndroidBitmapInfo &bitmapInfo) {
-        uint32_t *src = reinterpret_cast<uint32_t *>(pixels);
+    void ImageProcessor::sharpen_scalar(const void *srcPixels, void *dstPixels,
+                                        AndroidBitmapInfo &bitmapInfo, BorderMode border) {
+        const uint32_t *src = reinterpret_cast<const uint32_t *>(srcPixels);
         std::vector<std::vector<float>> kernel = {
                 {-1, -1, -1},
                 {-1, 9,  -1},
@@ -232,15 +263,19 @@ namespace ip {
         uint32_t width = bitmapInfo.width;
         uint32_t height = bitmapInfo.height;
         uint32_t stride = bitmapInfo.stride / 4;
-        std::vector<std::uint32_t> output(height * width);
+        bool inPlace = srcPixels == dstPixels;
+        std::vector<std::uint32_t> scratch(inPlace ? height * stride : 0);
+        uint32_t *output = inPlace ? scratch.data() : reinterpret_cast<uint32_t *>(dstPixels);
 
-        for (int y = 1; y < height - 1; y++) {
-            for (int x = 1; x < width - 1; x++) {
+        for (int y = 0; y < (int) height; y++) {
+            for (int x = 0; x < (int) width; x++) {
                 float r = 0, g = 0, b = 0;
                 for (int ky = -1; ky <= 1; ky++) {
+                    long sy = border_index(y + ky, height, border);
                     for (int kx = -1; kx <= 1; kx++) {
                         float weight = kernel[ky + 1][kx + 1];
-                        uint32_t color = src[(y + ky) * stride + kx + x];
+                        long sx = border_index(x + kx, width, border);
+                        uint32_t color = (sy < 0 || sx < 0) ? 0 : src[sy * stride + sx];
                         b += (float) ((color >> 16) & 0xFF) * weight;
                         g += (float) ((color >> 8) & 0xFF) * weight;
                         r += (float) (color & 0xFF) * weight;
@@ -255,7 +290,7 @@ namespace ip {
                         a << 24 | (uint32_t) b << 16 | (uint32_t) g << 8 | (uint32_t) r;
             }
         }
-        memcpy(src, output.data(), sizeof(uint32_t) * height * width);
+        if (inPlace) memcpy(dstPixels, output, sizeof(uint32_t) * height * stride);
     }
 
     bool ImageProcessor::EmbrossImage(JNIEnv *env, jobject bitmap, bool isNeon) {
@@ -273,11 +308,11 @@ namespace ip {
             LOG_INFO("Failed to lock the pixel information");
             return false;
         }
-        if (ImageProcessorSIMD::device_support_neon() && isNeon) {
-            uint8_t *dst = new uint8_t[info.width * info.height * 4];
-            ImageProcessorSIMD::emboss_neon_simd_float(reinterpret_cast<uint8_t *>(pixelData), dst,
-                                                       info.width, info.height, info.stride);
-            memcpy(pixelData, dst, info.width * info.height * 4);
+        if (use_neon(isNeon, TunedKernel::EMBOSS)) {
+            uint8_t *dst = new uint8_t[info.height * info.stride];
+            LuminanceSIMD::emboss_luma_neon(reinterpret_cast<uint8_t *>(pixelData), dst,
+                                            info.width, info.height, info.stride);
+            memcpy(pixelData, dst, info.height * info.stride);
             delete[] dst;
         } else {
             emboss_scalar(pixelData, info);
@@ -287,55 +322,33 @@ namespace ip {
     }
 
 
-    void ImageProcessor::emboss_scalar(void *pixelData, AndroidBitmapInfo &info) {
-        std::vector<std::vector<int32_t>> kernel = {
-                {-2, -1, 0},
-                {-1, 1,  1},
-                {0,  1,  2}
-        };
+    void ImageProcessor::emboss_scalar(const void *srcPixels, void *dstPixels,
+                                       AndroidBitmapInfo &info) {
         uint32_t width = info.width;
         uint32_t height = info.height;
-        uint32_t stride = info.stride / 4;
-        std::vector<std::uint32_t> output(height * width);
-
-        uint32_t *src = reinterpret_cast<uint32_t *>(pixelData);
-        for (int y = 1; y < height - 1; y++) {
-            for (int x = 1; x < width - 1; x++) {
-                float r = 0, g = 0, b = 0;
-
-                for (int ky = -1; ky <= 1; ky++) {
-                    for (int kx = -1; kx <= 1; kx++) {
-                        uint32_t color = src[(y + ky) * stride + (x + kx)];
-                        uint8_t blue = (color >> 16) & 0xFF;
-                        uint8_t green = (color >> 8) & 0xFF;
-                        uint8_t red = color & 0xFF;
-                        uint8_t gray = static_cast<uint8_t>(0.3f * red + 0.59f * green +
-                                                            0.11f * blue);
-                        int32_t weight = kernel[ky + 1][kx + 1];
-                        r += gray * weight;
-                        g += gray * weight;
-                        b += gray * weight;
-                    }
-                }
-
-                r = std::clamp(r + 128.0f, 0.0f, 255.0f);
-                g = std::clamp(g + 128.0f, 0.0f, 255.0f);
-                b = std::clamp(b + 128.0f, 0.0f, 255.0f);
-
-                uint32_t a = (src[y * stride + x] >> 24) & 0xFF;
-                output[y * width + x] = (a << 24) |
-                                        ((uint32_t) b << 16) |
-                                        ((uint32_t) g << 8) |
-                                        ((uint32_t) r);
-            }
+        const uint8_t *src = reinterpret_cast<const uint8_t *>(srcPixels);
+        uint8_t *pixels = reinterpret_cast<uint8_t *>(dstPixels);
+        if (width < 3 || height < 3) {
+            if (src != pixels) memcpy(pixels, src, height * info.stride);
+            return;
         }
 
-        // Copy back respecting stride
-        uint8_t *dstBytes = reinterpret_cast<uint8_t *>(pixelData);
-        for (uint32_t y = 0; y < height; y++) {
-            memcpy(dstBytes + y * info.stride,
-                   output.data() + y * width,
-                   width * sizeof(uint32_t));
+        // gray is computed once per pixel, the stencil only reads the luma plane afterwards
+        std::vector<uint8_t> luma(width * height);
+        LuminanceSIMD::rgba_to_luma_scalar(src, width, height, info.stride, luma.data(), width);
+
+        std::vector<uint8_t> out(width, 128);
+        // the frame has no full neighbourhood and is left flat, like the NEON path does
+        LuminanceSIMD::store_luma_row_rgba_scalar(out.data(), src, pixels, width);
+        LuminanceSIMD::store_luma_row_rgba_scalar(out.data(), src + (height - 1) * info.stride,
+                                                  pixels + (height - 1) * info.stride, width);
+        for (uint32_t y = 1; y < height - 1; y++) {
+            const uint8_t *top = luma.data() + (y - 1) * width;
+            LuminanceSIMD::emboss_row_scalar(top, top + width, top + 2 * width, out.data(),
+                                             width);
+            // the luma plane is separate, so the row can be written in place
+            LuminanceSIMD::store_luma_row_rgba_scalar(out.data(), src + y * info.stride,
+                                                      pixels + y * info.stride, width);
         }
     }
 
@@ -377,7 +390,8 @@ namespace ip {
 
     }
 
-    bool ImageProcessor::EdgeDetection(JNIEnv *env, jobject bitmap, bool isNeon) {
+    bool ImageProcessor::EdgeDetection(JNIEnv *env, jobject bitmap, bool isNeon,
+                                       GradientMagnitude mode, uint8_t *direction) {
         AndroidBitmapInfo info;
         void *pixelData = nullptr;
         if (AndroidBitmap_getInfo(env, bitmap, &info) < 0) {
@@ -392,103 +406,1694 @@ namespace ip {
             LOG_INFO("Failed to lock the pixel information");
             return false;
         }
-        if (ImageProcessorSIMD::device_support_neon()) {
-            uint8_t *outData = new uint8_t[info.height * info.width * 4];
-            ImageProcessorSIMD::edge_detection_simd_float(reinterpret_cast<uint8_t *>(pixelData),
-                                                          outData, info.width, info.height,
-                                                          info.stride);
-            memcpy(pixelData, outData, 4 * info.width * info.height);
+        if (use_neon(isNeon, TunedKernel::SOBEL_EDGE)) {
+            uint8_t *outData = new uint8_t[info.height * info.stride];
+            LuminanceSIMD::sobel_luma_neon(reinterpret_cast<uint8_t *>(pixelData), outData,
+                                           info.width, info.height, info.stride, mode,
+                                           direction, info.width);
+            memcpy(pixelData, outData, info.height * info.stride);
             delete[] outData;
-            return true;
+        } else {
+            // the luma plane is built up front, so the scalar path can work in place
+            LuminanceSIMD::sobel_luma_scalar(reinterpret_cast<uint8_t *>(pixelData),
+                                             reinterpret_cast<uint8_t *>(pixelData),
+                                             info.width, info.height, info.stride, mode,
+                                             direction, info.width);
         }
         AndroidBitmap_unlockPixels(env, bitmap);
         return true;
     }
 
-}
 
+    bool ImageProcessor::MedianImage(JNIEnv *env, jobject bitmap, int radius, bool isNeon) {
+        AndroidBitmapInfo info;
+        void *pixelData = nullptr;
+        if (AndroidBitmap_getInfo(env, bitmap, &info) < 0) {
+            LOG_ERROR("Failed to get the bitmap info");
+            return false;
+        }
+        if (info.format != ANDROID_BITMAP_FORMAT_RGBA_8888) {
+            LOG_ERROR("Invalid bit map format");
+            return false;
+        }
+        if (AndroidBitmap_lockPixels(env, bitmap, &pixelData) < 0) {
+            LOG_ERROR("Failed to lock the pixel information");
+            return false;
+        }
+        MedianFilter::median_rgba(reinterpret_cast<uint8_t *>(pixelData), info.width,
+                                  info.height, info.stride, radius,
+                                  ImageProcessorSIMD::device_support_neon() && isNeon);
+        AndroidBitmap_unlockPixels(env, bitmap);
+        return true;
+    }
 
-extern "C" {
-JNIEXPORT jboolean JNICALL
-Java_com_os_imageprocessor_JniBridge_GrayScaleImage(JNIEnv *env, jclass clazz, jobject bitmap,
-                                                    jboolean optimizeNeon) {
-    bool imageProcessed = ip::ImageProcessor::GrayScale(env, bitmap, optimizeNeon);
-    return imageProcessed ? JNI_TRUE : JNI_FALSE;
-}
-JNIEXPORT jboolean JNICALL
-Java_com_os_imageprocessor_JniBridge_CreateNegative(JNIEnv *env, jclass clazz, jobject bitmap,
-                                                    jboolean optimizeNeon) {
-    bool imageProcessed = ip::ImageProcessor::NegativeImage(env, bitmap, optimizeNeon);
-    return imageProcessed ? JNI_TRUE : JNI_FALSE;
-}
-JNIEXPORT jboolean JNICALL
-Java_com_os_imageprocessor_JniBridge_BlurImage(JNIEnv *env, jclass clazz, jobject bitmap,
-                                               int radius, int sigma,
-                                               jboolean optimizeNeon) {
-    bool imageProcessed = ip::ImageProcessor::BlurImage(env, bitmap, radius, sigma, optimizeNeon);
-    return imageProcessed ? JNI_TRUE : JNI_FALSE;
-}
-JNIEXPORT jboolean JNICALL
-Java_com_os_imageprocessor_JniBridge_Embross(JNIEnv *env, jclass clazz, jobject bitmap,
-                                             jboolean optimizeNeon) {
-    bool imageProcessed = ip::ImageProcessor::EmbrossImage(env, bitmap, optimizeNeon);
-    return imageProcessed ? JNI_TRUE : JNI_FALSE;
-}
-JNIEXPORT jboolean JNICALL
-Java_com_os_imageprocessor_JniBridge_Sharpen(JNIEnv *env, jclass clazz, jobject bitmap,
-                                             jboolean optimize_neon) {
-    bool imageProcessed = ip::ImageProcessor::SharpenImage(env, bitmap, optimize_neon);
-    return imageProcessed ? JNI_TRUE : JNI_FALSE;
+    bool ImageProcessor::BilateralImage(JNIEnv *env, jobject bitmap, float sigmaSpatial,
+                                        float sigmaRange, bool isNeon) {
+        if (!std::isfinite(sigmaSpatial) || !std::isfinite(sigmaRange) || sigmaSpatial <= 0.0f ||
+            sigmaRange <= 0.0f) {
+            LOG_ERROR("Invalid bilateral sigmas %f %f", sigmaSpatial, sigmaRange);
+            return false;
+        }
+        AndroidBitmapInfo info;
+        void *pixelData = nullptr;
+        if (AndroidBitmap_getInfo(env, bitmap, &info) < 0) {
+            LOG_ERROR("Failed to get the bitmap info");
+            return false;
+        }
+        if (info.format != ANDROID_BITMAP_FORMAT_RGBA_8888) {
+            LOG_ERROR("Invalid bit map format");
+            return false;
+        }
+        if (AndroidBitmap_lockPixels(env, bitmap, &pixelData) < 0) {
+            LOG_ERROR("Failed to lock the pixel information");
+            return false;
+        }
+        uint8_t *pixels = reinterpret_cast<uint8_t *>(pixelData);
+        if (ImageProcessorSIMD::device_support_neon() && isNeon) {
+            BilateralGrid::bilateral_rgba_neon(pixels, pixels, info.width, info.height,
+                                               info.stride, sigmaSpatial, sigmaRange);
+        } else {
+            BilateralGrid::bilateral_rgba_scalar(pixels, pixels, info.width, info.height,
+                                                 info.stride, sigmaSpatial, sigmaRange);
+        }
+        AndroidBitmap_unlockPixels(env, bitmap);
+        return true;
+    }
 
-}
-JNIEXPORT jboolean JNICALL
-Java_com_os_imageprocessor_JniBridge_EdgeDetection(JNIEnv *env, jclass clazz, jobject bitmap,
-                                                   jboolean optimize_neon) {
-    bool imageProcessed = ip::ImageProcessor::EdgeDetection(env, bitmap, optimize_neon);
-    return imageProcessed ? JNI_TRUE : JNI_FALSE;
+    bool ImageProcessor::CannyEdges(JNIEnv *env, jobject bitmap, int lowThreshold,
+                                    int highThreshold, bool isNeon) {
+        AndroidBitmapInfo info;
+        void *pixelData = nullptr;
+        if (AndroidBitmap_getInfo(env, bitmap, &info) < 0) {
+            LOG_ERROR("Failed to get the bitmap info");
+            return false;
+        }
+        if (info.format != ANDROID_BITMAP_FORMAT_RGBA_8888) {
+            LOG_ERROR("Invalid bit map format");
+            return false;
+        }
+        if (AndroidBitmap_lockPixels(env, bitmap, &pixelData) < 0) {
+            LOG_ERROR("Failed to lock the pixel information");
+            return false;
+        }
+        uint8_t *pixels = reinterpret_cast<uint8_t *>(pixelData);
+        CannyEdge::detect_rgba(pixels, info.width, info.height, info.stride, lowThreshold,
+                               highThreshold, ImageProcessorSIMD::device_support_neon() && isNeon);
+        AndroidBitmap_unlockPixels(env, bitmap);
+        return true;
+    }
 
-}
-JNIEXPORT void JNICALL
-Java_com_os_imageprocessor_JniBridge_convert_1yuv_1rgba(JNIEnv *env, jclass clazz,
-                                                        jbyteArray y_pixels, jbyteArray v_pixels,
-                                                        jbyteArray u_pixels,
-                                                        jobject outBitmap,
-                                                        jint width, jint height, jint y_stride,
-                                                        jint dst_stride, jint u_row_stride,
-                                                        jint v_row_stride, jint u_pixel_stride,
-                                                        jint v_pixel_stride,
-                                                        jboolean optimizeNeon) {
-    jbyte *yPtr = env->GetByteArrayElements(y_pixels, nullptr);
-    jbyte *uPixels = env->GetByteArrayElements(u_pixels, nullptr);
-    jbyte *vPixels = env->GetByteArrayElements(v_pixels, nullptr);
-    void *lockPixels = nullptr;
-    if (AndroidBitmap_lockPixels(env, outBitmap, &lockPixels) < 0) {
-        LOG_ERROR("Failed to lock the pixels");
-        return;
+    bool ImageProcessor::ConvertToYuv(JNIEnv *env, jobject bitmap, const YuvPlanes &dst,
+                                      YuvMatrix matrix, YuvRange range, bool isNeon) {
+        AndroidBitmapInfo info;
+        void *pixelData = nullptr;
+        if (AndroidBitmap_getInfo(env, bitmap, &info) < 0) {
+            LOG_ERROR("Failed to get the bitmap info");
+            return false;
+        }
+        if (info.format != ANDROID_BITMAP_FORMAT_RGBA_8888) {
+            LOG_ERROR("Invalid bit map format");
+            return false;
+        }
+        if (AndroidBitmap_lockPixels(env, bitmap, &pixelData) < 0) {
+            LOG_ERROR("Failed to lock the pixel information");
+            return false;
+        }
+        uint8_t *pixels = reinterpret_cast<uint8_t *>(pixelData);
+        if (ImageProcessorSIMD::device_support_neon() && isNeon) {
+            RgbaToYuv::convert_neon(pixels, info.width, info.height, info.stride, dst, matrix,
+                                    range);
+        } else {
+            RgbaToYuv::convert_scalar(pixels, info.width, info.height, info.stride, dst, matrix,
+                                      range);
+        }
+        AndroidBitmap_unlockPixels(env, bitmap);
+        return true;
     }
-    if (ip::ImageProcessorSIMD::device_support_neon() && optimizeNeon) {
-        ip::ImageProcessorSIMD::convert_yuv_rgba_neon(reinterpret_cast<uint8_t *>(yPtr),
-                                                      reinterpret_cast<uint8_t *>(uPixels),
-                                                      reinterpret_cast<uint8_t *>(vPixels),
-                                                      reinterpret_cast<uint8_t *>(lockPixels),
-                                                      height,
-                                                      width, y_stride, dst_stride, u_row_stride,
-                                                      v_row_stride, v_pixel_stride, v_pixel_stride);
-    } else {
-        if (optimizeNeon) {
-            LOG_ERROR("Device Does not support neon.. falling back to scalar");
+
+    bool ImageProcessor::Histogram(JNIEnv *env, jobject bitmap, ImageHistogram &out, bool isNeon) {
+        AndroidBitmapInfo info;
+        void *pixelData = nullptr;
+        if (AndroidBitmap_getInfo(env, bitmap, &info) < 0) {
+            LOG_ERROR("Failed to get the bitmap info");
+            return false;
+        }
+        if (info.format != ANDROID_BITMAP_FORMAT_RGBA_8888) {
+            LOG_ERROR("Invalid bit map format");
+            return false;
+        }
+        if (AndroidBitmap_lockPixels(env, bitmap, &pixelData) < 0) {
+            LOG_ERROR("Failed to lock the pixel information");
+            return false;
+        }
+        uint8_t *pixels = reinterpret_cast<uint8_t *>(pixelData);
+        if (ImageProcessorSIMD::device_support_neon() && isNeon) {
+            ImageStats::histogram_rgba_neon(pixels, info.width, info.height, info.stride, out);
+        } else {
+            ImageStats::histogram_rgba_scalar(pixels, info.width, info.height, info.stride, out);
         }
-        ip::ImageProcessor::convert_yuv_rgba_scalar(reinterpret_cast<uint8_t *>(yPtr),
-                                                    reinterpret_cast<uint8_t *>(vPixels),
-                                                    reinterpret_cast<uint8_t *>(uPixels),
-                                                    reinterpret_cast<uint8_t *>(lockPixels),
-                                                    width, height, y_stride, dst_stride,
-                                                    u_row_stride,
-                                                    v_row_stride, u_pixel_stride, v_pixel_stride);
+        AndroidBitmap_unlockPixels(env, bitmap);
+        return true;
     }
-    AndroidBitmap_unlockPixels(env, outBitmap);
-    env->ReleaseByteArrayElements(y_pixels, yPtr, 0);
-    env->ReleaseByteArrayElements(u_pixels, uPixels, 0);
-    env->ReleaseByteArrayElements(v_pixels, vPixels, 0);
+
+    bool ImageProcessor::AutoLevels(JNIEnv *env, jobject bitmap, float clipFraction, bool isNeon) {
+        AndroidBitmapInfo info;
+        void *pixelData = nullptr;
+        if (AndroidBitmap_getInfo(env, bitmap, &info) < 0) {
+            LOG_ERROR("Failed to get the bitmap info");
+            return false;
+        }
+        if (info.format != ANDROID_BITMAP_FORMAT_RGBA_8888) {
+            LOG_ERROR("Invalid bit map format");
+            return false;
+        }
+        if (AndroidBitmap_lockPixels(env, bitmap, &pixelData) < 0) {
+            LOG_ERROR("Failed to lock the pixel information");
+            return false;
+        }
+        uint8_t *pixels = reinterpret_cast<uint8_t *>(pixelData);
+        bool neon = ImageProcessorSIMD::device_support_neon() && isNeon;
+        ImageHistogram histogram;
+        if (neon) {
+            ImageStats::histogram_rgba_neon(pixels, info.width, info.height, info.stride,
+                                            histogram);
+        } else {
+            ImageStats::histogram_rgba_scalar(pixels, info.width, info.height, info.stride,
+                                              histogram);
+        }
+        uint8_t lut[3][256];
+        for (int c = ImageHistogram::CH_R; c <= ImageHistogram::CH_B; c++) {
+            ImageStats::auto_levels_lut(histogram.bins[c], clipFraction, lut[c]);
+        }
+        if (neon) {
+            ImageStats::apply_lut_rgba_neon(pixels, pixels, info.width, info.height, info.stride,
+                                            lut[0], lut[1], lut[2]);
+        } else {
+            ImageStats::apply_lut_rgba_scalar(pixels, pixels, info.width, info.height,
+                                              info.stride, lut[0], lut[1], lut[2]);
+        }
+        AndroidBitmap_unlockPixels(env, bitmap);
+        return true;
+    }
+
+    bool ImageProcessor::EqualizeHistogram(JNIEnv *env, jobject bitmap, bool isNeon) {
+        AndroidBitmapInfo info;
+        void *pixelData = nullptr;
+        if (AndroidBitmap_getInfo(env, bitmap, &info) < 0) {
+            LOG_ERROR("Failed to get the bitmap info");
+            return false;
+        }
+        if (info.format != ANDROID_BITMAP_FORMAT_RGBA_8888) {
+            LOG_ERROR("Invalid bit map format");
+            return false;
+        }
+        if (AndroidBitmap_lockPixels(env, bitmap, &pixelData) < 0) {
+            LOG_ERROR("Failed to lock the pixel information");
+            return false;
+        }
+        uint8_t *pixels = reinterpret_cast<uint8_t *>(pixelData);
+        bool neon = ImageProcessorSIMD::device_support_neon() && isNeon;
+        ImageHistogram histogram;
+        if (neon) {
+            ImageStats::histogram_rgba_neon(pixels, info.width, info.height, info.stride,
+                                            histogram);
+        } else {
+            ImageStats::histogram_rgba_scalar(pixels, info.width, info.height, info.stride,
+                                              histogram);
+        }
+        uint8_t lut[256];
+        ImageStats::equalize_lut(histogram.bins[ImageHistogram::CH_LUMA], lut);
+        if (neon) {
+            ImageStats::apply_lut_rgba_neon(pixels, pixels, info.width, info.height, info.stride,
+                                            lut, lut, lut);
+        } else {
+            ImageStats::apply_lut_rgba_scalar(pixels, pixels, info.width, info.height,
+                                              info.stride, lut, lut, lut);
+        }
+        AndroidBitmap_unlockPixels(env, bitmap);
+        return true;
+    }
+
+    bool ImageProcessor::Clahe(JNIEnv *env, jobject bitmap, int tilesX, int tilesY, float clipLimit,
+                               bool isNeon) {
+        AndroidBitmapInfo info;
+        void *pixelData = nullptr;
+        if (AndroidBitmap_getInfo(env, bitmap, &info) < 0) {
+            LOG_ERROR("Failed to get the bitmap info");
+            return false;
+        }
+        if (info.format != ANDROID_BITMAP_FORMAT_RGBA_8888) {
+            LOG_ERROR("Invalid bit map format");
+            return false;
+        }
+        if (AndroidBitmap_lockPixels(env, bitmap, &pixelData) < 0) {
+            LOG_ERROR("Failed to lock the pixel information");
+            return false;
+        }
+        uint8_t *pixels = reinterpret_cast<uint8_t *>(pixelData);
+        ImageStats::clahe_rgba(pixels, info.width, info.height, info.stride, tilesX, tilesY,
+                               clipLimit, ImageProcessorSIMD::device_support_neon() && isNeon);
+        AndroidBitmap_unlockPixels(env, bitmap);
+        return true;
+    }
+
+    bool ImageProcessor::BoxBlur(JNIEnv *env, jobject bitmap, int radius, bool isNeon) {
+        AndroidBitmapInfo info;
+        void *pixelData = nullptr;
+        if (AndroidBitmap_getInfo(env, bitmap, &info) < 0) {
+            LOG_ERROR("Failed to get the bitmap info");
+            return false;
+        }
+        if (info.format != ANDROID_BITMAP_FORMAT_RGBA_8888) {
+            LOG_ERROR("Invalid bit map format");
+            return false;
+        }
+        if (AndroidBitmap_lockPixels(env, bitmap, &pixelData) < 0) {
+            LOG_ERROR("Failed to lock the pixel information");
+            return false;
+        }
+        uint8_t *pixels = reinterpret_cast<uint8_t *>(pixelData);
+        if (ImageProcessorSIMD::device_support_neon() && isNeon) {
+            IntegralImage::box_blur_rgba_neon(pixels, pixels, info.width, info.height,
+                                              info.stride, radius);
+        } else {
+            IntegralImage::box_blur_rgba_scalar(pixels, pixels, info.width, info.height,
+                                                info.stride, radius);
+        }
+        AndroidBitmap_unlockPixels(env, bitmap);
+        return true;
+    }
+
+    bool ImageProcessor::AdaptiveThreshold(JNIEnv *env, jobject bitmap, int radius, int offset,
+                                           bool isNeon) {
+        AndroidBitmapInfo info;
+        void *pixelData = nullptr;
+        if (AndroidBitmap_getInfo(env, bitmap, &info) < 0) {
+            LOG_ERROR("Failed to get the bitmap info");
+            return false;
+        }
+        if (info.format != ANDROID_BITMAP_FORMAT_RGBA_8888) {
+            LOG_ERROR("Invalid bit map format");
+            return false;
+        }
+        if (AndroidBitmap_lockPixels(env, bitmap, &pixelData) < 0) {
+            LOG_ERROR("Failed to lock the pixel information");
+            return false;
+        }
+        uint8_t *pixels = reinterpret_cast<uint8_t *>(pixelData);
+        IntegralImage::adaptive_threshold_rgba(pixels, info.width, info.height, info.stride,
+                                               radius, offset,
+                                               ImageProcessorSIMD::device_support_neon() &&
+                                               isNeon);
+        AndroidBitmap_unlockPixels(env, bitmap);
+        return true;
+    }
+
+    bool ImageProcessor::LocalContrast(JNIEnv *env, jobject bitmap, int radius, float strength,
+                                       bool isNeon) {
+        AndroidBitmapInfo info;
+        void *pixelData = nullptr;
+        if (AndroidBitmap_getInfo(env, bitmap, &info) < 0) {
+            LOG_ERROR("Failed to get the bitmap info");
+            return false;
+        }
+        if (info.format != ANDROID_BITMAP_FORMAT_RGBA_8888) {
+            LOG_ERROR("Invalid bit map format");
+            return false;
+        }
+        if (AndroidBitmap_lockPixels(env, bitmap, &pixelData) < 0) {
+            LOG_ERROR("Failed to lock the pixel information");
+            return false;
+        }
+        uint8_t *pixels = reinterpret_cast<uint8_t *>(pixelData);
+        IntegralImage::local_contrast_rgba(pixels, info.width, info.height, info.stride, radius,
+                                           strength,
+                                           ImageProcessorSIMD::device_support_neon() && isNeon);
+        AndroidBitmap_unlockPixels(env, bitmap);
+        return true;
+    }
+
+    bool ImageProcessor::ApplyMorphology(JNIEnv *env, jobject bitmap, MorphOp op, int radiusX,
+                                         int radiusY, bool lumaOnly, bool isNeon) {
+        AndroidBitmapInfo info;
+        void *pixelData = nullptr;
+        if (AndroidBitmap_getInfo(env, bitmap, &info) < 0) {
+            LOG_ERROR("Failed to get the bitmap info");
+            return false;
+        }
+        if (info.format != ANDROID_BITMAP_FORMAT_RGBA_8888) {
+            LOG_ERROR("Invalid bit map format");
+            return false;
+        }
+        if (AndroidBitmap_lockPixels(env, bitmap, &pixelData) < 0) {
+            LOG_ERROR("Failed to lock the pixel information");
+            return false;
+        }
+        uint8_t *pixels = reinterpret_cast<uint8_t *>(pixelData);
+        bool neon = ImageProcessorSIMD::device_support_neon() && isNeon;
+        if (lumaOnly) {
+            Morphology::apply_luma_rgba(op, pixels, info.width, info.height, info.stride, radiusX,
+                                        radiusY, neon);
+        } else {
+            Morphology::apply_rgba(op, pixels, info.width, info.height, info.stride, radiusX,
+                                   radiusY, neon);
+        }
+        AndroidBitmap_unlockPixels(env, bitmap);
+        return true;
+    }
+
+    bool ImageProcessor::apply_filter_planar(FilterOp op, const PlanarImage &src,
+                                             PlanarImage &dst, int radius, float sigma) {
+        switch (op) {
+            case FilterOp::GRAY:
+                ImageProcessorSIMD::gray_scale_planar_neon(src, dst);
+                return true;
+            case FilterOp::NEGATIVE:
+                ImageProcessorSIMD::negative_planar_neon(src, dst);
+                return true;
+            case FilterOp::BLUR:
+                ImageProcessorSIMD::blur_planar_neon(src, dst, radius, sigma);
+                return true;
+            case FilterOp::SHARPEN:
+                ImageProcessorSIMD::sharp_planar_neon(src, dst);
+                return true;
+            case FilterOp::EMBOSS:
+                ImageProcessorSIMD::emboss_planar_neon(src, dst);
+                return true;
+            case FilterOp::SOBEL_EDGE:
+                ImageProcessorSIMD::edge_detection_planar_neon(
+                        src, dst, GradientMagnitude::ALPHA_MAX_BETA_MIN);
+                return true;
+            case FilterOp::MEDIAN:
+                MedianFilter::median_planar_neon(src, dst, radius);
+                return true;
+            default:
+                LOG_ERROR("Unknown filter %d in chain", static_cast<int>(op));
+                return false;
+        }
+    }
+
+    bool ImageProcessor::apply_filter_scalar(FilterOp op, const void *srcData, void *dstData,
+                                             AndroidBitmapInfo &info, int radius, float sigma) {
+        const uint8_t *src = reinterpret_cast<const uint8_t *>(srcData);
+        uint8_t *pixels = reinterpret_cast<uint8_t *>(dstData);
+        switch (op) {
+            case FilterOp::GRAY:
+                gray_scale_scalar(srcData, dstData, info);
+                return true;
+            case FilterOp::NEGATIVE:
+                negative_scalar(srcData, dstData, info);
+                return true;
+            case FilterOp::BLUR:
+                gaussian_blur_scalar(srcData, dstData, info, radius, sigma);
+                return true;
+            case FilterOp::SHARPEN:
+                sharpen_scalar(srcData, dstData, info);
+                return true;
+            case FilterOp::EMBOSS:
+                emboss_scalar(srcData, dstData, info);
+                return true;
+            case FilterOp::SOBEL_EDGE:
+                LuminanceSIMD::sobel_luma_scalar(src, pixels, info.width, info.height,
+                                                 info.stride,
+                                                 GradientMagnitude::ALPHA_MAX_BETA_MIN);
+                return true;
+            case FilterOp::MEDIAN:
+                MedianFilter::median_rgba(src, pixels, info.width, info.height, info.stride,
+                                          radius, false);
+                return true;
+            default:
+                LOG_ERROR("Unknown filter %d in chain", static_cast<int>(op));
+                return false;
+        }
+    }
+
+    bool ImageProcessor::ApplyFilterChain(JNIEnv *env, jobject bitmap, const FilterOp *ops,
+                                          size_t count, int radius, float sigma, bool isNeon) {
+        AndroidBitmapInfo info;
+        void *pixelData = nullptr;
+        if (AndroidBitmap_getInfo(env, bitmap, &info) < 0) {
+            LOG_ERROR("Failed to get the bitmap info");
+            return false;
+        }
+        if (info.format != ANDROID_BITMAP_FORMAT_RGBA_8888) {
+            LOG_ERROR("Invalid bit map format");
+            return false;
+        }
+        if (AndroidBitmap_lockPixels(env, bitmap, &pixelData) < 0) {
+            LOG_ERROR("Failed to lock the pixel information");
+            return false;
+        }
+        bool valid = apply_filter_chain(reinterpret_cast<uint8_t *>(pixelData), info, ops, count,
+                                        radius, sigma, isNeon);
+        AndroidBitmap_unlockPixels(env, bitmap);
+        return valid;
+    }
+
+    bool ImageProcessor::ApplyFilterChainTo(JNIEnv *env, jobject srcBitmap, jobject dstBitmap,
+                                            const FilterOp *ops, size_t count, int radius,
+                                            float sigma, bool isNeon) {
+        // one bitmap is locked only once
+        if (env->IsSameObject(srcBitmap, dstBitmap)) {
+            return ApplyFilterChain(env, dstBitmap, ops, count, radius, sigma, isNeon);
+        }
+        AndroidBitmapInfo info;
+        AndroidBitmapInfo dstInfo;
+        if (AndroidBitmap_getInfo(env, srcBitmap, &info) < 0 ||
+            AndroidBitmap_getInfo(env, dstBitmap, &dstInfo) < 0) {
+            LOG_ERROR("Failed to get the bitmap info");
+            return false;
+        }
+        if (info.format != ANDROID_BITMAP_FORMAT_RGBA_8888 ||
+            dstInfo.format != ANDROID_BITMAP_FORMAT_RGBA_8888) {
+            LOG_ERROR("Invalid bit map format");
+            return false;
+        }
+        // the kernels address both buffers with one stride
+        if (info.width != dstInfo.width || info.height != dstInfo.height ||
+            info.stride != dstInfo.stride) {
+            LOG_ERROR("The destination bitmap does not match the source");
+            return false;
+        }
+        void *srcPixels = nullptr;
+        void *dstPixels = nullptr;
+        if (AndroidBitmap_lockPixels(env, srcBitmap, &srcPixels) < 0) {
+            LOG_ERROR("Failed to lock the pixel information");
+            return false;
+        }
+        if (AndroidBitmap_lockPixels(env, dstBitmap, &dstPixels) < 0) {
+            LOG_ERROR("Failed to lock the pixel information");
+            AndroidBitmap_unlockPixels(env, srcBitmap);
+            return false;
+        }
+        bool valid = apply_filter_chain(reinterpret_cast<const uint8_t *>(srcPixels),
+                                        reinterpret_cast<uint8_t *>(dstPixels), info, ops, count,
+                                        radius, sigma, isNeon);
+        AndroidBitmap_unlockPixels(env, dstBitmap);
+        AndroidBitmap_unlockPixels(env, srcBitmap);
+        return valid;
+    }
+
+    bool ImageProcessor::apply_filter(FilterOp op, const uint8_t *src, uint8_t *dst,
+                                      AndroidBitmapInfo &info, int radius, float sigma,
+                                      bool isNeon) {
+        size_t bytes = (size_t) info.height * info.stride;
+        uint8_t *in = const_cast<uint8_t *>(src);
+        // the NEON stencils need a destination apart from the source, in place gets a copy
+        AlignedBytes scratch;
+        uint8_t *out = dst;
+        auto stencil_dst = [&]() -> uint8_t * {
+            if (src != dst) return dst;
+            scratch.resize(bytes);
+            out = scratch.data();
+            return out;
+        };
+        switch (op) {
+            case FilterOp::GRAY:
+                if (!use_neon(isNeon, TunedKernel::GRAY)) {
+                    return apply_filter_scalar(op, src, dst, info, radius, sigma);
+                }
+                ImageProcessorSIMD::gray_scale_neon_simd(in, dst, info.width, info.height,
+                                                         info.stride);
+                break;
+            case FilterOp::NEGATIVE:
+                if (!use_neon(isNeon, TunedKernel::NEGATIVE)) {
+                    return apply_filter_scalar(op, src, dst, info, radius, sigma);
+                }
+                ImageProcessorSIMD::negative_neon_simd(in, dst, info.width, info.height,
+                                                       info.stride);
+                break;
+            case FilterOp::BLUR:
+                if (!use_neon(isNeon, TunedKernel::BLUR)) {
+                    return apply_filter_scalar(op, src, dst, info, radius, sigma);
+                }
+                ImageProcessorSIMD::blur_neon_simd_float(in, stencil_dst(), info.width,
+                                                         info.height, info.stride, radius, sigma);
+                break;
+            case FilterOp::SHARPEN:
+                if (!use_neon(isNeon, TunedKernel::SHARPEN)) {
+                    return apply_filter_scalar(op, src, dst, info, radius, sigma);
+                }
+                ImageProcessorSIMD::sharp_neon_simd(in, stencil_dst(), info.width, info.height,
+                                                    info.stride);
+                break;
+            case FilterOp::EMBOSS:
+                if (!use_neon(isNeon, TunedKernel::EMBOSS)) {
+                    return apply_filter_scalar(op, src, dst, info, radius, sigma);
+                }
+                LuminanceSIMD::emboss_luma_neon(src, stencil_dst(), info.width, info.height,
+                                                info.stride);
+                break;
+            case FilterOp::SOBEL_EDGE:
+                if (!use_neon(isNeon, TunedKernel::SOBEL_EDGE)) {
+                    return apply_filter_scalar(op, src, dst, info, radius, sigma);
+                }
+                LuminanceSIMD::sobel_luma_neon(src, stencil_dst(), info.width, info.height,
+                                               info.stride, GradientMagnitude::ALPHA_MAX_BETA_MIN);
+                break;
+            case FilterOp::MEDIAN:
+                MedianFilter::median_rgba(src, dst, info.width, info.height, info.stride, radius,
+                                          ImageProcessorSIMD::device_support_neon() && isNeon);
+                break;
+            default:
+                LOG_ERROR("Unknown filter %d in chain", static_cast<int>(op));
+                return false;
+        }
+        if (out != dst) memcpy(dst, out, bytes);
+        return true;
+    }
+
+    bool ImageProcessor::apply_filter_chain(const uint8_t *src, uint8_t *dst,
+                                            AndroidBitmapInfo &info, const FilterOp *ops,
+                                            size_t count, int radius, float sigma, bool isNeon) {
+        if (count == 0) {
+            if (src != dst) memcpy(dst, src, (size_t) info.height * info.stride);
+            return true;
+        }
+        // a single filter goes straight from src to dst with the interleaved kernels
+        if (count == 1) return apply_filter(ops[0], src, dst, info, radius, sigma, isNeon);
+        bool valid = true;
+        if (ImageProcessorSIMD::device_support_neon() && isNeon) {
+            PlanarImage current;
+            PlanarImage next;
+            ImageProcessorSIMD::deinterleave_rgba_neon(src, info.width, info.height,
+                                                       info.stride, current);
+            for (size_t i = 0; i < count && valid; i++) {
+                valid = apply_filter_planar(ops[i], current, next, radius, sigma);
+                if (valid) current.swap(next);
+            }
+            // the bitmap is only written once, an invalid chain leaves it untouched
+            if (valid) ImageProcessorSIMD::interleave_rgba_neon(current, dst, info.stride);
+        } else {
+            // the first filter reads src, the rest work in place on dst
+            valid = apply_filter_scalar(ops[0], src, dst, info, radius, sigma);
+            for (size_t i = 1; i < count && valid; i++) {
+                valid = apply_filter_scalar(ops[i], dst, info, radius, sigma);
+            }
+        }
+        return valid;
+    }
+
+    int ImageProcessor::filter_halo(FilterOp op, int radius) {
+        switch (op) {
+            case FilterOp::BLUR:
+            case FilterOp::MEDIAN:
+                return radius > 0 ? radius : 0;
+            case FilterOp::SHARPEN:
+            case FilterOp::EMBOSS:
+            case FilterOp::SOBEL_EDGE:
+                return 1;
+            default:
+                return 0;
+        }
+    }
+
+    void ImageProcessor::convert_yuv_rgba(const uint8_t *yPtr, const uint8_t *uPtr,
+                                          const uint8_t *vPtr, uint8_t *outrgba, size_t width,
+                                          size_t height, size_t yStride, size_t dstStride,
+                                          size_t uRowStride, size_t vRowStride,
+                                          size_t uPixelStride, size_t vPixelStride, bool isNeon) {
+        if (ImageProcessorSIMD::device_support_neon() && isNeon &&
+            AutoTuner::instance().plan(TunedKernel::YUV_RGBA).useSimd) {
+            ImageProcessorSIMD::convert_yuv_rgba_neon(const_cast<uint8_t *>(yPtr),
+                                                      const_cast<uint8_t *>(uPtr),
+                                                      const_cast<uint8_t *>(vPtr), outrgba,
+                                                      height, width, yStride, dstStride,
+                                                      uRowStride, vRowStride, vPixelStride,
+                                                      vPixelStride);
+        } else {
+            if (isNeon) {
+                LOG_ERROR("Device Does not support neon.. falling back to scalar");
+            }
+            convert_yuv_rgba_scalar(yPtr, vPtr, uPtr, outrgba, width, height, yStride, dstStride,
+                                    uRowStride, vRowStride, uPixelStride, vPixelStride);
+        }
+    }
+}
+
+namespace {
+    JavaVM *g_vm = nullptr;
+
+    // Attaches a native worker to the VM on its first callback and detaches it when the
+    // worker exits. A thread the VM already knows, e.g. a JVM caller running a task inline, is
+    // only borrowed and never detached here.
+    struct JvmThread {
+        JNIEnv *env = nullptr;
+        bool attached = false;
+
+        JNIEnv *attach() {
+            if (env != nullptr) return env;
+            jint status = g_vm->GetEnv(reinterpret_cast<void **>(&env), JNI_VERSION_1_6);
+            if (status == JNI_OK) return env;
+            env = nullptr;
+            if (status != JNI_EDETACHED || g_vm->AttachCurrentThread(&env, nullptr) != JNI_OK) {
+                LOG_ERROR("Failed to attach the worker to the VM");
+                env = nullptr;
+                return nullptr;
+            }
+            attached = true;
+            return env;
+        }
+
+        ~JvmThread() {
+            if (attached) g_vm->DetachCurrentThread();
+        }
+    };
+
+    thread_local JvmThread t_jvm;
+
+    // Bytes rows x cols samples span in a plane, the last row is not padded to its stride.
+    size_t plane_span(size_t rows, size_t cols, size_t rowStride, size_t pixelStride) {
+        return (rows - 1) * rowStride + (cols - 1) * pixelStride + 1;
+    }
+
+    // plane_span(rows, cols, rowStride, pixelStride) <= capacity without overflowing size_t.
+    // rows and cols must be at least 1.
+    bool plane_fits(size_t capacity, size_t rows, size_t cols, size_t rowStride,
+                    size_t pixelStride) {
+        const size_t limit = std::numeric_limits<size_t>::max();
+        if (pixelStride != 0 && cols - 1 > (limit - 1) / pixelStride) return false;
+        size_t row = (cols - 1) * pixelStride + 1;
+        if (rowStride != 0 && rows - 1 > (limit - row) / rowStride) return false;
+        return (rows - 1) * rowStride + row <= capacity;
+    }
+
+    // Checks the size and stride of a single 8 bit plane against the array holding it.
+    bool plane_array_fits(JNIEnv *env, jbyteArray plane, jint width, jint height,
+                          jint stride) {
+        if (width <= 0 || height <= 0 || stride < width) {
+            LOG_ERROR("Invalid plane size %d x %d, stride %d", width, height, stride);
+            return false;
+        }
+        if ((size_t) env->GetArrayLength(plane) < plane_span(height, width, stride, 1)) {
+            LOG_ERROR("The plane is too small for %d x %d", width, height);
+            return false;
+        }
+        return true;
+    }
+
+    // Checks the strides and lengths of the planes of a width x height 4:2:0 frame before
+    // any of them is locked.
+    bool yuv_planes_fit(JNIEnv *env, jbyteArray yPixels, jbyteArray uPixels,
+                        jbyteArray vPixels, jint width, jint height, jint yStride,
+                        jint uRowStride, jint vRowStride, jint uPixelStride, jint vPixelStride) {
+        if (width <= 0 || height <= 0 || yStride < width || uPixelStride < 1 ||
+            vPixelStride < 1) {
+            LOG_ERROR("Invalid yuv frame geometry");
+            return false;
+        }
+        size_t chromaWidth = ((size_t) width + 1) / 2;
+        size_t chromaHeight = ((size_t) height + 1) / 2;
+        if ((size_t) uRowStride < plane_span(1, chromaWidth, 0, uPixelStride) ||
+            (size_t) vRowStride < plane_span(1, chromaWidth, 0, vPixelStride)) {
+            LOG_ERROR("Invalid chroma row stride");
+            return false;
+        }
+        if ((size_t) env->GetArrayLength(yPixels) < plane_span(height, width, yStride, 1) ||
+            (size_t) env->GetArrayLength(uPixels) <
+            plane_span(chromaHeight, chromaWidth, uRowStride, uPixelStride) ||
+            (size_t) env->GetArrayLength(vPixels) <
+            plane_span(chromaHeight, chromaWidth, vRowStride, vPixelStride)) {
+            LOG_ERROR("The yuv planes are too small for the frame");
+            return false;
+        }
+        return true;
+    }
+
+    // Both bitmaps of the incremental path are RGBA_8888 of the tracker's size.
+    bool matches_tracker(const AndroidBitmapInfo &info, const ip::FrameChangeTracker &tracker) {
+        return info.format == ANDROID_BITMAP_FORMAT_RGBA_8888 &&
+               info.width == tracker.width() && info.height == tracker.height() &&
+               info.stride >= info.width * 4;
+    }
+}
+
+
+extern "C" {
+JNIEXPORT jint JNICALL
+JNI_OnLoad(JavaVM *vm, void *) {
+    g_vm = vm;
+    return JNI_VERSION_1_6;
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_GrayScaleImage(JNIEnv *env, jclass clazz, jobject bitmap,
+                                                    jboolean optimizeNeon) {
+    bool imageProcessed = ip::ImageProcessor::GrayScale(env, bitmap, optimizeNeon);
+    return imageProcessed ? JNI_TRUE : JNI_FALSE;
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_CreateNegative(JNIEnv *env, jclass clazz, jobject bitmap,
+                                                    jboolean optimizeNeon) {
+    bool imageProcessed = ip::ImageProcessor::NegativeImage(env, bitmap, optimizeNeon);
+    return imageProcessed ? JNI_TRUE : JNI_FALSE;
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_BlurImage(JNIEnv *env, jclass clazz, jobject bitmap,
+                                               int radius, int sigma,
+                                               jboolean optimizeNeon) {
+    bool imageProcessed = ip::ImageProcessor::BlurImage(env, bitmap, radius, sigma, optimizeNeon);
+    return imageProcessed ? JNI_TRUE : JNI_FALSE;
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_BlurImageBorder(JNIEnv *env, jclass clazz, jobject bitmap,
+                                                     jint radius, jint sigma, jint border,
+                                                     jboolean optimizeNeon) {
+    bool imageProcessed = ip::ImageProcessor::BlurImage(env, bitmap, radius, sigma, optimizeNeon,
+                                                        static_cast<ip::BorderMode>(border));
+    return imageProcessed ? JNI_TRUE : JNI_FALSE;
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_SharpenBorder(JNIEnv *env, jclass clazz, jobject bitmap,
+                                                   jint border, jboolean optimizeNeon) {
+    bool imageProcessed = ip::ImageProcessor::SharpenImage(env, bitmap, optimizeNeon,
+                                                           static_cast<ip::BorderMode>(border));
+    return imageProcessed ? JNI_TRUE : JNI_FALSE;
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_Embross(JNIEnv *env, jclass clazz, jobject bitmap,
+                                             jboolean optimizeNeon) {
+    bool imageProcessed = ip::ImageProcessor::EmbrossImage(env, bitmap, optimizeNeon);
+    return imageProcessed ? JNI_TRUE : JNI_FALSE;
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_Sharpen(JNIEnv *env, jclass clazz, jobject bitmap,
+                                             jboolean optimize_neon) {
+    bool imageProcessed = ip::ImageProcessor::SharpenImage(env, bitmap, optimize_neon);
+    return imageProcessed ? JNI_TRUE : JNI_FALSE;
+
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_EdgeDetection(JNIEnv *env, jclass clazz, jobject bitmap,
+                                                   jboolean optimize_neon) {
+    bool imageProcessed = ip::ImageProcessor::EdgeDetection(env, bitmap, optimize_neon);
+    return imageProcessed ? JNI_TRUE : JNI_FALSE;
+
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_EdgeDetectionWithMode(JNIEnv *env, jclass clazz,
+                                                           jobject bitmap, jint magnitude_mode,
+                                                           jbyteArray direction,
+                                                           jboolean optimize_neon) {
+    jbyte *directionPtr = nullptr;
+    if (direction != nullptr) {
+        // the directions are written as one byte per pixel of the bitmap
+        AndroidBitmapInfo info;
+        if (AndroidBitmap_getInfo(env, bitmap, &info) < 0) {
+            LOG_ERROR("Failed to get the bitmap info");
+            return JNI_FALSE;
+        }
+        if ((size_t) env->GetArrayLength(direction) < (size_t) info.width * info.height) {
+            LOG_ERROR("The direction buffer is too small for the bitmap");
+            return JNI_FALSE;
+        }
+        directionPtr = env->GetByteArrayElements(direction, nullptr);
+    }
+    bool imageProcessed = ip::ImageProcessor::EdgeDetection(
+            env, bitmap, optimize_neon, static_cast<ip::GradientMagnitude>(magnitude_mode),
+            reinterpret_cast<uint8_t *>(directionPtr));
+    if (directionPtr != nullptr) {
+        env->ReleaseByteArrayElements(direction, directionPtr, 0);
+    }
+    return imageProcessed ? JNI_TRUE : JNI_FALSE;
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_MedianFilter(JNIEnv *env, jclass clazz, jobject bitmap,
+                                                  jint radius, jboolean optimizeNeon) {
+    bool imageProcessed = ip::ImageProcessor::MedianImage(env, bitmap, radius, optimizeNeon);
+    return imageProcessed ? JNI_TRUE : JNI_FALSE;
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_BilateralFilter(JNIEnv *env, jclass clazz, jobject bitmap,
+                                                     jfloat sigma_spatial, jfloat sigma_range,
+                                                     jboolean optimizeNeon) {
+    bool imageProcessed = ip::ImageProcessor::BilateralImage(env, bitmap, sigma_spatial,
+                                                             sigma_range, optimizeNeon);
+    return imageProcessed ? JNI_TRUE : JNI_FALSE;
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_CannyEdgeDetection(JNIEnv *env, jclass clazz, jobject bitmap,
+                                                        jint low_threshold, jint high_threshold,
+                                                        jboolean optimizeNeon) {
+    bool imageProcessed = ip::ImageProcessor::CannyEdges(env, bitmap, low_threshold,
+                                                         high_threshold, optimizeNeon);
+    return imageProcessed ? JNI_TRUE : JNI_FALSE;
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_cannyPlane(JNIEnv *env, jclass clazz, jbyteArray plane,
+                                                jint width, jint height, jint stride,
+                                                jbyteArray edges, jint low_threshold,
+                                                jint high_threshold, jboolean optimizeNeon) {
+    if (!plane_array_fits(env, plane, width, height, stride)) return JNI_FALSE;
+    if ((size_t) env->GetArrayLength(edges) < (size_t) width * height) {
+        LOG_ERROR("The edge buffer is too small for %d x %d", width, height);
+        return JNI_FALSE;
+    }
+    jbyte *planePtr = env->GetByteArrayElements(plane, nullptr);
+    jbyte *edgesPtr = env->GetByteArrayElements(edges, nullptr);
+    if (ip::ImageProcessorSIMD::device_support_neon() && optimizeNeon) {
+        ip::CannyEdge::detect_plane_neon(reinterpret_cast<uint8_t *>(planePtr), width, height,
+                                         stride, reinterpret_cast<uint8_t *>(edgesPtr), width,
+                                         low_threshold, high_threshold);
+    } else {
+        ip::CannyEdge::detect_plane_scalar(reinterpret_cast<uint8_t *>(planePtr), width, height,
+                                           stride, reinterpret_cast<uint8_t *>(edgesPtr), width,
+                                           low_threshold, high_threshold);
+    }
+    env->ReleaseByteArrayElements(edges, edgesPtr, 0);
+    env->ReleaseByteArrayElements(plane, planePtr, JNI_ABORT);
+    return JNI_TRUE;
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_rgbaToYuv(JNIEnv *env, jclass clazz, jobject bitmap,
+                                               jbyteArray out, jint layout, jint matrix,
+                                               jboolean full_range, jboolean optimizeNeon) {
+    AndroidBitmapInfo info;
+    if (AndroidBitmap_getInfo(env, bitmap, &info) < 0) {
+        LOG_ERROR("Failed to get the bitmap info");
+        return JNI_FALSE;
+    }
+    size_t lumaSize = (size_t) info.width * info.height;
+    size_t chromaWidth = (info.width + 1) / 2;
+    size_t chromaSize = chromaWidth * ((info.height + 1) / 2);
+    if ((size_t) env->GetArrayLength(out) < lumaSize + 2 * chromaSize) {
+        LOG_ERROR("The yuv buffer is too small for the bitmap");
+        return JNI_FALSE;
+    }
+    jbyte *outPtr = env->GetByteArrayElements(out, nullptr);
+    auto *y = reinterpret_cast<uint8_t *>(outPtr);
+    ip::YuvPlanes planes;
+    if (layout == 1) {
+        planes = ip::YuvPlanes::nv12(y, info.width, y + lumaSize, chromaWidth * 2);
+    } else if (layout == 2) {
+        planes = ip::YuvPlanes::nv21(y, info.width, y + lumaSize, chromaWidth * 2);
+    } else {
+        planes = ip::YuvPlanes::i420(y, info.width, y + lumaSize, chromaWidth,
+                                     y + lumaSize + chromaSize, chromaWidth);
+    }
+    bool imageProcessed = ip::ImageProcessor::ConvertToYuv(
+            env, bitmap, planes, static_cast<ip::YuvMatrix>(matrix),
+            full_range ? ip::YuvRange::FULL : ip::YuvRange::LIMITED, optimizeNeon);
+    env->ReleaseByteArrayElements(out, outPtr, imageProcessed ? 0 : JNI_ABORT);
+    return imageProcessed ? JNI_TRUE : JNI_FALSE;
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_rgbaToYuvPlanes(JNIEnv *env, jclass clazz, jobject bitmap,
+                                                     jobject y_plane, jint y_row_stride,
+                                                     jobject u_plane, jint u_row_stride,
+                                                     jobject v_plane, jint v_row_stride,
+                                                     jint chroma_pixel_stride, jint matrix,
+                                                     jboolean full_range,
+                                                     jboolean optimizeNeon) {
+    AndroidBitmapInfo info;
+    if (AndroidBitmap_getInfo(env, bitmap, &info) < 0) {
+        LOG_ERROR("Failed to get the bitmap info");
+        return JNI_FALSE;
+    }
+    // negative strides would wrap to huge size_t values below
+    size_t chromaWidth = (info.width + 1) / 2;
+    size_t chromaHeight = (info.height + 1) / 2;
+    if (info.width == 0 || info.height == 0 || y_row_stride < 0 || u_row_stride < 0 ||
+        v_row_stride < 0 || (chroma_pixel_stride != 1 && chroma_pixel_stride != 2) ||
+        (size_t) y_row_stride < info.width ||
+        (size_t) u_row_stride < chromaWidth * chroma_pixel_stride ||
+        (size_t) v_row_stride < chromaWidth * chroma_pixel_stride) {
+        LOG_ERROR("Invalid yuv plane strides %d %d %d, pixel stride %d", y_row_stride,
+                  u_row_stride, v_row_stride, chroma_pixel_stride);
+        return JNI_FALSE;
+    }
+    ip::YuvPlanes planes;
+    planes.y = static_cast<uint8_t *>(env->GetDirectBufferAddress(y_plane));
+    planes.u = static_cast<uint8_t *>(env->GetDirectBufferAddress(u_plane));
+    planes.v = static_cast<uint8_t *>(env->GetDirectBufferAddress(v_plane));
+    planes.yStride = y_row_stride;
+    planes.uStride = u_row_stride;
+    planes.vStride = v_row_stride;
+    planes.chromaPixelStride = chroma_pixel_stride;
+    if (planes.y == nullptr || planes.u == nullptr || planes.v == nullptr) {
+        LOG_ERROR("The yuv planes must be direct buffers");
+        return JNI_FALSE;
+    }
+    // the last row of a plane does not have to be padded to its row stride
+    if (!plane_fits((size_t) env->GetDirectBufferCapacity(y_plane), info.height, info.width,
+                    planes.yStride, 1) ||
+        !plane_fits((size_t) env->GetDirectBufferCapacity(u_plane), chromaHeight, chromaWidth,
+                    planes.uStride, planes.chromaPixelStride) ||
+        !plane_fits((size_t) env->GetDirectBufferCapacity(v_plane), chromaHeight, chromaWidth,
+                    planes.vStride, planes.chromaPixelStride)) {
+        LOG_ERROR("The yuv planes are too small for the bitmap");
+        return JNI_FALSE;
+    }
+    bool imageProcessed = ip::ImageProcessor::ConvertToYuv(
+            env, bitmap, planes, static_cast<ip::YuvMatrix>(matrix),
+            full_range ? ip::YuvRange::FULL : ip::YuvRange::LIMITED, optimizeNeon);
+    return imageProcessed ? JNI_TRUE : JNI_FALSE;
+}
+JNIEXPORT void JNICALL
+Java_com_os_imageprocessor_JniBridge_convert_1yuv_1rgba(JNIEnv *env, jclass clazz,
+                                                        jbyteArray y_pixels, jbyteArray v_pixels,
+                                                        jbyteArray u_pixels,
+                                                        jobject outBitmap,
+                                                        jint width, jint height, jint y_stride,
+                                                        jint dst_stride, jint u_row_stride,
+                                                        jint v_row_stride, jint u_pixel_stride,
+                                                        jint v_pixel_stride,
+                                                        jboolean optimizeNeon) {
+    jbyte *yPtr = env->GetByteArrayElements(y_pixels, nullptr);
+    jbyte *uPixels = env->GetByteArrayElements(u_pixels, nullptr);
+    jbyte *vPixels = env->GetByteArrayElements(v_pixels, nullptr);
+    void *lockPixels = nullptr;
+    if (AndroidBitmap_lockPixels(env, outBitmap, &lockPixels) < 0) {
+        LOG_ERROR("Failed to lock the pixels");
+        return;
+    }
+    ip::ImageProcessor::convert_yuv_rgba(reinterpret_cast<uint8_t *>(yPtr),
+                                         reinterpret_cast<uint8_t *>(uPixels),
+                                         reinterpret_cast<uint8_t *>(vPixels),
+                                         reinterpret_cast<uint8_t *>(lockPixels), width, height,
+                                         y_stride, dst_stride, u_row_stride, v_row_stride,
+                                         u_pixel_stride, v_pixel_stride, optimizeNeon);
+    AndroidBitmap_unlockPixels(env, outBitmap);
+    env->ReleaseByteArrayElements(y_pixels, yPtr, 0);
+    env->ReleaseByteArrayElements(u_pixels, uPixels, 0);
+    env->ReleaseByteArrayElements(v_pixels, vPixels, 0);
+}
+JNIEXPORT jlong JNICALL
+Java_com_os_imageprocessor_JniBridge_createFrameTracker(JNIEnv *env, jclass clazz, jint width,
+                                                        jint height, jint threshold) {
+    if (width <= 0 || height <= 0 || threshold < 0) {
+        LOG_ERROR("Invalid frame tracker %d x %d, threshold %d", width, height, threshold);
+        return 0;
+    }
+    auto *tracker = new ip::FrameChangeTracker(width, height, threshold);
+    return reinterpret_cast<jlong>(tracker);
+}
+JNIEXPORT void JNICALL
+Java_com_os_imageprocessor_JniBridge_releaseFrameTracker(JNIEnv *env, jclass clazz,
+                                                         jlong handle) {
+    if (handle == 0) return;
+    delete reinterpret_cast<ip::FrameChangeTracker *>(handle);
+}
+JNIEXPORT void JNICALL
+Java_com_os_imageprocessor_JniBridge_convert_1yuv_1rgba_1incremental(JNIEnv *env, jclass clazz,
+                                                                     jlong handle,
+                                                                     jbyteArray y_pixels,
+                                                                     jbyteArray v_pixels,
+                                                                     jbyteArray u_pixels,
+                                                                     jobject outBitmap,
+                                                                     jint y_stride,
+                                                                     jint dst_stride,
+                                                                     jint u_row_stride,
+                                                                     jint v_row_stride,
+                                                                     jint u_pixel_stride,
+                                                                     jint v_pixel_stride,
+                                                                     jboolean optimizeNeon) {
+    auto *tracker = reinterpret_cast<ip::FrameChangeTracker *>(handle);
+    if (tracker == nullptr) {
+        LOG_ERROR("Invalid frame tracker handle");
+        return;
+    }
+    AndroidBitmapInfo info;
+    if (AndroidBitmap_getInfo(env, outBitmap, &info) < 0) {
+        LOG_ERROR("Failed to get the bitmap info");
+        return;
+    }
+    // the dirty rows are written at the tracker's size, a different bitmap would overflow
+    if (!matches_tracker(info, *tracker) || dst_stride < (jint) info.width * 4 ||
+        (uint32_t) dst_stride > info.stride) {
+        LOG_ERROR("The bitmap does not match the frame tracker");
+        return;
+    }
+    if (!yuv_planes_fit(env, y_pixels, u_pixels, v_pixels, info.width, info.height, y_stride,
+                        u_row_stride, v_row_stride, u_pixel_stride, v_pixel_stride)) {
+        return;
+    }
+    jbyte *yPtr = env->GetByteArrayElements(y_pixels, nullptr);
+    jbyte *uPixels = env->GetByteArrayElements(u_pixels, nullptr);
+    jbyte *vPixels = env->GetByteArrayElements(v_pixels, nullptr);
+    void *lockPixels = nullptr;
+    if (AndroidBitmap_lockPixels(env, outBitmap, &lockPixels) < 0) {
+        LOG_ERROR("Failed to lock the pixels");
+        env->ReleaseByteArrayElements(y_pixels, yPtr, JNI_ABORT);
+        env->ReleaseByteArrayElements(u_pixels, uPixels, JNI_ABORT);
+        env->ReleaseByteArrayElements(v_pixels, vPixels, JNI_ABORT);
+        return;
+    }
+    bool useNeon = ip::ImageProcessorSIMD::device_support_neon() && optimizeNeon;
+    tracker->convert_yuv_rgba_incremental(reinterpret_cast<uint8_t *>(yPtr),
+                                          reinterpret_cast<uint8_t *>(uPixels),
+                                          reinterpret_cast<uint8_t *>(vPixels),
+                                          reinterpret_cast<uint8_t *>(lockPixels),
+                                          y_stride, dst_stride, u_row_stride, v_row_stride,
+                                          u_pixel_stride, v_pixel_stride, useNeon);
+    AndroidBitmap_unlockPixels(env, outBitmap);
+    // the planes are only read, nothing has to be copied back into the java arrays
+    env->ReleaseByteArrayElements(y_pixels, yPtr, JNI_ABORT);
+    env->ReleaseByteArrayElements(u_pixels, uPixels, JNI_ABORT);
+    env->ReleaseByteArrayElements(v_pixels, vPixels, JNI_ABORT);
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_convert_1filter_1incremental(JNIEnv *env, jclass clazz,
+                                                                  jlong handle,
+                                                                  jbyteArray y_pixels,
+                                                                  jbyteArray v_pixels,
+                                                                  jbyteArray u_pixels,
+                                                                  jobject rgbaBitmap,
+                                                                  jobject outBitmap,
+                                                                  jint y_stride,
+                                                                  jint u_row_stride,
+                                                                  jint v_row_stride,
+                                                                  jint u_pixel_stride,
+                                                                  jint v_pixel_stride,
+                                                                  jintArray ops, jint radius,
+                                                                  jint sigma,
+                                                                  jboolean optimizeNeon) {
+    auto *tracker = reinterpret_cast<ip::FrameChangeTracker *>(handle);
+    if (tracker == nullptr) {
+        LOG_ERROR("Invalid frame tracker handle");
+        return JNI_FALSE;
+    }
+    AndroidBitmapInfo info;
+    AndroidBitmapInfo outInfo;
+    if (AndroidBitmap_getInfo(env, rgbaBitmap, &info) < 0 ||
+        AndroidBitmap_getInfo(env, outBitmap, &outInfo) < 0) {
+        LOG_ERROR("Failed to get the bitmap info");
+        return JNI_FALSE;
+    }
+    // the band filter addresses both bitmaps with one stride
+    if (!matches_tracker(info, *tracker) || !matches_tracker(outInfo, *tracker) ||
+        info.stride != outInfo.stride || env->IsSameObject(rgbaBitmap, outBitmap)) {
+        LOG_ERROR("The bitmaps do not match the frame tracker");
+        return JNI_FALSE;
+    }
+    if (!yuv_planes_fit(env, y_pixels, u_pixels, v_pixels, info.width, info.height, y_stride,
+                        u_row_stride, v_row_stride, u_pixel_stride, v_pixel_stride)) {
+        return JNI_FALSE;
+    }
+    jsize count = env->GetArrayLength(ops);
+    std::vector<ip::FilterOp> chain(count);
+    env->GetIntArrayRegion(ops, 0, count, reinterpret_cast<jint *>(chain.data()));
+    int halo = 0;
+    // emboss and sobel write flat first and last rows instead of clamping there
+    bool flatBorderRows = false;
+    for (ip::FilterOp op: chain) {
+        // an unknown op would leave the cached output half filtered
+        if (op < ip::FilterOp::GRAY || op > ip::FilterOp::MEDIAN) {
+            LOG_ERROR("Unknown filter %d in chain", static_cast<int>(op));
+            return JNI_FALSE;
+        }
+        halo += ip::ImageProcessor::filter_halo(op, radius);
+        flatBorderRows = flatBorderRows || op == ip::FilterOp::EMBOSS ||
+                         op == ip::FilterOp::SOBEL_EDGE;
+    }
+
+    void *rgbaPixels = nullptr;
+    void *outPixels = nullptr;
+    if (AndroidBitmap_lockPixels(env, rgbaBitmap, &rgbaPixels) < 0) {
+        LOG_ERROR("Failed to lock the pixels");
+        return JNI_FALSE;
+    }
+    if (AndroidBitmap_lockPixels(env, outBitmap, &outPixels) < 0) {
+        LOG_ERROR("Failed to lock the pixels");
+        AndroidBitmap_unlockPixels(env, rgbaBitmap);
+        return JNI_FALSE;
+    }
+    jbyte *yPtr = env->GetByteArrayElements(y_pixels, nullptr);
+    jbyte *uPixels = env->GetByteArrayElements(u_pixels, nullptr);
+    jbyte *vPixels = env->GetByteArrayElements(v_pixels, nullptr);
+    bool useNeon = ip::ImageProcessorSIMD::device_support_neon() && optimizeNeon;
+    tracker->convert_yuv_rgba_incremental(reinterpret_cast<uint8_t *>(yPtr),
+                                          reinterpret_cast<uint8_t *>(uPixels),
+                                          reinterpret_cast<uint8_t *>(vPixels),
+                                          reinterpret_cast<uint8_t *>(rgbaPixels),
+                                          y_stride, info.stride, u_row_stride, v_row_stride,
+                                          u_pixel_stride, v_pixel_stride, useNeon);
+    env->ReleaseByteArrayElements(y_pixels, yPtr, JNI_ABORT);
+    env->ReleaseByteArrayElements(u_pixels, uPixels, JNI_ABORT);
+    env->ReleaseByteArrayElements(v_pixels, vPixels, JNI_ABORT);
+
+    bool valid = true;
+    // the chain clamps at the image border, so the bands are padded the same way
+    tracker->filter_dirty_rows(reinterpret_cast<const uint8_t *>(rgbaPixels),
+                               reinterpret_cast<uint8_t *>(outPixels), info.stride, halo,
+                               ip::BorderMode::CLAMP, 0, flatBorderRows,
+                               [&](const uint8_t *src, uint8_t *dst, size_t width, size_t rows,
+                                   size_t stride) -> void {
+        AndroidBitmapInfo band = info;
+        band.width = (uint32_t) width;
+        band.height = (uint32_t) rows;
+        band.stride = (uint32_t) stride;
+        valid = valid && ip::ImageProcessor::apply_filter_chain(src, dst, band, chain.data(),
+                                                                chain.size(), radius, sigma,
+                                                                useNeon);
+    });
+    AndroidBitmap_unlockPixels(env, outBitmap);
+    AndroidBitmap_unlockPixels(env, rgbaBitmap);
+    return valid ? JNI_TRUE : JNI_FALSE;
+}
+JNIEXPORT void JNICALL
+Java_com_os_imageprocessor_JniBridge_invalidateFrameTracker(JNIEnv *env, jclass clazz,
+                                                            jlong handle) {
+    if (handle != 0) reinterpret_cast<ip::FrameChangeTracker *>(handle)->invalidate();
+}
+JNIEXPORT jfloat JNICALL
+Java_com_os_imageprocessor_JniBridge_getSkippedFraction(JNIEnv *env, jclass clazz, jlong handle,
+                                                        jboolean lastFrameOnly) {
+    if (handle == 0) return 0.0f;
+    const ip::FrameChangeStats &stats = reinterpret_cast<ip::FrameChangeTracker *>(handle)->stats();
+    return lastFrameOnly ? stats.lastSkippedFraction : stats.skipped_fraction();
+}
+JNIEXPORT jlong JNICALL
+Java_com_os_imageprocessor_JniBridge_createTemporalDenoiser(JNIEnv *env, jclass clazz, jint width,
+                                                            jint height, jint frames,
+                                                            jint threshold) {
+    if (width <= 0 || height <= 0 || frames <= 0 || threshold < 0) {
+        LOG_ERROR("Invalid denoiser %d x %d, %d frames, threshold %d", width, height, frames,
+                  threshold);
+        return 0;
+    }
+    auto *denoiser = new ip::TemporalDenoiser(width, height, frames, threshold);
+    return reinterpret_cast<jlong>(denoiser);
+}
+JNIEXPORT void JNICALL
+Java_com_os_imageprocessor_JniBridge_releaseTemporalDenoiser(JNIEnv *env, jclass clazz,
+                                                             jlong handle) {
+    delete reinterpret_cast<ip::TemporalDenoiser *>(handle);
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_denoise_1yuv(JNIEnv *env, jclass clazz, jlong handle,
+                                                  jbyteArray y_pixels, jbyteArray v_pixels,
+                                                  jbyteArray u_pixels, jint y_stride,
+                                                  jint u_row_stride, jint v_row_stride,
+                                                  jint u_pixel_stride, jint v_pixel_stride,
+                                                  jboolean optimizeNeon) {
+    auto *denoiser = reinterpret_cast<ip::TemporalDenoiser *>(handle);
+    if (denoiser == nullptr) {
+        LOG_ERROR("Invalid denoiser handle");
+        return JNI_FALSE;
+    }
+    // the ring is sized for the denoiser's frame, the planes must cover all of it
+    if (!yuv_planes_fit(env, y_pixels, u_pixels, v_pixels, (jint) denoiser->width(),
+                        (jint) denoiser->height(), y_stride, u_row_stride, v_row_stride,
+                        u_pixel_stride, v_pixel_stride)) {
+        return JNI_FALSE;
+    }
+    jbyte *yPtr = env->GetByteArrayElements(y_pixels, nullptr);
+    jbyte *uPixels = env->GetByteArrayElements(u_pixels, nullptr);
+    jbyte *vPixels = env->GetByteArrayElements(v_pixels, nullptr);
+    bool useNeon = ip::ImageProcessorSIMD::device_support_neon() && optimizeNeon;
+    denoiser->denoise(reinterpret_cast<uint8_t *>(yPtr), reinterpret_cast<uint8_t *>(uPixels),
+                      reinterpret_cast<uint8_t *>(vPixels), y_stride, u_row_stride,
+                      v_row_stride, u_pixel_stride, v_pixel_stride, useNeon);
+    // the planes are denoised in place, so they are copied back into the java arrays
+    env->ReleaseByteArrayElements(y_pixels, yPtr, 0);
+    env->ReleaseByteArrayElements(u_pixels, uPixels, 0);
+    env->ReleaseByteArrayElements(v_pixels, vPixels, 0);
+    return JNI_TRUE;
+}
+JNIEXPORT void JNICALL
+Java_com_os_imageprocessor_JniBridge_resetTemporalDenoiser(JNIEnv *env, jclass clazz,
+                                                           jlong handle) {
+    if (handle != 0) reinterpret_cast<ip::TemporalDenoiser *>(handle)->reset();
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_ApplyFilterChain(JNIEnv *env, jclass clazz, jobject bitmap,
+                                                      jintArray ops, jint radius, jint sigma,
+                                                      jboolean optimizeNeon) {
+    jsize count = env->GetArrayLength(ops);
+    std::vector<ip::FilterOp> chain(count);
+    env->GetIntArrayRegion(ops, 0, count, reinterpret_cast<jint *>(chain.data()));
+    bool imageProcessed = ip::ImageProcessor::ApplyFilterChain(env, bitmap, chain.data(),
+                                                               chain.size(), radius, sigma,
+                                                               optimizeNeon);
+    return imageProcessed ? JNI_TRUE : JNI_FALSE;
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_ApplyFilterChainTo(JNIEnv *env, jclass clazz,
+                                                        jobject srcBitmap, jobject dstBitmap,
+                                                        jintArray ops, jint radius, jint sigma,
+                                                        jboolean optimizeNeon) {
+    jsize count = env->GetArrayLength(ops);
+    std::vector<ip::FilterOp> chain(count);
+    env->GetIntArrayRegion(ops, 0, count, reinterpret_cast<jint *>(chain.data()));
+    bool imageProcessed = ip::ImageProcessor::ApplyFilterChainTo(env, srcBitmap, dstBitmap,
+                                                                 chain.data(), chain.size(),
+                                                                 radius, sigma, optimizeNeon);
+    return imageProcessed ? JNI_TRUE : JNI_FALSE;
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_ApplyFilterChainAsync(JNIEnv *env, jclass clazz,
+                                                           jobject bitmap, jintArray ops,
+                                                           jint radius, jint sigma,
+                                                           jboolean optimizeNeon,
+                                                           jobject callback) {
+    AndroidBitmapInfo info;
+    if (AndroidBitmap_getInfo(env, bitmap, &info) < 0 ||
+        info.format != ANDROID_BITMAP_FORMAT_RGBA_8888) {
+        LOG_ERROR("Invalid bitmap for the async chain");
+        return JNI_FALSE;
+    }
+    jsize count = env->GetArrayLength(ops);
+    std::vector<ip::FilterOp> chain(count);
+    env->GetIntArrayRegion(ops, 0, count, reinterpret_cast<jint *>(chain.data()));
+    jobject bitmapRef = env->NewGlobalRef(bitmap);
+    jobject callbackRef = env->NewGlobalRef(callback);
+    bool neon = optimizeNeon == JNI_TRUE;
+    // runs on the lane of the calling thread; the JVM thread returns at once
+    ip::ThreadPool::shared()->enqueue_task(
+            ip::ThreadPool::thread_priority(),
+            [chain = std::move(chain), info, bitmapRef, callbackRef, radius, sigma,
+                    neon]() mutable -> void {
+                // every path ends here, so the callback always fires and the refs are freed
+                auto complete = [bitmapRef, callbackRef](JNIEnv *workerEnv,
+                                                         bool processed) -> void {
+                    jclass callbackClass = workerEnv->GetObjectClass(callbackRef);
+                    jmethodID onComplete = workerEnv->GetMethodID(callbackClass, "onComplete",
+                                                                  "(Z)V");
+                    workerEnv->CallVoidMethod(callbackRef, onComplete,
+                                              processed ? JNI_TRUE : JNI_FALSE);
+                    if (workerEnv->ExceptionCheck()) {
+                        // the worker is shared, an exception of the callback must not stay
+                        // pending
+                        workerEnv->ExceptionDescribe();
+                        workerEnv->ExceptionClear();
+                    }
+                    workerEnv->DeleteLocalRef(callbackClass);
+                    workerEnv->DeleteGlobalRef(callbackRef);
+                    workerEnv->DeleteGlobalRef(bitmapRef);
+                };
+                JNIEnv *workerEnv = t_jvm.attach();
+                if (workerEnv == nullptr) {
+                    // report the failure from a thread of its own, which attaches and detaches
+                    // once. If that fails too the VM is going away and the refs with it.
+                    std::thread([complete]() -> void {
+                        JvmThread reporter;
+                        if (JNIEnv *reporterEnv = reporter.attach()) complete(reporterEnv, false);
+                    }).detach();
+                    return;
+                }
+                void *pixels = nullptr;
+                bool processed = false;
+                if (AndroidBitmap_lockPixels(workerEnv, bitmapRef, &pixels) < 0) {
+                    LOG_ERROR("Failed to lock the pixel information");
+                } else {
+                    processed = ip::ImageProcessor::apply_filter_chain(
+                            reinterpret_cast<uint8_t *>(pixels), info, chain.data(), chain.size(),
+                            radius, (float) sigma, neon);
+                    AndroidBitmap_unlockPixels(workerEnv, bitmapRef);
+                }
+                complete(workerEnv, processed);
+            });
+    return JNI_TRUE;
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_loadTuningProfile(JNIEnv *env, jclass clazz,
+                                                       jstring directory) {
+    const char *dir = env->GetStringUTFChars(directory, nullptr);
+    bool loaded = ip::AutoTuner::instance().load_profile(dir);
+    env->ReleaseStringUTFChars(directory, dir);
+    return loaded ? JNI_TRUE : JNI_FALSE;
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_calibrateKernels(JNIEnv *env, jclass clazz,
+                                                      jstring directory, jint iterations) {
+    ip::AutoTuner &tuner = ip::AutoTuner::instance();
+    tuner.reset();
+    tuner.calibrate(iterations);
+    const char *dir = env->GetStringUTFChars(directory, nullptr);
+    bool saved = tuner.save_profile(dir);
+    env->ReleaseStringUTFChars(directory, dir);
+    return saved ? JNI_TRUE : JNI_FALSE;
+}
+JNIEXPORT void JNICALL
+Java_com_os_imageprocessor_JniBridge_setAffinityPolicy(JNIEnv *env, jclass clazz, jint policy) {
+    ip::ThreadPool::set_affinity_policy(static_cast<ip::AffinityPolicy>(policy));
+}
+JNIEXPORT jint JNICALL
+Java_com_os_imageprocessor_JniBridge_setTaskPriority(JNIEnv *env, jclass clazz, jint priority) {
+    return static_cast<jint>(
+            ip::ThreadPool::set_thread_priority(static_cast<ip::TaskPriority>(priority)));
+}
+JNIEXPORT void JNICALL
+Java_com_os_imageprocessor_JniBridge_setLaneNice(JNIEnv *env, jclass clazz, jint priority,
+                                                 jint nice) {
+    ip::ThreadPool::set_lane_nice(static_cast<ip::TaskPriority>(priority), nice);
+}
+JNIEXPORT jfloatArray JNICALL
+Java_com_os_imageprocessor_JniBridge_getLaneStats(JNIEnv *env, jclass clazz, jboolean reset) {
+    std::shared_ptr<ip::ThreadPool> pool = ip::ThreadPool::shared();
+    // depth, peak depth, tasks, mean wait, max wait per lane, preview first
+    jfloat values[5 * ip::ThreadPool::LANE_COUNT];
+    for (int l = 0; l < ip::ThreadPool::LANE_COUNT; l++) {
+        ip::LaneStats stats = pool->lane_stats(static_cast<ip::TaskPriority>(l));
+        values[l * 5] = (jfloat) stats.depth;
+        values[l * 5 + 1] = (jfloat) stats.peakDepth;
+        values[l * 5 + 2] = (jfloat) stats.tasks;
+        values[l * 5 + 3] = (jfloat) stats.meanWaitUs;
+        values[l * 5 + 4] = (jfloat) stats.maxWaitUs;
+    }
+    if (reset == JNI_TRUE) pool->reset_lane_stats();
+    jsize size = sizeof(values) / sizeof(values[0]);
+    jfloatArray result = env->NewFloatArray(size);
+    env->SetFloatArrayRegion(result, 0, size, values);
+    return result;
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_setTracingEnabled(JNIEnv *env, jclass clazz,
+                                                       jboolean enabled) {
+#ifdef IP_ENABLE_TRACING
+    ip::Tracer::set_enabled(enabled == JNI_TRUE);
+    return JNI_TRUE;
+#else
+    return JNI_FALSE;
+#endif
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_dumpTrace(JNIEnv *env, jclass clazz, jstring path) {
+    const char *filePath = env->GetStringUTFChars(path, nullptr);
+    bool written = ip::Tracer::dump_chrome_json(filePath);
+    env->ReleaseStringUTFChars(path, filePath);
+    if (!written) LOG_ERROR("Failed to write the trace");
+    return written ? JNI_TRUE : JNI_FALSE;
+}
+JNIEXPORT jfloatArray JNICALL
+Java_com_os_imageprocessor_JniBridge_benchmarkDispatch(JNIEnv *env, jclass clazz, jint tasks) {
+    std::vector<ip::DispatchResult> results = ip::DispatchBenchmark::run((size_t) tasks);
+    // threads, mutex ns per task, lock free ns per task, mutex latency, lock free latency
+    std::vector<jfloat> values;
+    for (const ip::DispatchResult &r: results) {
+        values.push_back((jfloat) r.threads);
+        values.push_back((jfloat) r.lockedNsPerTask);
+        values.push_back((jfloat) r.lockFreeNsPerTask);
+        values.push_back((jfloat) r.lockedLatencyUs);
+        values.push_back((jfloat) r.lockFreeLatencyUs);
+    }
+    jsize size = static_cast<jsize>(values.size());
+    jfloatArray result = env->NewFloatArray(size);
+    env->SetFloatArrayRegion(result, 0, size, values.data());
+    return result;
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_pinCameraThread(JNIEnv *env, jclass clazz) {
+    int core = ip::CpuTopology::instance().reserved_core();
+    if (core < 0 || !ip::CpuTopology::pin_current_thread(core)) {
+        LOG_ERROR("Failed to pin the camera thread");
+        return JNI_FALSE;
+    }
+    return JNI_TRUE;
+}
+JNIEXPORT jlong JNICALL
+Java_com_os_imageprocessor_JniBridge_createQualityController(JNIEnv *env, jclass clazz,
+                                                             jfloat target_frame_ms) {
+    if (!(target_frame_ms > 0.0f)) {
+        LOG_ERROR("Invalid frame target %f ms", target_frame_ms);
+        return 0;
+    }
+    return reinterpret_cast<jlong>(new ip::QualityController(target_frame_ms));
+}
+JNIEXPORT void JNICALL
+Java_com_os_imageprocessor_JniBridge_releaseQualityController(JNIEnv *env, jclass clazz,
+                                                              jlong handle) {
+    if (handle == 0) return;
+    delete reinterpret_cast<ip::QualityController *>(handle);
+}
+JNIEXPORT void JNICALL
+Java_com_os_imageprocessor_JniBridge_setQualityTarget(JNIEnv *env, jclass clazz, jlong handle,
+                                                      jfloat target_frame_ms) {
+    if (handle == 0 || !(target_frame_ms > 0.0f)) {
+        LOG_ERROR("Invalid quality controller or frame target");
+        return;
+    }
+    reinterpret_cast<ip::QualityController *>(handle)->set_target(target_frame_ms);
+}
+JNIEXPORT void JNICALL
+Java_com_os_imageprocessor_JniBridge_recordQualityStage(JNIEnv *env, jclass clazz, jlong handle,
+                                                        jint stage, jfloat ms) {
+    if (handle == 0 || stage < 0 || stage >= static_cast<jint>(ip::FrameStage::COUNT)) {
+        LOG_ERROR("Invalid quality controller or stage %d", stage);
+        return;
+    }
+    reinterpret_cast<ip::QualityController *>(handle)->record_stage(
+            static_cast<ip::FrameStage>(stage), ms);
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_processWithQuality(JNIEnv *env, jclass clazz, jlong handle,
+                                                        jobject bitmap, jint op, jint radius,
+                                                        jint sigma, jboolean optimizeNeon) {
+    auto *controller = reinterpret_cast<ip::QualityController *>(handle);
+    if (controller == nullptr) {
+        LOG_ERROR("Invalid quality controller handle");
+        return JNI_FALSE;
+    }
+    auto filter = static_cast<ip::FilterOp>(op);
+    if (!(ip::ImageProcessorSIMD::device_support_neon() && optimizeNeon)) {
+        // the scalar filters have no planar form, only the radius and threads can adapt
+        ip::ThreadCapScope cap{controller->thread_cap()};
+        auto start = std::chrono::steady_clock::now();
+        bool processed = ip::ImageProcessor::ApplyFilterChain(env, bitmap, &filter, 1,
+                                                              controller->radius_for(radius),
+                                                              sigma, false);
+        controller->record_stage(ip::FrameStage::FILTER,
+                                 std::chrono::duration<float, std::milli>(
+                                         std::chrono::steady_clock::now() - start).count());
+        controller->end_frame();
+        return processed ? JNI_TRUE : JNI_FALSE;
+    }
+    AndroidBitmapInfo info;
+    void *pixels = nullptr;
+    if (AndroidBitmap_getInfo(env, bitmap, &info) < 0 ||
+        info.format != ANDROID_BITMAP_FORMAT_RGBA_8888) {
+        LOG_ERROR("Invalid bitmap for the quality controller");
+        return JNI_FALSE;
+    }
+    if (AndroidBitmap_lockPixels(env, bitmap, &pixels) < 0) {
+        LOG_ERROR("Failed to lock the pixels");
+        return JNI_FALSE;
+    }
+    bool processed = controller->process_rgba_neon(reinterpret_cast<uint8_t *>(pixels),
+                                                   info.width, info.height, info.stride, filter,
+                                                   radius, sigma);
+    AndroidBitmap_unlockPixels(env, bitmap);
+    return processed ? JNI_TRUE : JNI_FALSE;
+}
+JNIEXPORT jfloatArray JNICALL
+Java_com_os_imageprocessor_JniBridge_getQualityState(JNIEnv *env, jclass clazz, jlong handle) {
+    auto *controller = reinterpret_cast<ip::QualityController *>(handle);
+    if (controller == nullptr) {
+        LOG_ERROR("Invalid quality controller handle");
+        return nullptr;
+    }
+    ip::QualityLevel quality = controller->quality();
+    // level, scale, radius factor, thread cap, frame ema, then the ema of every stage
+    jfloat state[5 + static_cast<int>(ip::FrameStage::COUNT)];
+    state[0] = (jfloat) controller->level();
+    state[1] = quality.scale;
+    state[2] = quality.radiusFactor;
+    state[3] = (jfloat) controller->thread_cap();
+    state[4] = controller->frame_time_ema();
+    for (int s = 0; s < static_cast<int>(ip::FrameStage::COUNT); s++) {
+        state[5 + s] = controller->stage_time_ema(static_cast<ip::FrameStage>(s));
+    }
+    jsize size = sizeof(state) / sizeof(state[0]);
+    jfloatArray result = env->NewFloatArray(size);
+    env->SetFloatArrayRegion(result, 0, size, state);
+    return result;
+}
+// the output arrays are checked before anything is computed into them
+static bool outputs_fit(JNIEnv *env, jintArray histogram, jfloatArray stats, int channels) {
+    if (env->GetArrayLength(histogram) < channels * 256 ||
+        env->GetArrayLength(stats) < channels * 4) {
+        LOG_ERROR("The histogram or stats array is too small for %d channels", channels);
+        return false;
+    }
+    return true;
+}
+static void write_stats(JNIEnv *env, jfloatArray stats, const ip::ChannelStats *channels,
+                        int count) {
+    // min, max, mean, variance per channel
+    std::vector<jfloat> values;
+    for (int c = 0; c < count; c++) {
+        values.push_back(channels[c].min);
+        values.push_back(channels[c].max);
+        values.push_back((jfloat) channels[c].mean);
+        values.push_back((jfloat) channels[c].variance);
+    }
+    env->SetFloatArrayRegion(stats, 0, (jsize) values.size(), values.data());
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_computeHistogram(JNIEnv *env, jclass clazz, jobject bitmap,
+                                                      jintArray histogram, jfloatArray stats,
+                                                      jboolean optimizeNeon) {
+    if (!outputs_fit(env, histogram, stats, 4)) return JNI_FALSE;
+    ip::ImageHistogram result;
+    if (!ip::ImageProcessor::Histogram(env, bitmap, result, optimizeNeon)) return JNI_FALSE;
+    env->SetIntArrayRegion(histogram, 0, 4 * 256, reinterpret_cast<const jint *>(result.bins));
+    write_stats(env, stats, result.stats, 4);
+    return JNI_TRUE;
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_computePlaneHistogram(JNIEnv *env, jclass clazz,
+                                                           jbyteArray plane, jint width,
+                                                           jint height, jint stride,
+                                                           jintArray histogram,
+                                                           jfloatArray stats,
+                                                           jboolean optimizeNeon) {
+    if (!plane_array_fits(env, plane, width, height, stride) ||
+        !outputs_fit(env, histogram, stats, 1)) {
+        return JNI_FALSE;
+    }
+    jbyte *planePtr = env->GetByteArrayElements(plane, nullptr);
+    uint32_t bins[256];
+    if (ip::ImageProcessorSIMD::device_support_neon() && optimizeNeon) {
+        ip::ImageStats::histogram_plane_parallel(reinterpret_cast<uint8_t *>(planePtr), width,
+                                                 height, stride, bins);
+    } else {
+        ip::ImageStats::histogram_plane_scalar(reinterpret_cast<uint8_t *>(planePtr), width,
+                                               height, stride, bins);
+    }
+    env->ReleaseByteArrayElements(plane, planePtr, JNI_ABORT);
+    env->SetIntArrayRegion(histogram, 0, 256, reinterpret_cast<const jint *>(bins));
+    ip::ChannelStats channel = ip::ImageStats::stats_from_histogram(bins);
+    write_stats(env, stats, &channel, 1);
+    return JNI_TRUE;
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_AutoLevels(JNIEnv *env, jclass clazz, jobject bitmap,
+                                                jfloat clip_fraction, jboolean optimizeNeon) {
+    bool imageProcessed = ip::ImageProcessor::AutoLevels(env, bitmap, clip_fraction,
+                                                         optimizeNeon);
+    return imageProcessed ? JNI_TRUE : JNI_FALSE;
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_EqualizeHistogram(JNIEnv *env, jclass clazz, jobject bitmap,
+                                                       jboolean optimizeNeon) {
+    bool imageProcessed = ip::ImageProcessor::EqualizeHistogram(env, bitmap, optimizeNeon);
+    return imageProcessed ? JNI_TRUE : JNI_FALSE;
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_Clahe(JNIEnv *env, jclass clazz, jobject bitmap,
+                                           jint tiles_x, jint tiles_y, jfloat clip_limit,
+                                           jboolean optimizeNeon) {
+    bool imageProcessed = ip::ImageProcessor::Clahe(env, bitmap, tiles_x, tiles_y, clip_limit,
+                                                    optimizeNeon);
+    return imageProcessed ? JNI_TRUE : JNI_FALSE;
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_enhancePlane(JNIEnv *env, jclass clazz, jbyteArray plane,
+                                                  jint width, jint height, jint stride,
+                                                  jint mode, jfloat param,
+                                                  jboolean optimizeNeon) {
+    if (!plane_array_fits(env, plane, width, height, stride)) return JNI_FALSE;
+    jbyte *planePtr = env->GetByteArrayElements(plane, nullptr);
+    auto *data = reinterpret_cast<uint8_t *>(planePtr);
+    bool neon = ip::ImageProcessorSIMD::device_support_neon() && optimizeNeon;
+    if (mode == 2) {
+        ip::ImageStats::clahe_plane(data, width, height, stride, 8, 8, param);
+    } else {
+        uint32_t bins[256];
+        uint8_t lut[256];
+        if (neon) {
+            ip::ImageStats::histogram_plane_parallel(data, width, height, stride, bins);
+        } else {
+            ip::ImageStats::histogram_plane_scalar(data, width, height, stride, bins);
+        }
+        if (mode == 0) {
+            ip::ImageStats::auto_levels_lut(bins, param, lut);
+        } else {
+            ip::ImageStats::equalize_lut(bins, lut);
+        }
+        if (neon) {
+            ip::ImageStats::apply_lut_plane_neon(data, data, width, height, stride, lut);
+        } else {
+            ip::ImageStats::apply_lut_plane_scalar(data, data, width, height, stride, lut);
+        }
+    }
+    env->ReleaseByteArrayElements(plane, planePtr, 0);
+    return JNI_TRUE;
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_BoxBlur(JNIEnv *env, jclass clazz, jobject bitmap, jint radius,
+                                             jboolean optimizeNeon) {
+    bool imageProcessed = ip::ImageProcessor::BoxBlur(env, bitmap, radius, optimizeNeon);
+    return imageProcessed ? JNI_TRUE : JNI_FALSE;
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_AdaptiveThreshold(JNIEnv *env, jclass clazz, jobject bitmap,
+                                                       jint radius, jint offset,
+                                                       jboolean optimizeNeon) {
+    bool imageProcessed = ip::ImageProcessor::AdaptiveThreshold(env, bitmap, radius, offset,
+                                                                optimizeNeon);
+    return imageProcessed ? JNI_TRUE : JNI_FALSE;
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_LocalContrast(JNIEnv *env, jclass clazz, jobject bitmap,
+                                                   jint radius, jfloat strength,
+                                                   jboolean optimizeNeon) {
+    bool imageProcessed = ip::ImageProcessor::LocalContrast(env, bitmap, radius, strength,
+                                                            optimizeNeon);
+    return imageProcessed ? JNI_TRUE : JNI_FALSE;
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_Morphology(JNIEnv *env, jclass clazz, jobject bitmap, jint op,
+                                                jint radius_x, jint radius_y, jboolean luma_only,
+                                                jboolean optimizeNeon) {
+    if (op < 0 || op > static_cast<int>(ip::MorphOp::CLOSE)) {
+        LOG_ERROR("Unknown morphology operation %d", op);
+        return JNI_FALSE;
+    }
+    bool imageProcessed = ip::ImageProcessor::ApplyMorphology(env, bitmap,
+                                                              static_cast<ip::MorphOp>(op),
+                                                              radius_x, radius_y, luma_only,
+                                                              optimizeNeon);
+    return imageProcessed ? JNI_TRUE : JNI_FALSE;
+}
+JNIEXPORT jlong JNICALL
+Java_com_os_imageprocessor_JniBridge_createSession(JNIEnv *env, jclass clazz, jobject bitmap,
+                                                   jintArray ops, jint radius, jint sigma,
+                                                   jboolean optimizeNeon) {
+    AndroidBitmapInfo info;
+    if (AndroidBitmap_getInfo(env, bitmap, &info) < 0) {
+        LOG_ERROR("Failed to get the bitmap info");
+        return 0;
+    }
+    if (ops == nullptr || env->GetArrayLength(ops) == 0) {
+        LOG_ERROR("A session needs at least one filter");
+        return 0;
+    }
+    jsize count = env->GetArrayLength(ops);
+    std::vector<ip::FilterOp> chain(count);
+    env->GetIntArrayRegion(ops, 0, count, reinterpret_cast<jint *>(chain.data()));
+    return reinterpret_cast<jlong>(ip::NativeSession::create(info, chain.data(), chain.size(),
+                                                             radius, sigma, optimizeNeon));
+}
+JNIEXPORT void JNICALL
+Java_com_os_imageprocessor_JniBridge_releaseSession(JNIEnv *env, jclass clazz, jlong handle) {
+    delete reinterpret_cast<ip::NativeSession *>(handle);
+}
+JNIEXPORT jboolean JNICALL
+Java_com_os_imageprocessor_JniBridge_processSession(JNIEnv *env, jclass clazz, jlong handle,
+                                                    jobject bitmap) {
+    auto *session = reinterpret_cast<ip::NativeSession *>(handle);
+    if (session == nullptr) {
+        LOG_ERROR("Invalid session handle");
+        return JNI_FALSE;
+    }
+    // the chain and its scratch planes are sized for the template bitmap
+    AndroidBitmapInfo info;
+    if (AndroidBitmap_getInfo(env, bitmap, &info) < 0) {
+        LOG_ERROR("Failed to get the bitmap info");
+        return JNI_FALSE;
+    }
+    if (!session->matches(info)) {
+        LOG_ERROR("Bitmap %u x %u does not match the session", info.width, info.height);
+        return JNI_FALSE;
+    }
+    void *pixels = nullptr;
+    if (AndroidBitmap_lockPixels(env, bitmap, &pixels) < 0) {
+        LOG_ERROR("Failed to lock the pixels");
+        return JNI_FALSE;
+    }
+    session->process(reinterpret_cast<uint8_t *>(pixels));
+    AndroidBitmap_unlockPixels(env, bitmap);
+    return JNI_TRUE;
 }
 }
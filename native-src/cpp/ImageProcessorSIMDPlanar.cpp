@@ -0,0 +1,412 @@
+//
+// Planar variants of the NEON filters. Every plane is a plain byte stream, so the kernels use
+// vld1q / vst1q and a chain of filters only pays the RGBA (de)interleave once.
+//
+#include <cassert>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include "ImageProcessorSIMD.h"
+#include "LuminanceSIMD.h"
+#include "ThreadPool.h"
+#include "AutoTuner.h"
+#include "Utility.h"
+
+namespace ip {
+    template<typename F>
+    static void for_each_row_band(size_t yBegin, size_t yEnd, F &&fn) {
+        IP_TRACE_KERNEL("ImageProcessorSIMDPlanar::row_band", yEnd - yBegin, 0);
+        ThreadPool::for_each_rows(yBegin, yEnd, AutoTuner::default_threads(), 0,
+                                  std::forward<F>(fn));
+    }
+
+    static void copy_alpha_plane(const PlanarImage &src, PlanarImage &dst) {
+        memcpy(dst.plane(PlanarImage::PLANE_A), src.plane(PlanarImage::PLANE_A),
+               src.stride * src.height);
+    }
+
+    void ImageProcessorSIMD::deinterleave_rgba_neon(const uint8_t *src, size_t width,
+                                                    size_t height, size_t stride,
+                                                    PlanarImage &dst) {
+        dst.resize(width, height);
+        for_each_row_band(0, height, [&](size_t yStart, size_t yEnd) -> void {
+            for (size_t y = yStart; y < yEnd; y++) {
+                const uint8_t *srcRow = src + y * stride;
+                uint8_t *r = dst.row(PlanarImage::PLANE_R, y);
+                uint8_t *g = dst.row(PlanarImage::PLANE_G, y);
+                uint8_t *b = dst.row(PlanarImage::PLANE_B, y);
+                uint8_t *a = dst.row(PlanarImage::PLANE_A, y);
+                size_t x = 0;
+                for (; x + 16 <= width; x += 16) {
+                    uint8x16x4_t ch = vld4q_u8(srcRow + x * 4);
+                    vst1q_u8(r + x, ch.val[0]);
+                    vst1q_u8(g + x, ch.val[1]);
+                    vst1q_u8(b + x, ch.val[2]);
+                    vst1q_u8(a + x, ch.val[3]);
+                }
+                for (; x < width; x++) {
+                    r[x] = srcRow[x * 4];
+                    g[x] = srcRow[x * 4 + 1];
+                    b[x] = srcRow[x * 4 + 2];
+                    a[x] = srcRow[x * 4 + 3];
+                }
+            }
+        });
+    }
+
+    void ImageProcessorSIMD::interleave_rgba_neon(const PlanarImage &src, uint8_t *dst,
+                                                  size_t stride) {
+        size_t width = src.width;
+        for_each_row_band(0, src.height, [&](size_t yStart, size_t yEnd) -> void {
+            for (size_t y = yStart; y < yEnd; y++) {
+                uint8_t *dstRow = dst + y * stride;
+                const uint8_t *r = src.row(PlanarImage::PLANE_R, y);
+                const uint8_t *g = src.row(PlanarImage::PLANE_G, y);
+                const uint8_t *b = src.row(PlanarImage::PLANE_B, y);
+                const uint8_t *a = src.row(PlanarImage::PLANE_A, y);
+                size_t x = 0;
+                for (; x + 16 <= width; x += 16) {
+                    uint8x16x4_t out;
+                    out.val[0] = vld1q_u8(r + x);
+                    out.val[1] = vld1q_u8(g + x);
+                    out.val[2] = vld1q_u8(b + x);
+                    out.val[3] = vld1q_u8(a + x);
+                    vst4q_u8(dstRow + x * 4, out);
+                }
+                for (; x < width; x++) {
+                    dstRow[x * 4] = r[x];
+                    dstRow[x * 4 + 1] = g[x];
+                    dstRow[x * 4 + 2] = b[x];
+                    dstRow[x * 4 + 3] = a[x];
+                }
+            }
+        });
+    }
+
+    void ImageProcessorSIMD::gray_scale_planar_neon(const PlanarImage &src, PlanarImage &dst) {
+        dst.resize(src.width, src.height);
+        copy_alpha_plane(src, dst);
+        for_each_row_band(0, src.height, [&](size_t yStart, size_t yEnd) -> void {
+            for (size_t y = yStart; y < yEnd; y++) {
+                // rows are padded to whole vectors, so no scalar tail is needed
+                LuminanceSIMD::planes_to_luma_row_neon(src.row(PlanarImage::PLANE_R, y),
+                                                       src.row(PlanarImage::PLANE_G, y),
+                                                       src.row(PlanarImage::PLANE_B, y),
+                                                       dst.row(PlanarImage::PLANE_R, y),
+                                                       src.stride);
+                memcpy(dst.row(PlanarImage::PLANE_G, y), dst.row(PlanarImage::PLANE_R, y),
+                       src.stride);
+                memcpy(dst.row(PlanarImage::PLANE_B, y), dst.row(PlanarImage::PLANE_R, y),
+                       src.stride);
+            }
+        });
+    }
+
+    void ImageProcessorSIMD::negative_planar_neon(const PlanarImage &src, PlanarImage &dst) {
+        dst.resize(src.width, src.height);
+        copy_alpha_plane(src, dst);
+        for_each_row_band(0, src.height, [&](size_t yStart, size_t yEnd) -> void {
+            for (int c = PlanarImage::PLANE_R; c <= PlanarImage::PLANE_B; c++) {
+                for (size_t y = yStart; y < yEnd; y++) {
+                    const uint8_t *in = src.row(c, y);
+                    uint8_t *out = dst.row(c, y);
+                    for (size_t x = 0; x < src.stride; x += 16) {
+                        vst1q_u8(out + x, vmvnq_u8(vld1q_u8(in + x)));
+                    }
+                }
+            }
+        });
+    }
+
+    // 3x3 sharpen of a single pixel with clamped neighbours, used for the left / right column
+    static uint8_t sharpen_pixel_clamped(const uint8_t *top, const uint8_t *mid,
+                                         const uint8_t *bottom, size_t x, size_t width) {
+        size_t xl = x == 0 ? 0 : x - 1;
+        size_t xr = x + 1 >= width ? width - 1 : x + 1;
+        int box = top[xl] + top[x] + top[xr] + mid[xl] + mid[x] + mid[xr] +
+                  bottom[xl] + bottom[x] + bottom[xr];
+        int v = 10 * mid[x] - box;
+        return (uint8_t) std::min(255, std::max(0, v));
+    }
+
+    void ImageProcessorSIMD::sharp_planar_neon(const PlanarImage &src, PlanarImage &dst) {
+        dst.resize(src.width, src.height);
+        copy_alpha_plane(src, dst);
+        size_t width = src.width;
+        size_t height = src.height;
+        for_each_row_band(0, height, [&](size_t yStart, size_t yEnd) -> void {
+            for (int c = PlanarImage::PLANE_R; c <= PlanarImage::PLANE_B; c++) {
+                for (size_t y = yStart; y < yEnd; y++) {
+                    const uint8_t *top = src.row(c, y == 0 ? 0 : y - 1);
+                    const uint8_t *mid = src.row(c, y);
+                    const uint8_t *bottom = src.row(c, y + 1 >= height ? height - 1 : y + 1);
+                    uint8_t *out = dst.row(c, y);
+
+                    // 9 c - (sum of the 8 neighbours) == 10 c - (sum of the 3x3 box)
+                    size_t x = 1;
+                    for (; x + 16 <= width - 1; x += 16) {
+                        uint16x8_t box_l = vdupq_n_u16(0);
+                        uint16x8_t box_h = vdupq_n_u16(0);
+                        for (const uint8_t *row: {top, mid, bottom}) {
+                            for (int kx = -1; kx <= 1; kx++) {
+                                uint8x16_t p = vld1q_u8(row + x + kx);
+                                box_l = vaddw_u8(box_l, vget_low_u8(p));
+                                box_h = vaddw_u8(box_h, vget_high_u8(p));
+                            }
+                        }
+                        uint8x16_t center = vld1q_u8(mid + x);
+                        int16x8_t c_l = vreinterpretq_s16_u16(
+                                vmull_u8(vget_low_u8(center), vdup_n_u8(10)));
+                        int16x8_t c_h = vreinterpretq_s16_u16(
+                                vmull_u8(vget_high_u8(center), vdup_n_u8(10)));
+                        int16x8_t v_l = vsubq_s16(c_l, vreinterpretq_s16_u16(box_l));
+                        int16x8_t v_h = vsubq_s16(c_h, vreinterpretq_s16_u16(box_h));
+                        vst1q_u8(out + x, vcombine_u8(vqmovun_s16(v_l), vqmovun_s16(v_h)));
+                    }
+                    out[0] = sharpen_pixel_clamped(top, mid, bottom, 0, width);
+                    for (; x < width; x++) {
+                        out[x] = sharpen_pixel_clamped(top, mid, bottom, x, width);
+                    }
+                }
+            }
+        });
+    }
+
+    void ImageProcessorSIMD::blur_planar_neon(const PlanarImage &src, PlanarImage &dst,
+                                              int radius, float sigma) {
+        PlanarImage horizontal;
+        std::vector<uint16_t> kernel;
+        if (radius >= 1) kernel = Utility::generate_gaussian_kernel_q8(radius, sigma);
+        blur_planar_neon(src, dst, kernel, horizontal);
+    }
+
+    void ImageProcessorSIMD::blur_planar_neon(const PlanarImage &src, PlanarImage &dst,
+                                              const std::vector<uint16_t> &kernel,
+                                              PlanarImage &horizontal) {
+        dst.resize(src.width, src.height);
+        int radius = (int) kernel.size() / 2;
+        // a tiny sigma puts all 256 on the centre tap, which is a copy and would also wrap to
+        // 0 in the u8 multiply below
+        if (radius < 1 || kernel[radius] > 255) {
+            dst.storage = src.storage;
+            return;
+        }
+        assert(std::all_of(kernel.begin(), kernel.end(),
+                           [](uint16_t tap) -> bool { return tap <= 255; }) &&
+               "blur_planar_neon needs every tap below 256");
+        copy_alpha_plane(src, dst);
+        size_t width = src.width;
+        size_t height = src.height;
+        horizontal.resize(width, height);
+
+        // horizontal pass, the taps are < 256 so they fit the u8 multiply-accumulate
+        for_each_row_band(0, height, [&](size_t yStart, size_t yEnd) -> void {
+            for (int c = PlanarImage::PLANE_R; c <= PlanarImage::PLANE_B; c++) {
+                for (size_t y = yStart; y < yEnd; y++) {
+                    const uint8_t *in = src.row(c, y);
+                    uint8_t *out = horizontal.row(c, y);
+                    size_t x = 0;
+                    for (; x < width && x < (size_t) radius; x++) {
+                        uint32_t acc = 128;
+                        for (int k = -radius; k <= radius; k++) {
+                            long xi = std::min(std::max((long) x + k, 0L), (long) width - 1);
+                            acc += in[xi] * kernel[k + radius];
+                        }
+                        out[x] = (uint8_t) (acc >> 8);
+                    }
+                    for (; x + 16 + radius <= width; x += 16) {
+                        uint16x8_t acc_l = vdupq_n_u16(0);
+                        uint16x8_t acc_h = vdupq_n_u16(0);
+                        for (int k = -radius; k <= radius; k++) {
+                            uint8x16_t p = vld1q_u8(in + x + k);
+                            uint8x8_t w = vdup_n_u8((uint8_t) kernel[k + radius]);
+                            acc_l = vmlal_u8(acc_l, vget_low_u8(p), w);
+                            acc_h = vmlal_u8(acc_h, vget_high_u8(p), w);
+                        }
+                        vst1q_u8(out + x, vcombine_u8(vrshrn_n_u16(acc_l, 8),
+                                                      vrshrn_n_u16(acc_h, 8)));
+                    }
+                    for (; x < width; x++) {
+                        uint32_t acc = 128;
+                        for (int k = -radius; k <= radius; k++) {
+                            long xi = std::min(std::max((long) x + k, 0L), (long) width - 1);
+                            acc += in[xi] * kernel[k + radius];
+                        }
+                        out[x] = (uint8_t) (acc >> 8);
+                    }
+                }
+            }
+        });
+
+        // vertical pass, every row is a full stream of vectors thanks to the padded stride
+        for_each_row_band(0, height, [&](size_t yStart, size_t yEnd) -> void {
+            for (int c = PlanarImage::PLANE_R; c <= PlanarImage::PLANE_B; c++) {
+                for (size_t y = yStart; y < yEnd; y++) {
+                    uint8_t *out = dst.row(c, y);
+                    for (size_t x = 0; x < src.stride; x += 16) {
+                        uint16x8_t acc_l = vdupq_n_u16(0);
+                        uint16x8_t acc_h = vdupq_n_u16(0);
+                        for (int k = -radius; k <= radius; k++) {
+                            long yi = std::min(std::max((long) y + k, 0L), (long) height - 1);
+                            uint8x16_t p = vld1q_u8(horizontal.row(c, yi) + x);
+                            uint8x8_t w = vdup_n_u8((uint8_t) kernel[k + radius]);
+                            acc_l = vmlal_u8(acc_l, vget_low_u8(p), w);
+                            acc_h = vmlal_u8(acc_h, vget_high_u8(p), w);
+                        }
+                        vst1q_u8(out + x, vcombine_u8(vrshrn_n_u16(acc_l, 8),
+                                                      vrshrn_n_u16(acc_h, 8)));
+                    }
+                }
+            }
+        });
+    }
+
+    // Runs a 3x3 luminance stencil over the planes, the luma of each row is computed once per
+    // task and the result is written to R, G and B.
+    template<typename RowOp>
+    static void run_planar_luma_stencil_3x3(const PlanarImage &src, PlanarImage &dst,
+                                            uint8_t borderLuma, RowOp &&rowOp) {
+        dst.resize(src.width, src.height);
+        copy_alpha_plane(src, dst);
+        size_t width = src.width;
+        size_t height = src.height;
+        for (int c = PlanarImage::PLANE_R; c <= PlanarImage::PLANE_B; c++) {
+            memset(dst.row(c, 0), borderLuma, dst.stride);
+            memset(dst.row(c, height - 1), borderLuma, dst.stride);
+        }
+        for_each_row_band(1, height - 1, [&](size_t yStart, size_t yEnd) -> void {
+            std::vector<uint8_t> lumaRows(src.stride * 3);
+            std::vector<int16_t> scratch(width * 2);
+            uint8_t *rows[3] = {lumaRows.data(), lumaRows.data() + src.stride,
+                                lumaRows.data() + 2 * src.stride};
+            auto luma_of = [&](size_t y, uint8_t *out) -> void {
+                LuminanceSIMD::planes_to_luma_row_neon(src.row(PlanarImage::PLANE_R, y),
+                                                       src.row(PlanarImage::PLANE_G, y),
+                                                       src.row(PlanarImage::PLANE_B, y),
+                                                       out, src.stride);
+            };
+            luma_of(yStart - 1, rows[0]);
+            luma_of(yStart, rows[1]);
+            for (size_t y = yStart; y < yEnd; y++) {
+                luma_of(y + 1, rows[2]);
+                uint8_t *out = dst.row(PlanarImage::PLANE_R, y);
+                rowOp(rows[0], rows[1], rows[2], out, scratch.data(), y);
+                out[0] = out[width - 1] = borderLuma;
+                memcpy(dst.row(PlanarImage::PLANE_G, y), out, width);
+                memcpy(dst.row(PlanarImage::PLANE_B, y), out, width);
+
+                uint8_t *recycled = rows[0];
+                rows[0] = rows[1];
+                rows[1] = rows[2];
+                rows[2] = recycled;
+            }
+        });
+    }
+
+    void ImageProcessorSIMD::edge_detection_planar_neon(const PlanarImage &src, PlanarImage &dst,
+                                                        GradientMagnitude mode) {
+        if (src.width < 3 || src.height < 3) {
+            dst = src;
+            return;
+        }
+        size_t width = src.width;
+        run_planar_luma_stencil_3x3(src, dst, 0,
+                                    [&](const uint8_t *top, const uint8_t *mid,
+                                        const uint8_t *bottom, uint8_t *out, int16_t *scratch,
+                                        size_t) -> void {
+                                        int16_t *vs = scratch;
+                                        int16_t *vd = scratch + width;
+                                        LuminanceSIMD::sobel_vertical_row_neon(top, mid, bottom,
+                                                                               vs, vd, width);
+                                        LuminanceSIMD::sobel_row_neon(vs, vd, out, nullptr,
+                                                                      width, mode);
+                                    });
+    }
+
+    void ImageProcessorSIMD::emboss_planar_neon(const PlanarImage &src, PlanarImage &dst) {
+        if (src.width < 3 || src.height < 3) {
+            dst = src;
+            return;
+        }
+        size_t width = src.width;
+        run_planar_luma_stencil_3x3(src, dst, 128,
+                                    [&](const uint8_t *top, const uint8_t *mid,
+                                        const uint8_t *bottom, uint8_t *out, int16_t *,
+                                        size_t) -> void {
+                                        LuminanceSIMD::emboss_row_neon(top, mid, bottom, out,
+                                                                       width);
+                                    });
+    }
+
+    void ImageProcessorSIMD::downsample_2x_planar_neon(const PlanarImage &src, PlanarImage &dst) {
+        dst.resize((src.width + 1) / 2, (src.height + 1) / 2);
+        for_each_row_band(0, dst.height, [&](size_t yStart, size_t yEnd) -> void {
+            for (int c = PlanarImage::PLANE_R; c <= PlanarImage::PLANE_A; c++) {
+                for (size_t y = yStart; y < yEnd; y++) {
+                    const uint8_t *r0 = src.row(c, 2 * y);
+                    const uint8_t *r1 = src.row(c, std::min(2 * y + 1, src.height - 1));
+                    uint8_t *out = dst.row(c, y);
+                    // 2 * dst.stride never exceeds src.stride, the reads stay in the row
+                    for (size_t x = 0; x < dst.width; x += 8) {
+                        uint16x8_t sum = vpaddlq_u8(vld1q_u8(r0 + 2 * x));
+                        sum = vpadalq_u8(sum, vld1q_u8(r1 + 2 * x));
+                        vst1_u8(out + x, vrshrn_n_u16(sum, 2));
+                    }
+                    if (src.width & 1) {
+                        size_t last = src.width - 1;
+                        out[dst.width - 1] = (uint8_t) ((r0[last] + r1[last] + 1) >> 1);
+                    }
+                }
+            }
+        });
+    }
+
+    // out[2x] = s[x], out[2x + 1] = mean(s[x], s[x + 1]), out holds at least 2 * width bytes
+    static void upsample_row_2x_neon(const uint8_t *s, uint8_t *out, size_t width,
+                                     size_t stride) {
+        size_t x = 0;
+        for (; x + 17 <= stride && x + 16 <= width; x += 16) {
+            uint8x16x2_t pair;
+            pair.val[0] = vld1q_u8(s + x);
+            pair.val[1] = vrhaddq_u8(pair.val[0], vld1q_u8(s + x + 1));
+            vst2q_u8(out + 2 * x, pair);
+        }
+        for (; x < width; x++) {
+            uint8_t next = x + 1 < width ? s[x + 1] : s[x];
+            out[2 * x] = s[x];
+            out[2 * x + 1] = (uint8_t) ((s[x] + next + 1) >> 1);
+        }
+        // the vector loop blended the last pixel with the row padding
+        out[2 * width - 1] = s[width - 1];
+    }
+
+    void ImageProcessorSIMD::upsample_2x_planar_neon(const PlanarImage &src, PlanarImage &dst,
+                                                     size_t width, size_t height) {
+        dst.resize(width, height);
+        for_each_row_band(0, height, [&](size_t yStart, size_t yEnd) -> void {
+            std::vector<uint8_t> upper(2 * src.stride + 32);
+            std::vector<uint8_t> lower(2 * src.stride + 32);
+            for (int c = PlanarImage::PLANE_R; c <= PlanarImage::PLANE_A; c++) {
+                for (size_t y = yStart; y < yEnd; y++) {
+                    size_t sy = y / 2;
+                    uint8_t *out = dst.row(c, y);
+                    upsample_row_2x_neon(src.row(c, sy), upper.data(), src.width, src.stride);
+                    if ((y & 1) == 0 || sy + 1 >= src.height) {
+                        memcpy(out, upper.data(), width);
+                        continue;
+                    }
+                    upsample_row_2x_neon(src.row(c, sy + 1), lower.data(), src.width,
+                                         src.stride);
+                    size_t x = 0;
+                    for (; x + 16 <= width; x += 16) {
+                        vst1q_u8(out + x, vrhaddq_u8(vld1q_u8(upper.data() + x),
+                                                     vld1q_u8(lower.data() + x)));
+                    }
+                    for (; x < width; x++) {
+                        out[x] = (uint8_t) ((upper[x] + lower[x] + 1) >> 1);
+                    }
+                }
+            }
+        });
+    }
+}
@@ -0,0 +1,429 @@
+//
+// Histograms, statistics and the tone filters built on them (auto levels, equalisation, CLAHE).
+//
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include "ImageStats.h"
+#include "LuminanceSIMD.h"
+#include "ThreadPool.h"
+#include "AutoTuner.h"
+
+namespace ip {
+    // consecutive pixels count into different copies, so runs of equal values do not stall on
+    // the store to load dependency of the same bin
+    static constexpr int SUB_HISTOGRAMS = 4;
+
+    void ImageStats::histogram_rgba_neon(const uint8_t *src, size_t width, size_t height,
+                                         size_t stride, ImageHistogram &out) {
+        IP_TRACE_KERNEL("ImageStats::histogram_rgba", height, height * stride);
+        out = ImageHistogram{};
+        std::mutex mergeMutex;
+        ThreadPool::for_each_rows(0, height, AutoTuner::default_threads(), 0,
+                                  [&](size_t yStart, size_t yEnd) -> void {
+            std::vector<uint32_t> local(SUB_HISTOGRAMS * 4 * 256, 0);
+            std::vector<uint8_t> luma(width);
+            for (size_t y = yStart; y < yEnd; y++) {
+                const uint8_t *row = src + y * stride;
+                LuminanceSIMD::rgba_to_luma_row_neon(row, luma.data(), width);
+                for (size_t x = 0; x < width; x++) {
+                    uint32_t *sub = local.data() + (x & (SUB_HISTOGRAMS - 1)) * 4 * 256;
+                    sub[row[x * 4]]++;
+                    sub[256 + row[x * 4 + 1]]++;
+                    sub[512 + row[x * 4 + 2]]++;
+                    sub[768 + luma[x]]++;
+                }
+            }
+            std::lock_guard<std::mutex> lock{mergeMutex};
+            for (int s = 0; s < SUB_HISTOGRAMS; s++) {
+                const uint32_t *sub = local.data() + s * 4 * 256;
+                for (int c = 0; c < 4; c++) {
+                    for (int v = 0; v < 256; v++) out.bins[c][v] += sub[c * 256 + v];
+                }
+            }
+        });
+        out.pixels = (uint64_t) width * height;
+        for (int c = 0; c < 4; c++) out.stats[c] = stats_from_histogram(out.bins[c]);
+    }
+
+    void ImageStats::histogram_rgba_scalar(const uint8_t *src, size_t width, size_t height,
+                                           size_t stride, ImageHistogram &out) {
+        out = ImageHistogram{};
+        std::vector<uint8_t> luma(width);
+        for (size_t y = 0; y < height; y++) {
+            const uint8_t *row = src + y * stride;
+            LuminanceSIMD::rgba_to_luma_row_scalar(row, luma.data(), width);
+            for (size_t x = 0; x < width; x++) {
+                out.bins[ImageHistogram::CH_R][row[x * 4]]++;
+                out.bins[ImageHistogram::CH_G][row[x * 4 + 1]]++;
+                out.bins[ImageHistogram::CH_B][row[x * 4 + 2]]++;
+                out.bins[ImageHistogram::CH_LUMA][luma[x]]++;
+            }
+        }
+        out.pixels = (uint64_t) width * height;
+        for (int c = 0; c < 4; c++) out.stats[c] = stats_from_histogram(out.bins[c]);
+    }
+
+    void ImageStats::histogram_plane_parallel(const uint8_t *plane, size_t width, size_t height,
+                                              size_t stride, uint32_t bins[256]) {
+        IP_TRACE_KERNEL("ImageStats::histogram_plane", height, height * stride);
+        memset(bins, 0, 256 * sizeof(uint32_t));
+        std::mutex mergeMutex;
+        ThreadPool::for_each_rows(0, height, AutoTuner::default_threads(), 0,
+                                  [&](size_t yStart, size_t yEnd) -> void {
+            uint32_t local[SUB_HISTOGRAMS][256] = {};
+            for (size_t y = yStart; y < yEnd; y++) {
+                const uint8_t *row = plane + y * stride;
+                size_t x = 0;
+                for (; x + SUB_HISTOGRAMS <= width; x += SUB_HISTOGRAMS) {
+                    local[0][row[x]]++;
+                    local[1][row[x + 1]]++;
+                    local[2][row[x + 2]]++;
+                    local[3][row[x + 3]]++;
+                }
+                for (; x < width; x++) local[0][row[x]]++;
+            }
+            std::lock_guard<std::mutex> lock{mergeMutex};
+            for (int v = 0; v < 256; v++) {
+                bins[v] += local[0][v] + local[1][v] + local[2][v] + local[3][v];
+            }
+        });
+    }
+
+    void ImageStats::histogram_plane_scalar(const uint8_t *plane, size_t width, size_t height,
+                                            size_t stride, uint32_t bins[256]) {
+        memset(bins, 0, 256 * sizeof(uint32_t));
+        for (size_t y = 0; y < height; y++) {
+            for (size_t x = 0; x < width; x++) bins[plane[y * stride + x]]++;
+        }
+    }
+
+    ChannelStats ImageStats::stats_from_histogram(const uint32_t bins[256]) {
+        ChannelStats stats;
+        uint64_t count = 0;
+        double sum = 0.0;
+        double sumSquares = 0.0;
+        int first = -1;
+        int last = -1;
+        for (int v = 0; v < 256; v++) {
+            if (bins[v] == 0) continue;
+            if (first < 0) first = v;
+            last = v;
+            count += bins[v];
+            sum += (double) v * bins[v];
+            sumSquares += (double) v * v * bins[v];
+        }
+        if (count == 0) return stats;
+        stats.min = (uint8_t) first;
+        stats.max = (uint8_t) last;
+        stats.mean = sum / (double) count;
+        stats.variance = sumSquares / (double) count - stats.mean * stats.mean;
+        return stats;
+    }
+
+    void ImageStats::auto_levels_lut(const uint32_t bins[256], float clipFraction,
+                                     uint8_t lut[256]) {
+        uint64_t total = 0;
+        for (int v = 0; v < 256; v++) total += bins[v];
+        auto clip = (uint64_t) ((double) total * std::max(0.0f, clipFraction));
+
+        int low = 0;
+        uint64_t cumulative = 0;
+        for (; low < 255; low++) {
+            cumulative += bins[low];
+            if (cumulative > clip) break;
+        }
+        int high = 255;
+        cumulative = 0;
+        for (; high > 0; high--) {
+            cumulative += bins[high];
+            if (cumulative > clip) break;
+        }
+        if (high <= low) {
+            for (int v = 0; v < 256; v++) lut[v] = (uint8_t) v;
+            return;
+        }
+        for (int v = 0; v < 256; v++) {
+            int mapped = ((v - low) * 255 + (high - low) / 2) / (high - low);
+            lut[v] = (uint8_t) std::min(255, std::max(0, mapped));
+        }
+    }
+
+    void ImageStats::equalize_lut(const uint32_t bins[256], uint8_t lut[256]) {
+        uint64_t cdf[256];
+        uint64_t cumulative = 0;
+        for (int v = 0; v < 256; v++) {
+            cumulative += bins[v];
+            cdf[v] = cumulative;
+        }
+        uint64_t cdfMin = 0;
+        for (int v = 0; v < 256; v++) {
+            if (cdf[v] != 0) {
+                cdfMin = cdf[v];
+                break;
+            }
+        }
+        uint64_t range = cumulative - cdfMin;
+        for (int v = 0; v < 256; v++) {
+            if (range == 0) {
+                lut[v] = (uint8_t) v;
+            } else {
+                uint64_t above = cdf[v] > cdfMin ? cdf[v] - cdfMin : 0;
+                lut[v] = (uint8_t) ((above * 255 + range / 2) / range);
+            }
+        }
+    }
+
+    uint8x16_t ImageStats::lookup_neon(const uint8x16x4_t table[4], uint8x16_t index) {
+        // vqtbl4q covers 64 entries, out of range lanes give 0 and vqtbx4q leaves them alone
+        uint8x16_t result = vqtbl4q_u8(table[0], index);
+        result = vqtbx4q_u8(result, table[1], vsubq_u8(index, vdupq_n_u8(64)));
+        result = vqtbx4q_u8(result, table[2], vsubq_u8(index, vdupq_n_u8(128)));
+        result = vqtbx4q_u8(result, table[3], vsubq_u8(index, vdupq_n_u8(192)));
+        return result;
+    }
+
+    void ImageStats::apply_lut_rgba_neon(const uint8_t *src, uint8_t *dst, size_t width,
+                                         size_t height, size_t stride, const uint8_t lutR[256],
+                                         const uint8_t lutG[256], const uint8_t lutB[256]) {
+        IP_TRACE_KERNEL("ImageStats::apply_lut_rgba", height, 2 * height * stride);
+        uint8x16x4_t tableR[4];
+        uint8x16x4_t tableG[4];
+        uint8x16x4_t tableB[4];
+        for (int i = 0; i < 4; i++) {
+            tableR[i] = vld1q_u8_x4(lutR + i * 64);
+            tableG[i] = vld1q_u8_x4(lutG + i * 64);
+            tableB[i] = vld1q_u8_x4(lutB + i * 64);
+        }
+        ThreadPool::for_each_rows(0, height, AutoTuner::default_threads(), 0,
+                                  [&](size_t yStart, size_t yEnd) -> void {
+            for (size_t y = yStart; y < yEnd; y++) {
+                const uint8_t *in = src + y * stride;
+                uint8_t *out = dst + y * stride;
+                size_t x = 0;
+                for (; x + 16 <= width; x += 16) {
+                    uint8x16x4_t ch = vld4q_u8(in + x * 4);
+                    ch.val[0] = lookup_neon(tableR, ch.val[0]);
+                    ch.val[1] = lookup_neon(tableG, ch.val[1]);
+                    ch.val[2] = lookup_neon(tableB, ch.val[2]);
+                    vst4q_u8(out + x * 4, ch);
+                }
+                for (; x < width; x++) {
+                    out[x * 4] = lutR[in[x * 4]];
+                    out[x * 4 + 1] = lutG[in[x * 4 + 1]];
+                    out[x * 4 + 2] = lutB[in[x * 4 + 2]];
+                    out[x * 4 + 3] = in[x * 4 + 3];
+                }
+            }
+        });
+    }
+
+    void ImageStats::apply_lut_rgba_scalar(const uint8_t *src, uint8_t *dst, size_t width,
+                                           size_t height, size_t stride, const uint8_t lutR[256],
+                                           const uint8_t lutG[256], const uint8_t lutB[256]) {
+        for (size_t y = 0; y < height; y++) {
+            const uint8_t *in = src + y * stride;
+            uint8_t *out = dst + y * stride;
+            for (size_t x = 0; x < width; x++) {
+                out[x * 4] = lutR[in[x * 4]];
+                out[x * 4 + 1] = lutG[in[x * 4 + 1]];
+                out[x * 4 + 2] = lutB[in[x * 4 + 2]];
+                out[x * 4 + 3] = in[x * 4 + 3];
+            }
+        }
+    }
+
+    void ImageStats::apply_lut_plane_neon(const uint8_t *src, uint8_t *dst, size_t width,
+                                          size_t height, size_t stride, const uint8_t lut[256]) {
+        IP_TRACE_KERNEL("ImageStats::apply_lut_plane", height, 2 * height * stride);
+        uint8x16x4_t table[4];
+        for (int i = 0; i < 4; i++) table[i] = vld1q_u8_x4(lut + i * 64);
+        ThreadPool::for_each_rows(0, height, AutoTuner::default_threads(), 0,
+                                  [&](size_t yStart, size_t yEnd) -> void {
+            for (size_t y = yStart; y < yEnd; y++) {
+                const uint8_t *in = src + y * stride;
+                uint8_t *out = dst + y * stride;
+                size_t x = 0;
+                for (; x + 16 <= width; x += 16) {
+                    vst1q_u8(out + x, lookup_neon(table, vld1q_u8(in + x)));
+                }
+                for (; x < width; x++) out[x] = lut[in[x]];
+            }
+        });
+    }
+
+    void ImageStats::apply_lut_plane_scalar(const uint8_t *src, uint8_t *dst, size_t width,
+                                            size_t height, size_t stride,
+                                            const uint8_t lut[256]) {
+        for (size_t y = 0; y < height; y++) {
+            for (size_t x = 0; x < width; x++) dst[y * stride + x] = lut[src[y * stride + x]];
+        }
+    }
+
+    // Position of a pixel between the centres of its two nearest tiles, weight in Q8.
+    struct TileBlend {
+        uint16_t first;
+        uint16_t second;
+        uint16_t weight;
+    };
+
+    static std::vector<TileBlend> tile_blend_table(size_t length, size_t tileSize, int tiles) {
+        std::vector<TileBlend> table(length);
+        for (size_t i = 0; i < length; i++) {
+            float f = ((float) i + 0.5f) / (float) tileSize - 0.5f;
+            int first = (int) std::floor(f);
+            float weight = f - (float) first;
+            if (first < 0) {
+                first = 0;
+                weight = 0.0f;
+            }
+            if (first >= tiles - 1) {
+                first = tiles - 1;
+                weight = 0.0f;
+            }
+            table[i].first = (uint16_t) first;
+            table[i].second = (uint16_t) std::min(first + 1, tiles - 1);
+            table[i].weight = (uint16_t) std::lround(weight * 256.0f);
+        }
+        return table;
+    }
+
+    void ImageStats::clahe_plane(uint8_t *plane, size_t width, size_t height, size_t stride,
+                                 int tilesX, int tilesY, float clipLimit) {
+        IP_TRACE_KERNEL("ImageStats::clahe_plane", height, 2 * height * stride);
+        if (width == 0 || height == 0) return;
+        tilesX = std::max(1, std::min(tilesX, (int) width));
+        tilesY = std::max(1, std::min(tilesY, (int) height));
+        size_t tileW = (width + tilesX - 1) / tilesX;
+        size_t tileH = (height + tilesY - 1) / tilesY;
+        std::vector<uint8_t> luts((size_t) tilesX * tilesY * 256);
+
+        ThreadPool::for_each_rows(0, (size_t) tilesY, AutoTuner::default_threads(), 0,
+                                  [&](size_t tyStart, size_t tyEnd) -> void {
+            for (size_t ty = tyStart; ty < tyEnd; ty++) {
+                for (int tx = 0; tx < tilesX; tx++) {
+                    size_t x0 = tx * tileW;
+                    size_t y0 = ty * tileH;
+                    size_t x1 = std::min(x0 + tileW, width);
+                    size_t y1 = std::min(y0 + tileH, height);
+                    uint8_t *lut = luts.data() + (ty * tilesX + tx) * 256;
+                    if (x0 >= x1 || y0 >= y1) {
+                        for (int v = 0; v < 256; v++) lut[v] = (uint8_t) v;
+                        continue;
+                    }
+                    uint32_t bins[256];
+                    histogram_plane_scalar(plane + y0 * stride + x0, x1 - x0, y1 - y0, stride,
+                                           bins);
+                    uint32_t tilePixels = (uint32_t) ((x1 - x0) * (y1 - y0));
+                    // clip the peaks and spread what was cut off evenly over all bins
+                    auto limit = (uint32_t) std::max(1.0f, clipLimit * tilePixels / 256.0f);
+                    uint32_t excess = 0;
+                    for (uint32_t &bin: bins) {
+                        if (bin > limit) {
+                            excess += bin - limit;
+                            bin = limit;
+                        }
+                    }
+                    uint32_t spread = excess / 256;
+                    uint32_t remainder = excess % 256;
+                    for (int v = 0; v < 256; v++) {
+                        bins[v] += spread + ((uint32_t) v < remainder ? 1 : 0);
+                    }
+                    // 64 bit, cumulative * 255 overflows 32 bits once a tile passes ~16M pixels
+                    uint64_t cumulative = 0;
+                    for (int v = 0; v < 256; v++) {
+                        cumulative += bins[v];
+                        lut[v] = (uint8_t) std::min<uint64_t>(
+                                255, (cumulative * 255 + tilePixels / 2) / tilePixels);
+                    }
+                }
+            }
+        });
+
+        std::vector<TileBlend> columns = tile_blend_table(width, tileW, tilesX);
+        std::vector<TileBlend> rows = tile_blend_table(height, tileH, tilesY);
+        ThreadPool::for_each_rows(0, height, AutoTuner::default_threads(), 0,
+                                  [&](size_t yStart, size_t yEnd) -> void {
+            for (size_t y = yStart; y < yEnd; y++) {
+                const TileBlend &r = rows[y];
+                const uint8_t *lutTop = luts.data() + (size_t) r.first * tilesX * 256;
+                const uint8_t *lutBottom = luts.data() + (size_t) r.second * tilesX * 256;
+                uint8_t *row = plane + y * stride;
+                for (size_t x = 0; x < width; x++) {
+                    const TileBlend &c = columns[x];
+                    uint8_t v = row[x];
+                    uint32_t top = lutTop[c.first * 256 + v] * (256 - c.weight) +
+                                   lutTop[c.second * 256 + v] * c.weight;
+                    uint32_t bottom = lutBottom[c.first * 256 + v] * (256 - c.weight) +
+                                      lutBottom[c.second * 256 + v] * c.weight;
+                    row[x] = (uint8_t) ((top * (256 - r.weight) + bottom * r.weight + 32768) >> 16);
+                }
+            }
+        });
+    }
+
+    void ImageStats::clahe_rgba(uint8_t *pixels, size_t width, size_t height, size_t stride,
+                                int tilesX, int tilesY, float clipLimit, bool useNeon) {
+        std::vector<uint8_t> before(width * height);
+        if (useNeon) {
+            LuminanceSIMD::rgba_to_luma_neon(pixels, width, height, stride, before.data(), width);
+        } else {
+            LuminanceSIMD::rgba_to_luma_scalar(pixels, width, height, stride, before.data(),
+                                               width);
+        }
+        std::vector<uint8_t> after(before);
+        clahe_plane(after.data(), width, height, width, tilesX, tilesY, clipLimit);
+
+        apply_luma_delta_rgba(pixels, width, height, stride, before.data(), after.data(), width,
+                              useNeon);
+    }
+
+    void ImageStats::apply_luma_delta_rgba(uint8_t *pixels, size_t width, size_t height,
+                                           size_t stride, const uint8_t *before,
+                                           const uint8_t *after, size_t lumaStride,
+                                           bool useNeon) {
+        IP_TRACE_KERNEL("ImageStats::apply_luma_delta", height, 2 * height * (stride + lumaStride));
+        // shifting R, G and B by the same amount keeps the hue of the pixel
+        auto apply_rows = [&](size_t yStart, size_t yEnd) -> void {
+            for (size_t y = yStart; y < yEnd; y++) {
+                uint8_t *row = pixels + y * stride;
+                const uint8_t *oldLuma = before + y * lumaStride;
+                const uint8_t *newLuma = after + y * lumaStride;
+                size_t x = 0;
+                if (useNeon) {
+                    for (; x + 16 <= width; x += 16) {
+                        uint8x16x4_t ch = vld4q_u8(row + x * 4);
+                        uint8x16_t o = vld1q_u8(oldLuma + x);
+                        uint8x16_t n = vld1q_u8(newLuma + x);
+                        int16x8_t d_l = vreinterpretq_s16_u16(
+                                vsubl_u8(vget_low_u8(n), vget_low_u8(o)));
+                        int16x8_t d_h = vreinterpretq_s16_u16(
+                                vsubl_u8(vget_high_u8(n), vget_high_u8(o)));
+                        for (int c = 0; c < 3; c++) {
+                            int16x8_t l = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(ch.val[c])));
+                            int16x8_t h = vreinterpretq_s16_u16(
+                                    vmovl_u8(vget_high_u8(ch.val[c])));
+                            ch.val[c] = vcombine_u8(vqmovun_s16(vaddq_s16(l, d_l)),
+                                                    vqmovun_s16(vaddq_s16(h, d_h)));
+                        }
+                        vst4q_u8(row + x * 4, ch);
+                    }
+                }
+                for (; x < width; x++) {
+                    int delta = (int) newLuma[x] - (int) oldLuma[x];
+                    for (int c = 0; c < 3; c++) {
+                        row[x * 4 + c] = (uint8_t) std::min(255, std::max(0, row[x * 4 + c] +
+                                                                              delta));
+                    }
+                }
+            }
+        };
+        if (useNeon) {
+            ThreadPool::for_each_rows(0, height, AutoTuner::default_threads(), 0, apply_rows);
+        } else {
+            apply_rows(0, height);
+        }
+    }
+}
@@ -0,0 +1,491 @@
+//
+// Summed area tables and the constant time window filters built on them.
+//
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include "IntegralImage.h"
+#include "ImageStats.h"
+#include "LuminanceSIMD.h"
+#include "ThreadPool.h"
+#include "AutoTuner.h"
+
+namespace ip {
+    // table columns every worker accumulates down the whole image in the second pass
+    static constexpr size_t COLUMN_STRIP = 64;
+    // flat windows are not stretched beyond target / MIN_DEVIATION, keeps noise down
+    static constexpr float MIN_DEVIATION = 8.0f;
+    static constexpr float RGBA_TARGET_DEVIATION = 48.0f;
+
+    // prefix sum inside 8 lanes, at most 8 * 255 so 16 bit lanes do not overflow
+    static inline uint16x8_t prefix8_u16(uint16x8_t v) {
+        uint16x8_t zero = vdupq_n_u16(0);
+        v = vaddq_u16(v, vextq_u16(zero, v, 7));
+        v = vaddq_u16(v, vextq_u16(zero, v, 6));
+        v = vaddq_u16(v, vextq_u16(zero, v, 4));
+        return v;
+    }
+
+    static inline uint32x4_t prefix4_u32(uint32x4_t v) {
+        uint32x4_t zero = vdupq_n_u32(0);
+        v = vaddq_u32(v, vextq_u32(zero, v, 3));
+        v = vaddq_u32(v, vextq_u32(zero, v, 2));
+        return v;
+    }
+
+    static inline void store_sums(uint32_t *dst, uint32x4_t v) {
+        vst1q_u32(dst, v);
+    }
+
+    static inline void store_sums(uint64_t *dst, uint32x4_t v) {
+        vst1q_u64(dst, vmovl_u32(vget_low_u32(v)));
+        vst1q_u64(dst + 2, vmovl_u32(vget_high_u32(v)));
+    }
+
+    // The row pass runs in 32 bit lanes for both table types, a single row of squares stays
+    // below 2^32 up to 66000 pixels.
+    template<typename T>
+    static void prefix_row_plane_neon(const uint8_t *src, T *out, size_t width) {
+        uint32x4_t carry = vdupq_n_u32(0);
+        size_t x = 0;
+        for (; x + 8 <= width; x += 8) {
+            uint16x8_t v = prefix8_u16(vmovl_u8(vld1_u8(src + x)));
+            uint32x4_t lo = vaddw_u16(carry, vget_low_u16(v));
+            uint32x4_t hi = vaddw_u16(carry, vget_high_u16(v));
+            store_sums(out + x, lo);
+            store_sums(out + x + 4, hi);
+            carry = vdupq_n_u32(vgetq_lane_u32(hi, 3));
+        }
+        uint32_t running = vgetq_lane_u32(carry, 0);
+        for (; x < width; x++) {
+            running += src[x];
+            out[x] = running;
+        }
+    }
+
+    static void prefix_row_squares_neon(const uint8_t *src, uint64_t *out, size_t width) {
+        uint32x4_t carry = vdupq_n_u32(0);
+        size_t x = 0;
+        for (; x + 8 <= width; x += 8) {
+            uint8x8_t p = vld1_u8(src + x);
+            uint16x8_t sq = vmull_u8(p, p);
+            uint32x4_t lo = vaddq_u32(prefix4_u32(vmovl_u16(vget_low_u16(sq))), carry);
+            carry = vdupq_n_u32(vgetq_lane_u32(lo, 3));
+            uint32x4_t hi = vaddq_u32(prefix4_u32(vmovl_u16(vget_high_u16(sq))), carry);
+            carry = vdupq_n_u32(vgetq_lane_u32(hi, 3));
+            store_sums(out + x, lo);
+            store_sums(out + x + 4, hi);
+        }
+        uint32_t running = vgetq_lane_u32(carry, 0);
+        for (; x < width; x++) {
+            running += (uint32_t) src[x] * src[x];
+            out[x] = running;
+        }
+    }
+
+    // one pixel per vector, the lanes are its channels
+    static void prefix_row_rgba_neon(const uint8_t *src, uint32_t *out, size_t width) {
+        uint32x4_t acc = vdupq_n_u32(0);
+        size_t x = 0;
+        for (; x + 4 <= width; x += 4) {
+            uint8x16_t p = vld1q_u8(src + x * 4);
+            uint16x8_t lo = vmovl_u8(vget_low_u8(p));
+            uint16x8_t hi = vmovl_u8(vget_high_u8(p));
+            acc = vaddw_u16(acc, vget_low_u16(lo));
+            vst1q_u32(out + x * 4, acc);
+            acc = vaddw_u16(acc, vget_high_u16(lo));
+            vst1q_u32(out + x * 4 + 4, acc);
+            acc = vaddw_u16(acc, vget_low_u16(hi));
+            vst1q_u32(out + x * 4 + 8, acc);
+            acc = vaddw_u16(acc, vget_high_u16(hi));
+            vst1q_u32(out + x * 4 + 12, acc);
+        }
+        uint32_t running[4];
+        vst1q_u32(running, acc);
+        for (; x < width; x++) {
+            for (int c = 0; c < 4; c++) {
+                running[c] += src[x * 4 + c];
+                out[x * 4 + c] = running[c];
+            }
+        }
+    }
+
+    static inline void add_row_neon(uint32_t *row, const uint32_t *above, size_t count) {
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            vst1q_u32(row + i, vaddq_u32(vld1q_u32(row + i), vld1q_u32(above + i)));
+        }
+        for (; i < count; i++) row[i] += above[i];
+    }
+
+    static inline void add_row_neon(uint64_t *row, const uint64_t *above, size_t count) {
+        size_t i = 0;
+        for (; i + 2 <= count; i += 2) {
+            vst1q_u64(row + i, vaddq_u64(vld1q_u64(row + i), vld1q_u64(above + i)));
+        }
+        for (; i < count; i++) row[i] += above[i];
+    }
+
+    // Pass 1 prefix sums every row independently, pass 2 adds each row to the one below it.
+    // The second pass is split into column strips, so no worker waits for another.
+    template<typename T, typename RowFn>
+    static void build_two_pass_neon(SummedAreaTable<T> &sum, size_t width, size_t height,
+                                    size_t channels, RowFn &&prefixRow) {
+        IP_TRACE_KERNEL("IntegralImage::build_two_pass", height,
+                        2 * sum.stride * (height + 1) * sizeof(T));
+        sum.resize(width, height, channels);
+        std::fill(sum.row(0), sum.row(0) + sum.stride, T(0));
+        uint32_t threads = AutoTuner::default_threads();
+        ThreadPool::for_each_rows(0, height, threads, 0, [&](size_t yStart, size_t yEnd) -> void {
+            for (size_t y = yStart; y < yEnd; y++) {
+                T *out = sum.row(y + 1);
+                std::fill(out, out + channels, T(0));
+                prefixRow(y, out + channels);
+            }
+        });
+        // the range is table columns here, not rows
+        ThreadPool::for_each_rows(0, sum.stride, threads, COLUMN_STRIP,
+                                  [&](size_t cStart, size_t cEnd) -> void {
+            for (size_t y = 2; y <= height; y++) {
+                add_row_neon(sum.row(y) + cStart, sum.row(y - 1) + cStart, cEnd - cStart);
+            }
+        });
+    }
+
+    template<typename T>
+    static void build_scalar(const uint8_t *src, size_t width, size_t height, size_t stride,
+                             size_t channels, bool squared, SummedAreaTable<T> &sum) {
+        sum.resize(width, height, channels);
+        std::fill(sum.row(0), sum.row(0) + sum.stride, T(0));
+        size_t rowValues = width * channels;
+        for (size_t y = 0; y < height; y++) {
+            const uint8_t *in = src + y * stride;
+            const T *above = sum.row(y);
+            T *out = sum.row(y + 1);
+            std::fill(out, out + channels, T(0));
+            T running[4] = {0, 0, 0, 0};
+            for (size_t i = 0; i < rowValues; i++) {
+                T v = in[i];
+                running[i % channels] += squared ? v * v : v;
+                out[i + channels] = above[i + channels] + running[i % channels];
+            }
+        }
+    }
+
+    void IntegralImage::build_plane_neon(const uint8_t *src, size_t width, size_t height,
+                                         size_t stride, IntegralImage32 &sum) {
+        build_two_pass_neon(sum, width, height, 1, [&](size_t y, uint32_t *out) -> void {
+            prefix_row_plane_neon(src + y * stride, out, width);
+        });
+    }
+
+    void IntegralImage::build_plane_neon(const uint8_t *src, size_t width, size_t height,
+                                         size_t stride, IntegralImage64 &sum) {
+        build_two_pass_neon(sum, width, height, 1, [&](size_t y, uint64_t *out) -> void {
+            prefix_row_plane_neon(src + y * stride, out, width);
+        });
+    }
+
+    void IntegralImage::build_plane_scalar(const uint8_t *src, size_t width, size_t height,
+                                           size_t stride, IntegralImage32 &sum) {
+        build_scalar(src, width, height, stride, 1, false, sum);
+    }
+
+    void IntegralImage::build_plane_scalar(const uint8_t *src, size_t width, size_t height,
+                                           size_t stride, IntegralImage64 &sum) {
+        build_scalar(src, width, height, stride, 1, false, sum);
+    }
+
+    void IntegralImage::build_plane_squares_neon(const uint8_t *src, size_t width, size_t height,
+                                                 size_t stride, IntegralImage64 &squares) {
+        build_two_pass_neon(squares, width, height, 1, [&](size_t y, uint64_t *out) -> void {
+            prefix_row_squares_neon(src + y * stride, out, width);
+        });
+    }
+
+    void IntegralImage::build_plane_squares_scalar(const uint8_t *src, size_t width,
+                                                   size_t height, size_t stride,
+                                                   IntegralImage64 &squares) {
+        build_scalar(src, width, height, stride, 1, true, squares);
+    }
+
+    void IntegralImage::build_rgba_neon(const uint8_t *src, size_t width, size_t height,
+                                        size_t stride, IntegralImage32 &sum) {
+        build_two_pass_neon(sum, width, height, 4, [&](size_t y, uint32_t *out) -> void {
+            prefix_row_rgba_neon(src + y * stride, out, width);
+        });
+    }
+
+    void IntegralImage::build_rgba_scalar(const uint8_t *src, size_t width, size_t height,
+                                          size_t stride, IntegralImage32 &sum) {
+        build_scalar(src, width, height, stride, 4, false, sum);
+    }
+
+    // ClippedWindow [x0, x1) x [y0, y1) of the pixel at (x, y), clipped at the border.
+    struct ClippedWindow {
+        size_t x0, x1, y0, y1;
+
+        ClippedWindow(size_t x, size_t y, size_t width, size_t height, size_t radius) {
+            x0 = x > radius ? x - radius : 0;
+            y0 = y > radius ? y - radius : 0;
+            x1 = std::min(width, x + radius + 1);
+            y1 = std::min(height, y + radius + 1);
+        }
+
+        uint32_t area() const { return (uint32_t) ((x1 - x0) * (y1 - y0)); }
+    };
+
+    static void copy_rows(const uint8_t *src, uint8_t *dst, size_t rowBytes, size_t height,
+                          size_t stride) {
+        if (src == dst) return;
+        for (size_t y = 0; y < height; y++) memcpy(dst + y * stride, src + y * stride, rowBytes);
+    }
+
+    void IntegralImage::box_blur_rgba_neon(const uint8_t *src, uint8_t *dst, size_t width,
+                                           size_t height, size_t stride, int radius) {
+        IP_TRACE_KERNEL("IntegralImage::box_blur_rgba", height, 2 * height * stride);
+        if (radius < 1 || width == 0 || height == 0) {
+            copy_rows(src, dst, width * 4, height, stride);
+            return;
+        }
+        IntegralImage32 sum;
+        build_rgba_neon(src, width, height, stride, sum);
+        auto r = (size_t) radius;
+        ThreadPool::for_each_rows(0, height, AutoTuner::default_threads(), 0,
+                                  [&](size_t yStart, size_t yEnd) -> void {
+            for (size_t y = yStart; y < yEnd; y++) {
+                const uint8_t *srcRow = src + y * stride;
+                uint8_t *dstRow = dst + y * stride;
+                for (size_t x = 0; x < width; x++) {
+                    ClippedWindow w{x, y, width, height, r};
+                    const uint32_t *top = sum.row(w.y0);
+                    const uint32_t *bottom = sum.row(w.y1);
+                    // a + d - (b + c) stays exact under wrap around
+                    uint32x4_t s = vsubq_u32(
+                            vaddq_u32(vld1q_u32(bottom + w.x1 * 4), vld1q_u32(top + w.x0 * 4)),
+                            vaddq_u32(vld1q_u32(bottom + w.x0 * 4), vld1q_u32(top + w.x1 * 4)));
+                    float32x4_t mean = vmulq_n_f32(vcvtq_f32_u32(s), 1.0f / (float) w.area());
+                    uint16x4_t m16 = vmovn_u32(vcvtnq_u32_f32(mean));
+                    uint8x8_t m8 = vmovn_u16(vcombine_u16(m16, m16));
+                    uint8_t alpha = srcRow[x * 4 + 3];
+                    vst1_lane_u32(reinterpret_cast<uint32_t *>(dstRow + x * 4),
+                                  vreinterpret_u32_u8(m8), 0);
+                    dstRow[x * 4 + 3] = alpha;
+                }
+            }
+        });
+    }
+
+    void IntegralImage::box_blur_rgba_scalar(const uint8_t *src, uint8_t *dst, size_t width,
+                                             size_t height, size_t stride, int radius) {
+        if (radius < 1 || width == 0 || height == 0) {
+            copy_rows(src, dst, width * 4, height, stride);
+            return;
+        }
+        IntegralImage32 sum;
+        build_rgba_scalar(src, width, height, stride, sum);
+        auto r = (size_t) radius;
+        for (size_t y = 0; y < height; y++) {
+            uint8_t *dstRow = dst + y * stride;
+            for (size_t x = 0; x < width; x++) {
+                ClippedWindow w{x, y, width, height, r};
+                uint32_t area = w.area();
+                for (size_t c = 0; c < 3; c++) {
+                    uint32_t s = sum.box_sum(w.x0, w.y0, w.x1, w.y1, c);
+                    dstRow[x * 4 + c] = (uint8_t) ((s + area / 2) / area);
+                }
+                dstRow[x * 4 + 3] = src[y * stride + x * 4 + 3];
+            }
+        }
+    }
+
+    void IntegralImage::adaptive_threshold_plane(const uint8_t *src, uint8_t *dst, size_t width,
+                                                 size_t height, size_t stride, int radius,
+                                                 int offset, bool useNeon) {
+        IP_TRACE_KERNEL("IntegralImage::adaptive_threshold", height, 2 * height * stride);
+        if (width == 0 || height == 0) return;
+        if (radius < 1) radius = 1;
+        IntegralImage32 sum;
+        if (useNeon) {
+            build_plane_neon(src, width, height, stride, sum);
+        } else {
+            build_plane_scalar(src, width, height, stride, sum);
+        }
+        auto r = (size_t) radius;
+        auto threshold_rows = [&](size_t yStart, size_t yEnd) -> void {
+            for (size_t y = yStart; y < yEnd; y++) {
+                const uint8_t *in = src + y * stride;
+                uint8_t *out = dst + y * stride;
+                size_t x = 0;
+                auto threshold_pixel = [&](size_t px) -> void {
+                    ClippedWindow w{px, y, width, height, r};
+                    int64_t area = w.area();
+                    int64_t s = sum.box_sum(w.x0, w.y0, w.x1, w.y1);
+                    out[px] = ((int64_t) in[px] + offset) * area > s ? 255 : 0;
+                };
+                if (useNeon && width > 2 * r + 8) {
+                    for (; x < r; x++) threshold_pixel(x);
+                    // inside the border the window has a constant area and four consecutive
+                    // pixels read four consecutive table entries
+                    ClippedWindow inner{r, y, width, height, r};
+                    const uint32_t *top = sum.row(inner.y0);
+                    const uint32_t *bottom = sum.row(inner.y1);
+                    float invArea = 1.0f / (float) ((2 * r + 1) * (inner.y1 - inner.y0));
+                    float32x4_t bias = vdupq_n_f32((float) offset);
+                    for (; x + 8 <= width - r; x += 8) {
+                        uint16x8_t p = vmovl_u8(vld1_u8(in + x));
+                        uint16x4_t masks[2];
+                        for (int h = 0; h < 2; h++) {
+                            size_t xl = x + h * 4 - r;
+                            size_t xr = x + h * 4 + r + 1;
+                            uint32x4_t s = vsubq_u32(
+                                    vaddq_u32(vld1q_u32(bottom + xr), vld1q_u32(top + xl)),
+                                    vaddq_u32(vld1q_u32(bottom + xl), vld1q_u32(top + xr)));
+                            float32x4_t mean = vmulq_n_f32(vcvtq_f32_u32(s), invArea);
+                            float32x4_t value = vaddq_f32(vcvtq_f32_u32(
+                                    vmovl_u16(h == 0 ? vget_low_u16(p) : vget_high_u16(p))), bias);
+                            masks[h] = vmovn_u32(vcgtq_f32(value, mean));
+                        }
+                        vst1_u8(out + x, vmovn_u16(vcombine_u16(masks[0], masks[1])));
+                    }
+                }
+                for (; x < width; x++) threshold_pixel(x);
+            }
+        };
+        if (useNeon) {
+            ThreadPool::for_each_rows(0, height, AutoTuner::default_threads(), 0, threshold_rows);
+        } else {
+            threshold_rows(0, height);
+        }
+    }
+
+    void IntegralImage::adaptive_threshold_rgba(uint8_t *pixels, size_t width, size_t height,
+                                                size_t stride, int radius, int offset,
+                                                bool useNeon) {
+        std::vector<uint8_t> luma(width * height);
+        std::vector<uint8_t> binary(width * height);
+        if (useNeon) {
+            LuminanceSIMD::rgba_to_luma_neon(pixels, width, height, stride, luma.data(), width);
+        } else {
+            LuminanceSIMD::rgba_to_luma_scalar(pixels, width, height, stride, luma.data(), width);
+        }
+        adaptive_threshold_plane(luma.data(), binary.data(), width, height, width, radius,
+                                 offset, useNeon);
+        for (size_t y = 0; y < height; y++) {
+            uint8_t *row = pixels + y * stride;
+            if (useNeon) {
+                LuminanceSIMD::store_luma_row_rgba_neon(binary.data() + y * width, row, row,
+                                                        width);
+            } else {
+                LuminanceSIMD::store_luma_row_rgba_scalar(binary.data() + y * width, row, row,
+                                                          width);
+            }
+        }
+    }
+
+    void IntegralImage::local_contrast_plane(const uint8_t *src, uint8_t *dst, size_t width,
+                                             size_t height, size_t stride, int radius,
+                                             float strength, float targetDeviation,
+                                             bool useNeon) {
+        IP_TRACE_KERNEL("IntegralImage::local_contrast", height, 2 * height * stride);
+        if (width == 0 || height == 0) return;
+        if (radius < 1) radius = 1;
+        strength = std::min(1.0f, std::max(0.0f, strength));
+        IntegralImage32 sum;
+        IntegralImage64 squares;
+        if (useNeon) {
+            build_plane_neon(src, width, height, stride, sum);
+            build_plane_squares_neon(src, width, height, stride, squares);
+        } else {
+            build_plane_scalar(src, width, height, stride, sum);
+            build_plane_squares_scalar(src, width, height, stride, squares);
+        }
+        auto r = (size_t) radius;
+        auto contrast_rows = [&](size_t yStart, size_t yEnd) -> void {
+            for (size_t y = yStart; y < yEnd; y++) {
+                const uint8_t *in = src + y * stride;
+                uint8_t *out = dst + y * stride;
+                size_t x = 0;
+                auto contrast_pixel = [&](size_t px) -> void {
+                    ClippedWindow w{px, y, width, height, r};
+                    float invArea = 1.0f / (float) w.area();
+                    float mean = (float) sum.box_sum(w.x0, w.y0, w.x1, w.y1) * invArea;
+                    float variance = (float) squares.box_sum(w.x0, w.y0, w.x1, w.y1) * invArea -
+                                     mean * mean;
+                    float deviation = std::sqrt(std::max(variance,
+                                                         MIN_DEVIATION * MIN_DEVIATION));
+                    float p = in[px];
+                    float normalised = mean + (p - mean) * targetDeviation / deviation;
+                    float v = p + strength * (normalised - p);
+                    out[px] = (uint8_t) std::min(255.0f, std::max(0.0f, v + 0.5f));
+                };
+                if (useNeon && width > 2 * r + 4) {
+                    for (; x < r; x++) contrast_pixel(x);
+                    ClippedWindow inner{r, y, width, height, r};
+                    const uint32_t *top = sum.row(inner.y0);
+                    const uint32_t *bottom = sum.row(inner.y1);
+                    const uint64_t *sqTop = squares.row(inner.y0);
+                    const uint64_t *sqBottom = squares.row(inner.y1);
+                    float invArea = 1.0f / (float) ((2 * r + 1) * (inner.y1 - inner.y0));
+                    float32x4_t minVariance = vdupq_n_f32(MIN_DEVIATION * MIN_DEVIATION);
+                    float32x4_t target = vdupq_n_f32(targetDeviation);
+                    for (; x + 4 <= width - r; x += 4) {
+                        size_t xl = x - r;
+                        size_t xr = x + r + 1;
+                        uint32x4_t s = vsubq_u32(
+                                vaddq_u32(vld1q_u32(bottom + xr), vld1q_u32(top + xl)),
+                                vaddq_u32(vld1q_u32(bottom + xl), vld1q_u32(top + xr)));
+                        uint64x2_t q0 = vsubq_u64(
+                                vaddq_u64(vld1q_u64(sqBottom + xr), vld1q_u64(sqTop + xl)),
+                                vaddq_u64(vld1q_u64(sqBottom + xl), vld1q_u64(sqTop + xr)));
+                        uint64x2_t q1 = vsubq_u64(
+                                vaddq_u64(vld1q_u64(sqBottom + xr + 2), vld1q_u64(sqTop + xl + 2)),
+                                vaddq_u64(vld1q_u64(sqBottom + xl + 2), vld1q_u64(sqTop + xr + 2)));
+                        float32x4_t sq = vcvt_high_f32_f64(vcvt_f32_f64(vcvtq_f64_u64(q0)),
+                                                           vcvtq_f64_u64(q1));
+                        float32x4_t mean = vmulq_n_f32(vcvtq_f32_u32(s), invArea);
+                        float32x4_t variance = vmlsq_f32(vmulq_n_f32(sq, invArea), mean, mean);
+                        float32x4_t deviation = vsqrtq_f32(vmaxq_f32(variance, minVariance));
+                        uint32_t packed;
+                        memcpy(&packed, in + x, sizeof(packed));
+                        uint8x8_t bytes = vreinterpret_u8_u32(vdup_n_u32(packed));
+                        float32x4_t p = vcvtq_f32_u32(
+                                vmovl_u16(vget_low_u16(vmovl_u8(bytes))));
+                        float32x4_t normalised = vmlaq_f32(
+                                mean, vsubq_f32(p, mean), vdivq_f32(target, deviation));
+                        float32x4_t v = vmlaq_n_f32(p, vsubq_f32(normalised, p), strength);
+                        uint32x4_t rounded = vcvtnq_u32_f32(vmaxq_f32(v, vdupq_n_f32(0.0f)));
+                        uint16x4_t v16 = vqmovn_u32(rounded);
+                        uint8x8_t v8 = vqmovn_u16(vcombine_u16(v16, v16));
+                        vst1_lane_u32(reinterpret_cast<uint32_t *>(out + x),
+                                      vreinterpret_u32_u8(v8), 0);
+                    }
+                }
+                for (; x < width; x++) contrast_pixel(x);
+            }
+        };
+        if (useNeon) {
+            ThreadPool::for_each_rows(0, height, AutoTuner::default_threads(), 0, contrast_rows);
+        } else {
+            contrast_rows(0, height);
+        }
+    }
+
+    void IntegralImage::local_contrast_rgba(uint8_t *pixels, size_t width, size_t height,
+                                            size_t stride, int radius, float strength,
+                                            bool useNeon) {
+        std::vector<uint8_t> before(width * height);
+        std::vector<uint8_t> after(width * height);
+        if (useNeon) {
+            LuminanceSIMD::rgba_to_luma_neon(pixels, width, height, stride, before.data(), width);
+        } else {
+            LuminanceSIMD::rgba_to_luma_scalar(pixels, width, height, stride, before.data(),
+                                               width);
+        }
+        local_contrast_plane(before.data(), after.data(), width, height, width, radius, strength,
+                             RGBA_TARGET_DEVIATION, useNeon);
+        ImageStats::apply_luma_delta_rgba(pixels, width, height, stride, before.data(),
+                                          after.data(), width, useNeon);
+    }
+}
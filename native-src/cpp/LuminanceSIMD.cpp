@@ -0,0 +1,387 @@
+//
+// Single channel (luminance) filters working in 8/16 bit integer lanes.
+//
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include "LuminanceSIMD.h"
+#include "ThreadPool.h"
+#include "AutoTuner.h"
+
+namespace ip {
+    namespace {
+        // Images without a full 3x3 neighbourhood are passed through unchanged, so a caller
+        // writing dst back never sees uninitialised rows.
+        void pass_through(const uint8_t *src, uint8_t *dst, size_t width, size_t height,
+                          size_t stride, uint8_t *direction = nullptr,
+                          size_t directionStride = 0) {
+            if (src != dst) memcpy(dst, src, height * stride);
+            if (direction == nullptr) return;
+            for (size_t y = 0; y < height; y++) {
+                memset(direction + y * directionStride, DIRECTION_0, width);
+            }
+        }
+    }
+
+    void LuminanceSIMD::rgba_to_luma_row_neon(const uint8_t *src, uint8_t *luma, size_t width) {
+        const uint8x8_t wr = vdup_n_u8(77);
+        const uint8x8_t wg = vdup_n_u8(150);
+        const uint8x8_t wb = vdup_n_u8(29);
+        size_t x = 0;
+        for (; x + 16 <= width; x += 16) {
+            uint8x16x4_t ch = vld4q_u8(src + x * 4);
+            uint16x8_t lo = vmull_u8(vget_low_u8(ch.val[0]), wr);
+            lo = vmlal_u8(lo, vget_low_u8(ch.val[1]), wg);
+            lo = vmlal_u8(lo, vget_low_u8(ch.val[2]), wb);
+            uint16x8_t hi = vmull_u8(vget_high_u8(ch.val[0]), wr);
+            hi = vmlal_u8(hi, vget_high_u8(ch.val[1]), wg);
+            hi = vmlal_u8(hi, vget_high_u8(ch.val[2]), wb);
+            // rounding narrow shift adds the +128 before the >> 8
+            vst1q_u8(luma + x, vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)));
+        }
+        rgba_to_luma_row_scalar(src + x * 4, luma + x, width - x);
+    }
+
+    void LuminanceSIMD::rgba_to_luma_row_scalar(const uint8_t *src, uint8_t *luma, size_t width) {
+        for (size_t x = 0; x < width; x++) {
+            const uint8_t *p = src + x * 4;
+            luma[x] = static_cast<uint8_t>((77 * p[0] + 150 * p[1] + 29 * p[2] + 128) >> 8);
+        }
+    }
+
+    void LuminanceSIMD::planes_to_luma_row_neon(const uint8_t *r, const uint8_t *g,
+                                                const uint8_t *b, uint8_t *luma, size_t width) {
+        const uint8x8_t wr = vdup_n_u8(77);
+        const uint8x8_t wg = vdup_n_u8(150);
+        const uint8x8_t wb = vdup_n_u8(29);
+        size_t x = 0;
+        for (; x + 16 <= width; x += 16) {
+            uint8x16_t pr = vld1q_u8(r + x);
+            uint8x16_t pg = vld1q_u8(g + x);
+            uint8x16_t pb = vld1q_u8(b + x);
+            uint16x8_t lo = vmull_u8(vget_low_u8(pr), wr);
+            lo = vmlal_u8(lo, vget_low_u8(pg), wg);
+            lo = vmlal_u8(lo, vget_low_u8(pb), wb);
+            uint16x8_t hi = vmull_u8(vget_high_u8(pr), wr);
+            hi = vmlal_u8(hi, vget_high_u8(pg), wg);
+            hi = vmlal_u8(hi, vget_high_u8(pb), wb);
+            vst1q_u8(luma + x, vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)));
+        }
+        for (; x < width; x++) {
+            luma[x] = static_cast<uint8_t>((77 * r[x] + 150 * g[x] + 29 * b[x] + 128) >> 8);
+        }
+    }
+
+    uint8x8_t LuminanceSIMD::magnitude_neon(int16x8_t gx, int16x8_t gy, GradientMagnitude mode) {
+        int16x8_t ax = vabsq_s16(gx);
+        int16x8_t ay = vabsq_s16(gy);
+        switch (mode) {
+            case GradientMagnitude::L1:
+                return vqmovun_s16(vaddq_s16(ax, ay));
+            case GradientMagnitude::ALPHA_MAX_BETA_MIN: {
+                int16x8_t mx = vmaxq_s16(ax, ay);
+                int16x8_t mn = vminq_s16(ax, ay);
+                int16x8_t m = vaddq_s16(mx, vaddq_s16(vshrq_n_s16(mn, 2), vshrq_n_s16(mn, 3)));
+                return vqmovun_s16(m);
+            }
+            case GradientMagnitude::EXACT:
+            default: {
+                int32x4_t sq_l = vmull_s16(vget_low_s16(gx), vget_low_s16(gx));
+                sq_l = vmlal_s16(sq_l, vget_low_s16(gy), vget_low_s16(gy));
+                int32x4_t sq_h = vmull_s16(vget_high_s16(gx), vget_high_s16(gx));
+                sq_h = vmlal_s16(sq_h, vget_high_s16(gy), vget_high_s16(gy));
+                uint32x4_t m_l = vcvtnq_u32_f32(vsqrtq_f32(vcvtq_f32_s32(sq_l)));
+                uint32x4_t m_h = vcvtnq_u32_f32(vsqrtq_f32(vcvtq_f32_s32(sq_h)));
+                return vqmovn_u16(vcombine_u16(vqmovn_u32(m_l), vqmovn_u32(m_h)));
+            }
+        }
+    }
+
+    uint8x8_t LuminanceSIMD::direction_neon(int16x8_t gx, int16x8_t gy) {
+        int16x8_t ax = vabsq_s16(gx);
+        int16x8_t ay = vabsq_s16(gy);
+        // tan(22.5) ~ 5 / 12 and tan(67.5) ~ 12 / 5, products stay below 12 * 1020
+        uint16x8_t horizontal = vcleq_s16(vmulq_n_s16(ay, 12), vmulq_n_s16(ax, 5));
+        uint16x8_t vertical = vcgeq_s16(vmulq_n_s16(ay, 5), vmulq_n_s16(ax, 12));
+        uint16x8_t sameSign = vcgeq_s16(veorq_s16(gx, gy), vdupq_n_s16(0));
+
+        uint16x8_t dir = vbslq_u16(sameSign, vdupq_n_u16(DIRECTION_45),
+                                   vdupq_n_u16(DIRECTION_135));
+        dir = vbslq_u16(vertical, vdupq_n_u16(DIRECTION_90), dir);
+        dir = vbslq_u16(horizontal, vdupq_n_u16(DIRECTION_0), dir);
+        return vmovn_u16(dir);
+    }
+
+    void LuminanceSIMD::sobel_row_neon(const int16_t *vs, const int16_t *vd, uint8_t *magnitude,
+                                       uint8_t *direction, size_t width, GradientMagnitude mode) {
+        if (width < 3) return;
+        size_t x = 1;
+        for (; x + 8 <= width - 1; x += 8) {
+            int16x8_t gx = vsubq_s16(vld1q_s16(vs + x + 1), vld1q_s16(vs + x - 1));
+            int16x8_t gy = vaddq_s16(vld1q_s16(vd + x - 1), vld1q_s16(vd + x + 1));
+            gy = vaddq_s16(gy, vshlq_n_s16(vld1q_s16(vd + x), 1));
+
+            vst1_u8(magnitude + x, magnitude_neon(gx, gy, mode));
+            if (direction != nullptr) {
+                vst1_u8(direction + x, direction_neon(gx, gy));
+            }
+        }
+        if (x < width - 1) {
+            sobel_row_scalar(vs + x - 1, vd + x - 1, magnitude + x - 1,
+                             direction != nullptr ? direction + x - 1 : nullptr,
+                             width - x + 1, mode);
+        }
+    }
+
+    void LuminanceSIMD::sobel_row_scalar(const int16_t *vs, const int16_t *vd, uint8_t *magnitude,
+                                         uint8_t *direction, size_t width,
+                                         GradientMagnitude mode) {
+        for (size_t x = 1; x + 1 < width; x++) {
+            int gx = vs[x + 1] - vs[x - 1];
+            int gy = vd[x - 1] + 2 * vd[x] + vd[x + 1];
+            int ax = std::abs(gx);
+            int ay = std::abs(gy);
+            int m;
+            if (mode == GradientMagnitude::L1) {
+                m = ax + ay;
+            } else if (mode == GradientMagnitude::ALPHA_MAX_BETA_MIN) {
+                int mx = std::max(ax, ay);
+                int mn = std::min(ax, ay);
+                m = mx + (mn >> 2) + (mn >> 3);
+            } else {
+                m = (int) std::lround(std::sqrt((float) (gx * gx + gy * gy)));
+            }
+            magnitude[x] = (uint8_t) std::min(m, 255);
+
+            if (direction != nullptr) {
+                uint8_t dir;
+                if (ay * 12 <= ax * 5) dir = DIRECTION_0;
+                else if (ay * 5 >= ax * 12) dir = DIRECTION_90;
+                else dir = ((gx ^ gy) >= 0) ? DIRECTION_45 : DIRECTION_135;
+                direction[x] = dir;
+            }
+        }
+    }
+
+    void LuminanceSIMD::rgba_to_luma_neon(const uint8_t *src, size_t width, size_t height,
+                                          size_t stride, uint8_t *luma, size_t lumaStride) {
+        IP_TRACE_KERNEL("LuminanceSIMD::rgba_to_luma", height, height * (stride + lumaStride));
+        ThreadPool::for_each_rows(0, height, AutoTuner::default_threads(), 0,
+                                  [&](size_t yStart, size_t yEnd) -> void {
+            for (size_t y = yStart; y < yEnd; y++) {
+                rgba_to_luma_row_neon(src + y * stride, luma + y * lumaStride, width);
+            }
+        });
+    }
+
+    void LuminanceSIMD::rgba_to_luma_scalar(const uint8_t *src, size_t width, size_t height,
+                                            size_t stride, uint8_t *luma, size_t lumaStride) {
+        for (size_t y = 0; y < height; y++) {
+            rgba_to_luma_row_scalar(src + y * stride, luma + y * lumaStride, width);
+        }
+    }
+
+    void LuminanceSIMD::store_luma_row_rgba_neon(const uint8_t *luma, const uint8_t *srcRow,
+                                                 uint8_t *dstRow, size_t width) {
+        size_t x = 0;
+        for (; x + 16 <= width; x += 16) {
+            uint8x16_t l = vld1q_u8(luma + x);
+            uint8x16x4_t out;
+            out.val[0] = l;
+            out.val[1] = l;
+            out.val[2] = l;
+            out.val[3] = vld4q_u8(srcRow + x * 4).val[3];
+            vst4q_u8(dstRow + x * 4, out);
+        }
+        store_luma_row_rgba_scalar(luma + x, srcRow + x * 4, dstRow + x * 4, width - x);
+    }
+
+    void LuminanceSIMD::store_luma_row_rgba_scalar(const uint8_t *luma, const uint8_t *srcRow,
+                                                   uint8_t *dstRow, size_t width) {
+        for (size_t x = 0; x < width; x++) {
+            uint8_t a = srcRow[x * 4 + 3];
+            dstRow[x * 4] = dstRow[x * 4 + 1] = dstRow[x * 4 + 2] = luma[x];
+            dstRow[x * 4 + 3] = a;
+        }
+    }
+
+    void LuminanceSIMD::sobel_vertical_row_neon(const uint8_t *top, const uint8_t *mid,
+                                                const uint8_t *bottom, int16_t *vs, int16_t *vd,
+                                                size_t width) {
+        size_t x = 0;
+        for (; x + 16 <= width; x += 16) {
+            uint8x16_t t8 = vld1q_u8(top + x);
+            uint8x16_t m8 = vld1q_u8(mid + x);
+            uint8x16_t b8 = vld1q_u8(bottom + x);
+            uint16x8_t s_l = vaddl_u8(vget_low_u8(t8), vget_low_u8(b8));
+            s_l = vaddq_u16(s_l, vshll_n_u8(vget_low_u8(m8), 1));
+            uint16x8_t s_h = vaddl_u8(vget_high_u8(t8), vget_high_u8(b8));
+            s_h = vaddq_u16(s_h, vshll_n_u8(vget_high_u8(m8), 1));
+            vst1q_s16(vs + x, vreinterpretq_s16_u16(s_l));
+            vst1q_s16(vs + x + 8, vreinterpretq_s16_u16(s_h));
+            vst1q_s16(vd + x, vreinterpretq_s16_u16(vsubl_u8(vget_low_u8(b8), vget_low_u8(t8))));
+            vst1q_s16(vd + x + 8,
+                      vreinterpretq_s16_u16(vsubl_u8(vget_high_u8(b8), vget_high_u8(t8))));
+        }
+        sobel_vertical_row_scalar(top + x, mid + x, bottom + x, vs + x, vd + x, width - x);
+    }
+
+    void LuminanceSIMD::sobel_vertical_row_scalar(const uint8_t *top, const uint8_t *mid,
+                                                  const uint8_t *bottom, int16_t *vs,
+                                                  int16_t *vd, size_t width) {
+        for (size_t x = 0; x < width; x++) {
+            vs[x] = (int16_t) (top[x] + 2 * mid[x] + bottom[x]);
+            vd[x] = (int16_t) (bottom[x] - top[x]);
+        }
+    }
+
+    void LuminanceSIMD::emboss_row_neon(const uint8_t *top, const uint8_t *mid,
+                                        const uint8_t *bottom, uint8_t *out, size_t width) {
+        //  -2 -1  0
+        //  -1  1  1
+        //   0  1  2
+        if (width < 3) return;
+        const int16x8_t bias = vdupq_n_s16(128);
+        size_t x = 1;
+        for (; x + 8 <= width - 1; x += 8) {
+            int16x8_t tl = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(top + x - 1)));
+            int16x8_t tc = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(top + x)));
+            int16x8_t ml = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(mid + x - 1)));
+            int16x8_t mc = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(mid + x)));
+            int16x8_t mr = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(mid + x + 1)));
+            int16x8_t bc = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(bottom + x)));
+            int16x8_t br = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(bottom + x + 1)));
+
+            int16x8_t positive = vaddq_s16(vaddq_s16(mc, mr), vaddq_s16(bc, vshlq_n_s16(br, 1)));
+            int16x8_t negative = vaddq_s16(vaddq_s16(vshlq_n_s16(tl, 1), tc), ml);
+            int16x8_t sum = vaddq_s16(vsubq_s16(positive, negative), bias);
+            vst1_u8(out + x, vqmovun_s16(sum));
+        }
+        if (x < width - 1) {
+            emboss_row_scalar(top + x - 1, mid + x - 1, bottom + x - 1, out + x - 1,
+                              width - x + 1);
+        }
+    }
+
+    void LuminanceSIMD::emboss_row_scalar(const uint8_t *top, const uint8_t *mid,
+                                          const uint8_t *bottom, uint8_t *out, size_t width) {
+        for (size_t x = 1; x + 1 < width; x++) {
+            int sum = -2 * top[x - 1] - top[x] - mid[x - 1] + mid[x] + mid[x + 1] +
+                      bottom[x] + 2 * bottom[x + 1] + 128;
+            out[x] = (uint8_t) std::min(255, std::max(0, sum));
+        }
+    }
+
+    // Runs a 3x3 luminance stencil over an RGBA image. Every task keeps a rolling window of
+    // three luma rows, so the gray value of a pixel is computed once per task instead of once
+    // per neighbour. rowOp(top, mid, bottom, out, scratch, y) fills out[1, width - 1), the
+    // frame pixels get borderLuma and the row is expanded to RGBA only when it is stored.
+    // The rows are split according to the tuned plan of `kernel`. Not in place: the tasks
+    // read the neighbour rows of src while others store theirs, so dst must be apart.
+    template<typename RowOp>
+    static void run_luma_stencil_3x3(const uint8_t *src, uint8_t *dst, size_t width,
+                                     size_t height, size_t stride, uint8_t borderLuma,
+                                     TunedKernel kernel, RowOp &&rowOp) {
+        assert(src != dst && "run_luma_stencil_3x3 is not in place safe");
+        IP_TRACE_KERNEL("LuminanceSIMD::stencil_3x3", height, 2 * height * stride);
+        std::vector<uint8_t> border(width, borderLuma);
+        LuminanceSIMD::store_luma_row_rgba_neon(border.data(), src, dst, width);
+        LuminanceSIMD::store_luma_row_rgba_neon(border.data(), src + (height - 1) * stride,
+                                                dst + (height - 1) * stride, width);
+
+        KernelPlan plan = AutoTuner::instance().plan(kernel);
+        ThreadPool::for_each_rows(1, height - 1, plan.threads, plan.grainRows,
+                                  [&](size_t yStart, size_t yEnd) -> void {
+            std::vector<uint8_t> lumaRows(width * 3);
+            std::vector<uint8_t> out(width);
+            std::vector<int16_t> scratch(width * 2);
+            uint8_t *top = lumaRows.data();
+            uint8_t *mid = top + width;
+            uint8_t *bottom = mid + width;
+            LuminanceSIMD::rgba_to_luma_row_neon(src + (yStart - 1) * stride, top, width);
+            LuminanceSIMD::rgba_to_luma_row_neon(src + yStart * stride, mid, width);
+
+            for (size_t y = yStart; y < yEnd; y++) {
+                LuminanceSIMD::rgba_to_luma_row_neon(src + (y + 1) * stride, bottom, width);
+                rowOp(top, mid, bottom, out.data(), scratch.data(), y);
+                out[0] = out[width - 1] = borderLuma;
+                LuminanceSIMD::store_luma_row_rgba_neon(out.data(), src + y * stride,
+                                                        dst + y * stride, width);
+
+                uint8_t *recycled = top;
+                top = mid;
+                mid = bottom;
+                bottom = recycled;
+            }
+        });
+    }
+
+    void LuminanceSIMD::sobel_luma_neon(const uint8_t *src, uint8_t *dst, size_t width,
+                                        size_t height, size_t stride, GradientMagnitude mode,
+                                        uint8_t *direction, size_t directionStride) {
+        if (width < 3 || height < 3) {
+            pass_through(src, dst, width, height, stride, direction, directionStride);
+            return;
+        }
+        if (direction != nullptr) {
+            memset(direction, DIRECTION_0, width);
+            memset(direction + (height - 1) * directionStride, DIRECTION_0, width);
+        }
+        run_luma_stencil_3x3(src, dst, width, height, stride, 0, TunedKernel::SOBEL_EDGE,
+                             [&](const uint8_t *top, const uint8_t *mid, const uint8_t *bottom,
+                                 uint8_t *out, int16_t *scratch, size_t y) -> void {
+                                 int16_t *vs = scratch;
+                                 int16_t *vd = scratch + width;
+                                 sobel_vertical_row_neon(top, mid, bottom, vs, vd, width);
+                                 uint8_t *dirRow = nullptr;
+                                 if (direction != nullptr) {
+                                     dirRow = direction + y * directionStride;
+                                     dirRow[0] = dirRow[width - 1] = DIRECTION_0;
+                                 }
+                                 sobel_row_neon(vs, vd, out, dirRow, width, mode);
+                             });
+    }
+
+    void LuminanceSIMD::emboss_luma_neon(const uint8_t *src, uint8_t *dst, size_t width,
+                                         size_t height, size_t stride) {
+        if (width < 3 || height < 3) {
+            pass_through(src, dst, width, height, stride);
+            return;
+        }
+        run_luma_stencil_3x3(src, dst, width, height, stride, 128, TunedKernel::EMBOSS,
+                             [&](const uint8_t *top, const uint8_t *mid, const uint8_t *bottom,
+                                 uint8_t *out, int16_t *, size_t) -> void {
+                                 emboss_row_neon(top, mid, bottom, out, width);
+                             });
+    }
+
+    void LuminanceSIMD::sobel_luma_scalar(const uint8_t *src, uint8_t *dst, size_t width,
+                                          size_t height, size_t stride, GradientMagnitude mode,
+                                          uint8_t *direction, size_t directionStride) {
+        if (width < 3 || height < 3) {
+            pass_through(src, dst, width, height, stride, direction, directionStride);
+            return;
+        }
+        std::vector<uint8_t> luma(width * height);
+        rgba_to_luma_scalar(src, width, height, stride, luma.data(), width);
+        std::vector<int16_t> vs(width), vd(width);
+        std::vector<uint8_t> magnitude(width);
+        for (size_t y = 0; y < height; y++) {
+            uint8_t *dirRow = direction != nullptr ? direction + y * directionStride : nullptr;
+            std::fill(magnitude.begin(), magnitude.end(), 0);
+            if (dirRow != nullptr) memset(dirRow, DIRECTION_0, width);
+            if (y > 0 && y < height - 1) {
+                const uint8_t *top = luma.data() + (y - 1) * width;
+                const uint8_t *mid = top + width;
+                const uint8_t *bottom = mid + width;
+                sobel_vertical_row_scalar(top, mid, bottom, vs.data(), vd.data(), width);
+                sobel_row_scalar(vs.data(), vd.data(), magnitude.data(), dirRow, width, mode);
+            }
+            store_luma_row_rgba_scalar(magnitude.data(), src + y * stride, dst + y * stride,
+                                       width);
+        }
+    }
+}
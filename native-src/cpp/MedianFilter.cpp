@@ -0,0 +1,338 @@
+//
+// Median filter, sorting networks for the small windows and Perreault's constant time
+// histogram method for the large ones.
+//
+#include <cstring>
+#include <utility>
+#include <algorithm>
+#include "MedianFilter.h"
+#include "ImageProcessorSIMD.h"
+#include "ThreadPool.h"
+#include "AutoTuner.h"
+
+namespace ip {
+    static constexpr int BINS = 256;
+    static constexpr int COARSE_BINS = 16;
+
+    // Batcher's odd-even merge sort on 32 inputs, cut down to the compare-exchanges that can
+    // still reach the middle element of `count` inputs. The inputs above count would hold 255
+    // and never move, so every exchange touching them is dropped.
+    static std::vector<std::pair<uint8_t, uint8_t>> median_network(size_t count) {
+        std::vector<std::pair<uint8_t, uint8_t>> pairs;
+        const size_t n = 32;
+        for (size_t p = 1; p < n; p <<= 1) {
+            for (size_t k = p; k >= 1; k >>= 1) {
+                for (size_t j = k % p; j + k < n; j += 2 * k) {
+                    for (size_t i = 0; i < std::min(k, n - j - k); i++) {
+                        if ((i + j) / (2 * p) == (i + j + k) / (2 * p) && i + j + k < count) {
+                            pairs.emplace_back((uint8_t) (i + j), (uint8_t) (i + j + k));
+                        }
+                    }
+                }
+            }
+        }
+        std::vector<bool> needed(count, false);
+        needed[count / 2] = true;
+        std::vector<std::pair<uint8_t, uint8_t>> pruned;
+        for (auto it = pairs.rbegin(); it != pairs.rend(); ++it) {
+            if (needed[it->first] || needed[it->second]) {
+                needed[it->first] = true;
+                needed[it->second] = true;
+                pruned.push_back(*it);
+            }
+        }
+        std::reverse(pruned.begin(), pruned.end());
+        return pruned;
+    }
+
+    static inline void sort2(uint8x16_t &a, uint8x16_t &b) {
+        uint8x16_t lo = vminq_u8(a, b);
+        b = vmaxq_u8(a, b);
+        a = lo;
+    }
+
+    static inline uint8x16_t median3(uint8x16_t a, uint8x16_t b, uint8x16_t c) {
+        return vmaxq_u8(vminq_u8(a, b), vminq_u8(vmaxq_u8(a, b), c));
+    }
+
+    size_t MedianFilter::pad_plane(const uint8_t *src, size_t width, size_t height,
+                                   size_t stride, size_t radius, std::vector<uint8_t> &padded) {
+        size_t paddedStride = ((width + 2 * radius + 15) & ~static_cast<size_t>(15)) + 16;
+        padded.assign(paddedStride * (height + 2 * radius), 0);
+        for (size_t py = 0; py < height + 2 * radius; py++) {
+            size_t y = py < radius ? 0 : std::min(height - 1, py - radius);
+            const uint8_t *in = src + y * stride;
+            uint8_t *out = padded.data() + py * paddedStride;
+            memset(out, in[0], radius);
+            memcpy(out + radius, in, width);
+            memset(out + radius + width, in[width - 1], radius);
+        }
+        return paddedStride;
+    }
+
+    // Every column triple is sorted, then the median is the median of the largest low, the
+    // middle mid and the smallest high.
+    void MedianFilter::median_3x3_neon(const uint8_t *padded, size_t paddedStride, uint8_t *dst,
+                                       size_t width, size_t height, size_t stride) {
+        IP_TRACE_KERNEL("MedianFilter::median_3x3", height, height * (paddedStride + stride));
+        ThreadPool::for_each_rows(0, height, AutoTuner::default_threads(), 0,
+                                  [&](size_t yStart, size_t yEnd) -> void {
+            uint8_t tail[16];
+            for (size_t y = yStart; y < yEnd; y++) {
+                const uint8_t *rows[3] = {padded + y * paddedStride,
+                                          padded + (y + 1) * paddedStride,
+                                          padded + (y + 2) * paddedStride};
+                uint8_t *out = dst + y * stride;
+                for (size_t x = 0; x < width; x += 16) {
+                    uint8x16_t lo[3], mid[3], hi[3];
+                    for (int dx = 0; dx < 3; dx++) {
+                        uint8x16_t a = vld1q_u8(rows[0] + x + dx);
+                        uint8x16_t b = vld1q_u8(rows[1] + x + dx);
+                        uint8x16_t c = vld1q_u8(rows[2] + x + dx);
+                        sort2(a, b);
+                        sort2(b, c);
+                        sort2(a, b);
+                        lo[dx] = a;
+                        mid[dx] = b;
+                        hi[dx] = c;
+                    }
+                    uint8x16_t maxLo = vmaxq_u8(vmaxq_u8(lo[0], lo[1]), lo[2]);
+                    uint8x16_t minHi = vminq_u8(vminq_u8(hi[0], hi[1]), hi[2]);
+                    uint8x16_t medMid = median3(mid[0], mid[1], mid[2]);
+                    uint8x16_t m = median3(maxLo, medMid, minHi);
+                    if (x + 16 <= width) {
+                        vst1q_u8(out + x, m);
+                    } else {
+                        vst1q_u8(tail, m);
+                        memcpy(out + x, tail, width - x);
+                    }
+                }
+            }
+        });
+    }
+
+    void MedianFilter::median_5x5_neon(const uint8_t *padded, size_t paddedStride, uint8_t *dst,
+                                       size_t width, size_t height, size_t stride) {
+        IP_TRACE_KERNEL("MedianFilter::median_5x5", height, height * (paddedStride + stride));
+        static const std::vector<std::pair<uint8_t, uint8_t>> network = median_network(25);
+        ThreadPool::for_each_rows(0, height, AutoTuner::default_threads(), 0,
+                                  [&](size_t yStart, size_t yEnd) -> void {
+            uint8_t tail[16];
+            uint8x16_t v[25];
+            for (size_t y = yStart; y < yEnd; y++) {
+                uint8_t *out = dst + y * stride;
+                for (size_t x = 0; x < width; x += 16) {
+                    for (int dy = 0; dy < 5; dy++) {
+                        const uint8_t *row = padded + (y + dy) * paddedStride + x;
+                        for (int dx = 0; dx < 5; dx++) v[dy * 5 + dx] = vld1q_u8(row + dx);
+                    }
+                    for (const auto &p: network) sort2(v[p.first], v[p.second]);
+                    if (x + 16 <= width) {
+                        vst1q_u8(out + x, v[12]);
+                    } else {
+                        vst1q_u8(tail, v[12]);
+                        memcpy(out + x, tail, width - x);
+                    }
+                }
+            }
+        });
+    }
+
+    template<bool USE_NEON>
+    static inline void add_histogram(uint16_t *acc, const uint16_t *h, size_t bins) {
+        size_t i = 0;
+        if (USE_NEON) {
+            for (; i + 8 <= bins; i += 8) {
+                vst1q_u16(acc + i, vaddq_u16(vld1q_u16(acc + i), vld1q_u16(h + i)));
+            }
+        }
+        for (; i < bins; i++) acc[i] += h[i];
+    }
+
+    template<bool USE_NEON>
+    static inline void sub_histogram(uint16_t *acc, const uint16_t *h, size_t bins) {
+        size_t i = 0;
+        if (USE_NEON) {
+            for (; i + 8 <= bins; i += 8) {
+                vst1q_u16(acc + i, vsubq_u16(vld1q_u16(acc + i), vld1q_u16(h + i)));
+            }
+        }
+        for (; i < bins; i++) acc[i] -= h[i];
+    }
+
+    // Perreault & Hebert: one histogram per padded column covering the 2 radius + 1 rows of
+    // the window, moved down by one add and one remove per row. The window histogram slides
+    // right by adding the entering column and subtracting the leaving one. A 16 bin coarse
+    // level narrows the median search to one block of 16 fine bins.
+    template<bool USE_NEON>
+    void MedianFilter::median_histogram(const uint8_t *padded, size_t paddedStride, uint8_t *dst,
+                                        size_t width, size_t height, size_t stride,
+                                        size_t radius) {
+        IP_TRACE_KERNEL("MedianFilter::median_histogram", width, height * (paddedStride + stride));
+        const size_t window = 2 * radius + 1;
+        const uint16_t half = (uint16_t) (window * window / 2 + 1);
+        auto strip = [&](size_t xStart, size_t xEnd) -> void {
+            // padded columns [xStart, xEnd + 2 radius) feed the outputs [xStart, xEnd)
+            size_t columns = xEnd - xStart + 2 * radius;
+            std::vector<uint16_t> fine(columns * BINS, 0);
+            std::vector<uint16_t> coarse(columns * COARSE_BINS, 0);
+            uint16_t kernelFine[BINS];
+            uint16_t kernelCoarse[COARSE_BINS];
+            for (size_t py = 0; py < 2 * radius; py++) {
+                const uint8_t *row = padded + py * paddedStride + xStart;
+                for (size_t c = 0; c < columns; c++) {
+                    fine[c * BINS + row[c]]++;
+                    coarse[c * COARSE_BINS + (row[c] >> 4)]++;
+                }
+            }
+            for (size_t y = 0; y < height; y++) {
+                const uint8_t *enter = padded + (y + 2 * radius) * paddedStride + xStart;
+                if (y > 0) {
+                    const uint8_t *leave = padded + (y - 1) * paddedStride + xStart;
+                    for (size_t c = 0; c < columns; c++) {
+                        fine[c * BINS + leave[c]]--;
+                        coarse[c * COARSE_BINS + (leave[c] >> 4)]--;
+                    }
+                }
+                for (size_t c = 0; c < columns; c++) {
+                    fine[c * BINS + enter[c]]++;
+                    coarse[c * COARSE_BINS + (enter[c] >> 4)]++;
+                }
+                memset(kernelFine, 0, sizeof(kernelFine));
+                memset(kernelCoarse, 0, sizeof(kernelCoarse));
+                for (size_t c = 0; c < window; c++) {
+                    add_histogram<USE_NEON>(kernelFine, fine.data() + c * BINS, BINS);
+                    add_histogram<USE_NEON>(kernelCoarse, coarse.data() + c * COARSE_BINS,
+                                            COARSE_BINS);
+                }
+                uint8_t *out = dst + y * stride;
+                for (size_t x = xStart; x < xEnd; x++) {
+                    size_t c = x - xStart;
+                    uint16_t count = 0;
+                    int block = 0;
+                    while (count + kernelCoarse[block] < half) count += kernelCoarse[block++];
+                    int bin = block * 16;
+                    while (count + kernelFine[bin] < half) count += kernelFine[bin++];
+                    out[x] = (uint8_t) bin;
+                    if (x + 1 < xEnd) {
+                        add_histogram<USE_NEON>(kernelFine, fine.data() + (c + window) * BINS,
+                                                BINS);
+                        sub_histogram<USE_NEON>(kernelFine, fine.data() + c * BINS, BINS);
+                        add_histogram<USE_NEON>(kernelCoarse,
+                                                coarse.data() + (c + window) * COARSE_BINS,
+                                                COARSE_BINS);
+                        sub_histogram<USE_NEON>(kernelCoarse, coarse.data() + c * COARSE_BINS,
+                                                COARSE_BINS);
+                    }
+                }
+            }
+        };
+        if (USE_NEON) {
+            // every worker takes one strip of columns and keeps its histograms to itself. Each
+            // strip also builds the histograms of the 2 radius columns it shares with its
+            // neighbours, so batch strips stay at least 8 windows wide.
+            ThreadPool::for_each_rows(0, width, AutoTuner::default_threads(), 0, strip,
+                                      8 * window);
+        } else {
+            strip(0, width);
+        }
+    }
+
+    void MedianFilter::median_plane_neon(const uint8_t *src, uint8_t *dst, size_t width,
+                                         size_t height, size_t stride, int radius) {
+        if (width == 0 || height == 0) return;
+        auto r = (size_t) std::min(std::max(radius, 0), MAX_RADIUS);
+        if (r == 0) {
+            if (src != dst) {
+                for (size_t y = 0; y < height; y++) {
+                    memcpy(dst + y * stride, src + y * stride, width);
+                }
+            }
+            return;
+        }
+        std::vector<uint8_t> padded;
+        size_t paddedStride = pad_plane(src, width, height, stride, r, padded);
+        if (r == 1) {
+            median_3x3_neon(padded.data(), paddedStride, dst, width, height, stride);
+        } else if (r == 2) {
+            median_5x5_neon(padded.data(), paddedStride, dst, width, height, stride);
+        } else {
+            median_histogram<true>(padded.data(), paddedStride, dst, width, height, stride, r);
+        }
+    }
+
+    void MedianFilter::median_plane_scalar(const uint8_t *src, uint8_t *dst, size_t width,
+                                           size_t height, size_t stride, int radius) {
+        if (width == 0 || height == 0) return;
+        auto r = (size_t) std::min(std::max(radius, 0), MAX_RADIUS);
+        if (r == 0) {
+            if (src != dst) {
+                for (size_t y = 0; y < height; y++) {
+                    memcpy(dst + y * stride, src + y * stride, width);
+                }
+            }
+            return;
+        }
+        std::vector<uint8_t> padded;
+        size_t paddedStride = pad_plane(src, width, height, stride, r, padded);
+        if (r > 2) {
+            median_histogram<false>(padded.data(), paddedStride, dst, width, height, stride, r);
+            return;
+        }
+        size_t window = 2 * r + 1;
+        std::vector<uint8_t> values(window * window);
+        for (size_t y = 0; y < height; y++) {
+            for (size_t x = 0; x < width; x++) {
+                for (size_t dy = 0; dy < window; dy++) {
+                    memcpy(values.data() + dy * window,
+                           padded.data() + (y + dy) * paddedStride + x, window);
+                }
+                std::nth_element(values.begin(), values.begin() + values.size() / 2,
+                                 values.end());
+                dst[y * stride + x] = values[values.size() / 2];
+            }
+        }
+    }
+
+    void MedianFilter::median_planar_neon(const PlanarImage &src, PlanarImage &dst, int radius) {
+        dst.resize(src.width, src.height);
+        memcpy(dst.plane(PlanarImage::PLANE_A), src.plane(PlanarImage::PLANE_A),
+               src.stride * src.height);
+        for (int c = PlanarImage::PLANE_R; c <= PlanarImage::PLANE_B; c++) {
+            median_plane_neon(src.plane(c), dst.plane(c), src.width, src.height, src.stride,
+                              radius);
+        }
+    }
+
+    void MedianFilter::median_rgba(const uint8_t *src, uint8_t *dst, size_t width, size_t height,
+                                   size_t stride, int radius, bool useNeon) {
+        if (width == 0 || height == 0) return;
+        PlanarImage planes;
+        if (useNeon) {
+            PlanarImage filtered;
+            ImageProcessorSIMD::deinterleave_rgba_neon(src, width, height, stride, planes);
+            median_planar_neon(planes, filtered, radius);
+            ImageProcessorSIMD::interleave_rgba_neon(filtered, dst, stride);
+            return;
+        }
+        planes.resize(width, height);
+        for (size_t y = 0; y < height; y++) {
+            const uint8_t *row = src + y * stride;
+            for (size_t x = 0; x < width; x++) {
+                for (int c = 0; c < 3; c++) planes.row(c, y)[x] = row[x * 4 + c];
+            }
+        }
+        for (int c = PlanarImage::PLANE_R; c <= PlanarImage::PLANE_B; c++) {
+            median_plane_scalar(planes.plane(c), planes.plane(c), width, height, planes.stride,
+                                radius);
+        }
+        for (size_t y = 0; y < height; y++) {
+            const uint8_t *srcRow = src + y * stride;
+            uint8_t *row = dst + y * stride;
+            for (size_t x = 0; x < width; x++) {
+                for (int c = 0; c < 3; c++) row[x * 4 + c] = planes.row(c, y)[x];
+                row[x * 4 + 3] = srcRow[x * 4 + 3];
+            }
+        }
+    }
+}
@@ -0,0 +1,325 @@
+//
+// Erosion, dilation, opening and closing with rectangular structuring elements.
+//
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include "Morphology.h"
+#include "ImageProcessorSIMD.h"
+#include "LuminanceSIMD.h"
+#include "ThreadPool.h"
+#include "AutoTuner.h"
+
+namespace ip {
+    template<bool IS_MAX>
+    static inline uint8x16_t pick_neon(uint8x16_t a, uint8x16_t b) {
+        return IS_MAX ? vmaxq_u8(a, b) : vminq_u8(a, b);
+    }
+
+    template<bool IS_MAX>
+    static inline uint8_t pick_scalar(uint8_t a, uint8_t b) {
+        return IS_MAX ? std::max(a, b) : std::min(a, b);
+    }
+
+    // value that never wins the comparison, used for the padding outside the image
+    template<bool IS_MAX>
+    static inline uint8_t identity() {
+        return IS_MAX ? 0 : 255;
+    }
+
+    // van Herk / Gil-Werman along one line of n values, in[i * step]. The line is padded by
+    // radius on both ends and cut into blocks of the window size k; inside a block g holds the
+    // running value from the left and h from the right, so every window [i, i + k) is
+    // pick(h[i], g[i + k - 1]). g and h hold n + 2 radius values.
+    template<bool IS_MAX>
+    static void vhgw_line_scalar(const uint8_t *in, size_t inStep, uint8_t *out, size_t outStep,
+                                 size_t n, size_t radius, uint8_t *g, uint8_t *h) {
+        size_t k = 2 * radius + 1;
+        size_t total = n + 2 * radius;
+        auto padded = [&](size_t p) -> uint8_t {
+            return p >= radius && p < radius + n ? in[(p - radius) * inStep] : identity<IS_MAX>();
+        };
+        for (size_t p = 0; p < total; p++) {
+            uint8_t v = padded(p);
+            g[p] = p % k == 0 ? v : pick_scalar<IS_MAX>(g[p - 1], v);
+        }
+        for (size_t p = total; p-- > 0;) {
+            uint8_t v = padded(p);
+            h[p] = (p + 1) % k == 0 || p + 1 == total ? v : pick_scalar<IS_MAX>(h[p + 1], v);
+        }
+        for (size_t i = 0; i < n; i++) {
+            out[i * outStep] = pick_scalar<IS_MAX>(h[i], g[i + 2 * radius]);
+        }
+    }
+
+    // Same recurrence down 16 columns at once, rows are the line direction.
+    template<bool IS_MAX>
+    static void vhgw_columns_neon(const uint8_t *src, uint8_t *dst, size_t stride, size_t height,
+                                  size_t radius, uint8x16_t *g, uint8x16_t *h) {
+        size_t k = 2 * radius + 1;
+        size_t total = height + 2 * radius;
+        uint8x16_t pad = vdupq_n_u8(identity<IS_MAX>());
+        auto padded = [&](size_t p) -> uint8x16_t {
+            return p >= radius && p < radius + height ? vld1q_u8(src + (p - radius) * stride)
+                                                      : pad;
+        };
+        for (size_t p = 0; p < total; p++) {
+            uint8x16_t v = padded(p);
+            g[p] = p % k == 0 ? v : pick_neon<IS_MAX>(g[p - 1], v);
+        }
+        for (size_t p = total; p-- > 0;) {
+            uint8x16_t v = padded(p);
+            h[p] = (p + 1) % k == 0 || p + 1 == total ? v : pick_neon<IS_MAX>(h[p + 1], v);
+        }
+        for (size_t y = 0; y < height; y++) {
+            vst1q_u8(dst + y * stride, pick_neon<IS_MAX>(h[y], g[y + 2 * radius]));
+        }
+    }
+
+    // Vertical pass over a whole plane, the pool splits it into 16 column strips.
+    template<bool IS_MAX>
+    static void vertical_pass_neon(const uint8_t *src, uint8_t *dst, size_t width, size_t height,
+                                   size_t stride, size_t radius) {
+        IP_TRACE_KERNEL("Morphology::vertical_pass", height, 2 * height * stride);
+        if (radius == 0) {
+            if (src != dst) {
+                for (size_t y = 0; y < height; y++) {
+                    memcpy(dst + y * stride, src + y * stride, width);
+                }
+            }
+            return;
+        }
+        size_t vectors = width / 16;
+        size_t total = height + 2 * radius;
+        ThreadPool::for_each_rows(0, vectors + 1, AutoTuner::default_threads(), 0,
+                                  [&](size_t vStart, size_t vEnd) -> void {
+            std::vector<uint8x16_t> g(total);
+            std::vector<uint8x16_t> h(total);
+            for (size_t v = vStart; v < vEnd; v++) {
+                if (v < vectors) {
+                    vhgw_columns_neon<IS_MAX>(src + v * 16, dst + v * 16, stride, height, radius,
+                                              g.data(), h.data());
+                    continue;
+                }
+                // columns left over after the last full vector
+                auto *gs = reinterpret_cast<uint8_t *>(g.data());
+                auto *hs = reinterpret_cast<uint8_t *>(h.data());
+                for (size_t x = vectors * 16; x < width; x++) {
+                    vhgw_line_scalar<IS_MAX>(src + x, stride, dst + x, stride, height, radius,
+                                             gs, hs);
+                }
+            }
+        });
+    }
+
+    static inline void transpose_8x8_neon(const uint8_t *src, size_t srcStride, uint8_t *dst,
+                                          size_t dstStride) {
+        uint8x8x2_t t01 = vtrn_u8(vld1_u8(src), vld1_u8(src + srcStride));
+        uint8x8x2_t t23 = vtrn_u8(vld1_u8(src + 2 * srcStride), vld1_u8(src + 3 * srcStride));
+        uint8x8x2_t t45 = vtrn_u8(vld1_u8(src + 4 * srcStride), vld1_u8(src + 5 * srcStride));
+        uint8x8x2_t t67 = vtrn_u8(vld1_u8(src + 6 * srcStride), vld1_u8(src + 7 * srcStride));
+
+        uint16x4x2_t u02 = vtrn_u16(vreinterpret_u16_u8(t01.val[0]),
+                                    vreinterpret_u16_u8(t23.val[0]));
+        uint16x4x2_t u13 = vtrn_u16(vreinterpret_u16_u8(t01.val[1]),
+                                    vreinterpret_u16_u8(t23.val[1]));
+        uint16x4x2_t u46 = vtrn_u16(vreinterpret_u16_u8(t45.val[0]),
+                                    vreinterpret_u16_u8(t67.val[0]));
+        uint16x4x2_t u57 = vtrn_u16(vreinterpret_u16_u8(t45.val[1]),
+                                    vreinterpret_u16_u8(t67.val[1]));
+
+        uint32x2x2_t v04 = vtrn_u32(vreinterpret_u32_u16(u02.val[0]),
+                                    vreinterpret_u32_u16(u46.val[0]));
+        uint32x2x2_t v26 = vtrn_u32(vreinterpret_u32_u16(u02.val[1]),
+                                    vreinterpret_u32_u16(u46.val[1]));
+        uint32x2x2_t v15 = vtrn_u32(vreinterpret_u32_u16(u13.val[0]),
+                                    vreinterpret_u32_u16(u57.val[0]));
+        uint32x2x2_t v37 = vtrn_u32(vreinterpret_u32_u16(u13.val[1]),
+                                    vreinterpret_u32_u16(u57.val[1]));
+
+        vst1_u8(dst, vreinterpret_u8_u32(v04.val[0]));
+        vst1_u8(dst + dstStride, vreinterpret_u8_u32(v15.val[0]));
+        vst1_u8(dst + 2 * dstStride, vreinterpret_u8_u32(v26.val[0]));
+        vst1_u8(dst + 3 * dstStride, vreinterpret_u8_u32(v37.val[0]));
+        vst1_u8(dst + 4 * dstStride, vreinterpret_u8_u32(v04.val[1]));
+        vst1_u8(dst + 5 * dstStride, vreinterpret_u8_u32(v15.val[1]));
+        vst1_u8(dst + 6 * dstStride, vreinterpret_u8_u32(v26.val[1]));
+        vst1_u8(dst + 7 * dstStride, vreinterpret_u8_u32(v37.val[1]));
+    }
+
+    void Morphology::transpose_neon(const uint8_t *src, size_t width, size_t height,
+                                    size_t srcStride, uint8_t *dst, size_t dstStride) {
+        IP_TRACE_KERNEL("Morphology::transpose", height, height * srcStride + width * dstStride);
+        size_t fullX = width & ~static_cast<size_t>(7);
+        size_t tileRows = (height + 7) / 8;
+        ThreadPool::for_each_rows(0, tileRows, AutoTuner::default_threads(), 0,
+                                  [&](size_t tStart, size_t tEnd) -> void {
+            for (size_t t = tStart; t < tEnd; t++) {
+                size_t y = t * 8;
+                if (y + 8 <= height) {
+                    for (size_t x = 0; x < fullX; x += 8) {
+                        transpose_8x8_neon(src + y * srcStride + x, srcStride,
+                                           dst + x * dstStride + y, dstStride);
+                    }
+                } else {
+                    for (size_t yy = y; yy < height; yy++) {
+                        for (size_t x = 0; x < fullX; x++) {
+                            dst[x * dstStride + yy] = src[yy * srcStride + x];
+                        }
+                    }
+                }
+                for (size_t yy = y; yy < std::min(height, y + 8); yy++) {
+                    for (size_t x = fullX; x < width; x++) {
+                        dst[x * dstStride + yy] = src[yy * srcStride + x];
+                    }
+                }
+            }
+        });
+    }
+
+    // The vertical pass is the one that vectorises, so the horizontal pass runs as a vertical
+    // pass on the transposed plane.
+    template<bool IS_MAX>
+    void Morphology::separable_neon(const uint8_t *src, uint8_t *dst, size_t width,
+                                    size_t height, size_t stride, size_t radiusX,
+                                    size_t radiusY) {
+        vertical_pass_neon<IS_MAX>(src, dst, width, height, stride, radiusY);
+        if (radiusX == 0) return;
+        size_t transposedStride = (height + 15) & ~static_cast<size_t>(15);
+        std::vector<uint8_t> transposed(transposedStride * width);
+        transpose_neon(dst, width, height, stride, transposed.data(), transposedStride);
+        vertical_pass_neon<IS_MAX>(transposed.data(), transposed.data(), height, width,
+                                   transposedStride, radiusX);
+        transpose_neon(transposed.data(), height, width, transposedStride, dst, stride);
+    }
+
+    template<bool IS_MAX>
+    void Morphology::separable_scalar(const uint8_t *src, uint8_t *dst, size_t width,
+                                      size_t height, size_t stride, size_t radiusX,
+                                      size_t radiusY) {
+        std::vector<uint8_t> g(std::max(width + 2 * radiusX, height + 2 * radiusY));
+        std::vector<uint8_t> h(g.size());
+        std::vector<uint8_t> line(std::max(width, height));
+        for (size_t y = 0; y < height; y++) {
+            // the line copy makes the in place case safe
+            memcpy(line.data(), src + y * stride, width);
+            vhgw_line_scalar<IS_MAX>(line.data(), 1, dst + y * stride, 1, width, radiusX,
+                                     g.data(), h.data());
+        }
+        for (size_t x = 0; x < width; x++) {
+            for (size_t y = 0; y < height; y++) line[y] = dst[y * stride + x];
+            vhgw_line_scalar<IS_MAX>(line.data(), 1, dst + x, stride, height, radiusY, g.data(),
+                                     h.data());
+        }
+    }
+
+    void Morphology::apply_plane_neon(MorphOp op, const uint8_t *src, uint8_t *dst,
+                                      size_t width, size_t height, size_t stride, int radiusX,
+                                      int radiusY) {
+        auto rx = (size_t) std::max(0, radiusX);
+        auto ry = (size_t) std::max(0, radiusY);
+        switch (op) {
+            case MorphOp::ERODE:
+                separable_neon<false>(src, dst, width, height, stride, rx, ry);
+                break;
+            case MorphOp::DILATE:
+                separable_neon<true>(src, dst, width, height, stride, rx, ry);
+                break;
+            case MorphOp::OPEN:
+                separable_neon<false>(src, dst, width, height, stride, rx, ry);
+                separable_neon<true>(dst, dst, width, height, stride, rx, ry);
+                break;
+            case MorphOp::CLOSE:
+                separable_neon<true>(src, dst, width, height, stride, rx, ry);
+                separable_neon<false>(dst, dst, width, height, stride, rx, ry);
+                break;
+        }
+    }
+
+    void Morphology::apply_plane_scalar(MorphOp op, const uint8_t *src, uint8_t *dst,
+                                        size_t width, size_t height, size_t stride, int radiusX,
+                                        int radiusY) {
+        auto rx = (size_t) std::max(0, radiusX);
+        auto ry = (size_t) std::max(0, radiusY);
+        switch (op) {
+            case MorphOp::ERODE:
+                separable_scalar<false>(src, dst, width, height, stride, rx, ry);
+                break;
+            case MorphOp::DILATE:
+                separable_scalar<true>(src, dst, width, height, stride, rx, ry);
+                break;
+            case MorphOp::OPEN:
+                separable_scalar<false>(src, dst, width, height, stride, rx, ry);
+                separable_scalar<true>(dst, dst, width, height, stride, rx, ry);
+                break;
+            case MorphOp::CLOSE:
+                separable_scalar<true>(src, dst, width, height, stride, rx, ry);
+                separable_scalar<false>(dst, dst, width, height, stride, rx, ry);
+                break;
+        }
+    }
+
+    void Morphology::apply_rgba(MorphOp op, uint8_t *pixels, size_t width, size_t height,
+                                size_t stride, int radiusX, int radiusY, bool useNeon) {
+        if (width == 0 || height == 0) return;
+        PlanarImage planes;
+        if (useNeon) {
+            ImageProcessorSIMD::deinterleave_rgba_neon(pixels, width, height, stride, planes);
+        } else {
+            planes.resize(width, height);
+            for (size_t y = 0; y < height; y++) {
+                const uint8_t *row = pixels + y * stride;
+                for (size_t x = 0; x < width; x++) {
+                    for (int c = 0; c < 4; c++) planes.row(c, y)[x] = row[x * 4 + c];
+                }
+            }
+        }
+        for (int c = PlanarImage::PLANE_R; c <= PlanarImage::PLANE_B; c++) {
+            if (useNeon) {
+                apply_plane_neon(op, planes.plane(c), planes.plane(c), width, height,
+                                 planes.stride, radiusX, radiusY);
+            } else {
+                apply_plane_scalar(op, planes.plane(c), planes.plane(c), width, height,
+                                   planes.stride, radiusX, radiusY);
+            }
+        }
+        if (useNeon) {
+            ImageProcessorSIMD::interleave_rgba_neon(planes, pixels, stride);
+        } else {
+            for (size_t y = 0; y < height; y++) {
+                uint8_t *row = pixels + y * stride;
+                for (size_t x = 0; x < width; x++) {
+                    for (int c = 0; c < 3; c++) row[x * 4 + c] = planes.row(c, y)[x];
+                }
+            }
+        }
+    }
+
+    void Morphology::apply_luma_rgba(MorphOp op, uint8_t *pixels, size_t width, size_t height,
+                                     size_t stride, int radiusX, int radiusY, bool useNeon) {
+        if (width == 0 || height == 0) return;
+        size_t lumaStride = (width + 15) & ~static_cast<size_t>(15);
+        std::vector<uint8_t> luma(lumaStride * height);
+        if (useNeon) {
+            LuminanceSIMD::rgba_to_luma_neon(pixels, width, height, stride, luma.data(),
+                                             lumaStride);
+            apply_plane_neon(op, luma.data(), luma.data(), width, height, lumaStride, radiusX,
+                             radiusY);
+        } else {
+            LuminanceSIMD::rgba_to_luma_scalar(pixels, width, height, stride, luma.data(),
+                                               lumaStride);
+            apply_plane_scalar(op, luma.data(), luma.data(), width, height, lumaStride,
+                               radiusX, radiusY);
+        }
+        for (size_t y = 0; y < height; y++) {
+            uint8_t *row = pixels + y * stride;
+            if (useNeon) {
+                LuminanceSIMD::store_luma_row_rgba_neon(luma.data() + y * lumaStride, row, row,
+                                                        width);
+            } else {
+                LuminanceSIMD::store_luma_row_rgba_scalar(luma.data() + y * lumaStride, row,
+                                                          row, width);
+            }
+        }
+    }
+}
@@ -0,0 +1,79 @@
+//
+// Long lived processing session for the per frame path: the bitmap geometry, filter chain,
+// blur kernel, scratch planes and thread count are fixed once at creation.
+//
+#include <android/log.h>
+#include "NativeSession.h"
+#include "ImageProcessorSIMD.h"
+#include "Utility.h"
+#include "ThreadPool.h"
+#include "AutoTuner.h"
+
+#define LOG_TAG "core_native_image"
+#define LOG_ERROR(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+namespace ip {
+    NativeSession::NativeSession(const AndroidBitmapInfo &info, const FilterOp *ops,
+                                 size_t count, int radius, float sigma, bool useNeon)
+            : m_info(info), m_ops(ops, ops + count), m_radius(radius), m_sigma(sigma),
+              m_useNeon(useNeon) {
+        m_threads = AutoTuner::default_threads();
+        for (FilterOp op: m_ops) {
+            if (op == FilterOp::BLUR && radius >= 1) {
+                m_blurKernel = Utility::generate_gaussian_kernel_q8(radius, sigma);
+                break;
+            }
+        }
+        if (m_useNeon) {
+            m_current.resize(info.width, info.height);
+            m_next.resize(info.width, info.height);
+        }
+    }
+
+    NativeSession *NativeSession::create(const AndroidBitmapInfo &info, const FilterOp *ops,
+                                         size_t count, int radius, float sigma, bool useNeon) {
+        if (info.format != ANDROID_BITMAP_FORMAT_RGBA_8888) {
+            LOG_ERROR("Invalid bit map format");
+            return nullptr;
+        }
+        if (ops == nullptr || count == 0) {
+            LOG_ERROR("Empty filter chain");
+            return nullptr;
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (ops[i] < FilterOp::GRAY || ops[i] > FilterOp::MEDIAN) {
+                LOG_ERROR("Unknown filter %d in chain", static_cast<int>(ops[i]));
+                return nullptr;
+            }
+        }
+        bool neon = ImageProcessorSIMD::device_support_neon() && useNeon;
+        return new NativeSession(info, ops, count, radius, sigma, neon);
+    }
+
+    bool NativeSession::matches(const AndroidBitmapInfo &info) const {
+        return info.width == m_info.width && info.height == m_info.height &&
+               info.stride == m_info.stride && info.format == m_info.format;
+    }
+
+    void NativeSession::process(uint8_t *pixels) {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        ThreadCapScope cap{m_threads};
+        if (!m_useNeon) {
+            for (FilterOp op: m_ops) {
+                ImageProcessor::apply_filter_scalar(op, pixels, m_info, m_radius, m_sigma);
+            }
+            return;
+        }
+        ImageProcessorSIMD::deinterleave_rgba_neon(pixels, m_info.width, m_info.height,
+                                                   m_info.stride, m_current);
+        for (FilterOp op: m_ops) {
+            if (op == FilterOp::BLUR) {
+                ImageProcessorSIMD::blur_planar_neon(m_current, m_next, m_blurKernel, m_scratch);
+            } else {
+                ImageProcessor::apply_filter_planar(op, m_current, m_next, m_radius, m_sigma);
+            }
+            m_current.swap(m_next);
+        }
+        ImageProcessorSIMD::interleave_rgba_neon(m_current, pixels, m_info.stride);
+    }
+}
@@ -0,0 +1,176 @@
+//
+// Frame budget controller for the live preview, trades resolution, blur radius and threads
+// against a target frame time.
+//
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include "QualityController.h"
+#include "ImageProcessorSIMD.h"
+#include "ThreadPool.h"
+#include "AutoTuner.h"
+
+namespace ip {
+    // at half resolution the radius is halved as well, so the blur footprint stays comparable
+    static const QualityLevel LEVELS[] = {
+            {1.0f, 1.0f},
+            {1.0f, 0.66f},
+            {1.0f, 0.33f},
+            {0.5f, 0.5f},
+            {0.5f, 0.25f},
+            {0.5f, 0.0f},
+    };
+
+    static float elapsed_ms(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<float, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+    }
+
+    QualityController::QualityController(float targetFrameMs)
+            : m_targetMs(targetFrameMs) {
+        m_maxThreads = AutoTuner::default_threads();
+        m_threadCap = m_maxThreads;
+    }
+
+    int QualityController::level_count() {
+        return static_cast<int>(sizeof(LEVELS) / sizeof(LEVELS[0]));
+    }
+
+    void QualityController::set_target(float targetFrameMs) {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_targetMs = targetFrameMs;
+        m_overBudget = 0;
+        m_underBudget = 0;
+    }
+
+    void QualityController::record_stage(FrameStage stage, float ms) {
+        assert(static_cast<int>(stage) >= 0 && stage < FrameStage::COUNT &&
+               "record_stage needs a FrameStage below COUNT");
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_currentStages[static_cast<int>(stage)] += ms;
+    }
+
+    void QualityController::end_frame() {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        float frame = 0.0f;
+        for (int s = 0; s < static_cast<int>(FrameStage::COUNT); s++) {
+            float ms = m_currentStages[s];
+            frame += ms;
+            m_stageEma[s] = m_hasEma ? m_stageEma[s] + EMA_ALPHA * (ms - m_stageEma[s]) : ms;
+            m_currentStages[s] = 0.0f;
+        }
+        m_frameEma = m_hasEma ? m_frameEma + EMA_ALPHA * (frame - m_frameEma) : frame;
+        m_hasEma = true;
+        adapt();
+    }
+
+    void QualityController::adapt() {
+        if (m_cooldown > 0) {
+            m_cooldown--;
+            return;
+        }
+        if (m_frameEma > m_targetMs) {
+            m_overBudget++;
+            m_underBudget = 0;
+        } else if (m_frameEma < m_targetMs * UPGRADE_HEADROOM) {
+            m_underBudget++;
+            m_overBudget = 0;
+        } else {
+            // inside the dead band, nothing to do
+            m_overBudget = 0;
+            m_underBudget = 0;
+        }
+
+        if (m_overBudget >= DEGRADE_FRAMES) {
+            // threads given away to save power come back before the quality drops
+            if (m_threadCap < m_maxThreads) {
+                m_threadCap = m_maxThreads;
+            } else if (m_level < level_count() - 1) {
+                m_level++;
+            } else {
+                return;
+            }
+        } else if (m_underBudget >= UPGRADE_FRAMES) {
+            if (m_level > 0) {
+                m_level--;
+            } else if (m_frameEma < m_targetMs * THREAD_SAVING_HEADROOM && m_threadCap > 1) {
+                m_threadCap--;
+            } else {
+                return;
+            }
+        } else {
+            return;
+        }
+        m_overBudget = 0;
+        m_underBudget = 0;
+        m_cooldown = COOLDOWN_FRAMES;
+    }
+
+    bool QualityController::process_rgba_neon(uint8_t *pixels, size_t width, size_t height,
+                                              size_t stride, FilterOp op, int radius,
+                                              float sigma) {
+        QualityLevel q = quality();
+        int effectiveRadius = radius_for(radius);
+        float effectiveSigma = radius > 0 ? sigma * (float) effectiveRadius / (float) radius
+                                          : sigma;
+        ThreadCapScope cap{thread_cap()};
+
+        auto start = std::chrono::steady_clock::now();
+        ImageProcessorSIMD::deinterleave_rgba_neon(pixels, width, height, stride, m_full);
+        const PlanarImage *work = &m_full;
+        if (q.scale < 1.0f) {
+            ImageProcessorSIMD::downsample_2x_planar_neon(m_full, m_small);
+            work = &m_small;
+        }
+        record_stage(FrameStage::DOWNSAMPLE, elapsed_ms(start));
+
+        start = std::chrono::steady_clock::now();
+        bool valid = ImageProcessor::apply_filter_planar(op, *work, m_filtered, effectiveRadius,
+                                                         effectiveSigma);
+        record_stage(FrameStage::FILTER, elapsed_ms(start));
+
+        if (valid) {
+            start = std::chrono::steady_clock::now();
+            if (q.scale < 1.0f) {
+                ImageProcessorSIMD::upsample_2x_planar_neon(m_filtered, m_full, width, height);
+                ImageProcessorSIMD::interleave_rgba_neon(m_full, pixels, stride);
+            } else {
+                ImageProcessorSIMD::interleave_rgba_neon(m_filtered, pixels, stride);
+            }
+            record_stage(FrameStage::OUTPUT, elapsed_ms(start));
+        }
+        end_frame();
+        return valid;
+    }
+
+    int QualityController::level() const {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        return m_level;
+    }
+
+    QualityLevel QualityController::quality() const {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        return LEVELS[m_level];
+    }
+
+    int QualityController::radius_for(int requested) const {
+        QualityLevel q = quality();
+        return std::max(1, (int) std::lround((float) requested * q.radiusFactor));
+    }
+
+    uint32_t QualityController::thread_cap() const {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        return m_threadCap;
+    }
+
+    float QualityController::frame_time_ema() const {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        return m_frameEma;
+    }
+
+    float QualityController::stage_time_ema(FrameStage stage) const {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        return m_stageEma[static_cast<int>(stage)];
+    }
+}
@@ -0,0 +1,207 @@
+//
+// RGBA to 4:2:0 YUV (I420, NV12, NV21) for the video encoders.
+//
+#include <cmath>
+#include <algorithm>
+#include "RgbaToYuv.h"
+#include "ThreadPool.h"
+#include "AutoTuner.h"
+
+namespace ip {
+    YuvPlanes YuvPlanes::i420(uint8_t *y, size_t yStride, uint8_t *u, size_t uStride, uint8_t *v,
+                              size_t vStride) {
+        YuvPlanes planes;
+        planes.y = y;
+        planes.u = u;
+        planes.v = v;
+        planes.yStride = yStride;
+        planes.uStride = uStride;
+        planes.vStride = vStride;
+        planes.chromaPixelStride = 1;
+        return planes;
+    }
+
+    YuvPlanes YuvPlanes::nv12(uint8_t *y, size_t yStride, uint8_t *uv, size_t uvStride) {
+        YuvPlanes planes = i420(y, yStride, uv, uvStride, uv + 1, uvStride);
+        planes.chromaPixelStride = 2;
+        return planes;
+    }
+
+    YuvPlanes YuvPlanes::nv21(uint8_t *y, size_t yStride, uint8_t *vu, size_t vuStride) {
+        YuvPlanes planes = i420(y, yStride, vu + 1, vuStride, vu, vuStride);
+        planes.chromaPixelStride = 2;
+        return planes;
+    }
+
+    // The G weights absorb the rounding, so the Y weights keep their exact sum and the U / V
+    // weights sum to 0 (a gray pixel always gives 128).
+    YuvCoefficients YuvCoefficients::make(YuvMatrix matrix, YuvRange range) {
+        const double kr = matrix == YuvMatrix::BT709 ? 0.2126 : 0.299;
+        const double kb = matrix == YuvMatrix::BT709 ? 0.0722 : 0.114;
+        const bool full = range == YuvRange::FULL;
+        const double yScale = full ? 256.0 : 256.0 * 219.0 / 255.0;
+        const double cScale = full ? 128.0 : 128.0 * 224.0 / 255.0;
+        YuvCoefficients c{};
+        c.yR = (uint8_t) std::lround(kr * yScale);
+        c.yB = (uint8_t) std::lround(kb * yScale);
+        c.yG = (uint8_t) (std::lround(yScale) - c.yR - c.yB);
+        c.yBias = (uint16_t) ((full ? 0 : 16 << 8) + 128);
+        c.uB = (int16_t) std::lround(cScale);
+        c.uR = (int16_t) -std::lround(cScale * kr / (1.0 - kb));
+        c.uG = (int16_t) (-c.uB - c.uR);
+        c.vR = (int16_t) std::lround(cScale);
+        c.vB = (int16_t) -std::lround(cScale * kb / (1.0 - kr));
+        c.vG = (int16_t) (-c.vR - c.vB);
+        return c;
+    }
+
+    static inline uint8_t luma_of(const uint8_t *p, const YuvCoefficients &c) {
+        return (uint8_t) ((c.yR * p[0] + c.yG * p[1] + c.yB * p[2] + c.yBias) >> 8);
+    }
+
+    // rounding shift of the signed sum, saturated to a signed byte and moved to [0, 255]
+    static inline uint8_t chroma_of(int r, int g, int b, int16_t cr, int16_t cg, int16_t cb) {
+        int t = (cr * r + cg * g + cb * b + 128) >> 8;
+        return (uint8_t) (std::min(127, std::max(-128, t)) + 128);
+    }
+
+    static inline uint8x16_t luma_16(const uint8x16x4_t &p, const YuvCoefficients &c) {
+        const uint8x8_t cr = vdup_n_u8(c.yR);
+        const uint8x8_t cg = vdup_n_u8(c.yG);
+        const uint8x8_t cb = vdup_n_u8(c.yB);
+        const uint16x8_t bias = vdupq_n_u16(c.yBias);
+        // the weights sum to at most 256, so 255 * 256 + bias still fits 16 bits
+        uint16x8_t lo = vmlal_u8(vmull_u8(vget_low_u8(p.val[0]), cr), vget_low_u8(p.val[1]), cg);
+        lo = vaddq_u16(vmlal_u8(lo, vget_low_u8(p.val[2]), cb), bias);
+        uint16x8_t hi = vmlal_u8(vmull_u8(vget_high_u8(p.val[0]), cr), vget_high_u8(p.val[1]),
+                                 cg);
+        hi = vaddq_u16(vmlal_u8(hi, vget_high_u8(p.val[2]), cb), bias);
+        return vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8));
+    }
+
+    // |weights| are at most 128 per sign, so every partial sum of 8 bit means fits 16 bits
+    static inline uint8x8_t chroma_8(int16x8_t r, int16x8_t g, int16x8_t b, int16_t cr,
+                                     int16_t cg, int16_t cb) {
+        int16x8_t t = vmlaq_n_s16(vmlaq_n_s16(vmulq_n_s16(r, cr), g, cg), b, cb);
+        return veor_u8(vreinterpret_u8_s8(vqrshrn_n_s16(t, 8)), vdup_n_u8(0x80));
+    }
+
+    // rounded mean of the 2x2 blocks of one channel of the two rows
+    static inline int16x8_t mean_2x2(uint8x16_t top, uint8x16_t bottom) {
+        uint16x8_t sum = vaddq_u16(vpaddlq_u8(top), vpaddlq_u8(bottom));
+        return vreinterpretq_s16_u16(vrshrq_n_u16(sum, 2));
+    }
+
+    void RgbaToYuv::convert_row_pair_neon(const uint8_t *row0, const uint8_t *row1,
+                                          uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+                                          size_t chromaPixelStride, size_t width,
+                                          const YuvCoefficients &c) {
+        const bool interleavedUV = chromaPixelStride == 2 && v == u + 1;
+        const bool interleavedVU = chromaPixelStride == 2 && u == v + 1;
+        size_t x = 0;
+        for (; x + 16 <= width; x += 16) {
+            uint8x16x4_t p0 = vld4q_u8(row0 + x * 4);
+            uint8x16x4_t p1 = vld4q_u8(row1 + x * 4);
+            vst1q_u8(y0 + x, luma_16(p0, c));
+            if (y1 != nullptr) vst1q_u8(y1 + x, luma_16(p1, c));
+
+            int16x8_t r = mean_2x2(p0.val[0], p1.val[0]);
+            int16x8_t g = mean_2x2(p0.val[1], p1.val[1]);
+            int16x8_t b = mean_2x2(p0.val[2], p1.val[2]);
+            uint8x8_t cu = chroma_8(r, g, b, c.uR, c.uG, c.uB);
+            uint8x8_t cv = chroma_8(r, g, b, c.vR, c.vG, c.vB);
+            size_t cx = x >> 1;
+            if (chromaPixelStride == 1) {
+                vst1_u8(u + cx, cu);
+                vst1_u8(v + cx, cv);
+            } else if (interleavedUV) {
+                uint8x8x2_t uv = {cu, cv};
+                vst2_u8(u + cx * 2, uv);
+            } else if (interleavedVU) {
+                uint8x8x2_t vu = {cv, cu};
+                vst2_u8(v + cx * 2, vu);
+            } else {
+                uint8_t tu[8], tv[8];
+                vst1_u8(tu, cu);
+                vst1_u8(tv, cv);
+                for (int i = 0; i < 8; i++) {
+                    u[(cx + i) * chromaPixelStride] = tu[i];
+                    v[(cx + i) * chromaPixelStride] = tv[i];
+                }
+            }
+        }
+        if (x < width) {
+            convert_row_pair_scalar(row0, row1, y0, y1, u, v, chromaPixelStride, x, width, c);
+        }
+    }
+
+    void RgbaToYuv::convert_row_pair_scalar(const uint8_t *row0, const uint8_t *row1,
+                                            uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+                                            size_t chromaPixelStride, size_t xStart,
+                                            size_t width, const YuvCoefficients &c) {
+        for (size_t x = xStart; x < width; x += 2) {
+            // an odd width replicates the last column into the block
+            size_t x1 = std::min(x + 1, width - 1);
+            y0[x] = luma_of(row0 + x * 4, c);
+            if (x1 != x) y0[x1] = luma_of(row0 + x1 * 4, c);
+            if (y1 != nullptr) {
+                y1[x] = luma_of(row1 + x * 4, c);
+                if (x1 != x) y1[x1] = luma_of(row1 + x1 * 4, c);
+            }
+            int mean[3];
+            for (int ch = 0; ch < 3; ch++) {
+                int sum = row0[x * 4 + ch] + row0[x1 * 4 + ch] + row1[x * 4 + ch] +
+                          row1[x1 * 4 + ch];
+                mean[ch] = (sum + 2) >> 2;
+            }
+            size_t cx = (x >> 1) * chromaPixelStride;
+            u[cx] = chroma_of(mean[0], mean[1], mean[2], c.uR, c.uG, c.uB);
+            v[cx] = chroma_of(mean[0], mean[1], mean[2], c.vR, c.vG, c.vB);
+        }
+    }
+
+    static void convert(const uint8_t *rgba, size_t width, size_t height, size_t stride,
+                        const YuvPlanes &dst, YuvMatrix matrix, YuvRange range, bool useNeon) {
+        IP_TRACE_KERNEL("RgbaToYuv::convert", (height + 1) / 2,
+                        height * stride + width * height * 3 / 2);
+        if (width == 0 || height == 0) return;
+        const YuvCoefficients c = YuvCoefficients::make(matrix, range);
+        auto chroma_rows = [&](size_t cyStart, size_t cyEnd) -> void {
+            for (size_t cy = cyStart; cy < cyEnd; cy++) {
+                size_t y = cy * 2;
+                bool pair = y + 1 < height;
+                const uint8_t *row0 = rgba + y * stride;
+                const uint8_t *row1 = pair ? row0 + stride : row0;
+                uint8_t *y0 = dst.y + y * dst.yStride;
+                uint8_t *y1 = pair ? y0 + dst.yStride : nullptr;
+                uint8_t *u = dst.u + cy * dst.uStride;
+                uint8_t *v = dst.v + cy * dst.vStride;
+                if (useNeon) {
+                    RgbaToYuv::convert_row_pair_neon(row0, row1, y0, y1, u, v,
+                                                     dst.chromaPixelStride, width, c);
+                } else {
+                    RgbaToYuv::convert_row_pair_scalar(row0, row1, y0, y1, u, v,
+                                                       dst.chromaPixelStride, 0, width, c);
+                }
+            }
+        };
+        size_t chromaHeight = (height + 1) / 2;
+        if (useNeon) {
+            ThreadPool::for_each_rows(0, chromaHeight, AutoTuner::default_threads(), 0,
+                                      chroma_rows);
+        } else {
+            chroma_rows(0, chromaHeight);
+        }
+    }
+
+    void RgbaToYuv::convert_neon(const uint8_t *rgba, size_t width, size_t height, size_t stride,
+                                 const YuvPlanes &dst, YuvMatrix matrix, YuvRange range) {
+        convert(rgba, width, height, stride, dst, matrix, range, true);
+    }
+
+    void RgbaToYuv::convert_scalar(const uint8_t *rgba, size_t width, size_t height,
+                                   size_t stride, const YuvPlanes &dst, YuvMatrix matrix,
+                                   YuvRange range) {
+        convert(rgba, width, height, stride, dst, matrix, range, false);
+    }
+}
@@ -0,0 +1,26 @@
+//
+// Building blocks of the thread pool queue: a small buffer task object, a bounded lock free
+// multi producer / multi consumer ring and a futex based parking spot for idle workers.
+//
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "TaskQueue.h"
+
+namespace ip {
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+                  "the futex word must be a plain 32 bit integer");
+
+    void Parker::wait(uint32_t epoch) {
+        m_sleepers.fetch_add(1, std::memory_order_seq_cst);
+        // returns at once when a notify already moved the epoch past the one read
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(&m_epoch), FUTEX_WAIT_PRIVATE, epoch,
+                nullptr, nullptr, 0);
+        m_sleepers.fetch_sub(1, std::memory_order_seq_cst);
+    }
+
+    void Parker::wake(int count) {
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(&m_epoch), FUTEX_WAKE_PRIVATE, count,
+                nullptr, nullptr, 0);
+    }
+}
@@ -0,0 +1,167 @@
+//
+// Motion adaptive temporal denoise for camera preview frames, applied to the YUV 4:2:0 planes
+// before they are converted to RGBA.
+//
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <arm_neon.h>
+#include "TemporalDenoiser.h"
+#include "ThreadPool.h"
+#include "AutoTuner.h"
+
+namespace ip {
+    namespace {
+        // interleaved chroma rows are blended through a stack buffer of this many samples
+        constexpr size_t CHUNK = 256;
+
+        // (num + den / 2) / den per lane. Both operands are integers below 2^16 and therefore
+        // exact in float, so the truncated quotient matches the scalar integer division.
+        inline uint8x8_t divide_rounded_neon(uint16x8_t num, uint16x8_t den) {
+            uint16x8_t rounded = vaddq_u16(num, vshrq_n_u16(den, 1));
+            float32x4_t lo = vdivq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(rounded))),
+                                       vcvtq_f32_u32(vmovl_u16(vget_low_u16(den))));
+            float32x4_t hi = vdivq_f32(vcvtq_f32_u32(vmovl_high_u16(rounded)),
+                                       vcvtq_f32_u32(vmovl_high_u16(den)));
+            uint16x8_t quotient = vcombine_u16(vmovn_u32(vcvtq_u32_f32(lo)),
+                                               vmovn_u32(vcvtq_u32_f32(hi)));
+            return vqmovn_u16(quotient);
+        }
+    }
+
+    TemporalDenoiser::TemporalDenoiser(size_t width, size_t height, size_t frames,
+                                       uint32_t threshold)
+            : m_width(width), m_height(height) {
+        m_chromaWidth = (width + 1) / 2;
+        m_chromaHeight = (height + 1) / 2;
+        m_frameSize = width * height + 2 * m_chromaWidth * m_chromaHeight;
+        m_frames = std::min(std::max<size_t>(frames, 1), MAX_FRAMES);
+        m_threshold = static_cast<uint8_t>(std::min<uint32_t>(std::max<uint32_t>(threshold, 1),
+                                                              255));
+        // rounded up so a difference of 0 gets exactly WEIGHT_ONE, the product stays below
+        // 4096 + threshold and fits 16 bits
+        m_weightScale = static_cast<uint16_t>((WEIGHT_ONE * 256 + m_threshold - 1) /
+                                              m_threshold);
+        m_ring.resize(m_frames * m_frameSize);
+    }
+
+    void TemporalDenoiser::blend_row_neon(const uint8_t *current, const uint8_t *const *history,
+                                          size_t count, uint8_t *out, size_t width,
+                                          uint8_t threshold, uint16_t weightScale) {
+        uint8x16_t limit = vdupq_n_u8(threshold);
+        size_t x = 0;
+        for (; x + 16 <= width; x += 16) {
+            uint8x16_t cur = vld1q_u8(current + x);
+            // the current sample always counts with WEIGHT_ONE (Q4)
+            uint16x8_t numLo = vshll_n_u8(vget_low_u8(cur), 4);
+            uint16x8_t numHi = vshll_high_n_u8(cur, 4);
+            uint16x8_t denLo = vdupq_n_u16(WEIGHT_ONE);
+            uint16x8_t denHi = vdupq_n_u16(WEIGHT_ONE);
+            for (size_t i = 0; i < count; i++) {
+                uint8x16_t prev = vld1q_u8(history[i] + x);
+                // threshold - |prev - cur|, zero once the difference looks like motion
+                uint8x16_t closeness = vqsubq_u8(limit, vabdq_u8(prev, cur));
+                uint16x8_t weightLo = vshrq_n_u16(
+                        vmulq_n_u16(vmovl_u8(vget_low_u8(closeness)), weightScale), 8);
+                uint16x8_t weightHi = vshrq_n_u16(
+                        vmulq_n_u16(vmovl_high_u8(closeness), weightScale), 8);
+                numLo = vmlaq_u16(numLo, weightLo, vmovl_u8(vget_low_u8(prev)));
+                numHi = vmlaq_u16(numHi, weightHi, vmovl_high_u8(prev));
+                denLo = vaddq_u16(denLo, weightLo);
+                denHi = vaddq_u16(denHi, weightHi);
+            }
+            vst1q_u8(out + x, vcombine_u8(divide_rounded_neon(numLo, denLo),
+                                          divide_rounded_neon(numHi, denHi)));
+        }
+        blend_row_scalar(current, history, count, out, x, width, threshold, weightScale);
+    }
+
+    void TemporalDenoiser::blend_row_scalar(const uint8_t *current,
+                                            const uint8_t *const *history, size_t count,
+                                            uint8_t *out, size_t xStart, size_t width,
+                                            uint8_t threshold, uint16_t weightScale) {
+        for (size_t x = xStart; x < width; x++) {
+            uint32_t cur = current[x];
+            uint32_t num = cur * WEIGHT_ONE;
+            uint32_t den = WEIGHT_ONE;
+            for (size_t i = 0; i < count; i++) {
+                uint32_t prev = history[i][x];
+                uint32_t diff = (uint32_t) std::abs((int) prev - (int) cur);
+                uint32_t closeness = diff >= threshold ? 0 : threshold - diff;
+                uint32_t weight = (closeness * weightScale) >> 8;
+                num += weight * prev;
+                den += weight;
+            }
+            out[x] = static_cast<uint8_t>((num + den / 2) / den);
+        }
+    }
+
+    void TemporalDenoiser::denoise_row(uint8_t *pixels, size_t pixelStride, size_t planeOffset,
+                                       size_t planeWidth, size_t row, bool useNeon) {
+        size_t rowOffset = planeOffset + row * planeWidth;
+        uint8_t *current = m_ring.data() + m_head * m_frameSize + rowOffset;
+        if (pixelStride == 1) {
+            memcpy(current, pixels, planeWidth);
+        } else {
+            for (size_t x = 0; x < planeWidth; x++) current[x] = pixels[x * pixelStride];
+        }
+        size_t count = m_count - 1;
+        if (count == 0) return;
+
+        // newest first, the ring slot before the head is the previous frame
+        const uint8_t *history[MAX_FRAMES];
+        for (size_t i = 0; i < count; i++) {
+            size_t slot = (m_head + m_frames - 1 - i) % m_frames;
+            history[i] = m_ring.data() + slot * m_frameSize + rowOffset;
+        }
+        auto blend = [this, useNeon, count](const uint8_t *cur, const uint8_t *const *prev,
+                                            uint8_t *out, size_t width) -> void {
+            if (useNeon) {
+                blend_row_neon(cur, prev, count, out, width, m_threshold, m_weightScale);
+            } else {
+                blend_row_scalar(cur, prev, count, out, 0, width, m_threshold, m_weightScale);
+            }
+        };
+        if (pixelStride == 1) {
+            blend(current, history, pixels, planeWidth);
+            return;
+        }
+        uint8_t blended[CHUNK];
+        const uint8_t *chunk[MAX_FRAMES];
+        for (size_t x0 = 0; x0 < planeWidth; x0 += CHUNK) {
+            size_t width = std::min(CHUNK, planeWidth - x0);
+            for (size_t i = 0; i < count; i++) chunk[i] = history[i] + x0;
+            blend(current + x0, chunk, blended, width);
+            for (size_t x = 0; x < width; x++) pixels[(x0 + x) * pixelStride] = blended[x];
+        }
+    }
+
+    void TemporalDenoiser::denoise(uint8_t *yPixel, uint8_t *uPix, uint8_t *vPix,
+                                   size_t yStride, size_t uRowStride, size_t vRowStride,
+                                   size_t uPixelStride, size_t vPixelStride, bool useNeon) {
+        if (m_count < m_frames) m_count++;
+        IP_TRACE_KERNEL("TemporalDenoiser::denoise", m_height + m_chromaHeight,
+                        m_frameSize * (m_count + 1));
+        size_t uOffset = m_width * m_height;
+        size_t vOffset = uOffset + m_chromaWidth * m_chromaHeight;
+        uint32_t threads = AutoTuner::default_threads();
+
+        ThreadPool::for_each_rows(0, m_height, threads, 0,
+                                  [&](size_t yStart, size_t yEnd) -> void {
+            for (size_t y = yStart; y < yEnd; y++) {
+                denoise_row(yPixel + y * yStride, 1, 0, m_width, y, useNeon);
+            }
+        });
+        ThreadPool::for_each_rows(0, m_chromaHeight, threads, 0,
+                                  [&](size_t yStart, size_t yEnd) -> void {
+            for (size_t y = yStart; y < yEnd; y++) {
+                denoise_row(uPix + y * uRowStride, uPixelStride, uOffset, m_chromaWidth, y,
+                            useNeon);
+                denoise_row(vPix + y * vRowStride, vPixelStride, vOffset, m_chromaWidth, y,
+                            useNeon);
+            }
+        });
+        m_head = (m_head + 1) % m_frames;
+        m_framesProcessed++;
+    }
+}
@@ -1,52 +1,293 @@
 //
 // Created by ghima on 12-11-2025.
 //
+#include <android/log.h>
+#include <chrono>
+#include <sys/resource.h>
+#include <unistd.h>
 #include "ThreadPool.h"
 
+#define LOG_TAG "core_native_image"
+#define LOG_ERROR(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
 namespace ip {
-    ThreadPool::ThreadPool(uint32_t size) {
+    // nice values of Android's THREAD_PRIORITY_DISPLAY and THREAD_PRIORITY_BACKGROUND
+    constexpr int PREVIEW_NICE = -4;
+    constexpr int BATCH_NICE = 10;
+    // no nice value applied yet, the worker runs with the one it inherited
+    constexpr int INHERITED_NICE = INT32_MIN;
+
+    std::atomic<int> ThreadPool::s_affinityPolicy{static_cast<int>(AffinityPolicy::ALL_CORES)};
+    std::atomic<int> ThreadPool::s_laneNice[LANE_COUNT] = {{PREVIEW_NICE}, {BATCH_NICE}};
+    thread_local TaskPriority ThreadPool::t_priority = TaskPriority::PREVIEW;
+    thread_local int ThreadPool::t_nice = INHERITED_NICE;
+    thread_local float ThreadPool::t_workerSpeed = 1.0f;
+    thread_local uint32_t ThreadPool::t_threadCap = 0;
+    thread_local ThreadPool *ThreadPool::t_pool = nullptr;
+
+    namespace {
+        // waits at most this long before looking at the pool queue again
+        constexpr std::chrono::microseconds HELP_POLL{200};
+
+        std::mutex g_sharedMutex;
+        std::shared_ptr<ThreadPool> g_shared;
+        int g_sharedPolicy = -1;
+        // pools replaced after a policy change, destroyed once nobody uses them any more
+        std::vector<std::shared_ptr<ThreadPool>> g_retired;
+
+        std::atomic<bool> g_niceFailed{false};
+    }
+
+    ThreadPool::ThreadPool(uint32_t size, size_t queueCapacity)
+            : m_lanes{Lane(queueCapacity), Lane(queueCapacity)} {
+        static_assert(LANE_COUNT == 2, "every lane needs an initializer");
+        const CpuTopology &topology = CpuTopology::instance();
+        AffinityPolicy policy = affinity_policy();
+        std::vector<CpuCore> cores = topology.allowed_cores(policy);
+        // on equal cores the workers float within the allowed set, otherwise every worker is
+        // pinned to one core (fastest first) so its share can follow the core speed
+        bool perCore = topology.is_heterogeneous();
+        bool pinned = perCore || policy != AffinityPolicy::ALL_CORES;
+        std::vector<uint32_t> sharing(cores.size(), 0);
+        for (uint32_t i = 0; i < size; i++) sharing[i % cores.size()]++;
+
         for (int i = 0; i < size; i++) {
-            m_threads.emplace_back([this]() -> void {
-                while (true) {
-                    std::function<void()> task;
-                    {
-                        std::unique_lock<std::mutex> u_lock{mutex_};
-                        m_cv.wait(u_lock, [this]() -> bool {
-                            return m_stop || !this->m_tasks.empty();
-                        });
-                        if (m_tasks.empty() && m_stop) return;
-                        task = std::move(m_tasks.front());
-                        m_tasks.pop();
+            const CpuCore &core = cores[i % cores.size()];
+            float speed = perCore ? core.relativeSpeed / (float) sharing[i % cores.size()] : 1.0f;
+            add_speed(speed);
+            int cpu = core.id;
+            m_threads.emplace_back([this, pinned, perCore, cpu, speed, cores]() -> void {
+                float workerSpeed = speed;
+                if (pinned) {
+                    if (perCore) {
+                        // a worker that could not be pinned may run on any core, so it gets an
+                        // average share rather than the one of the core it was meant for
+                        if (!CpuTopology::pin_current_thread(cpu) && speed != 1.0f) {
+                            workerSpeed = 1.0f;
+                            add_speed(workerSpeed - speed);
+                        }
+                    } else {
+                        CpuTopology::pin_current_thread(cores);
                     }
-                    task();
-
                 }
+                t_workerSpeed = workerSpeed;
+                t_pool = this;
+                worker_loop();
             });
         }
     }
 
+    void ThreadPool::add_speed(float delta) {
+        float total = m_totalSpeed.load(std::memory_order_relaxed);
+        while (!m_totalSpeed.compare_exchange_weak(total, total + delta,
+                                                   std::memory_order_relaxed)) {}
+    }
 
-    ThreadPool::~ThreadPool() {
-        {
-            std::lock_guard<std::mutex> lock_{mutex_};
-            m_stop = true;
+    uint64_t ThreadPool::now_ns() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    void ThreadPool::apply_nice(int nice) {
+        if (t_nice == nice) return;
+        if (setpriority(PRIO_PROCESS, static_cast<id_t>(gettid()), nice) != 0) {
+            if (!g_niceFailed.exchange(true)) LOG_ERROR("Failed to set worker nice %d", nice);
+        }
+        // not retried on failure, the worker keeps whatever it has
+        t_nice = nice;
+    }
+
+    bool ThreadPool::try_pop(TaskPriority lowest, QueuedTask &queued, TaskPriority &lane) {
+        for (int l = 0; l <= static_cast<int>(lowest); l++) {
+            if (m_lanes[l].tasks.try_pop(queued)) {
+                lane = static_cast<TaskPriority>(l);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void ThreadPool::run_task(TaskPriority lane, QueuedTask &queued) {
+        Lane &stats = m_lanes[static_cast<int>(lane)];
+        stats.depth.fetch_sub(1, std::memory_order_relaxed);
+        uint64_t waitNs = now_ns() - queued.enqueuedNs;
+        stats.started.fetch_add(1, std::memory_order_relaxed);
+        stats.waitNs.fetch_add(waitNs, std::memory_order_relaxed);
+        uint64_t maxWait = stats.maxWaitNs.load(std::memory_order_relaxed);
+        while (waitNs > maxWait &&
+               !stats.maxWaitNs.compare_exchange_weak(maxWait, waitNs,
+                                                      std::memory_order_relaxed)) {
+        }
+
+        // nested tasks stay on the lane; only pool workers are reniced, never a caller thread
+        TaskPriority previous = t_priority;
+        bool worker = t_pool != nullptr;
+        t_priority = lane;
+        if (worker) apply_nice(s_laneNice[static_cast<int>(lane)].load());
+        queued.task();
+        queued.task.reset();
+        t_priority = previous;
+        if (worker && previous != lane) apply_nice(s_laneNice[static_cast<int>(previous)].load());
+        finish_task();
+    }
+
+    void ThreadPool::worker_loop() {
+        QueuedTask queued;
+        TaskPriority lane = TaskPriority::PREVIEW;
+        while (true) {
+            bool found = false;
+            for (int spin = 0, rounds = spin_rounds(); spin < rounds && !found; spin++) {
+                found = try_pop(TaskPriority::BATCH, queued, lane);
+                if (!found) cpu_relax();
+            }
+            if (!found) {
+                // a push after this read changes the epoch and cancels the wait below
+                uint32_t epoch = m_parker.prepare_wait();
+                found = try_pop(TaskPriority::BATCH, queued, lane);
+                if (!found) {
+                    if (m_stop.load(std::memory_order_acquire)) return;
+                    m_parker.wait(epoch);
+                    continue;
+                }
+            }
+            run_task(lane, queued);
         }
-        m_cv.notify_all();
+    }
+
+
+    ThreadPool::~ThreadPool() {
+        joinAll();
+    }
+
+    void ThreadPool::joinAll() {
+        m_stop.store(true, std::memory_order_release);
+        m_parker.notify_all();
 
         for (std::thread &thread: m_threads) {
             if (thread.joinable()) thread.join();
         }
     }
 
-    void ThreadPool::joinAll() {
+    void ThreadPool::finish_task() {
+        if (m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::lock_guard<std::mutex> lock{mutex_};
+            m_idleCv.notify_all();
+        }
+    }
+
+    bool ThreadPool::run_pending_task() {
+        QueuedTask queued;
+        TaskPriority lane;
+        if (!try_pop(t_priority, queued, lane)) return false;
+        run_task(lane, queued);
+        return true;
+    }
+
+    void ThreadPool::run_preview_tasks() {
+        QueuedTask queued;
+        TaskPriority lane;
+        while (try_pop(TaskPriority::PREVIEW, queued, lane)) run_task(lane, queued);
+    }
+
+    LaneStats ThreadPool::lane_stats(TaskPriority priority) const {
+        const Lane &lane = m_lanes[static_cast<int>(priority)];
+        LaneStats stats;
+        stats.depth = lane.depth.load(std::memory_order_relaxed);
+        stats.peakDepth = lane.peakDepth.load(std::memory_order_relaxed);
+        stats.tasks = lane.started.load(std::memory_order_relaxed);
+        if (stats.tasks > 0) {
+            stats.meanWaitUs = (double) lane.waitNs.load(std::memory_order_relaxed) /
+                               (double) stats.tasks / 1000.0;
+        }
+        stats.maxWaitUs = (double) lane.maxWaitNs.load(std::memory_order_relaxed) / 1000.0;
+        return stats;
+    }
+
+    void ThreadPool::reset_lane_stats() {
+        for (Lane &lane: m_lanes) {
+            lane.peakDepth.store(lane.depth.load(std::memory_order_relaxed),
+                                 std::memory_order_relaxed);
+            lane.started.store(0, std::memory_order_relaxed);
+            lane.waitNs.store(0, std::memory_order_relaxed);
+            lane.maxWaitNs.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void ThreadPool::wait_idle() {
+        std::unique_lock<std::mutex> lock{mutex_};
+        m_idleCv.wait(lock, [this]() -> bool {
+            return m_pending.load(std::memory_order_acquire) == 0;
+        });
+    }
+
+    std::shared_ptr<ThreadPool> ThreadPool::shared() {
+        std::vector<std::shared_ptr<ThreadPool>> released;
+        std::shared_ptr<ThreadPool> pool;
         {
-            std::lock_guard<std::mutex> lock_{mutex_};
-            m_stop = true;
+            std::lock_guard<std::mutex> lock{g_sharedMutex};
+            int policy = s_affinityPolicy.load();
+            if (g_shared == nullptr || g_sharedPolicy != policy) {
+                if (g_shared != nullptr) g_retired.push_back(std::move(g_shared));
+                auto size = static_cast<uint32_t>(
+                        CpuTopology::instance().allowed_cores(affinity_policy()).size());
+                size = std::max<uint32_t>(size, 1);
+                g_shared = std::make_shared<ThreadPool>(size);
+                g_sharedPolicy = policy;
+            }
+            // a pool cannot join its own workers, so one is only released from outside it
+            for (size_t i = 0; i < g_retired.size();) {
+                if (g_retired[i].use_count() == 1 && g_retired[i].get() != t_pool) {
+                    released.push_back(std::move(g_retired[i]));
+                    g_retired.erase(g_retired.begin() + i);
+                } else {
+                    i++;
+                }
+            }
+            pool = g_shared;
         }
-        m_cv.notify_all();
+        // the retired workers are joined here, outside the lock
+        released.clear();
+        return pool;
+    }
 
-        for (std::thread &thread: m_threads) {
-            if (thread.joinable()) thread.join();
+    void Latch::count_down(ptrdiff_t n) {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_count -= n;
+        if (m_count <= 0) m_cv.notify_all();
+    }
+
+    bool Latch::try_wait() {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        return m_count <= 0;
+    }
+
+    void Latch::wait() {
+        std::unique_lock<std::mutex> lock{m_mutex};
+        m_cv.wait(lock, [this]() -> bool { return m_count <= 0; });
+    }
+
+    void Latch::wait(ThreadPool &pool) {
+        while (!try_wait()) {
+            if (pool.run_pending_task()) continue;
+            std::unique_lock<std::mutex> lock{m_mutex};
+            m_cv.wait_for(lock, HELP_POLL, [this]() -> bool { return m_count <= 0; });
+        }
+    }
+
+    void TaskGroup::finish() {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        if (--m_pending == 0) m_cv.notify_all();
+    }
+
+    void TaskGroup::wait() {
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock{m_mutex};
+                if (m_pending == 0) return;
+            }
+            if (m_pool.run_pending_task()) continue;
+            std::unique_lock<std::mutex> lock{m_mutex};
+            m_cv.wait_for(lock, HELP_POLL, [this]() -> bool { return m_pending == 0; });
         }
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,122 @@
+//
+// Execution tracing of the kernels and the row slices the workers run, dumped as Chrome
+// trace event JSON that opens in Perfetto or chrome://tracing.
+//
+#include "Tracing.h"
+
+#ifdef IP_ENABLE_TRACING
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <unistd.h>
+
+namespace ip {
+    std::atomic<bool> Tracer::s_enabled{false};
+    thread_local const TraceLabel *TraceScope::t_current = nullptr;
+
+    namespace {
+        // every ring ever handed out; the pool workers live as long as their pool, but callers
+        // outside it (JNI and camera threads) come and go, so the ring of an exited thread
+        // goes back to the free list instead of growing the registry
+        std::mutex g_ringsMutex;
+        std::vector<std::unique_ptr<TraceRing>> g_rings;
+        std::vector<TraceRing *> g_freeRings;
+
+        struct RingOwner {
+            TraceRing *ring = nullptr;
+            uint32_t tid = 0;
+
+            TraceRing *acquire() {
+                if (ring != nullptr) return ring;
+                tid = static_cast<uint32_t>(gettid());
+                std::lock_guard<std::mutex> lock{g_ringsMutex};
+                if (!g_freeRings.empty()) {
+                    ring = g_freeRings.back();
+                    g_freeRings.pop_back();
+                } else {
+                    g_rings.emplace_back(new TraceRing());
+                    ring = g_rings.back().get();
+                }
+                return ring;
+            }
+
+            ~RingOwner() {
+                if (ring == nullptr) return;
+                std::lock_guard<std::mutex> lock{g_ringsMutex};
+                g_freeRings.push_back(ring);
+            }
+        };
+
+        thread_local RingOwner t_ring;
+
+        const auto g_epoch = std::chrono::steady_clock::now();
+    }
+
+    void TraceRing::snapshot(std::vector<TraceEvent> &out) const {
+        uint64_t head = m_head.load(std::memory_order_acquire);
+        uint64_t first = head > CAPACITY ? head - CAPACITY : 0;
+        size_t start = out.size();
+        for (uint64_t i = first; i < head; i++) {
+            out.push_back(m_events[i & (CAPACITY - 1)]);
+        }
+        // slots the writer reused while they were copied are dropped
+        uint64_t after = m_head.load(std::memory_order_acquire);
+        uint64_t valid = after > CAPACITY ? after - CAPACITY : 0;
+        if (valid > first) {
+            size_t stale = static_cast<size_t>(std::min(valid, head) - first);
+            out.erase(out.begin() + start, out.begin() + start + stale);
+        }
+    }
+
+    uint64_t Tracer::now_ns() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - g_epoch).count());
+    }
+
+    void Tracer::record(const TraceEvent &event) {
+        TraceRing *ring = t_ring.acquire();
+        TraceEvent stamped = event;
+        stamped.tid = t_ring.tid;
+        ring->push(stamped);
+    }
+
+    void Tracer::clear() {
+        std::lock_guard<std::mutex> lock{g_ringsMutex};
+        for (std::unique_ptr<TraceRing> &ring: g_rings) ring->clear();
+    }
+
+    bool Tracer::dump_chrome_json(const char *path) {
+        std::vector<TraceEvent> events;
+        {
+            std::lock_guard<std::mutex> lock{g_ringsMutex};
+            for (std::unique_ptr<TraceRing> &ring: g_rings) ring->snapshot(events);
+        }
+        std::sort(events.begin(), events.end(), [](const TraceEvent &a, const TraceEvent &b) {
+            return a.beginNs < b.beginNs;
+        });
+
+        FILE *file = fopen(path, "w");
+        if (file == nullptr) return false;
+        int pid = static_cast<int>(getpid());
+        fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+        for (size_t i = 0; i < events.size(); i++) {
+            const TraceEvent &e = events[i];
+            // complete ("X") events in microseconds; names are string literals of the kernels
+            fprintf(file,
+                    "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                    "\"pid\":%d,\"tid\":%" PRIu32 ",\"args\":{\"rowBegin\":%" PRIu32
+                    ",\"rowEnd\":%" PRIu32 ",\"bytes\":%" PRIu64 "}}",
+                    i == 0 ? "" : ",", e.name, e.depth == 0 ? "kernel" : "rows",
+                    (double) e.beginNs / 1000.0, (double) (e.endNs - e.beginNs) / 1000.0, pid,
+                    e.tid, e.rowBegin, e.rowEnd, e.bytes);
+        }
+        fprintf(file, "\n]}\n");
+        return fclose(file) == 0;
+    }
+}
+
+#endif
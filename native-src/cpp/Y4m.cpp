@@ -0,0 +1,135 @@
+//
+// YUV4MPEG2 streams of 4:2:0 frames, read from and written to a file or pipe.
+//
+#include <android/log.h>
+#include <cstdlib>
+#include <cstring>
+#include "Y4m.h"
+
+#define LOG_TAG "core_native_image"
+#define LOG_ERROR(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+namespace ip {
+    namespace {
+        constexpr const char *STREAM_MAGIC = "YUV4MPEG2";
+        constexpr const char *FRAME_MAGIC = "FRAME";
+        // headers are a handful of short tags, anything longer is not a Y4M stream
+        constexpr size_t MAX_HEADER = 4096;
+
+        bool read_line(FILE *file, std::string &line) {
+            line.clear();
+            int c;
+            while ((c = fgetc(file)) != EOF && c != '\n') {
+                if (line.size() >= MAX_HEADER) return false;
+                line.push_back(static_cast<char>(c));
+            }
+            return c == '\n';
+        }
+
+        // 0, which open() rejects, for a size that is malformed or above MAX_DIMENSION
+        uint32_t parse_dimension(const std::string &value) {
+            unsigned long size = strtoul(value.c_str(), nullptr, 10);
+            return size > Y4mHeader::MAX_DIMENSION ? 0 : static_cast<uint32_t>(size);
+        }
+
+        bool parse_ratio(const std::string &value, uint32_t &num, uint32_t &den) {
+            size_t colon = value.find(':');
+            if (colon == std::string::npos) return false;
+            num = static_cast<uint32_t>(strtoul(value.c_str(), nullptr, 10));
+            den = static_cast<uint32_t>(strtoul(value.c_str() + colon + 1, nullptr, 10));
+            return true;
+        }
+    }
+
+    bool Y4mHeader::is_supported_colorspace(const std::string &colorspace) {
+        // the bare prefix would also take 420p10 and other 16 bit sample streams
+        return colorspace == "420jpeg" || colorspace == "420" || colorspace == "420paldv" ||
+               colorspace == "420mpeg2";
+    }
+
+    bool Y4mReader::open(FILE *file) {
+        m_file = file;
+        m_header = Y4mHeader{};
+        std::string line;
+        if (!read_line(file, line) || line.compare(0, strlen(STREAM_MAGIC), STREAM_MAGIC) != 0) {
+            LOG_ERROR("Not a YUV4MPEG2 stream");
+            return false;
+        }
+        size_t pos = strlen(STREAM_MAGIC);
+        while (pos < line.size()) {
+            size_t end = line.find(' ', pos + 1);
+            if (end == std::string::npos) end = line.size();
+            std::string tag = line.substr(pos + 1, end - pos - 1);
+            pos = end;
+            if (tag.empty()) continue;
+            std::string value = tag.substr(1);
+            switch (tag[0]) {
+                case 'W':
+                    m_header.width = parse_dimension(value);
+                    break;
+                case 'H':
+                    m_header.height = parse_dimension(value);
+                    break;
+                case 'F':
+                    parse_ratio(value, m_header.fpsNum, m_header.fpsDen);
+                    break;
+                case 'I':
+                    m_header.interlace = value.empty() ? 'p' : value[0];
+                    break;
+                case 'A':
+                    parse_ratio(value, m_header.aspectNum, m_header.aspectDen);
+                    break;
+                case 'C':
+                    m_header.colorspace = value;
+                    break;
+                case 'X':
+                    m_header.extensions.push_back(value);
+                    break;
+                default:
+                    break;
+            }
+        }
+        if (m_header.width == 0 || m_header.height == 0) {
+            LOG_ERROR("Y4M stream without a frame size of 1 to %u", Y4mHeader::MAX_DIMENSION);
+            return false;
+        }
+        if (!Y4mHeader::is_supported_colorspace(m_header.colorspace)) {
+            LOG_ERROR("Unsupported Y4M colorspace %s, only 4:2:0 is", m_header.colorspace.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    bool Y4mReader::read_frame(uint8_t *planes) {
+        std::string line;
+        if (!read_line(m_file, line)) return false;
+        if (line.compare(0, strlen(FRAME_MAGIC), FRAME_MAGIC) != 0) {
+            LOG_ERROR("Corrupt Y4M frame header");
+            return false;
+        }
+        size_t size = m_header.frame_size();
+        if (fread(planes, 1, size, m_file) != size) {
+            LOG_ERROR("Truncated Y4M frame");
+            return false;
+        }
+        return true;
+    }
+
+    bool Y4mWriter::open(FILE *file, const Y4mHeader &header) {
+        m_file = file;
+        m_frameSize = header.frame_size();
+        int written = fprintf(file, "%s W%u H%u F%u:%u I%c A%u:%u C%s", STREAM_MAGIC,
+                              header.width, header.height, header.fpsNum, header.fpsDen,
+                              header.interlace, header.aspectNum, header.aspectDen,
+                              header.colorspace.c_str());
+        for (const std::string &extension: header.extensions) {
+            if (written >= 0) written = fprintf(file, " X%s", extension.c_str());
+        }
+        return written >= 0 && fputc('\n', file) != EOF;
+    }
+
+    bool Y4mWriter::write_frame(const uint8_t *planes) {
+        return fprintf(m_file, "%s\n", FRAME_MAGIC) >= 0 &&
+               fwrite(planes, 1, m_frameSize, m_file) == m_frameSize;
+    }
+}
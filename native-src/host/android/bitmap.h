@@ -0,0 +1,48 @@
+//
+// Stands in for the NDK bitmap header when the core is built for Linux (tools/). There are no
+// Java bitmaps off Android, so the JNI entry points fail and the tools call the pixel level
+// functions directly. jni.h comes from the JDK.
+//
+
+#ifndef OSFEATURENDKDEMO_HOST_ANDROID_BITMAP_H
+#define OSFEATURENDKDEMO_HOST_ANDROID_BITMAP_H
+
+#include <cstdint>
+#include <jni.h>
+
+enum AndroidBitmapFormat {
+    ANDROID_BITMAP_FORMAT_NONE = 0,
+    ANDROID_BITMAP_FORMAT_RGBA_8888 = 1,
+    ANDROID_BITMAP_FORMAT_RGB_565 = 4,
+    ANDROID_BITMAP_FORMAT_RGBA_4444 = 7,
+    ANDROID_BITMAP_FORMAT_A_8 = 8
+};
+
+enum {
+    ANDROID_BITMAP_RESULT_SUCCESS = 0,
+    ANDROID_BITMAP_RESULT_BAD_PARAMETER = -1,
+    ANDROID_BITMAP_RESULT_JNI_EXCEPTION = -2,
+    ANDROID_BITMAP_RESULT_ALLOCATION_FAILED = -3
+};
+
+struct AndroidBitmapInfo {
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    int32_t format;
+    uint32_t flags;
+};
+
+inline int AndroidBitmap_getInfo(JNIEnv *, jobject, AndroidBitmapInfo *) {
+    return ANDROID_BITMAP_RESULT_BAD_PARAMETER;
+}
+
+inline int AndroidBitmap_lockPixels(JNIEnv *, jobject, void **) {
+    return ANDROID_BITMAP_RESULT_BAD_PARAMETER;
+}
+
+inline int AndroidBitmap_unlockPixels(JNIEnv *, jobject) {
+    return ANDROID_BITMAP_RESULT_BAD_PARAMETER;
+}
+
+#endif //OSFEATURENDKDEMO_HOST_ANDROID_BITMAP_H
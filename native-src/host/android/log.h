@@ -0,0 +1,36 @@
+//
+// Stands in for the NDK log header when the core is built for Linux (tools/): messages go to
+// stderr.
+//
+
+#ifndef OSFEATURENDKDEMO_HOST_ANDROID_LOG_H
+#define OSFEATURENDKDEMO_HOST_ANDROID_LOG_H
+
+#include <cstdarg>
+#include <cstdio>
+
+enum android_LogPriority {
+    ANDROID_LOG_UNKNOWN = 0,
+    ANDROID_LOG_DEFAULT,
+    ANDROID_LOG_VERBOSE,
+    ANDROID_LOG_DEBUG,
+    ANDROID_LOG_INFO,
+    ANDROID_LOG_WARN,
+    ANDROID_LOG_ERROR,
+    ANDROID_LOG_FATAL,
+    ANDROID_LOG_SILENT
+};
+
+inline int __android_log_print(int prio, const char *tag, const char *fmt, ...) {
+    // the kernels log at info level on every call, the tools only want problems
+    if (prio < ANDROID_LOG_WARN) return 0;
+    va_list args;
+    va_start(args, fmt);
+    int written = fprintf(stderr, "%s: ", tag);
+    written += vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+    return written + 1;
+}
+
+#endif //OSFEATURENDKDEMO_HOST_ANDROID_LOG_H
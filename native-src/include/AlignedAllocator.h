@@ -0,0 +1,54 @@
+//
+// Cache line aligned storage for image rows.
+//
+
+#ifndef OSFEATURENDKDEMO_ALIGNEDALLOCATOR_H
+#define OSFEATURENDKDEMO_ALIGNEDALLOCATOR_H
+
+#include <cstdint>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace ip {
+    constexpr size_t CACHE_LINE = 64;
+
+    // rounds a row length in bytes up to whole cache lines
+    inline size_t align_up(size_t bytes, size_t alignment = CACHE_LINE) {
+        return (bytes + alignment - 1) & ~(alignment - 1);
+    }
+
+    // std::vector allocator whose blocks start on an ALIGNMENT boundary. With a row stride
+    // from align_up every row of the buffer starts on a cache line as well.
+    template<typename T, size_t ALIGNMENT = CACHE_LINE>
+    struct AlignedAllocator {
+        using value_type = T;
+
+        template<typename U>
+        struct rebind {
+            using other = AlignedAllocator<U, ALIGNMENT>;
+        };
+
+        AlignedAllocator() noexcept = default;
+
+        template<typename U>
+        AlignedAllocator(const AlignedAllocator<U, ALIGNMENT> &) noexcept {}
+
+        T *allocate(size_t n) {
+            return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(ALIGNMENT)));
+        }
+
+        void deallocate(T *p, size_t) noexcept {
+            ::operator delete(p, std::align_val_t(ALIGNMENT));
+        }
+
+        template<typename U>
+        bool operator==(const AlignedAllocator<U, ALIGNMENT> &) const noexcept { return true; }
+
+        template<typename U>
+        bool operator!=(const AlignedAllocator<U, ALIGNMENT> &) const noexcept { return false; }
+    };
+
+    using AlignedBytes = std::vector<uint8_t, AlignedAllocator<uint8_t>>;
+}
+#endif //OSFEATURENDKDEMO_ALIGNEDALLOCATOR_H
@@ -0,0 +1,37 @@
+//
+// Awaitable versions of the filters and the YUV conversion for host C++ callers. Every task
+// hops onto the shared worker pool before it touches the pixels, so a caller can keep many
+// images in flight with a few threads. The pixels must stay valid until the task completes.
+//
+
+#ifndef OSFEATURENDKDEMO_ASYNCPROCESSING_H
+#define OSFEATURENDKDEMO_ASYNCPROCESSING_H
+
+#include "AsyncTask.h"
+
+#ifdef IP_HAS_COROUTINES
+
+#include <cstdint>
+#include <vector>
+#include <android/bitmap.h>
+#include "ImageProcessor.h"
+#include "RgbaToYuv.h"
+
+namespace ip {
+    AsyncTask<bool> filter_async(FilterOp op, uint8_t *pixels, AndroidBitmapInfo info, int radius,
+                                 float sigma, bool isNeon,
+                                 TaskPriority priority = ThreadPool::thread_priority());
+
+    AsyncTask<bool> filter_chain_async(std::vector<FilterOp> ops, uint8_t *pixels,
+                                       AndroidBitmapInfo info, int radius, float sigma,
+                                       bool isNeon,
+                                       TaskPriority priority = ThreadPool::thread_priority());
+
+    // 4:2:0 planes as filled by the camera (chromaPixelStride 1 planar, 2 semi planar) to RGBA.
+    AsyncTask<void> convert_yuv_rgba_async(YuvPlanes src, uint8_t *dst, size_t width,
+                                           size_t height, size_t dstStride, bool isNeon,
+                                           TaskPriority priority = ThreadPool::thread_priority());
+}
+
+#endif
+#endif //OSFEATURENDKDEMO_ASYNCPROCESSING_H
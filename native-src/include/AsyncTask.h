@@ -0,0 +1,197 @@
+//
+// C++20 coroutine tasks on the native worker pool. A task is lazy: it starts when it is awaited
+// or handed to start / sync_wait, and `co_await resume_on(pool)` moves it onto a pool worker.
+// Only available when the library is compiled as C++20 (IP_HAS_COROUTINES).
+//
+
+#ifndef OSFEATURENDKDEMO_ASYNCTASK_H
+#define OSFEATURENDKDEMO_ASYNCTASK_H
+
+#if __cplusplus >= 202002L && __has_include(<coroutine>)
+#define IP_HAS_COROUTINES 1
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include "ThreadPool.h"
+
+namespace ip {
+    template<typename T = void>
+    class AsyncTask;
+
+    namespace detail {
+        struct PromiseBase {
+            // resumed when the task finishes, by symmetric transfer so deep chains of awaits
+            // do not grow the stack
+            std::coroutine_handle<> m_continuation = std::noop_coroutine();
+            std::exception_ptr m_error;
+
+            struct FinalAwaiter {
+                bool await_ready() const noexcept { return false; }
+
+                template<typename P>
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<P> handle) noexcept {
+                    return handle.promise().m_continuation;
+                }
+
+                void await_resume() const noexcept {}
+            };
+
+            std::suspend_always initial_suspend() const noexcept { return {}; }
+
+            FinalAwaiter final_suspend() const noexcept { return {}; }
+
+            void unhandled_exception() { m_error = std::current_exception(); }
+
+            void rethrow_error() const {
+                if (m_error) std::rethrow_exception(m_error);
+            }
+        };
+
+        template<typename T>
+        struct Promise : PromiseBase {
+            std::optional<T> m_value;
+
+            AsyncTask<T> get_return_object();
+
+            template<typename U>
+            void return_value(U &&value) { m_value.emplace(std::forward<U>(value)); }
+
+            T result() {
+                rethrow_error();
+                return std::move(*m_value);
+            }
+        };
+
+        template<>
+        struct Promise<void> : PromiseBase {
+            AsyncTask<void> get_return_object();
+
+            void return_void() const {}
+
+            void result() const { rethrow_error(); }
+        };
+
+        // Fire and forget driver of start(), its frame frees itself at the end.
+        struct Detached {
+            struct promise_type {
+                Detached get_return_object() const noexcept { return {}; }
+
+                std::suspend_never initial_suspend() const noexcept { return {}; }
+
+                std::suspend_never final_suspend() const noexcept { return {}; }
+
+                void return_void() const noexcept {}
+
+                void unhandled_exception() const noexcept { std::terminate(); }
+            };
+        };
+    }
+
+    template<typename T>
+    class AsyncTask {
+    public:
+        using promise_type = detail::Promise<T>;
+
+    private:
+        std::coroutine_handle<promise_type> m_handle;
+
+    public:
+        explicit AsyncTask(std::coroutine_handle<promise_type> handle) : m_handle(handle) {}
+
+        AsyncTask(AsyncTask &&other) noexcept : m_handle(std::exchange(other.m_handle, {})) {}
+
+        AsyncTask &operator=(AsyncTask &&other) noexcept {
+            if (this != &other) {
+                if (m_handle) m_handle.destroy();
+                m_handle = std::exchange(other.m_handle, {});
+            }
+            return *this;
+        }
+
+        AsyncTask(const AsyncTask &) = delete;
+
+        AsyncTask &operator=(const AsyncTask &) = delete;
+
+        ~AsyncTask() {
+            if (m_handle) m_handle.destroy();
+        }
+
+        bool await_ready() const noexcept { return false; }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+            m_handle.promise().m_continuation = caller;
+            return m_handle;
+        }
+
+        T await_resume() { return m_handle.promise().result(); }
+    };
+
+    namespace detail {
+        template<typename T>
+        AsyncTask<T> Promise<T>::get_return_object() {
+            return AsyncTask<T>{std::coroutine_handle<Promise<T>>::from_promise(*this)};
+        }
+
+        inline AsyncTask<void> Promise<void>::get_return_object() {
+            return AsyncTask<void>{std::coroutine_handle<Promise<void>>::from_promise(*this)};
+        }
+    }
+
+    // Awaitable that continues the coroutine on a worker of pool, queued on the given lane.
+    struct ResumeOn {
+        ThreadPool &pool;
+        TaskPriority priority;
+
+        bool await_ready() const noexcept { return false; }
+
+        void await_suspend(std::coroutine_handle<> handle) const {
+            pool.enqueue_task(priority, [handle]() -> void { handle.resume(); });
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    inline ResumeOn resume_on(ThreadPool &pool,
+                              TaskPriority priority = ThreadPool::thread_priority()) {
+        return ResumeOn{pool, priority};
+    }
+
+    // Runs task without a waiting caller and passes its result to done on the thread that
+    // finished it. The task must not throw.
+    template<typename T, typename F>
+    void start(AsyncTask<T> task, F done) {
+        [](AsyncTask<T> owned, F callback) -> detail::Detached {
+            if constexpr (std::is_void_v<T>) {
+                co_await owned;
+                callback();
+            } else {
+                callback(co_await owned);
+            }
+        }(std::move(task), std::move(done));
+    }
+
+    // Blocks the calling thread until task has finished. Not for pool workers: the worker
+    // would sit idle while the task waits for a free one.
+    template<typename T>
+    T sync_wait(AsyncTask<T> task) {
+        Latch finished{1};
+        if constexpr (std::is_void_v<T>) {
+            start(std::move(task), [&finished]() -> void { finished.count_down(); });
+            finished.wait();
+        } else {
+            std::optional<T> result;
+            start(std::move(task), [&finished, &result](T value) -> void {
+                result.emplace(std::move(value));
+                finished.count_down();
+            });
+            finished.wait();
+            return std::move(*result);
+        }
+    }
+}
+
+#endif
+#endif //OSFEATURENDKDEMO_ASYNCTASK_H
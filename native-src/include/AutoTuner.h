@@ -0,0 +1,77 @@
+//
+// Per device tuning of thread count, row grain and backend for the image kernels.
+//
+
+#ifndef OSFEATURENDKDEMO_AUTOTUNER_H
+#define OSFEATURENDKDEMO_AUTOTUNER_H
+
+#include <array>
+#include <mutex>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+namespace ip {
+    enum class TunedKernel : int {
+        GRAY = 0,
+        NEGATIVE,
+        BLUR,
+        SHARPEN,
+        EMBOSS,
+        SOBEL_EDGE,
+        YUV_RGBA,
+        COUNT
+    };
+
+    struct KernelPlan {
+        uint32_t threads = 0;   // 0 keeps the hardware_concurrency() default
+        uint32_t grainRows = 0; // 0 gives every thread one static slice
+        bool useSimd = true;
+    };
+
+    class AutoTuner {
+    private:
+        mutable std::mutex m_mutex;
+        std::array<KernelPlan, static_cast<size_t>(TunedKernel::COUNT)> m_plans{};
+        bool m_tuned = false;
+
+        AutoTuner() = default;
+
+        void set_plan(TunedKernel kernel, const KernelPlan &plan);
+
+        // best time in ms of `iterations` runs of the kernel on the synthetic frame
+        static double bench(TunedKernel kernel, bool simd, uint8_t *src, uint8_t *dst,
+                            size_t width, size_t height, size_t stride, int iterations);
+
+        static std::string profile_path(const std::string &directory);
+
+    public:
+        AutoTuner(const AutoTuner &) = delete;
+
+        AutoTuner &operator=(const AutoTuner &) = delete;
+
+        static AutoTuner &instance();
+
+        // Plan with the thread count resolved, ready for ThreadPool::for_each_rows.
+        KernelPlan plan(TunedKernel kernel) const;
+
+        static uint32_t default_threads();
+
+        // Identifies the SoC from /proc/cpuinfo, a profile only applies to the model it was
+        // measured on.
+        static std::string cpu_model();
+
+        // Micro benchmarks every kernel across thread counts, grain sizes and scalar vs NEON
+        // and keeps the fastest plan. Must not run concurrently with other image calls.
+        void calibrate(int iterations = 3);
+
+        bool load_profile(const std::string &directory);
+
+        bool save_profile(const std::string &directory) const;
+
+        void reset();
+
+        bool is_tuned() const;
+    };
+}
+#endif //OSFEATURENDKDEMO_AUTOTUNER_H
@@ -0,0 +1,72 @@
+//
+// Edge preserving smoothing with a bilateral grid (splat, blur, slice).
+//
+
+#ifndef OSFEATURENDKDEMO_BILATERALGRID_H
+#define OSFEATURENDKDEMO_BILATERALGRID_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <arm_neon.h>
+
+namespace ip {
+    // Cells of {R sum, G sum, B sum, weight}, indexed by (x, y, luminance). One cell spans
+    // sigmaSpatial pixels and sigmaRange luminance levels, with PADDING empty cells on every
+    // side so the blur and the trilinear slice never leave the grid. sigmaRange is clamped to
+    // [1, 255] and sigmaSpatial raised until the grid has at most MAX_CELLS cells.
+    struct GridShape {
+        static constexpr size_t PADDING = 2;
+        // 32 MB for each of the two float grids
+        static constexpr size_t MAX_CELLS = 1 << 21;
+
+        size_t width = 0;
+        size_t height = 0;
+        size_t depth = 0;
+        float invSpatial = 1.0f;
+        float invRange = 1.0f;
+
+        GridShape(size_t imageWidth, size_t imageHeight, float sigmaSpatial, float sigmaRange);
+
+        size_t cells() const { return width * height * depth; }
+
+        // offset of the first float of the cell
+        size_t index(size_t gx, size_t gy, size_t gz) const {
+            return ((gy * width + gx) * depth + gz) * 4;
+        }
+    };
+
+    class BilateralGrid {
+    public:
+        // sigmaSpatial in pixels, sigmaRange in luminance levels (0 - 255). The cost is linear
+        // in the pixel count, a larger sigmaSpatial only makes the grid smaller. Alpha is kept,
+        // src and dst may be the same image.
+        static void bilateral_rgba_neon(const uint8_t *src, uint8_t *dst, size_t width,
+                                        size_t height, size_t stride, float sigmaSpatial,
+                                        float sigmaRange);
+
+        static void bilateral_rgba_scalar(const uint8_t *src, uint8_t *dst, size_t width,
+                                          size_t height, size_t stride, float sigmaSpatial,
+                                          float sigmaRange);
+
+    private:
+        template<bool USE_NEON>
+        static void splat(const uint8_t *src, const uint8_t *luma, size_t width, size_t height,
+                          size_t stride, const GridShape &shape, float *grid);
+
+        // [1 4 6 4 1] / 16 along one axis (0 = luminance, 1 = x, 2 = y), a gaussian of one
+        // cell, which is the requested sigma at the grid's sampling rate.
+        template<bool USE_NEON>
+        static void blur_axis(const float *in, float *out, const GridShape &shape, int axis);
+
+        template<bool USE_NEON>
+        static void slice(const uint8_t *src, const uint8_t *luma, uint8_t *dst, size_t width,
+                          size_t height, size_t stride, const GridShape &shape,
+                          const float *grid);
+
+        template<bool USE_NEON>
+        static void run(const uint8_t *src, uint8_t *dst, size_t width, size_t height,
+                        size_t stride, float sigmaSpatial, float sigmaRange);
+    };
+}
+#endif //OSFEATURENDKDEMO_BILATERALGRID_H
@@ -0,0 +1,87 @@
+//
+// Border handling for the neighbourhood filters: halo padded row copies and whole vector
+// stores, so the edges run through the same NEON code as the interior.
+//
+
+#ifndef OSFEATURENDKDEMO_BORDER_H
+#define OSFEATURENDKDEMO_BORDER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <arm_neon.h>
+#include "AlignedAllocator.h"
+
+namespace ip {
+    enum class BorderMode : int {
+        CLAMP = 0,   // aaa|abcd|ddd
+        REFLECT = 1, // dcb|abcd|cba, the edge sample is not repeated
+        WRAP = 2,    // bcd|abcd|abc
+        CONSTANT = 3 // kkk|abcd|kkk
+    };
+
+    // Sample read for coordinate i of a line of n samples, -1 when the constant is used.
+    inline long border_index(long i, long n, BorderMode mode) {
+        if (i >= 0 && i < n) return i;
+        switch (mode) {
+            case BorderMode::CLAMP:
+                return i < 0 ? 0 : n - 1;
+            case BorderMode::REFLECT: {
+                if (n == 1) return 0;
+                long period = 2 * (n - 1);
+                long m = i % period;
+                if (m < 0) m += period;
+                return m < n ? m : period - m;
+            }
+            case BorderMode::WRAP: {
+                long m = i % n;
+                return m < 0 ? m + n : m;
+            }
+            default:
+                return -1;
+        }
+    }
+
+    // Padded copies of the rows [yBegin - halo, yEnd + halo) of an interleaved image, each
+    // with halo pixels on both sides. row(y) points at pixel 0 of image row y, so a kernel
+    // reads x - halo .. x + halo without any bounds check. Rows are at least minWidth pixels
+    // wide (the tail beyond the right halo is zero) and start on cache lines.
+    class HaloRows {
+    private:
+        AlignedBytes m_data{};
+        size_t m_rowBytes = 0;
+        size_t m_halo = 0;
+        size_t m_bytesPerPixel = 0;
+        long m_first = 0;
+
+    public:
+        void build(const uint8_t *src, size_t width, size_t height, size_t stride,
+                   size_t bytesPerPixel, long yBegin, long yEnd, size_t halo, BorderMode mode,
+                   uint8_t constant, size_t minWidth = 0);
+
+        const uint8_t *row(long y) const {
+            return m_data.data() + (y - m_first) * m_rowBytes + m_halo * m_bytesPerPixel;
+        }
+    };
+
+    // Stores a row of RGBA results 16 pixels at a time. The last vector is moved back to end
+    // exactly at width and overlaps the previous one, so there is no scalar tail; a row
+    // narrower than 16 pixels goes through a stack buffer. op(x) returns the pixels
+    // x .. x + 15 and may read up to 16 pixels from x, which HaloRows with minWidth 16
+    // guarantees.
+    template<typename VectorOp>
+    inline void store_row_rgba(uint8_t *dstRow, size_t width, VectorOp &&op) {
+        if (width < 16) {
+            uint8_t tmp[64];
+            vst4q_u8(tmp, op((size_t) 0));
+            memcpy(dstRow, tmp, width * 4);
+            return;
+        }
+        for (size_t x = 0;; x += 16) {
+            if (x + 16 > width) x = width - 16;
+            vst4q_u8(dstRow + x * 4, op(x));
+            if (x + 16 == width) break;
+        }
+    }
+}
+#endif //OSFEATURENDKDEMO_BORDER_H
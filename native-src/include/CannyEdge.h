@@ -0,0 +1,73 @@
+//
+// Canny edge detector on a single channel plane, built on the luminance sobel kernels.
+//
+
+#ifndef OSFEATURENDKDEMO_CANNYEDGE_H
+#define OSFEATURENDKDEMO_CANNYEDGE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <arm_neon.h>
+#include "LuminanceSIMD.h"
+
+namespace ip {
+    class CannyEdge {
+    public:
+        // values of the plane between non-maximum suppression and hysteresis
+        static constexpr uint8_t NOT_EDGE = 0;
+        static constexpr uint8_t WEAK_EDGE = 128;
+        static constexpr uint8_t STRONG_EDGE = 255;
+
+        // Writes 255 on edge pixels and 0 elsewhere to edges (width x height, edgesStride bytes
+        // per row). Thresholds apply to the 8 bit sobel magnitude. preBlur runs the 5x5
+        // binomial blur (sigma 1) first, leave it off for an already smoothed plane.
+        static void detect_plane_neon(const uint8_t *src, size_t width, size_t height,
+                                      size_t stride, uint8_t *edges, size_t edgesStride,
+                                      int lowThreshold, int highThreshold, bool preBlur = true,
+                                      GradientMagnitude mode =
+                                      GradientMagnitude::ALPHA_MAX_BETA_MIN);
+
+        static void detect_plane_scalar(const uint8_t *src, size_t width, size_t height,
+                                        size_t stride, uint8_t *edges, size_t edgesStride,
+                                        int lowThreshold, int highThreshold,
+                                        bool preBlur = true,
+                                        GradientMagnitude mode =
+                                        GradientMagnitude::ALPHA_MAX_BETA_MIN);
+
+        // Edges of the luminance written as white on black, alpha is kept.
+        static void detect_rgba(uint8_t *pixels, size_t width, size_t height, size_t stride,
+                                int lowThreshold, int highThreshold, bool useNeon);
+
+        // [1 4 6 4 1] x [1 4 6 4 1] / 256 with replicated borders, dst is width x height.
+        static void gaussian_5x5_neon(const uint8_t *src, size_t width, size_t height,
+                                      size_t stride, uint8_t *dst);
+
+        static void gaussian_5x5_scalar(const uint8_t *src, size_t width, size_t height,
+                                        size_t stride, uint8_t *dst);
+
+        // Keeps a pixel when its magnitude beats both neighbours along the gradient direction
+        // and classifies it against the thresholds. Outputs x in [1, width - 1).
+        static void non_max_suppression_row_neon(const uint8_t *top, const uint8_t *mid,
+                                                 const uint8_t *bottom, const uint8_t *direction,
+                                                 uint8_t *out, size_t width, uint8_t low,
+                                                 uint8_t high);
+
+        static void non_max_suppression_row_scalar(const uint8_t *top, const uint8_t *mid,
+                                                   const uint8_t *bottom,
+                                                   const uint8_t *direction, uint8_t *out,
+                                                   size_t width, uint8_t low, uint8_t high);
+
+        // Keeps the weak pixels 8-connected to a strong one. With parallel set, every strip of
+        // rows is labelled with union-find by its own worker and the strips are joined along
+        // their boundary rows afterwards. classes is width x height, edges receives 255 / 0.
+        static void hysteresis(const uint8_t *classes, size_t width, size_t height,
+                               uint8_t *edges, size_t edgesStride, bool parallel);
+
+    private:
+        template<bool USE_NEON>
+        static void detect(const uint8_t *src, size_t width, size_t height, size_t stride,
+                           uint8_t *edges, size_t edgesStride, int lowThreshold,
+                           int highThreshold, bool preBlur, GradientMagnitude mode);
+    };
+}
+#endif //OSFEATURENDKDEMO_CANNYEDGE_H
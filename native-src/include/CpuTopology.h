@@ -0,0 +1,56 @@
+//
+// CPU cores and their relative speed read from /sys/devices/system/cpu, used to place the
+// worker threads on big.LITTLE devices.
+//
+
+#ifndef OSFEATURENDKDEMO_CPUTOPOLOGY_H
+#define OSFEATURENDKDEMO_CPUTOPOLOGY_H
+
+#include <cstdint>
+#include <vector>
+
+namespace ip {
+    enum class AffinityPolicy : int {
+        ALL_CORES = 0,          // every core, workers are weighted by the speed of their core
+        PERFORMANCE_CORES = 1,  // skip the slowest cluster
+        RESERVE_CAMERA_CORE = 2 // all cores but one performance core kept for the camera thread
+    };
+
+    struct CpuCore {
+        int id = 0;
+        uint32_t maxFreqKhz = 0;
+        // maxFreqKhz relative to the fastest core, 1.0 when the frequency is unknown
+        float relativeSpeed = 1.0f;
+    };
+
+    class CpuTopology {
+    private:
+        std::vector<CpuCore> m_cores{};
+        int m_reservedCore = -1;
+
+        CpuTopology();
+
+        static std::vector<int> parse_cpu_list(const char *path);
+
+        static uint32_t read_max_freq(int cpu);
+
+    public:
+        static const CpuTopology &instance();
+
+        const std::vector<CpuCore> &cores() const { return m_cores; }
+
+        // true when the cores do not all run at the same maximum frequency
+        bool is_heterogeneous() const;
+
+        // Cores the workers may run on, fastest first.
+        std::vector<CpuCore> allowed_cores(AffinityPolicy policy) const;
+
+        // Performance core left free by RESERVE_CAMERA_CORE, -1 when there is only one core.
+        int reserved_core() const { return m_reservedCore; }
+
+        static bool pin_current_thread(int cpu);
+
+        static bool pin_current_thread(const std::vector<CpuCore> &cores);
+    };
+}
+#endif //OSFEATURENDKDEMO_CPUTOPOLOGY_H
@@ -0,0 +1,31 @@
+//
+// Measures task dispatch of the thread pool queue against the mutex queue it replaced.
+//
+
+#ifndef OSFEATURENDKDEMO_DISPATCHBENCHMARK_H
+#define OSFEATURENDKDEMO_DISPATCHBENCHMARK_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace ip {
+    struct DispatchResult {
+        uint32_t threads = 0;
+        // wall time per empty task with `threads` producers feeding `threads` workers
+        double lockedNsPerTask = 0.0;
+        double lockFreeNsPerTask = 0.0;
+        // mean time from the push of a task to its start on a worker
+        double lockedLatencyUs = 0.0;
+        double lockFreeLatencyUs = 0.0;
+    };
+
+    class DispatchBenchmark {
+    public:
+        // Runs `tasks` empty tasks through the std::mutex + std::function queue and through the
+        // lock free ring at 4, 8, 12 and 16 threads per side. Counts above the core count are
+        // oversubscribed on purpose, that is where the mutex queue degrades most.
+        static std::vector<DispatchResult> run(size_t tasks = 200000);
+    };
+}
+#endif //OSFEATURENDKDEMO_DISPATCHBENCHMARK_H
@@ -0,0 +1,151 @@
+//
+// Incremental processing for mostly static camera frames (tripod, document scanning).
+//
+
+#ifndef OSFEATURENDKDEMO_FRAMECHANGETRACKER_H
+#define OSFEATURENDKDEMO_FRAMECHANGETRACKER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include "AlignedAllocator.h"
+#include "Border.h"
+
+namespace ip {
+    struct FrameChangeStats {
+        uint64_t framesProcessed = 0;
+        uint64_t tilesTotal = 0;
+        uint64_t tilesSkipped = 0;
+        float lastSkippedFraction = 0.0f;
+
+        float skipped_fraction() const {
+            return tilesTotal == 0 ? 0.0f : (float) tilesSkipped / (float) tilesTotal;
+        }
+    };
+
+    class FrameChangeTracker {
+    private:
+        size_t m_width;
+        size_t m_height;
+        size_t m_tileWidth;
+        size_t m_tileHeight;
+        size_t m_tilesX;
+        size_t m_tilesY;
+        // mean absolute luma difference per pixel a tile must exceed to be treated as changed
+        uint32_t m_threshold;
+        bool m_hasReference = false;
+
+        // Y plane the cached output was produced from. Only dirty tiles are refreshed, so slow
+        // drift below the threshold keeps accumulating until the tile is finally re-converted.
+        std::vector<uint8_t> m_referenceY{};
+        std::vector<uint8_t> m_dirtyTiles{};
+        std::vector<uint8_t> m_dirtyRows{};
+        FrameChangeStats m_stats{};
+        // output rows filter_dirty_rows refreshes and the band it filters them in
+        std::vector<uint8_t> m_refilterRows{};
+        AlignedBytes m_band{};
+
+        static uint32_t
+        block_sad_neon(const uint8_t *a, size_t aStride, const uint8_t *b, size_t bStride,
+                       size_t width, size_t height);
+
+        static uint32_t
+        block_sad_scalar(const uint8_t *a, size_t aStride, const uint8_t *b, size_t bStride,
+                         size_t width, size_t height);
+
+        void finish_frame(size_t skippedTiles);
+
+        // marks the rows whose output reads a dirty row, returns how many there are
+        size_t mark_refilter_rows(size_t halo, BorderMode border);
+
+        // true when a marked row lies within halo rows of the top or bottom edge
+        bool touches_border_halo(size_t halo) const;
+
+        // copies the rows [first - halo, first + rows + halo) of src into m_band
+        uint8_t *build_band(const uint8_t *src, size_t stride, size_t first, size_t rows,
+                            size_t halo, BorderMode border, uint8_t constant);
+
+    public:
+        FrameChangeTracker(size_t width, size_t height, uint32_t threshold,
+                           size_t tileWidth = 64, size_t tileHeight = 16);
+
+        // Compares the incoming Y plane against the reference, converts only the tiles whose
+        // content changed and keeps the rest of dstRGBA as it was. dstRGBA must therefore be
+        // the same buffer on every call.
+        void convert_yuv_rgba_incremental(const uint8_t *yPixel, const uint8_t *uPix,
+                                          const uint8_t *vPix, uint8_t *dstRGBA,
+                                          size_t yStride, size_t yDstStride,
+                                          size_t uRowStride, size_t vRowStride,
+                                          size_t uPixelStride, size_t vPixelStride,
+                                          bool useNeon);
+
+        // Runs a full frame kernel (src, dst, width, rows, stride) only where the output can
+        // differ from the last call: the rows touched by the last conversion grown by halo,
+        // the number of rows above and below an output row the kernel reads. Every band is
+        // filtered from a copy with halo extra rows on both sides, filled by the border mode
+        // where they fall outside the image, and only its exact rows are written to dst, so
+        // the result matches a full frame pass for kernels that treat the border through that
+        // mode. A kernel that instead writes flat first and last rows (emboss, sobel) passes
+        // flatBorderRows: a band whose padding leaves the image would filter those rows like
+        // any other, so such a frame is filtered in full. Rows outside the bands keep the
+        // previous output in dst; src must be a different buffer and the kernel must also work
+        // in place.
+        template<typename Kernel>
+        void filter_dirty_rows(const uint8_t *src, uint8_t *dst, size_t stride, int halo,
+                               BorderMode border, uint8_t constant, bool flatBorderRows,
+                               Kernel &&kernel) {
+            if (halo < 0) halo = 0;
+            size_t marked = mark_refilter_rows((size_t) halo, border);
+            if (marked == 0) return;
+            if (flatBorderRows && touches_border_halo((size_t) halo)) marked = m_height;
+            if (marked == m_height) {
+                kernel(src, dst, m_width, m_height, stride);
+                return;
+            }
+            // gaps narrower than the two halos are cheaper to filter than to copy twice
+            size_t gap = 2 * (size_t) halo;
+            size_t y = 0;
+            while (y < m_height) {
+                if (!m_refilterRows[y]) {
+                    y++;
+                    continue;
+                }
+                size_t runStart = y;
+                size_t runEnd = y;
+                while (y < m_height) {
+                    if (m_refilterRows[y]) {
+                        runEnd = ++y;
+                    } else if (y - runEnd >= gap) {
+                        break;
+                    } else {
+                        y++;
+                    }
+                }
+                size_t rows = runEnd - runStart;
+                uint8_t *band = build_band(src, stride, runStart, rows, (size_t) halo, border,
+                                           constant);
+                kernel(band, band, m_width, rows + 2 * (size_t) halo, stride);
+                memcpy(dst + runStart * stride, band + (size_t) halo * stride, rows * stride);
+            }
+        }
+
+        // Forces the next frame to be fully converted, e.g. after the output buffer changed.
+        void invalidate() { m_hasReference = false; }
+
+        bool is_tile_dirty(size_t tileX, size_t tileY) const {
+            return m_dirtyTiles[tileY * m_tilesX + tileX] != 0;
+        }
+
+        size_t width() const { return m_width; }
+
+        size_t height() const { return m_height; }
+
+        size_t tiles_x() const { return m_tilesX; }
+
+        size_t tiles_y() const { return m_tilesY; }
+
+        const FrameChangeStats &stats() const { return m_stats; }
+    };
+}
+#endif //OSFEATURENDKDEMO_FRAMECHANGETRACKER_H
@@ -3,21 +3,127 @@
 
 #include <jni.h>
 #include <android/bitmap.h>
+#include "LuminanceSIMD.h"
+#include "AutoTuner.h"
+#include "PlanarImage.h"
+#include "ImageStats.h"
+#include "IntegralImage.h"
+#include "Morphology.h"
+#include "MedianFilter.h"
+#include "BilateralGrid.h"
+#include "CannyEdge.h"
+#include "RgbaToYuv.h"
+#include "Border.h"
 
 namespace ip {
+    // Same order as the kotlin PROCESS_TYPE enum, the ordinal is passed through JNI.
+    enum class FilterOp : int {
+        GRAY = 0,
+        NEGATIVE = 1,
+        BLUR = 2,
+        SHARPEN = 3,
+        EMBOSS = 4,
+        SOBEL_EDGE = 5,
+        MEDIAN = 6
+    };
+
     class ImageProcessor {
     public:
-        static bool GrayScale(JNIEnv *env, jobject bitmap);
+        static bool GrayScale(JNIEnv *env, jobject bitmap, bool isNeon);
+
+        static bool NegativeImage(JNIEnv *env, jobject bitmap, bool isNeon);
+
+        static bool BlurImage(JNIEnv *env, jobject bitmap, int radius, float sigma, bool isNeon,
+                              BorderMode border = BorderMode::CLAMP);
+
+        static bool SharpenImage(JNIEnv *env, jobject bitmap, bool isNeon,
+                                 BorderMode border = BorderMode::CLAMP);
+
+        static bool EmbrossImage(JNIEnv *env, jobject bitmap, bool isNeon);
+
+        static bool EdgeDetection(JNIEnv *env, jobject bitmap, bool isNeon,
+                                  GradientMagnitude mode = GradientMagnitude::ALPHA_MAX_BETA_MIN,
+                                  uint8_t *direction = nullptr);
+
+        // Salt and pepper / low light noise, radius is clamped to MedianFilter::MAX_RADIUS.
+        static bool MedianImage(JNIEnv *env, jobject bitmap, int radius, bool isNeon);
+
+        // Edge preserving smoothing, sigmaSpatial in pixels and sigmaRange in luminance levels.
+        static bool BilateralImage(JNIEnv *env, jobject bitmap, float sigmaSpatial,
+                                   float sigmaRange, bool isNeon);
+
+        // Thin connected edges of the luminance, white on black. Thresholds are sobel magnitudes.
+        static bool CannyEdges(JNIEnv *env, jobject bitmap, int lowThreshold, int highThreshold,
+                               bool isNeon);
+
+        // Writes the bitmap into caller owned 4:2:0 planes sized for the bitmap.
+        static bool ConvertToYuv(JNIEnv *env, jobject bitmap, const YuvPlanes &dst,
+                                 YuvMatrix matrix, YuvRange range, bool isNeon);
+
+        static bool Histogram(JNIEnv *env, jobject bitmap, ImageHistogram &out, bool isNeon);
+
+        // Per channel stretch, clipFraction of the pixels saturate at each end.
+        static bool AutoLevels(JNIEnv *env, jobject bitmap, float clipFraction, bool isNeon);
+
+        // Equalises the luma histogram, the same table is applied to R, G and B.
+        static bool EqualizeHistogram(JNIEnv *env, jobject bitmap, bool isNeon);
+
+        static bool Clahe(JNIEnv *env, jobject bitmap, int tilesX, int tilesY, float clipLimit,
+                          bool isNeon);
+
+        // Window filters on summed area tables, the cost per pixel does not depend on radius.
+        static bool BoxBlur(JNIEnv *env, jobject bitmap, int radius, bool isNeon);
+
+        static bool AdaptiveThreshold(JNIEnv *env, jobject bitmap, int radius, int offset,
+                                      bool isNeon);
+
+        static bool LocalContrast(JNIEnv *env, jobject bitmap, int radius, float strength,
+                                  bool isNeon);
+
+        // lumaOnly filters the luminance and writes gray, otherwise R, G and B are filtered.
+        static bool ApplyMorphology(JNIEnv *env, jobject bitmap, MorphOp op, int radiusX,
+                                    int radiusY, bool lumaOnly, bool isNeon);
+
+        // Runs several filters in a row on one bitmap. The NEON path converts to planar once,
+        // ping-pongs between two planar buffers and converts back after the last filter.
+        static bool ApplyFilterChain(JNIEnv *env, jobject bitmap, const FilterOp *ops,
+                                     size_t count, int radius, float sigma, bool isNeon);
 
-        static bool NegativeImage(JNIEnv *env, jobject bitmap);
+        // Reads srcBitmap and writes the chain into dstBitmap, which must have the same size
+        // and stride. The kernels write dst directly, no copy of the frame is made first.
+        static bool ApplyFilterChainTo(JNIEnv *env, jobject srcBitmap, jobject dstBitmap,
+                                       const FilterOp *ops, size_t count, int radius, float sigma,
+                                       bool isNeon);
 
-        static bool BlurImage(JNIEnv *env, jobject bitmap, int radius, float sigma);
+        // One filter from src into dst, both laid out as described by info (RGBA_8888). src
+        // may be dst, the stencils then filter into scratch and copy back.
+        static bool apply_filter(FilterOp op, const uint8_t *src, uint8_t *dst,
+                                 AndroidBitmapInfo &info, int radius, float sigma, bool isNeon);
 
-        static bool SharpenImage(JNIEnv *env, jobject bitmap);
+        // ApplyFilterChain on pixels the caller holds already (the async API, host code).
+        static bool apply_filter_chain(const uint8_t *src, uint8_t *dst, AndroidBitmapInfo &info,
+                                       const FilterOp *ops, size_t count, int radius, float sigma,
+                                       bool isNeon);
 
-        static bool EmbrossImage(JNIEnv *env, jobject bitmap);
+        static bool apply_filter_chain(uint8_t *pixels, AndroidBitmapInfo &info,
+                                       const FilterOp *ops, size_t count, int radius, float sigma,
+                                       bool isNeon) {
+            return apply_filter_chain(pixels, pixels, info, ops, count, radius, sigma, isNeon);
+        }
+
+        // Rows above and below an output row the filter reads, 0 for the per pixel ones.
+        static int filter_halo(FilterOp op, int radius);
+
+        // NEON or scalar YUV 4:2:0 to RGBA as picked by the tuned plan.
+        static void convert_yuv_rgba(const uint8_t *yPtr, const uint8_t *uPtr, const uint8_t *vPtr,
+                                     uint8_t *outrgba, size_t width, size_t height,
+                                     size_t yStride, size_t dstStride, size_t uRowStride,
+                                     size_t vRowStride, size_t uPixelStride, size_t vPixelStride,
+                                     bool isNeon);
 
-        static bool EdgeDetection(JNIEnv *env, jobject bitmap);
+        // One NEON filter on planar images, false for an unknown op.
+        static bool apply_filter_planar(FilterOp op, const PlanarImage &src, PlanarImage &dst,
+                                        int radius, float sigma);
 
         static void
         convert_yuv_rgba_scalar(const uint8_t *yPtr, const uint8_t *vPtr, const uint8_t *uPtr,
@@ -28,16 +134,61 @@ namespace ip {
                                 size_t uPixelStride, size_t vPixelStride, int xStart = 0);
 
     private:
-        static void gray_scale_scalar(void *pixelData, AndroidBitmapInfo &bitmapInfo);
+        // the tuner benchmarks the scalar paths against the NEON ones
+        friend class AutoTuner;
+
+        // sessions run the same scalar filters without the per call bitmap checks
+        friend class NativeSession;
+
+        // One step of a chain on the interleaved bitmap, false for an unknown op.
+        static bool apply_filter_scalar(FilterOp op, const void *src, void *dst,
+                                        AndroidBitmapInfo &info, int radius, float sigma);
+
+        static bool apply_filter_scalar(FilterOp op, void *pixelData, AndroidBitmapInfo &info,
+                                        int radius, float sigma) {
+            return apply_filter_scalar(op, pixelData, pixelData, info, radius, sigma);
+        }
+
+        // NEON is used when requested, supported and not beaten by scalar in the tuned plan
+        static bool use_neon(bool isNeon, TunedKernel kernel);
+
+        // The scalar filters read src and write dst. With a separate dst nothing else is
+        // allocated for the frame; src == dst works too, the stencils then copy once.
+        static void gray_scale_scalar(const void *src, void *dst, AndroidBitmapInfo &bitmapInfo);
+
+        static void negative_scalar(const void *src, void *dst, AndroidBitmapInfo &bitmapInfo);
 
-        static void negative_scalar(void *pixelData, AndroidBitmapInfo &bitmapInfo);
+        static void sharpen_scalar(const void *src, void *dst, AndroidBitmapInfo &bitmapInfo,
+                                   BorderMode border = BorderMode::CLAMP);
 
-        static void sharpen_scalar(void *pixels, AndroidBitmapInfo &bitmapInfo);
+        static void emboss_scalar(const void *src, void *dst, AndroidBitmapInfo &bitmapInfo);
 
-        static void emboss_scalar(void *pixels, AndroidBitmapInfo &bitmapInfo);
+        static void
+        gaussian_blur_scalar(const void *src, void *dst, AndroidBitmapInfo &bitmapInfo,
+                             int radius, float sigma, BorderMode border = BorderMode::CLAMP);
+
+        static void gray_scale_scalar(void *pixels, AndroidBitmapInfo &bitmapInfo) {
+            gray_scale_scalar(pixels, pixels, bitmapInfo);
+        }
+
+        static void negative_scalar(void *pixels, AndroidBitmapInfo &bitmapInfo) {
+            negative_scalar(pixels, pixels, bitmapInfo);
+        }
+
+        static void sharpen_scalar(void *pixels, AndroidBitmapInfo &bitmapInfo,
+                                   BorderMode border = BorderMode::CLAMP) {
+            sharpen_scalar(pixels, pixels, bitmapInfo, border);
+        }
+
+        static void emboss_scalar(void *pixels, AndroidBitmapInfo &bitmapInfo) {
+            emboss_scalar(pixels, pixels, bitmapInfo);
+        }
 
         static void
-        gaussian_blur_scalar(void *pixels, AndroidBitmapInfo &bitmapInfo, int radius, float sigma);
+        gaussian_blur_scalar(void *pixels, AndroidBitmapInfo &bitmapInfo, int radius, float sigma,
+                             BorderMode border = BorderMode::CLAMP) {
+            gaussian_blur_scalar(pixels, pixels, bitmapInfo, radius, sigma, border);
+        }
 
 
         static uint8_t clamp255(int v) {
@@ -6,36 +6,36 @@
 #define OSFEATURENDKDEMO_IMAGEPROCESSORSIMD_H
 
 #include <cstdint>
+#include <vector>
 #include <arm_neon.h>
+#include "PlanarImage.h"
+#include "Border.h"
+#include "LuminanceSIMD.h"
 
 namespace ip {
     class ImageProcessorSIMD {
     public:
         static bool device_support_neon();
 
-        static void gray_scale_neon_simd(uint8_t *src, uint8_t *dst, size_t pixels);
-
-        static void negative_neon_simd(uint8_t *src, uint8_t *dst, size_t pixels);
-
         static void
-        sharp_neon_simd(uint8_t *src, uint8_t *dst, size_t width, size_t height,
-                        size_t stride);
+        gray_scale_neon_simd(uint8_t *src, uint8_t *dst, size_t width, size_t height,
+                             size_t stride);
 
         static void
-        blur_neon_simd(uint8_t *src, uint8_t *dst, size_t width, size_t height, size_t stride,
-                       int radius, float sigma);
+        negative_neon_simd(uint8_t *src, uint8_t *dst, size_t width, size_t height,
+                           size_t stride);
 
+        // src and dst must not alias; every pixel is written, the rim reads through border
         static void
-        blur_neon_simd_float(uint8_t *src, uint8_t *dst, size_t width, size_t height, size_t stride,
-                             int radius, float sigma);
-
-        static void
-        edge_detection_simd_float(uint8_t *src, uint8_t *dst, size_t width, size_t height,
-                                  size_t stride);
+        sharp_neon_simd(uint8_t *src, uint8_t *dst, size_t width, size_t height,
+                        size_t stride, BorderMode border = BorderMode::CLAMP,
+                        uint8_t constant = 0);
 
+        // src and dst must not alias; every pixel is written, the rim reads through border
         static void
-        emboss_neon_simd_float(uint8_t *src, uint8_t *dst, size_t width, size_t height,
-                               size_t stride);
+        blur_neon_simd_float(uint8_t *src, uint8_t *dst, size_t width, size_t height, size_t stride,
+                             int radius, float sigma, BorderMode border = BorderMode::CLAMP,
+                             uint8_t constant = 0);
 
         static void
         convert_yuv_rgba_neon(uint8_t *yPixel, uint8_t *uPix,
@@ -46,6 +46,51 @@ namespace ip {
                               size_t vRowStride, size_t vPixelStride,
                               size_t uPixelStride);
 
+        // Converts the pixels [xStart, xEnd) of a single row, xStart must be even so the chroma
+        // samples stay aligned. width is the full row width and bounds the chroma reads.
+        static void
+        convert_yuv_rgba_row_neon(const uint8_t *yRow, const uint8_t *uRow,
+                                  const uint8_t *vRow, uint8_t *dstRow,
+                                  size_t xStart, size_t xEnd, size_t width,
+                                  size_t uPixelStride, size_t vPixelStride);
+
+        // Planar working format: a chain deinterleaves once, runs every filter on whole planes
+        // with plain vld1q / vst1q and interleaves back at the end.
+        static void
+        deinterleave_rgba_neon(const uint8_t *src, size_t width, size_t height, size_t stride,
+                               PlanarImage &dst);
+
+        static void interleave_rgba_neon(const PlanarImage &src, uint8_t *dst, size_t stride);
+
+        static void gray_scale_planar_neon(const PlanarImage &src, PlanarImage &dst);
+
+        static void negative_planar_neon(const PlanarImage &src, PlanarImage &dst);
+
+        static void sharp_planar_neon(const PlanarImage &src, PlanarImage &dst);
+
+        static void
+        blur_planar_neon(const PlanarImage &src, PlanarImage &dst, int radius, float sigma);
+
+        // Same blur with a kernel from Utility::generate_gaussian_kernel_q8 and a caller owned
+        // scratch image for the horizontal pass, so a repeated blur allocates nothing.
+        static void
+        blur_planar_neon(const PlanarImage &src, PlanarImage &dst,
+                         const std::vector<uint16_t> &kernel, PlanarImage &horizontal);
+
+        static void
+        edge_detection_planar_neon(const PlanarImage &src, PlanarImage &dst,
+                                   GradientMagnitude mode);
+
+        static void emboss_planar_neon(const PlanarImage &src, PlanarImage &dst);
+
+        // Half resolution copy, every output pixel is the rounded mean of a 2x2 block.
+        static void downsample_2x_planar_neon(const PlanarImage &src, PlanarImage &dst);
+
+        // Bilinear 2x upscale of src into a width x height image (the size before downsampling).
+        static void
+        upsample_2x_planar_neon(const PlanarImage &src, PlanarImage &dst, size_t width,
+                                size_t height);
+
         static uint8x8_t get_real_uv_pattern_for_stride_two(const uint8_t *src);
     };
 }
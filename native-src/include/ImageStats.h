@@ -0,0 +1,97 @@
+//
+// Histograms, statistics and the tone filters built on them (auto levels, equalisation, CLAHE).
+//
+
+#ifndef OSFEATURENDKDEMO_IMAGESTATS_H
+#define OSFEATURENDKDEMO_IMAGESTATS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <arm_neon.h>
+
+namespace ip {
+    struct ChannelStats {
+        uint8_t min = 0;
+        uint8_t max = 0;
+        double mean = 0.0;
+        double variance = 0.0;
+    };
+
+    struct ImageHistogram {
+        static constexpr int CH_R = 0;
+        static constexpr int CH_G = 1;
+        static constexpr int CH_B = 2;
+        static constexpr int CH_LUMA = 3;
+
+        uint32_t bins[4][256] = {};
+        ChannelStats stats[4] = {};
+        uint64_t pixels = 0;
+    };
+
+    class ImageStats {
+    public:
+        // Per channel and luma histograms of an RGBA image, stats are filled in as well.
+        // Every task counts into its own sub-histograms which are merged at the end.
+        static void histogram_rgba_neon(const uint8_t *src, size_t width, size_t height,
+                                        size_t stride, ImageHistogram &out);
+
+        static void histogram_rgba_scalar(const uint8_t *src, size_t width, size_t height,
+                                          size_t stride, ImageHistogram &out);
+
+        // Histogram of a single 8 bit plane (e.g. the camera Y plane). Counting is a scatter,
+        // so the fast path parallelises over rows with sub-histograms instead of using NEON.
+        static void histogram_plane_parallel(const uint8_t *plane, size_t width, size_t height,
+                                             size_t stride, uint32_t bins[256]);
+
+        static void histogram_plane_scalar(const uint8_t *plane, size_t width, size_t height,
+                                           size_t stride, uint32_t bins[256]);
+
+        static ChannelStats stats_from_histogram(const uint32_t bins[256]);
+
+        // Linear stretch of [low, high] to [0, 255], low / high cut clipFraction of the pixels
+        // off each end of the histogram.
+        static void
+        auto_levels_lut(const uint32_t bins[256], float clipFraction, uint8_t lut[256]);
+
+        // Maps the cumulative distribution to [0, 255].
+        static void equalize_lut(const uint32_t bins[256], uint8_t lut[256]);
+
+        // R, G and B go through their own 256 entry table, alpha is kept.
+        static void
+        apply_lut_rgba_neon(const uint8_t *src, uint8_t *dst, size_t width, size_t height,
+                            size_t stride, const uint8_t lutR[256], const uint8_t lutG[256],
+                            const uint8_t lutB[256]);
+
+        static void
+        apply_lut_rgba_scalar(const uint8_t *src, uint8_t *dst, size_t width, size_t height,
+                              size_t stride, const uint8_t lutR[256], const uint8_t lutG[256],
+                              const uint8_t lutB[256]);
+
+        static void
+        apply_lut_plane_neon(const uint8_t *src, uint8_t *dst, size_t width, size_t height,
+                             size_t stride, const uint8_t lut[256]);
+
+        static void
+        apply_lut_plane_scalar(const uint8_t *src, uint8_t *dst, size_t width, size_t height,
+                               size_t stride, const uint8_t lut[256]);
+
+        // Contrast limited adaptive equalisation of a luma plane in place. clipLimit is the
+        // allowed bin height as a multiple of the mean bin height.
+        static void clahe_plane(uint8_t *plane, size_t width, size_t height, size_t stride,
+                                int tilesX, int tilesY, float clipLimit);
+
+        // CLAHE on the luminance of an RGBA image, R, G and B are shifted by the luma change.
+        static void clahe_rgba(uint8_t *pixels, size_t width, size_t height, size_t stride,
+                               int tilesX, int tilesY, float clipLimit, bool useNeon);
+
+        // Adds after - before of every pixel's luma to its R, G and B, which keeps the hue of
+        // the pixel. before and after are luma planes with lumaStride bytes per row.
+        static void apply_luma_delta_rgba(uint8_t *pixels, size_t width, size_t height,
+                                          size_t stride, const uint8_t *before,
+                                          const uint8_t *after, size_t lumaStride, bool useNeon);
+
+    private:
+        static uint8x16_t lookup_neon(const uint8x16x4_t table[4], uint8x16_t index);
+    };
+}
+#endif //OSFEATURENDKDEMO_IMAGESTATS_H
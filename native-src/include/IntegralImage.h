@@ -0,0 +1,110 @@
+//
+// Summed area tables and the constant time window filters built on them.
+//
+
+#ifndef OSFEATURENDKDEMO_INTEGRALIMAGE_H
+#define OSFEATURENDKDEMO_INTEGRALIMAGE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <arm_neon.h>
+
+namespace ip {
+    // Row 0 and column 0 are zero, entry (y + 1, x + 1) holds the sum of the source over
+    // [0, x] x [0, y], interleaved per channel like the source.
+    template<typename T>
+    struct SummedAreaTable {
+        size_t width = 0;
+        size_t height = 0;
+        size_t channels = 1;
+        // elements per row, (width + 1) * channels
+        size_t stride = 0;
+        std::vector<T> data{};
+
+        void resize(size_t w, size_t h, size_t c) {
+            width = w;
+            height = h;
+            channels = c;
+            stride = (w + 1) * c;
+            data.resize(stride * (h + 1));
+        }
+
+        T *row(size_t y) { return data.data() + y * stride; }
+
+        const T *row(size_t y) const { return data.data() + y * stride; }
+
+        // Sum of channel c over [x0, x1) x [y0, y1). Unsigned wrap around cancels out, so a
+        // 32 bit table stays exact as long as the window sum itself fits.
+        T box_sum(size_t x0, size_t y0, size_t x1, size_t y1, size_t c = 0) const {
+            const T *top = row(y0);
+            const T *bottom = row(y1);
+            return bottom[x1 * channels + c] - bottom[x0 * channels + c] -
+                   top[x1 * channels + c] + top[x0 * channels + c];
+        }
+    };
+
+    // 8 bit windows up to 4096 x 4096 fit the 32 bit table, squared values need 64 bits.
+    using IntegralImage32 = SummedAreaTable<uint32_t>;
+    using IntegralImage64 = SummedAreaTable<uint64_t>;
+
+    class IntegralImage {
+    public:
+        // Tables are built in two passes: every row is prefix summed on its own (rows in
+        // parallel), then the rows are accumulated downwards (column strips in parallel).
+        static void build_plane_neon(const uint8_t *src, size_t width, size_t height,
+                                     size_t stride, IntegralImage32 &sum);
+
+        static void build_plane_neon(const uint8_t *src, size_t width, size_t height,
+                                     size_t stride, IntegralImage64 &sum);
+
+        static void build_plane_scalar(const uint8_t *src, size_t width, size_t height,
+                                       size_t stride, IntegralImage32 &sum);
+
+        static void build_plane_scalar(const uint8_t *src, size_t width, size_t height,
+                                       size_t stride, IntegralImage64 &sum);
+
+        // Table of the squared values, for local variance.
+        static void build_plane_squares_neon(const uint8_t *src, size_t width, size_t height,
+                                             size_t stride, IntegralImage64 &squares);
+
+        static void build_plane_squares_scalar(const uint8_t *src, size_t width, size_t height,
+                                               size_t stride, IntegralImage64 &squares);
+
+        // Four channel table of an RGBA image.
+        static void build_rgba_neon(const uint8_t *src, size_t width, size_t height,
+                                    size_t stride, IntegralImage32 &sum);
+
+        static void build_rgba_scalar(const uint8_t *src, size_t width, size_t height,
+                                      size_t stride, IntegralImage32 &sum);
+
+        // Mean of the (2 radius + 1)^2 window, clipped at the image border. The cost per pixel
+        // does not depend on the radius. Alpha is kept.
+        static void box_blur_rgba_neon(const uint8_t *src, uint8_t *dst, size_t width,
+                                       size_t height, size_t stride, int radius);
+
+        static void box_blur_rgba_scalar(const uint8_t *src, uint8_t *dst, size_t width,
+                                         size_t height, size_t stride, int radius);
+
+        // 255 where the pixel is brighter than the window mean minus offset, 0 otherwise.
+        static void adaptive_threshold_plane(const uint8_t *src, uint8_t *dst, size_t width,
+                                             size_t height, size_t stride, int radius,
+                                             int offset, bool useNeon);
+
+        // Binarises the luminance of an RGBA image, e.g. for document scans. Alpha is kept.
+        static void adaptive_threshold_rgba(uint8_t *pixels, size_t width, size_t height,
+                                            size_t stride, int radius, int offset, bool useNeon);
+
+        // Stretches the deviation from the window mean towards targetDeviation, strength in
+        // [0, 1] blends between the input and the fully normalised plane.
+        static void local_contrast_plane(const uint8_t *src, uint8_t *dst, size_t width,
+                                         size_t height, size_t stride, int radius,
+                                         float strength, float targetDeviation, bool useNeon);
+
+        // Local contrast on the luminance of an RGBA image, R, G and B follow the luma change.
+        static void local_contrast_rgba(uint8_t *pixels, size_t width, size_t height,
+                                        size_t stride, int radius, float strength,
+                                        bool useNeon);
+    };
+}
+#endif //OSFEATURENDKDEMO_INTEGRALIMAGE_H
@@ -0,0 +1,112 @@
+//
+// Single channel (luminance) filters working in 8/16 bit integer lanes.
+//
+
+#ifndef OSFEATURENDKDEMO_LUMINANCESIMD_H
+#define OSFEATURENDKDEMO_LUMINANCESIMD_H
+
+#include <cstdint>
+#include <cstddef>
+#include <arm_neon.h>
+
+namespace ip {
+    enum class GradientMagnitude : int {
+        L1 = 0,                 // |gx| + |gy|
+        ALPHA_MAX_BETA_MIN = 1, // max + 3/8 min, within ~7% of the exact value
+        EXACT = 2               // sqrt(gx^2 + gy^2)
+    };
+
+    // Quantised gradient direction written by the sobel kernels, one byte per pixel.
+    // The value tells along which neighbours the gradient runs (used for non-maximum suppression).
+    enum GradientDirection : uint8_t {
+        DIRECTION_0 = 0,   // left / right
+        DIRECTION_45 = 1,  // top-left / bottom-right
+        DIRECTION_90 = 2,  // top / bottom
+        DIRECTION_135 = 3  // top-right / bottom-left
+    };
+
+    class LuminanceSIMD {
+    public:
+        // (77 R + 150 G + 29 B + 128) >> 8, same weights the gray scale filter uses
+        static void rgba_to_luma_row_neon(const uint8_t *src, uint8_t *luma, size_t width);
+
+        static void rgba_to_luma_row_scalar(const uint8_t *src, uint8_t *luma, size_t width);
+
+        // Same weights on separate R, G and B planes (PlanarImage rows).
+        static void
+        planes_to_luma_row_neon(const uint8_t *r, const uint8_t *g, const uint8_t *b,
+                                uint8_t *luma, size_t width);
+
+        // Luminance plane of a whole RGBA image, one byte per pixel.
+        static void
+        rgba_to_luma_neon(const uint8_t *src, size_t width, size_t height, size_t stride,
+                          uint8_t *luma, size_t lumaStride);
+
+        static void
+        rgba_to_luma_scalar(const uint8_t *src, size_t width, size_t height, size_t stride,
+                            uint8_t *luma, size_t lumaStride);
+
+        // Expands a luma row back to RGBA (gray in R, G and B) keeping the source alpha.
+        static void
+        store_luma_row_rgba_neon(const uint8_t *luma, const uint8_t *srcRow, uint8_t *dstRow,
+                                 size_t width);
+
+        static void
+        store_luma_row_rgba_scalar(const uint8_t *luma, const uint8_t *srcRow, uint8_t *dstRow,
+                                   size_t width);
+
+        // Sobel on the luminance of an RGBA image using the separable [1 2 1] x [-1 0 1]
+        // passes in int16. The magnitude is written to R, G and B, alpha is kept.
+        // direction is optional (width x height bytes, directionStride bytes per row).
+        // The NEON variants are not in place safe, dst must not overlap src.
+        static void
+        sobel_luma_neon(const uint8_t *src, uint8_t *dst, size_t width, size_t height,
+                        size_t stride, GradientMagnitude mode, uint8_t *direction = nullptr,
+                        size_t directionStride = 0);
+
+        static void
+        sobel_luma_scalar(const uint8_t *src, uint8_t *dst, size_t width, size_t height,
+                          size_t stride, GradientMagnitude mode, uint8_t *direction = nullptr,
+                          size_t directionStride = 0);
+
+        // Emboss on the luminance of an RGBA image, gray is computed once per pixel and the
+        // 3x3 stencil runs on 8 bit rows widened to int16. dst must not overlap src.
+        static void
+        emboss_luma_neon(const uint8_t *src, uint8_t *dst, size_t width, size_t height,
+                         size_t stride);
+
+        // Emboss stencil on three luma rows, out is written for x in [1, width - 1).
+        static void
+        emboss_row_neon(const uint8_t *top, const uint8_t *mid, const uint8_t *bottom,
+                        uint8_t *out, size_t width);
+
+        static void
+        emboss_row_scalar(const uint8_t *top, const uint8_t *mid, const uint8_t *bottom,
+                          uint8_t *out, size_t width);
+
+        // Vertical part of the separable sobel: vs = top + 2 mid + bottom, vd = bottom - top.
+        static void
+        sobel_vertical_row_neon(const uint8_t *top, const uint8_t *mid, const uint8_t *bottom,
+                                int16_t *vs, int16_t *vd, size_t width);
+
+        static void
+        sobel_vertical_row_scalar(const uint8_t *top, const uint8_t *mid, const uint8_t *bottom,
+                                  int16_t *vs, int16_t *vd, size_t width);
+
+        // Horizontal part of the separable sobel for one row. vs holds top + 2 mid + bottom and
+        // vd holds bottom - top for every column, outputs are produced for x in [1, width - 1).
+        static void
+        sobel_row_neon(const int16_t *vs, const int16_t *vd, uint8_t *magnitude,
+                       uint8_t *direction, size_t width, GradientMagnitude mode);
+
+        static void
+        sobel_row_scalar(const int16_t *vs, const int16_t *vd, uint8_t *magnitude,
+                         uint8_t *direction, size_t width, GradientMagnitude mode);
+
+    private:
+        static uint8x8_t magnitude_neon(int16x8_t gx, int16x8_t gy, GradientMagnitude mode);
+
+        static uint8x8_t direction_neon(int16x8_t gx, int16x8_t gy);
+    };
+}
+#endif //OSFEATURENDKDEMO_LUMINANCESIMD_H
@@ -0,0 +1,58 @@
+//
+// Median filter, sorting networks for the small windows and Perreault's constant time
+// histogram method for the large ones.
+//
+
+#ifndef OSFEATURENDKDEMO_MEDIANFILTER_H
+#define OSFEATURENDKDEMO_MEDIANFILTER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <arm_neon.h>
+#include "PlanarImage.h"
+
+namespace ip {
+    class MedianFilter {
+    public:
+        // radius 127 keeps the window count inside the 16 bit histogram bins
+        static constexpr int MAX_RADIUS = 127;
+
+        // Median of the (2 radius + 1)^2 window, the border is replicated. Radius 1 and 2 run
+        // a sorting network on 16 pixels per vector, larger radii keep one histogram per column
+        // and slide a window histogram along the row, O(1) per pixel in the radius.
+        static void median_plane_neon(const uint8_t *src, uint8_t *dst, size_t width,
+                                      size_t height, size_t stride, int radius);
+
+        static void median_plane_scalar(const uint8_t *src, uint8_t *dst, size_t width,
+                                        size_t height, size_t stride, int radius);
+
+        // R, G and B are filtered separately, alpha is kept. src may be dst.
+        static void median_rgba(const uint8_t *src, uint8_t *dst, size_t width, size_t height,
+                                size_t stride, int radius, bool useNeon);
+
+        static void median_rgba(uint8_t *pixels, size_t width, size_t height, size_t stride,
+                                int radius, bool useNeon) {
+            median_rgba(pixels, pixels, width, height, stride, radius, useNeon);
+        }
+
+        static void median_planar_neon(const PlanarImage &src, PlanarImage &dst, int radius);
+
+    private:
+        // Copy of the plane with radius replicated pixels on every side, rows padded so the
+        // network loads of the last vector stay inside the buffer.
+        static size_t pad_plane(const uint8_t *src, size_t width, size_t height, size_t stride,
+                                size_t radius, std::vector<uint8_t> &padded);
+
+        static void median_3x3_neon(const uint8_t *padded, size_t paddedStride, uint8_t *dst,
+                                    size_t width, size_t height, size_t stride);
+
+        static void median_5x5_neon(const uint8_t *padded, size_t paddedStride, uint8_t *dst,
+                                    size_t width, size_t height, size_t stride);
+
+        template<bool USE_NEON>
+        static void median_histogram(const uint8_t *padded, size_t paddedStride, uint8_t *dst,
+                                     size_t width, size_t height, size_t stride, size_t radius);
+    };
+}
+#endif //OSFEATURENDKDEMO_MEDIANFILTER_H
@@ -0,0 +1,56 @@
+//
+// Erosion, dilation, opening and closing with rectangular structuring elements.
+//
+
+#ifndef OSFEATURENDKDEMO_MORPHOLOGY_H
+#define OSFEATURENDKDEMO_MORPHOLOGY_H
+
+#include <cstdint>
+#include <cstddef>
+#include <arm_neon.h>
+
+namespace ip {
+    enum class MorphOp : int {
+        ERODE = 0,  // window minimum
+        DILATE = 1, // window maximum
+        OPEN = 2,   // erode then dilate, removes bright specks
+        CLOSE = 3   // dilate then erode, fills dark holes
+    };
+
+    class Morphology {
+    public:
+        // (2 radiusX + 1) x (2 radiusY + 1) rectangle, pixels outside the image are ignored.
+        // van Herk / Gil-Werman running min / max, three comparisons per pixel and pass
+        // whatever the radius. src and dst may be the same plane.
+        static void apply_plane_neon(MorphOp op, const uint8_t *src, uint8_t *dst, size_t width,
+                                     size_t height, size_t stride, int radiusX, int radiusY);
+
+        static void apply_plane_scalar(MorphOp op, const uint8_t *src, uint8_t *dst,
+                                       size_t width, size_t height, size_t stride, int radiusX,
+                                       int radiusY);
+
+        // R, G and B are filtered as separate planes, alpha is kept.
+        static void apply_rgba(MorphOp op, uint8_t *pixels, size_t width, size_t height,
+                               size_t stride, int radiusX, int radiusY, bool useNeon);
+
+        // Filters the luminance and writes it back as gray, e.g. for scanned documents.
+        static void apply_luma_rgba(MorphOp op, uint8_t *pixels, size_t width, size_t height,
+                                    size_t stride, int radiusX, int radiusY, bool useNeon);
+
+        // 8 x 8 tiled transpose, dst has height columns and width rows.
+        static void transpose_neon(const uint8_t *src, size_t width, size_t height,
+                                   size_t srcStride, uint8_t *dst, size_t dstStride);
+
+    private:
+        template<bool IS_MAX>
+        static void separable_neon(const uint8_t *src, uint8_t *dst, size_t width,
+                                   size_t height, size_t stride, size_t radiusX,
+                                   size_t radiusY);
+
+        template<bool IS_MAX>
+        static void separable_scalar(const uint8_t *src, uint8_t *dst, size_t width,
+                                     size_t height, size_t stride, size_t radiusX,
+                                     size_t radiusY);
+    };
+}
+#endif //OSFEATURENDKDEMO_MORPHOLOGY_H
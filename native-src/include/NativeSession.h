@@ -0,0 +1,57 @@
+//
+// Long lived processing session for the per frame path: the bitmap geometry, filter chain,
+// blur kernel, scratch planes and thread count are fixed once at creation.
+//
+
+#ifndef OSFEATURENDKDEMO_NATIVESESSION_H
+#define OSFEATURENDKDEMO_NATIVESESSION_H
+
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+#include <android/bitmap.h>
+#include "ImageProcessor.h"
+#include "PlanarImage.h"
+
+namespace ip {
+    class NativeSession {
+    private:
+        AndroidBitmapInfo m_info;
+        std::vector<FilterOp> m_ops;
+        int m_radius;
+        float m_sigma;
+        bool m_useNeon;
+        uint32_t m_threads;
+        // q8 taps of every BLUR step, empty when the chain does not blur
+        std::vector<uint16_t> m_blurKernel;
+
+        // one frame at a time, the planes below are reused by every frame
+        std::mutex m_mutex;
+        PlanarImage m_current{};
+        PlanarImage m_next{};
+        PlanarImage m_scratch{};
+
+        NativeSession(const AndroidBitmapInfo &info, const FilterOp *ops, size_t count,
+                      int radius, float sigma, bool useNeon);
+
+    public:
+        // Validates the template bitmap (RGBA_8888) and the chain once, nullptr when either
+        // is invalid or the chain is empty. useNeon is combined with the device support here.
+        static NativeSession *create(const AndroidBitmapInfo &info, const FilterOp *ops,
+                                     size_t count, int radius, float sigma, bool useNeon);
+
+        // True when a bitmap has the width, height, stride and format of the template, the
+        // only layout process() accepts.
+        bool matches(const AndroidBitmapInfo &info) const;
+
+        // Runs the chain in place on pixels laid out like the template bitmap. Nothing is
+        // checked or allocated after the first frame.
+        void process(uint8_t *pixels);
+
+        size_t width() const { return m_info.width; }
+
+        size_t height() const { return m_info.height; }
+    };
+}
+#endif //OSFEATURENDKDEMO_NATIVESESSION_H
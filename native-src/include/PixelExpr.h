@@ -0,0 +1,326 @@
+//
+// Compile time composition of per pixel maps on RGBA, e.g. clamp(gray(pixel()) * 1.2f + 10).
+// A composed expression runs as one loop: one load and one store per pixel whatever its depth.
+//
+
+#ifndef OSFEATURENDKDEMO_PIXELEXPR_H
+#define OSFEATURENDKDEMO_PIXELEXPR_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+#include <arm_neon.h>
+#include "ThreadPool.h"
+
+namespace ip {
+    namespace expr {
+        // 16 pixels of R, G and B. Nodes whose result always fits a byte stay in U8Block, the
+        // others widen to saturating int16 lanes. Alpha never enters an expression.
+        struct U8Block {
+            uint8x16_t c[3];
+        };
+
+        struct S16Block {
+            int16x8_t lo[3];
+            int16x8_t hi[3];
+        };
+
+        // scalar value of a node, kept in the same range as the NEON lanes
+        struct Rgb {
+            int c[3];
+        };
+
+        inline int clamp_s16(int v) { return std::min(32767, std::max(-32768, v)); }
+
+        inline int clamp_u8(int v) { return std::min(255, std::max(0, v)); }
+
+        inline S16Block widen(const U8Block &b) {
+            S16Block out;
+            for (int c = 0; c < 3; c++) {
+                out.lo[c] = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(b.c[c])));
+                out.hi[c] = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(b.c[c])));
+            }
+            return out;
+        }
+
+        inline const S16Block &widen(const S16Block &b) { return b; }
+
+        inline U8Block saturate(const S16Block &b) {
+            U8Block out;
+            for (int c = 0; c < 3; c++) {
+                out.c[c] = vcombine_u8(vqmovun_s16(b.lo[c]), vqmovun_s16(b.hi[c]));
+            }
+            return out;
+        }
+
+        inline const U8Block &saturate(const U8Block &b) { return b; }
+
+        // Every node derives from Expr<Node> and provides
+        //   Block neon(const uint8x16x4_t &px) const   with Block U8Block or S16Block
+        //   Rgb scalar(const uint8_t *px) const
+        template<typename Node>
+        struct Expr {
+            const Node &self() const { return static_cast<const Node &>(*this); }
+        };
+
+        struct Source : Expr<Source> {
+            using Block = U8Block;
+
+            Block neon(const uint8x16x4_t &px) const { return {{px.val[0], px.val[1], px.val[2]}}; }
+
+            Rgb scalar(const uint8_t *px) const { return {{px[0], px[1], px[2]}}; }
+        };
+
+        // (77 R + 150 G + 29 B + 128) >> 8 on all three channels, the input is clamped first
+        template<typename E>
+        struct Gray : Expr<Gray<E>> {
+            using Block = U8Block;
+            E e;
+
+            explicit Gray(const E &e) : e(e) {}
+
+            Block neon(const uint8x16x4_t &px) const {
+                U8Block in = saturate(e.neon(px));
+                uint16x8_t lo = vmull_u8(vget_low_u8(in.c[0]), vdup_n_u8(77));
+                lo = vmlal_u8(lo, vget_low_u8(in.c[1]), vdup_n_u8(150));
+                lo = vmlal_u8(lo, vget_low_u8(in.c[2]), vdup_n_u8(29));
+                uint16x8_t hi = vmull_u8(vget_high_u8(in.c[0]), vdup_n_u8(77));
+                hi = vmlal_u8(hi, vget_high_u8(in.c[1]), vdup_n_u8(150));
+                hi = vmlal_u8(hi, vget_high_u8(in.c[2]), vdup_n_u8(29));
+                uint8x16_t gray = vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8));
+                return {{gray, gray, gray}};
+            }
+
+            Rgb scalar(const uint8_t *px) const {
+                Rgb in = e.scalar(px);
+                int gray = (77 * clamp_u8(in.c[0]) + 150 * clamp_u8(in.c[1]) +
+                            29 * clamp_u8(in.c[2]) + 128) >> 8;
+                return {{gray, gray, gray}};
+            }
+        };
+
+        // 255 - x on the clamped input, a single NOT per channel
+        template<typename E>
+        struct Invert : Expr<Invert<E>> {
+            using Block = U8Block;
+            E e;
+
+            explicit Invert(const E &e) : e(e) {}
+
+            Block neon(const uint8x16x4_t &px) const {
+                U8Block in = saturate(e.neon(px));
+                return {{vmvnq_u8(in.c[0]), vmvnq_u8(in.c[1]), vmvnq_u8(in.c[2])}};
+            }
+
+            Rgb scalar(const uint8_t *px) const {
+                Rgb in = e.scalar(px);
+                return {{255 - clamp_u8(in.c[0]), 255 - clamp_u8(in.c[1]),
+                         255 - clamp_u8(in.c[2])}};
+            }
+        };
+
+        template<typename E>
+        struct Clamp : Expr<Clamp<E>> {
+            using Block = U8Block;
+            E e;
+
+            explicit Clamp(const E &e) : e(e) {}
+
+            Block neon(const uint8x16x4_t &px) const { return saturate(e.neon(px)); }
+
+            Rgb scalar(const uint8_t *px) const {
+                Rgb in = e.scalar(px);
+                return {{clamp_u8(in.c[0]), clamp_u8(in.c[1]), clamp_u8(in.c[2])}};
+            }
+        };
+
+        // x * k with k in Q8 fixed point, rounded and saturated to int16
+        template<typename E>
+        struct Scale : Expr<Scale<E>> {
+            using Block = S16Block;
+            E e;
+            int16_t q;
+
+            Scale(const E &e, float k)
+                    : e(e), q((int16_t) clamp_s16((int) std::lround(k * 256.0f))) {}
+
+            Block neon(const uint8x16x4_t &px) const {
+                S16Block in = widen(e.neon(px));
+                S16Block out;
+                for (int c = 0; c < 3; c++) {
+                    out.lo[c] = vcombine_s16(
+                            vqrshrn_n_s32(vmull_n_s16(vget_low_s16(in.lo[c]), q), 8),
+                            vqrshrn_n_s32(vmull_n_s16(vget_high_s16(in.lo[c]), q), 8));
+                    out.hi[c] = vcombine_s16(
+                            vqrshrn_n_s32(vmull_n_s16(vget_low_s16(in.hi[c]), q), 8),
+                            vqrshrn_n_s32(vmull_n_s16(vget_high_s16(in.hi[c]), q), 8));
+                }
+                return out;
+            }
+
+            Rgb scalar(const uint8_t *px) const {
+                Rgb in = e.scalar(px);
+                for (int c = 0; c < 3; c++) in.c[c] = clamp_s16((in.c[c] * q + 128) >> 8);
+                return in;
+            }
+        };
+
+        // x + b, or b - x when reversed, saturated to int16
+        template<typename E>
+        struct Offset : Expr<Offset<E>> {
+            using Block = S16Block;
+            E e;
+            int16_t b;
+            bool reversed;
+
+            Offset(const E &e, int b, bool reversed)
+                    : e(e), b((int16_t) clamp_s16(b)), reversed(reversed) {}
+
+            Block neon(const uint8x16x4_t &px) const {
+                S16Block in = widen(e.neon(px));
+                const int16x8_t bv = vdupq_n_s16(b);
+                S16Block out;
+                for (int c = 0; c < 3; c++) {
+                    out.lo[c] = reversed ? vqsubq_s16(bv, in.lo[c]) : vqaddq_s16(in.lo[c], bv);
+                    out.hi[c] = reversed ? vqsubq_s16(bv, in.hi[c]) : vqaddq_s16(in.hi[c], bv);
+                }
+                return out;
+            }
+
+            Rgb scalar(const uint8_t *px) const {
+                Rgb in = e.scalar(px);
+                for (int c = 0; c < 3; c++) {
+                    in.c[c] = clamp_s16(reversed ? b - in.c[c] : in.c[c] + b);
+                }
+                return in;
+            }
+        };
+
+        // a + b or a - b of two expressions, saturated to int16
+        template<typename A, typename B>
+        struct Combine : Expr<Combine<A, B>> {
+            using Block = S16Block;
+            A a;
+            B b;
+            bool subtract;
+
+            Combine(const A &a, const B &b, bool subtract) : a(a), b(b), subtract(subtract) {}
+
+            Block neon(const uint8x16x4_t &px) const {
+                S16Block l = widen(a.neon(px));
+                S16Block r = widen(b.neon(px));
+                S16Block out;
+                for (int c = 0; c < 3; c++) {
+                    out.lo[c] = subtract ? vqsubq_s16(l.lo[c], r.lo[c])
+                                         : vqaddq_s16(l.lo[c], r.lo[c]);
+                    out.hi[c] = subtract ? vqsubq_s16(l.hi[c], r.hi[c])
+                                         : vqaddq_s16(l.hi[c], r.hi[c]);
+                }
+                return out;
+            }
+
+            Rgb scalar(const uint8_t *px) const {
+                Rgb l = a.scalar(px);
+                Rgb r = b.scalar(px);
+                for (int c = 0; c < 3; c++) {
+                    l.c[c] = clamp_s16(subtract ? l.c[c] - r.c[c] : l.c[c] + r.c[c]);
+                }
+                return l;
+            }
+        };
+
+        inline Source pixel() { return Source{}; }
+
+        template<typename E>
+        Gray<E> gray(const Expr<E> &e) { return Gray<E>(e.self()); }
+
+        template<typename E>
+        Invert<E> invert(const Expr<E> &e) { return Invert<E>(e.self()); }
+
+        template<typename E>
+        Clamp<E> clamp(const Expr<E> &e) { return Clamp<E>(e.self()); }
+
+        template<typename E>
+        Scale<E> operator*(const Expr<E> &e, float k) { return Scale<E>(e.self(), k); }
+
+        template<typename E>
+        Offset<E> operator+(const Expr<E> &e, int b) { return Offset<E>(e.self(), b, false); }
+
+        template<typename E>
+        Offset<E> operator-(const Expr<E> &e, int b) { return Offset<E>(e.self(), -b, false); }
+
+        template<typename E>
+        Offset<E> operator-(int b, const Expr<E> &e) { return Offset<E>(e.self(), b, true); }
+
+        template<typename A, typename B>
+        Combine<A, B> operator+(const Expr<A> &a, const Expr<B> &b) {
+            return Combine<A, B>(a.self(), b.self(), false);
+        }
+
+        template<typename A, typename B>
+        Combine<A, B> operator-(const Expr<A> &a, const Expr<B> &b) {
+            return Combine<A, B>(a.self(), b.self(), true);
+        }
+
+        // contrast around mid gray, then brightness: (x - 128) * contrast + 128 + brightness
+        template<typename E>
+        Clamp<Offset<Scale<Offset<E>>>> brightness_contrast(const Expr<E> &e, int brightness,
+                                                             float contrast) {
+            return clamp((e - 128) * contrast + (128 + brightness));
+        }
+
+        template<typename E>
+        inline void store_scalar(const E &e, const uint8_t *in, uint8_t *out) {
+            Rgb v = e.scalar(in);
+            uint8_t alpha = in[3];
+            out[0] = (uint8_t) clamp_u8(v.c[0]);
+            out[1] = (uint8_t) clamp_u8(v.c[1]);
+            out[2] = (uint8_t) clamp_u8(v.c[2]);
+            out[3] = alpha;
+        }
+
+        // Rows [yStart, yEnd) of an RGBA image, src and dst may be the same buffer.
+        template<typename E>
+        inline void map_rgba_rows_neon(const uint8_t *src, uint8_t *dst, size_t width,
+                                       size_t stride, size_t yStart, size_t yEnd,
+                                       const Expr<E> &expr) {
+            const E &e = expr.self();
+            for (size_t y = yStart; y < yEnd; y++) {
+                const uint8_t *in = src + y * stride;
+                uint8_t *out = dst + y * stride;
+                size_t x = 0;
+                for (; x + 16 <= width; x += 16) {
+                    uint8x16x4_t px = vld4q_u8(in + x * 4);
+                    U8Block v = saturate(e.neon(px));
+                    uint8x16x4_t result = {{v.c[0], v.c[1], v.c[2], px.val[3]}};
+                    vst4q_u8(out + x * 4, result);
+                }
+                for (; x < width; x++) store_scalar(e, in + x * 4, out + x * 4);
+            }
+        }
+
+        template<typename E>
+        inline void map_rgba_neon(const uint8_t *src, uint8_t *dst, size_t width, size_t height,
+                                  size_t stride, const Expr<E> &expr, uint32_t threads,
+                                  size_t grainRows = 0) {
+            ThreadPool::for_each_rows(0, height, threads, grainRows,
+                                      [&](size_t yStart, size_t yEnd) -> void {
+                map_rgba_rows_neon(src, dst, width, stride, yStart, yEnd, expr);
+            });
+        }
+
+        // Reference path, bit exact with the NEON one.
+        template<typename E>
+        inline void map_rgba_scalar(const uint8_t *src, uint8_t *dst, size_t width,
+                                    size_t height, size_t stride, const Expr<E> &expr) {
+            const E &e = expr.self();
+            for (size_t y = 0; y < height; y++) {
+                for (size_t x = 0; x < width; x++) {
+                    store_scalar(e, src + y * stride + x * 4, dst + y * stride + x * 4);
+                }
+            }
+        }
+    }
+}
+#endif //OSFEATURENDKDEMO_PIXELEXPR_H
@@ -0,0 +1,55 @@
+//
+// Planar (structure of arrays) RGBA image used as working format for filter chains.
+//
+
+#ifndef OSFEATURENDKDEMO_PLANARIMAGE_H
+#define OSFEATURENDKDEMO_PLANARIMAGE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <utility>
+#include "AlignedAllocator.h"
+
+namespace ip {
+    struct PlanarImage {
+        static constexpr int PLANE_R = 0;
+        static constexpr int PLANE_G = 1;
+        static constexpr int PLANE_B = 2;
+        static constexpr int PLANE_A = 3;
+
+        size_t width = 0;
+        size_t height = 0;
+        // bytes per row of every plane, rounded up to whole cache lines so that, with the
+        // aligned storage, every row of every plane starts on a cache line
+        size_t stride = 0;
+        AlignedBytes storage{};
+
+        PlanarImage() = default;
+
+        PlanarImage(size_t w, size_t h) { resize(w, h); }
+
+        void resize(size_t w, size_t h) {
+            width = w;
+            height = h;
+            stride = align_up(w);
+            storage.resize(stride * h * 4);
+        }
+
+        uint8_t *plane(int c) { return storage.data() + c * stride * height; }
+
+        const uint8_t *plane(int c) const { return storage.data() + c * stride * height; }
+
+        uint8_t *row(int c, size_t y) { return plane(c) + y * stride; }
+
+        const uint8_t *row(int c, size_t y) const { return plane(c) + y * stride; }
+
+        void swap(PlanarImage &other) {
+            std::swap(width, other.width);
+            std::swap(height, other.height);
+            std::swap(stride, other.stride);
+            storage.swap(other.storage);
+        }
+    };
+}
+#endif //OSFEATURENDKDEMO_PLANARIMAGE_H
@@ -0,0 +1,91 @@
+//
+// Frame budget controller for the live preview, trades resolution, blur radius and threads
+// against a target frame time.
+//
+
+#ifndef OSFEATURENDKDEMO_QUALITYCONTROLLER_H
+#define OSFEATURENDKDEMO_QUALITYCONTROLLER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include "ImageProcessor.h"
+#include "PlanarImage.h"
+
+namespace ip {
+    enum class FrameStage : int {
+        CONVERT = 0,    // camera frame to RGBA, measured by the caller
+        DOWNSAMPLE = 1, // RGBA to planar at the processing resolution
+        FILTER = 2,
+        OUTPUT = 3,     // back to full resolution RGBA
+        COUNT
+    };
+
+    // One rung of the quality ladder, index 0 is full quality.
+    struct QualityLevel {
+        float scale;        // 1.0 full resolution, 0.5 half resolution
+        float radiusFactor; // applied to the requested blur radius, never below 1
+    };
+
+    class QualityController {
+    private:
+        static constexpr float EMA_ALPHA = 0.25f;
+        // degrade after this many frames over budget, upgrade after this many well under it
+        static constexpr int DEGRADE_FRAMES = 3;
+        static constexpr int UPGRADE_FRAMES = 20;
+        // frames ignored after every change, the EMA has to settle on the new level first
+        static constexpr int COOLDOWN_FRAMES = 8;
+        static constexpr float UPGRADE_HEADROOM = 0.7f;
+        static constexpr float THREAD_SAVING_HEADROOM = 0.4f;
+
+        mutable std::mutex m_mutex;
+        float m_targetMs;
+        float m_frameEma = 0.0f;
+        float m_stageEma[static_cast<int>(FrameStage::COUNT)] = {};
+        float m_currentStages[static_cast<int>(FrameStage::COUNT)] = {};
+        bool m_hasEma = false;
+        int m_level = 0;
+        uint32_t m_maxThreads;
+        uint32_t m_threadCap;
+        int m_overBudget = 0;
+        int m_underBudget = 0;
+        int m_cooldown = 0;
+
+        PlanarImage m_full{};
+        PlanarImage m_small{};
+        PlanarImage m_filtered{};
+
+        void adapt();
+
+    public:
+        explicit QualityController(float targetFrameMs);
+
+        void set_target(float targetFrameMs);
+
+        // Adds the time of a stage to the current frame.
+        void record_stage(FrameStage stage, float ms);
+
+        // Folds the stages of the current frame into the averages and adjusts the quality.
+        void end_frame();
+
+        // Runs op at the current quality on an RGBA image in place, timing every stage and
+        // ending the frame. Needs NEON.
+        bool process_rgba_neon(uint8_t *pixels, size_t width, size_t height, size_t stride,
+                               FilterOp op, int radius, float sigma);
+
+        int level() const;
+
+        static int level_count();
+
+        QualityLevel quality() const;
+
+        int radius_for(int requested) const;
+
+        uint32_t thread_cap() const;
+
+        float frame_time_ema() const;
+
+        float stage_time_ema(FrameStage stage) const;
+    };
+}
+#endif //OSFEATURENDKDEMO_QUALITYCONTROLLER_H
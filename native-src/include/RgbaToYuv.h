@@ -0,0 +1,78 @@
+//
+// RGBA to 4:2:0 YUV (I420, NV12, NV21) for the video encoders.
+//
+
+#ifndef OSFEATURENDKDEMO_RGBATOYUV_H
+#define OSFEATURENDKDEMO_RGBATOYUV_H
+
+#include <cstdint>
+#include <cstddef>
+#include <arm_neon.h>
+
+namespace ip {
+    enum class YuvMatrix : int {
+        BT601 = 0, // SD content, what the camera and JPEG use
+        BT709 = 1  // HD content
+    };
+
+    enum class YuvRange : int {
+        LIMITED = 0, // Y in [16, 235], U / V in [16, 240], what MediaCodec expects by default
+        FULL = 1     // every channel in [0, 255]
+    };
+
+    // Destination planes, laid out like android.media.Image: a chroma pixel stride of 1 is
+    // I420, 2 with v == u + 1 is NV12 and 2 with u == v + 1 is NV21. Any other layout is
+    // written sample by sample.
+    struct YuvPlanes {
+        uint8_t *y = nullptr;
+        uint8_t *u = nullptr;
+        uint8_t *v = nullptr;
+        size_t yStride = 0;
+        size_t uStride = 0;
+        size_t vStride = 0;
+        size_t chromaPixelStride = 1;
+
+        static YuvPlanes i420(uint8_t *y, size_t yStride, uint8_t *u, size_t uStride, uint8_t *v,
+                              size_t vStride);
+
+        static YuvPlanes nv12(uint8_t *y, size_t yStride, uint8_t *uv, size_t uvStride);
+
+        static YuvPlanes nv21(uint8_t *y, size_t yStride, uint8_t *vu, size_t vuStride);
+    };
+
+    // Q8 weights, Y = (yR R + yG G + yB B + yBias) >> 8 and U / V from the 2x2 mean.
+    struct YuvCoefficients {
+        uint8_t yR, yG, yB;
+        uint16_t yBias;
+        int16_t uR, uG, uB;
+        int16_t vR, vG, vB;
+
+        static YuvCoefficients make(YuvMatrix matrix, YuvRange range);
+    };
+
+    class RgbaToYuv {
+    public:
+        // Alpha is ignored. Chroma is the rounded mean of every 2x2 block, odd sizes replicate
+        // the last row / column. Rows are split between the pool workers.
+        static void convert_neon(const uint8_t *rgba, size_t width, size_t height, size_t stride,
+                                 const YuvPlanes &dst, YuvMatrix matrix, YuvRange range);
+
+        static void convert_scalar(const uint8_t *rgba, size_t width, size_t height,
+                                   size_t stride, const YuvPlanes &dst, YuvMatrix matrix,
+                                   YuvRange range);
+
+        // One chroma row and its two luma rows. For the last row of an odd height row1 is row0
+        // and y1 is nullptr. The scalar variant starts at the even pixel xStart, so it also
+        // finishes the tail of a NEON row.
+        static void convert_row_pair_neon(const uint8_t *row0, const uint8_t *row1,
+                                          uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+                                          size_t chromaPixelStride, size_t width,
+                                          const YuvCoefficients &c);
+
+        static void convert_row_pair_scalar(const uint8_t *row0, const uint8_t *row1,
+                                            uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+                                            size_t chromaPixelStride, size_t xStart,
+                                            size_t width, const YuvCoefficients &c);
+    };
+}
+#endif //OSFEATURENDKDEMO_RGBATOYUV_H
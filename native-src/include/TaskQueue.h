@@ -0,0 +1,228 @@
+//
+// Building blocks of the thread pool queue: a small buffer task object, a bounded lock free
+// multi producer / multi consumer ring and a futex based parking spot for idle workers.
+//
+
+#ifndef OSFEATURENDKDEMO_TASKQUEUE_H
+#define OSFEATURENDKDEMO_TASKQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include "AlignedAllocator.h"
+
+namespace ip {
+    inline void cpu_relax() {
+#if defined(__aarch64__) || defined(__arm__)
+        __asm__ __volatile__("yield");
+#elif defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+
+    // Move only void() callable. Captures up to INLINE_SIZE bytes live inside the object, so
+    // queueing the row and group tasks of the pool does not allocate; larger ones fall back
+    // to a single heap block.
+    class Task {
+    public:
+        static constexpr size_t INLINE_SIZE = 64;
+
+    private:
+        enum class Op {
+            MOVE,
+            DESTROY
+        };
+        using Invoke = void (*)(void *);
+        using Manage = void (*)(Op, void *, void *);
+
+        alignas(std::max_align_t) unsigned char m_storage[INLINE_SIZE];
+        Invoke m_invoke = nullptr;
+        Manage m_manage = nullptr;
+
+        template<typename F>
+        static constexpr bool fits_inline = sizeof(F) <= INLINE_SIZE &&
+                                            alignof(F) <= alignof(std::max_align_t) &&
+                                            std::is_nothrow_move_constructible<F>::value;
+
+        void move_from(Task &other) noexcept {
+            if (other.m_manage == nullptr) return;
+            other.m_manage(Op::MOVE, m_storage, other.m_storage);
+            m_invoke = other.m_invoke;
+            m_manage = other.m_manage;
+            other.m_invoke = nullptr;
+            other.m_manage = nullptr;
+        }
+
+    public:
+        Task() = default;
+
+        template<typename F, typename = std::enable_if_t<
+                !std::is_same<std::decay_t<F>, Task>::value>>
+        Task(F &&fn) {
+            using Fn = std::decay_t<F>;
+            if constexpr (fits_inline<Fn>) {
+                new(m_storage) Fn(std::forward<F>(fn));
+                m_invoke = [](void *storage) -> void { (*static_cast<Fn *>(storage))(); };
+                m_manage = [](Op op, void *dst, void *src) -> void {
+                    Fn *from = static_cast<Fn *>(src);
+                    if (op == Op::MOVE) new(dst) Fn(std::move(*from));
+                    from->~Fn();
+                };
+            } else {
+                new(m_storage) Fn *(new Fn(std::forward<F>(fn)));
+                m_invoke = [](void *storage) -> void { (**static_cast<Fn **>(storage))(); };
+                m_manage = [](Op op, void *dst, void *src) -> void {
+                    Fn *heap = *static_cast<Fn **>(src);
+                    if (op == Op::MOVE) {
+                        new(dst) Fn *(heap);
+                    } else {
+                        delete heap;
+                    }
+                };
+            }
+        }
+
+        Task(Task &&other) noexcept { move_from(other); }
+
+        Task &operator=(Task &&other) noexcept {
+            if (this != &other) {
+                reset();
+                move_from(other);
+            }
+            return *this;
+        }
+
+        Task(const Task &) = delete;
+
+        Task &operator=(const Task &) = delete;
+
+        ~Task() { reset(); }
+
+        void reset() {
+            if (m_manage != nullptr) m_manage(Op::DESTROY, nullptr, m_storage);
+            m_invoke = nullptr;
+            m_manage = nullptr;
+        }
+
+        explicit operator bool() const { return m_invoke != nullptr; }
+
+        void operator()() { m_invoke(m_storage); }
+    };
+
+    // Bounded MPMC ring after Dmitry Vyukov: every cell carries a sequence number telling
+    // producers and consumers whose turn it is, so push and pop are one CAS on their own
+    // index. capacity is rounded up to a power of two.
+    template<typename T>
+    class MpmcQueue {
+    private:
+        struct Cell {
+            std::atomic<size_t> sequence{0};
+            T value{};
+        };
+
+        std::unique_ptr<Cell[]> m_cells;
+        size_t m_mask;
+        // producers and consumers each spin on their own cache line
+        alignas(CACHE_LINE) std::atomic<size_t> m_enqueue{0};
+        alignas(CACHE_LINE) std::atomic<size_t> m_dequeue{0};
+
+    public:
+        explicit MpmcQueue(size_t capacity) {
+            size_t size = 2;
+            while (size < capacity) size <<= 1;
+            m_cells.reset(new Cell[size]);
+            m_mask = size - 1;
+            for (size_t i = 0; i < size; i++) {
+                m_cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        // false when the ring is full, value is left untouched then
+        bool try_push(T &&value) {
+            size_t pos = m_enqueue.load(std::memory_order_relaxed);
+            Cell *cell;
+            while (true) {
+                cell = &m_cells[pos & m_mask];
+                size_t sequence = cell->sequence.load(std::memory_order_acquire);
+                auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+                if (diff == 0) {
+                    if (m_enqueue.compare_exchange_weak(pos, pos + 1,
+                                                        std::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    pos = m_enqueue.load(std::memory_order_relaxed);
+                }
+            }
+            cell->value = std::move(value);
+            cell->sequence.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool try_pop(T &out) {
+            size_t pos = m_dequeue.load(std::memory_order_relaxed);
+            Cell *cell;
+            while (true) {
+                cell = &m_cells[pos & m_mask];
+                size_t sequence = cell->sequence.load(std::memory_order_acquire);
+                auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+                if (diff == 0) {
+                    if (m_dequeue.compare_exchange_weak(pos, pos + 1,
+                                                        std::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    pos = m_dequeue.load(std::memory_order_relaxed);
+                }
+            }
+            out = std::move(cell->value);
+            cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+            return true;
+        }
+
+        size_t capacity() const { return m_mask + 1; }
+    };
+
+    // Attempts an idle worker makes before parking. Spinning only pays off when the producer
+    // runs on another core, so single core devices park at once.
+    inline int spin_rounds() {
+        static const int rounds = std::thread::hardware_concurrency() > 1 ? 64 : 0;
+        return rounds;
+    }
+
+    // Event count on a futex word. A worker reads the epoch, checks its queue once more and
+    // then sleeps only if no notify bumped the epoch in between, so wakeups are never lost
+    // and producers skip the syscall while nobody sleeps.
+    class Parker {
+    private:
+        std::atomic<uint32_t> m_epoch{0};
+        std::atomic<uint32_t> m_sleepers{0};
+
+        void wake(int count);
+
+    public:
+        uint32_t prepare_wait() const { return m_epoch.load(std::memory_order_seq_cst); }
+
+        void wait(uint32_t epoch);
+
+        void notify_one() {
+            m_epoch.fetch_add(1, std::memory_order_seq_cst);
+            if (m_sleepers.load(std::memory_order_seq_cst) != 0) wake(1);
+        }
+
+        void notify_all() {
+            m_epoch.fetch_add(1, std::memory_order_seq_cst);
+            if (m_sleepers.load(std::memory_order_seq_cst) != 0) wake(INT32_MAX);
+        }
+    };
+}
+#endif //OSFEATURENDKDEMO_TASKQUEUE_H
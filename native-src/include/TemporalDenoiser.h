@@ -0,0 +1,81 @@
+//
+// Motion adaptive temporal denoise for camera preview frames, applied to the YUV 4:2:0 planes
+// before they are converted to RGBA.
+//
+
+#ifndef OSFEATURENDKDEMO_TEMPORALDENOISER_H
+#define OSFEATURENDKDEMO_TEMPORALDENOISER_H
+
+#include <cstdint>
+#include <cstddef>
+#include "AlignedAllocator.h"
+
+namespace ip {
+    class TemporalDenoiser {
+    public:
+        // 16 frames of Q4 weights still fit the 16 bit accumulators of the NEON kernel
+        static constexpr size_t MAX_FRAMES = 16;
+        static constexpr uint32_t WEIGHT_ONE = 16;
+
+    private:
+        size_t m_width;
+        size_t m_height;
+        size_t m_chromaWidth;
+        size_t m_chromaHeight;
+        size_t m_frameSize;
+        size_t m_frames;
+        // absolute difference to the current frame at which an older sample stops counting
+        uint8_t m_threshold;
+        // (threshold - diff) * m_weightScale >> 8 maps the difference onto a Q4 weight
+        uint16_t m_weightScale;
+
+        // m_frames raw input frames, each one compact Y, U and V planes. The current frame is
+        // written over the oldest one, so memory stays at m_frames frames however long the
+        // stream runs.
+        AlignedBytes m_ring{};
+        size_t m_head = 0;
+        size_t m_count = 0;
+        uint64_t m_framesProcessed = 0;
+
+        static void
+        blend_row_neon(const uint8_t *current, const uint8_t *const *history, size_t count,
+                       uint8_t *out, size_t width, uint8_t threshold, uint16_t weightScale);
+
+        // starts at xStart, so it also finishes the tail of a NEON row
+        static void
+        blend_row_scalar(const uint8_t *current, const uint8_t *const *history, size_t count,
+                         uint8_t *out, size_t xStart, size_t width, uint8_t threshold,
+                         uint16_t weightScale);
+
+        // copies one row of a plane into the ring and writes the blended row back over it
+        void denoise_row(uint8_t *pixels, size_t pixelStride, size_t planeOffset,
+                         size_t planeWidth, size_t row, bool useNeon);
+
+    public:
+        // frames is the window including the current frame, clamped to [1, MAX_FRAMES].
+        // threshold is the per sample difference treated as motion, higher values denoise
+        // harder but smear moving edges.
+        TemporalDenoiser(size_t width, size_t height, size_t frames, uint32_t threshold);
+
+        // Replaces every sample with the weighted mean of itself and the same sample of the
+        // earlier frames in the window. An earlier sample is weighted by how close it is to the
+        // current one, so static areas average over the whole window and moving ones keep the
+        // current frame. The planes are changed in place, chroma may be interleaved
+        // (pixel stride 2).
+        void denoise(uint8_t *yPixel, uint8_t *uPix, uint8_t *vPix, size_t yStride,
+                     size_t uRowStride, size_t vRowStride, size_t uPixelStride,
+                     size_t vPixelStride, bool useNeon);
+
+        // Forgets the earlier frames, e.g. after the camera switched.
+        void reset() { m_count = 0; }
+
+        size_t width() const { return m_width; }
+
+        size_t height() const { return m_height; }
+
+        size_t frames() const { return m_frames; }
+
+        uint64_t frames_processed() const { return m_framesProcessed; }
+    };
+}
+#endif //OSFEATURENDKDEMO_TEMPORALDENOISER_H
@@ -5,34 +5,349 @@
 #ifndef OSFEATURENDKDEMO_THREADPOOL_H
 #define OSFEATURENDKDEMO_THREADPOOL_H
 
-#include <queue>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <cmath>
 #include <condition_variable>
+#include <future>
+#include <memory>
+#include <type_traits>
+#include "CpuTopology.h"
+#include "Tracing.h"
+#include "TaskQueue.h"
 
 namespace ip {
+    class ThreadPool;
+
+    // Scheduling lanes of the pool, highest priority first. A worker always drains the
+    // preview lane before it takes batch work.
+    enum class TaskPriority : int {
+        PREVIEW = 0, // latency bound work of the live frame path
+        BATCH = 1,   // throughput work such as gallery exports, split into small grains
+        COUNT
+    };
+
+    struct LaneStats {
+        size_t depth = 0;        // tasks queued right now
+        size_t peakDepth = 0;
+        uint64_t tasks = 0;      // tasks started since the last reset
+        double meanWaitUs = 0.0; // from the push of a task to its start
+        double maxWaitUs = 0.0;
+    };
+
+    // Countdown latch: wait() returns once count_down has been called count times.
+    class Latch {
+    private:
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        ptrdiff_t m_count;
+
+    public:
+        explicit Latch(ptrdiff_t count) : m_count(count) {}
+
+        void count_down(ptrdiff_t n = 1);
+
+        bool try_wait();
+
+        void wait();
+
+        // Runs queued tasks of pool while waiting, so a worker of pool may wait on work it
+        // queued itself without starving the pool.
+        void wait(ThreadPool &pool);
+    };
+
     class ThreadPool {
+    public:
+        static constexpr int LANE_COUNT = static_cast<int>(TaskPriority::COUNT);
+        // batch row loops hand out at most this many rows per claim
+        static constexpr size_t BATCH_GRAIN_ROWS = 16;
+
     private:
+        struct QueuedTask {
+            Task task;
+            uint64_t enqueuedNs = 0;
+        };
+
+        struct Lane {
+            MpmcQueue<QueuedTask> tasks;
+            std::atomic<size_t> depth{0};
+            std::atomic<size_t> peakDepth{0};
+            std::atomic<uint64_t> started{0};
+            std::atomic<uint64_t> waitNs{0};
+            std::atomic<uint64_t> maxWaitNs{0};
+
+            explicit Lane(size_t capacity) : tasks(capacity) {}
+        };
+
         std::vector<std::thread> m_threads{};
-        std::queue<std::function<void()>> m_tasks{};
-        std::condition_variable m_cv{};
+        Lane m_lanes[LANE_COUNT];
+        Parker m_parker{};
+        std::condition_variable m_idleCv{};
+        // only guards the idle wait, tasks never take it
         std::mutex mutex_;
-        bool m_stop = false;
+        std::atomic<bool> m_stop{false};
+        // tasks queued or running
+        std::atomic<size_t> m_pending{0};
+        // sum of the relative speeds of the workers, a homogeneous pool sums to its size
+        std::atomic<float> m_totalSpeed{0.0f};
+
+        static std::atomic<int> s_affinityPolicy;
+        // nice value a worker switches to while it runs a task of each lane
+        static std::atomic<int> s_laneNice[LANE_COUNT];
+        // lane of the task the calling thread runs, new tasks of the thread go to the same lane
+        static thread_local TaskPriority t_priority;
+        // nice value last applied to the calling worker
+        static thread_local int t_nice;
+        // relative speed of the core the calling worker is pinned to
+        static thread_local float t_workerSpeed;
+        // upper bound for for_each_rows started from this thread, 0 means no cap
+        static thread_local uint32_t t_threadCap;
+        // pool the calling thread is a worker of
+        static thread_local ThreadPool *t_pool;
+
+        friend class ThreadCapScope;
+
+        friend class PriorityScope;
+
+        // workers adjust the sum after they started, e.g. when pinning failed
+        void add_speed(float delta);
+
+        static uint64_t now_ns();
+
+        static void apply_nice(int nice);
+
+        // pops from the lanes down to lowest, highest priority first
+        bool try_pop(TaskPriority lowest, QueuedTask &queued, TaskPriority &lane);
+
+        void run_task(TaskPriority lane, QueuedTask &queued);
+
+        void finish_task();
+
+        void worker_loop();
 
     public:
-        explicit ThreadPool(uint32_t size);
+        explicit ThreadPool(uint32_t size, size_t queueCapacity = 1024);
 
         template<typename T>
-        void enqueue_task(T &&task) {
-            {
-                std::lock_guard<std::mutex> lock{mutex_};
-                m_tasks.emplace(std::forward<T>(task));
+        void enqueue_task(TaskPriority priority, T &&task) {
+            Lane &lane = m_lanes[static_cast<int>(priority)];
+            QueuedTask queued{Task{std::forward<T>(task)}, now_ns()};
+            m_pending.fetch_add(1, std::memory_order_relaxed);
+            size_t depth = lane.depth.fetch_add(1, std::memory_order_relaxed) + 1;
+            size_t peak = lane.peakDepth.load(std::memory_order_relaxed);
+            while (depth > peak &&
+                   !lane.peakDepth.compare_exchange_weak(peak, depth, std::memory_order_relaxed)) {
+            }
+            if (!lane.tasks.try_push(std::move(queued))) {
+                // lane full: the caller runs the task itself rather than blocking
+                run_task(priority, queued);
+                return;
             }
-            m_cv.notify_one();
+            m_parker.notify_one();
+        }
+
+        // Queues task on the lane of the calling thread.
+        template<typename T>
+        void enqueue_task(T &&task) {
+            enqueue_task(t_priority, std::forward<T>(task));
+        }
+
+        // Queues task and returns a future for its result.
+        template<typename F>
+        auto submit(F &&task) -> std::future<std::invoke_result_t<std::decay_t<F>>> {
+            using Result = std::invoke_result_t<std::decay_t<F>>;
+            auto job = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+            std::future<Result> result = job->get_future();
+            enqueue_task([job]() -> void { (*job)(); });
+            return result;
+        }
+
+        // Runs one queued task of the calling thread's lane or a more urgent one on the calling
+        // thread, false when there was none. Preview waiters so never pick up batch work.
+        bool run_pending_task();
+
+        // Runs every queued preview task; batch loops call it between their grains.
+        void run_preview_tasks();
+
+        LaneStats lane_stats(TaskPriority priority) const;
+
+        void reset_lane_stats();
+
+        // Nice value of the workers while they run tasks of the lane, taking effect with the
+        // next task. Lowering it below the process default needs the Android foreground
+        // priorities apps are allowed.
+        static void set_lane_nice(TaskPriority priority, int nice) {
+            s_laneNice[static_cast<int>(priority)].store(nice);
+        }
+
+        // Lane of the tasks the calling thread queues from now on; returns the previous one.
+        static TaskPriority set_thread_priority(TaskPriority priority) {
+            TaskPriority previous = t_priority;
+            t_priority = priority;
+            return previous;
         }
 
+        static TaskPriority thread_priority() { return t_priority; }
+
+        // Blocks until every task queued so far has finished; the workers keep running.
+        void wait_idle();
+
         ~ThreadPool();
+
+        // Drains the queue, then stops and joins the workers. The pool cannot take tasks
+        // afterwards, use wait_idle to wait for work and keep the pool.
         void joinAll();
+
+        size_t size() const { return m_threads.size(); }
+
+        // Process wide pool with one worker per core the affinity policy allows. It is rebuilt
+        // when the policy changes; callers keep the returned pointer for the whole job so work
+        // started on the previous pool finishes there.
+        static std::shared_ptr<ThreadPool> shared();
+
+        // Applies to the pools created afterwards.
+        static void set_affinity_policy(AffinityPolicy policy) {
+            s_affinityPolicy.store(static_cast<int>(policy));
+        }
+
+        static AffinityPolicy affinity_policy() {
+            return static_cast<AffinityPolicy>(s_affinityPolicy.load());
+        }
+
+        float total_speed() const { return m_totalSpeed.load(std::memory_order_relaxed); }
+
+        // Runs fn(yStart, yEnd) over [yBegin, yEnd) on `threads` workers of the shared pool,
+        // the calling thread being one of them. With grainRows == 0 every worker claims about
+        // its share of the rows, otherwise the workers keep claiming chunks of grainRows rows
+        // until the range is exhausted. Both are scaled by the speed of the worker's core, so
+        // efficiency cores get proportionally smaller row ranges. On the batch lane chunks are
+        // capped at BATCH_GRAIN_ROWS and queued preview tasks run between them. Kernels whose
+        // chunks carry a fixed setup cost (e.g. overlapping column strips) raise that cap with
+        // minBatchGrain.
+        template<typename F>
+        static void for_each_rows(size_t yBegin, size_t yEnd, uint32_t threads, size_t grainRows,
+                                  F &&fn, size_t minBatchGrain = 0) {
+            if (yEnd <= yBegin) return;
+            size_t rows = yEnd - yBegin;
+            if (t_threadCap > 0 && threads > t_threadCap) threads = t_threadCap;
+            if (threads < 1) threads = 1;
+            if ((size_t) threads > rows) threads = static_cast<uint32_t>(rows);
+            // row slices are traced under the kernel scope of the calling thread
+            TraceLabel label = TraceScope::current();
+            if (threads == 1) {
+                TraceScope slice{label, yBegin, yEnd};
+                fn(yBegin, yEnd);
+                return;
+            }
+            std::shared_ptr<ThreadPool> pool = shared();
+            std::atomic<size_t> next{yBegin};
+            // speed of the `threads` workers that take part, the caller counting as an average one
+            float totalSpeed = pool->total_speed() * (float) threads / (float) pool->size();
+            TaskPriority priority = t_priority;
+            bool batch = priority == TaskPriority::BATCH;
+            size_t batchGrain = std::max(BATCH_GRAIN_ROWS, minBatchGrain);
+            if (batch && (grainRows == 0 || grainRows > batchGrain)) {
+                grainRows = batchGrain;
+            }
+            ThreadPool *owner = pool.get();
+            auto claim_rows = [&fn, &next, &label, yEnd, rows, grainRows, totalSpeed, batch,
+                               owner]() -> void {
+                size_t chunk = grainRows == 0
+                               ? (size_t) std::ceil((float) rows * t_workerSpeed / totalSpeed)
+                               : (size_t) ((float) grainRows * t_workerSpeed + 0.5f);
+                if (chunk < 1) chunk = 1;
+                while (true) {
+                    size_t yStart = next.fetch_add(chunk, std::memory_order_relaxed);
+                    if (yStart >= yEnd) return;
+                    size_t yStop = std::min(yStart + chunk, yEnd);
+                    {
+                        TraceScope slice{label, yStart, yStop};
+                        fn(yStart, yStop);
+                    }
+                    if (batch) owner->run_preview_tasks();
+                }
+            };
+            Latch done{threads - 1};
+            for (uint32_t t = 1; t < threads; t++) {
+                pool->enqueue_task(priority, [&claim_rows, &done]() -> void {
+                    claim_rows();
+                    done.count_down();
+                });
+            }
+            claim_rows();
+            done.wait(*pool);
+        }
+    };
+
+    // Tasks that can be waited on together; the destructor waits for any still running.
+    class TaskGroup {
+    private:
+        ThreadPool &m_pool;
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        size_t m_pending = 0;
+
+        void finish();
+
+    public:
+        explicit TaskGroup(ThreadPool &pool) : m_pool(pool) {}
+
+        ~TaskGroup() { wait(); }
+
+        TaskGroup(const TaskGroup &) = delete;
+
+        TaskGroup &operator=(const TaskGroup &) = delete;
+
+        template<typename F>
+        void run(F &&task) {
+            {
+                std::lock_guard<std::mutex> lock{m_mutex};
+                m_pending++;
+            }
+            m_pool.enqueue_task([this, task = std::forward<F>(task)]() mutable -> void {
+                task();
+                finish();
+            });
+        }
+
+        // Waits for every task run so far, running queued tasks of the pool meanwhile.
+        void wait();
+    };
+
+    // Queues the tasks the current thread starts on the given lane while in scope.
+    class PriorityScope {
+    private:
+        TaskPriority m_previous;
+
+    public:
+        explicit PriorityScope(TaskPriority priority)
+                : m_previous(ThreadPool::set_thread_priority(priority)) {}
+
+        ~PriorityScope() { ThreadPool::t_priority = m_previous; }
+
+        PriorityScope(const PriorityScope &) = delete;
+
+        PriorityScope &operator=(const PriorityScope &) = delete;
+    };
+
+    // Caps the threads of every for_each_rows started by the current thread while in scope.
+    class ThreadCapScope {
+    private:
+        uint32_t m_previous;
+
+    public:
+        explicit ThreadCapScope(uint32_t cap) : m_previous(ThreadPool::t_threadCap) {
+            ThreadPool::t_threadCap = cap;
+        }
+
+        ~ThreadCapScope() { ThreadPool::t_threadCap = m_previous; }
+
+        ThreadCapScope(const ThreadCapScope &) = delete;
+
+        ThreadCapScope &operator=(const ThreadCapScope &) = delete;
     };
 }
 #endif //OSFEATURENDKDEMO_THREADPOOL_H
@@ -0,0 +1,183 @@
+//
+// Execution tracing of the kernels and the row slices the workers run, dumped as Chrome
+// trace event JSON that opens in Perfetto or chrome://tracing.
+//
+// Compiled in with -DIP_ENABLE_TRACING, otherwise every type below is an empty stub and
+// IP_TRACE_KERNEL expands to nothing. When compiled in but switched off with
+// Tracer::set_enabled(false) a scope costs one relaxed load and one predictable branch.
+//
+
+#ifndef OSFEATURENDKDEMO_TRACING_H
+#define OSFEATURENDKDEMO_TRACING_H
+
+#include <cstdint>
+#include <cstddef>
+
+#ifdef IP_ENABLE_TRACING
+
+#include <atomic>
+#include <vector>
+
+#endif
+
+namespace ip {
+#ifdef IP_ENABLE_TRACING
+
+    // One complete event, begin and end of a kernel or of a row slice run by a worker.
+    struct TraceEvent {
+        const char *name = nullptr;
+        uint64_t beginNs = 0;
+        uint64_t endNs = 0;
+        uint64_t bytes = 0;
+        uint32_t tid = 0;
+        uint32_t rowBegin = 0;
+        uint32_t rowEnd = 0;
+        // 0 for a kernel, 1 for a row slice
+        uint32_t depth = 0;
+    };
+
+    // Fixed size ring written only by its owning thread. Once full the oldest events are
+    // overwritten; a reader copies the slots and then drops those overwritten meanwhile.
+    class TraceRing {
+    public:
+        static constexpr size_t CAPACITY = 8192;
+
+    private:
+        std::vector<TraceEvent> m_events = std::vector<TraceEvent>(CAPACITY);
+        std::atomic<uint64_t> m_head{0};
+
+    public:
+        void push(const TraceEvent &event) {
+            uint64_t head = m_head.load(std::memory_order_relaxed);
+            m_events[head & (CAPACITY - 1)] = event;
+            m_head.store(head + 1, std::memory_order_release);
+        }
+
+        void snapshot(std::vector<TraceEvent> &out) const;
+
+        void clear() { m_head.store(0, std::memory_order_release); }
+    };
+
+    class Tracer {
+    private:
+        static std::atomic<bool> s_enabled;
+
+    public:
+        static bool enabled() {
+            return __builtin_expect(s_enabled.load(std::memory_order_relaxed), 0);
+        }
+
+        static void set_enabled(bool enabled) {
+            s_enabled.store(enabled, std::memory_order_relaxed);
+        }
+
+        static uint64_t now_ns();
+
+        // Appends to the ring of the calling thread, registering it on first use.
+        static void record(const TraceEvent &event);
+
+        // Writes the events of every thread as {"traceEvents": [...]}, false when the file
+        // cannot be written. Best taken while the pipeline is idle.
+        static bool dump_chrome_json(const char *path);
+
+        static void clear();
+    };
+
+    // What a kernel scope hands to the row slices of the for_each_rows calls it makes.
+    struct TraceLabel {
+        const char *name = nullptr;
+        size_t rowBegin = 0;
+        size_t rowEnd = 0;
+        uint64_t bytes = 0;
+    };
+
+    class TraceScope {
+    private:
+        static thread_local const TraceLabel *t_current;
+
+        TraceLabel m_label{};
+        const TraceLabel *m_previous = nullptr;
+        uint64_t m_beginNs = 0;
+        uint32_t m_depth = 0;
+        bool m_active = false;
+
+    public:
+        // Kernel scope over rows [rowBegin, rowEnd) touching bytes, names the slices below it.
+        TraceScope(const char *name, size_t rowBegin, size_t rowEnd, uint64_t bytes) {
+            if (!Tracer::enabled()) return;
+            m_label = {name, rowBegin, rowEnd, bytes};
+            m_previous = t_current;
+            t_current = &m_label;
+            m_active = true;
+            m_beginNs = Tracer::now_ns();
+        }
+
+        // Row slice of a kernel run on a worker, its bytes are the slice's share.
+        TraceScope(const TraceLabel &parent, size_t rowBegin, size_t rowEnd) {
+            if (!Tracer::enabled() || parent.name == nullptr) return;
+            size_t rows = parent.rowEnd - parent.rowBegin;
+            uint64_t bytes = rows == 0 ? 0 : parent.bytes * (rowEnd - rowBegin) / rows;
+            m_label = {parent.name, rowBegin, rowEnd, bytes};
+            m_depth = 1;
+            m_active = true;
+            m_beginNs = Tracer::now_ns();
+        }
+
+        ~TraceScope() {
+            if (!m_active) return;
+            TraceEvent event;
+            event.name = m_label.name;
+            event.beginNs = m_beginNs;
+            event.endNs = Tracer::now_ns();
+            event.bytes = m_label.bytes;
+            event.rowBegin = static_cast<uint32_t>(m_label.rowBegin);
+            event.rowEnd = static_cast<uint32_t>(m_label.rowEnd);
+            event.depth = m_depth;
+            Tracer::record(event);
+            if (m_depth == 0) t_current = m_previous;
+        }
+
+        TraceScope(const TraceScope &) = delete;
+
+        TraceScope &operator=(const TraceScope &) = delete;
+
+        // Label of the innermost kernel scope on this thread, unnamed when there is none.
+        static TraceLabel current() {
+            if (!Tracer::enabled() || t_current == nullptr) return {};
+            return *t_current;
+        }
+    };
+
+#define IP_TRACE_JOIN_(a, b) a##b
+#define IP_TRACE_JOIN(a, b) IP_TRACE_JOIN_(a, b)
+#define IP_TRACE_KERNEL(name, rows, bytes) \
+    ::ip::TraceScope IP_TRACE_JOIN(ipTraceScope, __LINE__){(name), 0, (rows), (bytes)}
+
+#else
+
+    struct TraceLabel {
+    };
+
+    class Tracer {
+    public:
+        static bool enabled() { return false; }
+
+        static void set_enabled(bool) {}
+
+        static bool dump_chrome_json(const char *) { return false; }
+
+        static void clear() {}
+    };
+
+    class TraceScope {
+    public:
+        TraceScope(const TraceLabel &, size_t, size_t) {}
+
+        static TraceLabel current() { return {}; }
+    };
+
+#define IP_TRACE_KERNEL(name, rows, bytes) ((void) 0)
+
+#endif
+}
+#endif //OSFEATURENDKDEMO_TRACING_H
@@ -6,6 +6,8 @@
 #define OSFEATURENDKDEMO_UTILITY_H
 
 #include <vector>
+#include <cmath>
+#include <cstdint>
 
 namespace ip {
     class Utility {
@@ -30,6 +32,30 @@ namespace ip {
             }
             return kernel;
         }
+
+        // 1D gaussian for separable passes, weights in Q8 fixed point summing to exactly 256
+        // so an 8 bit pixel times the weights never leaves uint16.
+        static std::vector<uint16_t> generate_gaussian_kernel_q8(int radius, float sigma) {
+            int size = 2 * radius + 1;
+            std::vector<float> weights(size);
+            float sum = 0.0f;
+            float s = 2.0f * sigma * sigma;
+            for (int i = -radius; i <= radius; i++) {
+                weights[i + radius] = std::exp(-(i * i) / s);
+                sum += weights[i + radius];
+            }
+            // rounding the running sum keeps the total at 256 without any negative tap
+            std::vector<uint16_t> kernel(size);
+            float cumulative = 0.0f;
+            int previous = 0;
+            for (int i = 0; i < size; i++) {
+                cumulative += weights[i] / sum;
+                int current = i == size - 1 ? 256 : static_cast<int>(cumulative * 256.0f + 0.5f);
+                kernel[i] = static_cast<uint16_t>(current - previous);
+                previous = current;
+            }
+            return kernel;
+        }
     };
 }
 #endif //OSFEATURENDKDEMO_UTILITY_H
@@ -0,0 +1,73 @@
+//
+// YUV4MPEG2 streams of 4:2:0 frames, read from and written to a file or pipe. Frames are
+// planar: the Y plane, then U and V, every row tightly packed.
+//
+
+#ifndef OSFEATURENDKDEMO_Y4M_H
+#define OSFEATURENDKDEMO_Y4M_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace ip {
+    struct Y4mHeader {
+        // larger streams are rejected before any frame buffer is sized from the header
+        static constexpr uint32_t MAX_DIMENSION = 8192;
+
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t fpsNum = 25;
+        uint32_t fpsDen = 1;
+        char interlace = 'p';
+        uint32_t aspectNum = 0;
+        uint32_t aspectDen = 0;
+        // only the 4:2:0 variants: 420jpeg, 420, 420paldv, 420mpeg2
+        std::string colorspace = "420jpeg";
+        // X tags, written back unchanged
+        std::vector<std::string> extensions;
+
+        size_t chroma_width() const { return (width + 1) / 2; }
+
+        size_t chroma_height() const { return (height + 1) / 2; }
+
+        size_t luma_size() const { return (size_t) width * height; }
+
+        size_t chroma_size() const { return chroma_width() * chroma_height(); }
+
+        size_t frame_size() const { return luma_size() + 2 * chroma_size(); }
+
+        // the 8 bit 4:2:0 colorspaces listed above
+        static bool is_supported_colorspace(const std::string &colorspace);
+    };
+
+    class Y4mReader {
+    private:
+        FILE *m_file = nullptr;
+        Y4mHeader m_header{};
+
+    public:
+        // Parses the stream header, false when the stream is not 4:2:0 Y4M.
+        bool open(FILE *file);
+
+        const Y4mHeader &header() const { return m_header; }
+
+        // Reads the next frame into frame_size() bytes, false at the end of the stream or on a
+        // truncated frame.
+        bool read_frame(uint8_t *planes);
+    };
+
+    class Y4mWriter {
+    private:
+        FILE *m_file = nullptr;
+        size_t m_frameSize = 0;
+
+    public:
+        bool open(FILE *file, const Y4mHeader &header);
+
+        bool write_frame(const uint8_t *planes);
+    };
+}
+#endif //OSFEATURENDKDEMO_Y4M_H
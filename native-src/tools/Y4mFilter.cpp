@@ -0,0 +1,410 @@
+//
+// Headless video filtering: streams a Y4M file or pipe through the YUV to RGBA converter and a
+// chain of the bitmap filters, then writes Y4M, raw I420 or raw RGBA. Reading, filtering and
+// writing run on their own threads joined by bounded queues, so a slow disk or pipe overlaps
+// with the filters instead of adding to them; the filters themselves still split rows across
+// the shared pool. At the end it reports fps and the latency of every stage on stderr.
+//
+// Built against the core for AArch64 Linux, the host/ headers stand in for the NDK ones:
+//   clang++ -std=c++17 -O2 -pthread -Iinclude -Ihost -I$JAVA_HOME/include
+//       -I$JAVA_HOME/include/linux tools/Y4mFilter.cpp cpp/*.cpp -o y4m_filter
+//
+//   ffmpeg -i in.mp4 -f yuv4mpegpipe - | ./y4m_filter --ops blur,sharpen -o out.y4m
+//
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "AlignedAllocator.h"
+#include "ImageProcessor.h"
+#include "ImageProcessorSIMD.h"
+#include "RgbaToYuv.h"
+#include "ThreadPool.h"
+#include "Y4m.h"
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    enum class OutputFormat {
+        Y4M,
+        YUV,
+        RGBA
+    };
+
+    enum Stage {
+        READ = 0,
+        CONVERT,
+        FILTER,
+        ENCODE,
+        WRITE,
+        // from the start of the read to the end of the write, queueing included
+        TOTAL,
+        STAGE_COUNT
+    };
+
+    const char *const STAGE_NAMES[STAGE_COUNT] = {"read", "yuv->rgba", "filter", "rgba->yuv",
+                                                  "write", "end to end"};
+
+    struct Options {
+        const char *input = "-";
+        const char *output = "-";
+        OutputFormat format = OutputFormat::Y4M;
+        std::vector<ip::FilterOp> ops{};
+        int radius = 3;
+        float sigma = 1.5f;
+        bool isNeon = true;
+        size_t queueDepth = 4;
+        uint32_t threads = 0;
+        long frames = -1;
+    };
+
+    // One frame in flight. The buffers are allocated once and the frame goes back to the
+    // reader through the free queue after it is written.
+    struct Frame {
+        uint64_t index = 0;
+        // planar 4:2:0 in, reused for the encoded frame out
+        std::vector<uint8_t> yuv;
+        ip::AlignedBytes rgba;
+        ip::AlignedBytes filtered;
+        Clock::time_point started{};
+        double stageMs[STAGE_COUNT] = {};
+    };
+
+    using FramePtr = std::unique_ptr<Frame>;
+
+    // Blocking queue with a fixed capacity. close() wakes everyone: push fails from then on and
+    // pop drains what is left before it fails.
+    template<typename T>
+    class BoundedQueue {
+    private:
+        std::deque<T> m_items{};
+        size_t m_capacity;
+        bool m_closed = false;
+        std::mutex m_mutex;
+        std::condition_variable m_notEmpty;
+        std::condition_variable m_notFull;
+
+    public:
+        explicit BoundedQueue(size_t capacity) : m_capacity(capacity) {}
+
+        bool push(T item) {
+            {
+                std::unique_lock<std::mutex> lock{m_mutex};
+                m_notFull.wait(lock, [this]() -> bool {
+                    return m_closed || m_items.size() < m_capacity;
+                });
+                if (m_closed) return false;
+                m_items.push_back(std::move(item));
+            }
+            m_notEmpty.notify_one();
+            return true;
+        }
+
+        bool pop(T &item) {
+            {
+                std::unique_lock<std::mutex> lock{m_mutex};
+                m_notEmpty.wait(lock, [this]() -> bool { return m_closed || !m_items.empty(); });
+                if (m_items.empty()) return false;
+                item = std::move(m_items.front());
+                m_items.pop_front();
+            }
+            m_notFull.notify_one();
+            return true;
+        }
+
+        void close() {
+            {
+                std::lock_guard<std::mutex> lock{m_mutex};
+                m_closed = true;
+            }
+            m_notEmpty.notify_all();
+            m_notFull.notify_all();
+        }
+    };
+
+    double elapsed_ms(Clock::time_point from, Clock::time_point to) {
+        return std::chrono::duration<double, std::milli>(to - from).count();
+    }
+
+    bool parse_ops(const char *list, std::vector<ip::FilterOp> &ops) {
+        static const struct {
+            const char *name;
+            ip::FilterOp op;
+        } NAMES[] = {{"gray",     ip::FilterOp::GRAY},
+                     {"negative", ip::FilterOp::NEGATIVE},
+                     {"blur",     ip::FilterOp::BLUR},
+                     {"sharpen",  ip::FilterOp::SHARPEN},
+                     {"emboss",   ip::FilterOp::EMBOSS},
+                     {"edge",     ip::FilterOp::SOBEL_EDGE},
+                     {"median",   ip::FilterOp::MEDIAN}};
+        std::string names = list;
+        size_t pos = 0;
+        while (pos <= names.size()) {
+            size_t end = names.find(',', pos);
+            if (end == std::string::npos) end = names.size();
+            std::string name = names.substr(pos, end - pos);
+            pos = end + 1;
+            if (name.empty()) continue;
+            auto found = std::find_if(std::begin(NAMES), std::end(NAMES),
+                                      [&name](const auto &entry) -> bool {
+                                          return name == entry.name;
+                                      });
+            if (found == std::end(NAMES)) {
+                fprintf(stderr, "unknown op %s\n", name.c_str());
+                return false;
+            }
+            ops.push_back(found->op);
+        }
+        return true;
+    }
+
+    void usage(const char *program) {
+        fprintf(stderr,
+                "usage: %s [-i in.y4m|-] [-o out|-] [--format y4m|yuv|rgba]\n"
+                "          [--ops gray,negative,blur,sharpen,emboss,edge,median]\n"
+                "          [--radius N] [--sigma S] [--scalar] [--queue N] [--threads N]\n"
+                "          [--frames N]\n", program);
+    }
+
+    bool parse_options(int argc, char **argv, Options &options) {
+        for (int i = 1; i < argc; i++) {
+            const char *arg = argv[i];
+            const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+            bool takesValue = true;
+            if (strcmp(arg, "--scalar") == 0) {
+                options.isNeon = false;
+                takesValue = false;
+            } else if (value == nullptr) {
+                usage(argv[0]);
+                return false;
+            } else if (strcmp(arg, "-i") == 0) {
+                options.input = value;
+            } else if (strcmp(arg, "-o") == 0) {
+                options.output = value;
+            } else if (strcmp(arg, "--format") == 0) {
+                if (strcmp(value, "y4m") == 0) {
+                    options.format = OutputFormat::Y4M;
+                } else if (strcmp(value, "yuv") == 0) {
+                    options.format = OutputFormat::YUV;
+                } else if (strcmp(value, "rgba") == 0) {
+                    options.format = OutputFormat::RGBA;
+                } else {
+                    usage(argv[0]);
+                    return false;
+                }
+            } else if (strcmp(arg, "--ops") == 0) {
+                if (!parse_ops(value, options.ops)) return false;
+            } else if (strcmp(arg, "--radius") == 0) {
+                options.radius = atoi(value);
+            } else if (strcmp(arg, "--sigma") == 0) {
+                options.sigma = strtof(value, nullptr);
+            } else if (strcmp(arg, "--queue") == 0) {
+                options.queueDepth = std::max(1, atoi(value));
+            } else if (strcmp(arg, "--threads") == 0) {
+                options.threads = static_cast<uint32_t>(std::max(0, atoi(value)));
+            } else if (strcmp(arg, "--frames") == 0) {
+                options.frames = atol(value);
+            } else {
+                usage(argv[0]);
+                return false;
+            }
+            if (takesValue) i++;
+        }
+        return true;
+    }
+
+    FILE *open_stream(const char *path, const char *mode, FILE *standard) {
+        if (strcmp(path, "-") == 0) return standard;
+        FILE *file = fopen(path, mode);
+        if (file == nullptr) fprintf(stderr, "cannot open %s\n", path);
+        return file;
+    }
+
+    struct StageStats {
+        std::vector<double> samples{};
+
+        void report(const char *name) {
+            if (samples.empty()) return;
+            std::sort(samples.begin(), samples.end());
+            double sum = 0.0;
+            for (double sample: samples) sum += sample;
+            size_t p95 = std::min(samples.size() - 1, samples.size() * 95 / 100);
+            fprintf(stderr, "  %-11s mean %8.3f ms  p95 %8.3f ms  max %8.3f ms\n", name,
+                    sum / (double) samples.size(), samples[p95], samples.back());
+        }
+    };
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) return 2;
+    options.isNeon = options.isNeon && ip::ImageProcessorSIMD::device_support_neon();
+
+    FILE *in = open_stream(options.input, "rb", stdin);
+    if (in == nullptr) return 1;
+    ip::Y4mReader reader;
+    if (!reader.open(in)) return 1;
+    const ip::Y4mHeader &header = reader.header();
+
+    FILE *out = open_stream(options.output, "wb", stdout);
+    if (out == nullptr) return 1;
+    ip::Y4mWriter writer;
+    // the encoder takes the mean of every 2x2 block, which is the centred JPEG siting
+    ip::Y4mHeader outHeader = header;
+    outHeader.colorspace = "420jpeg";
+    outHeader.extensions.erase(
+            std::remove_if(outHeader.extensions.begin(), outHeader.extensions.end(),
+                           [](const std::string &tag) -> bool {
+                               return tag.compare(0, 6, "YSCSS=") == 0;
+                           }), outHeader.extensions.end());
+    if (options.format == OutputFormat::Y4M && !writer.open(out, outHeader)) return 1;
+
+    // the reader caps both sizes at Y4mHeader::MAX_DIMENSION, so none of the sizes below
+    // overflows
+    AndroidBitmapInfo info{};
+    info.width = header.width;
+    info.height = header.height;
+    info.stride = header.width * 4;
+    info.format = ANDROID_BITMAP_FORMAT_RGBA_8888;
+    size_t rgbaSize = (size_t) info.stride * info.height;
+    size_t chromaWidth = header.chroma_width();
+
+    // every frame is either queued or owned by one stage, so this bounds the memory as well
+    size_t frameCount = 2 * options.queueDepth + 3;
+    BoundedQueue<FramePtr> freeFrames{frameCount};
+    BoundedQueue<FramePtr> decoded{options.queueDepth};
+    BoundedQueue<FramePtr> filtered{options.queueDepth};
+    for (size_t i = 0; i < frameCount; i++) {
+        FramePtr frame = std::make_unique<Frame>();
+        frame->yuv.resize(header.frame_size());
+        frame->rgba.resize(rgbaSize);
+        frame->filtered.resize(rgbaSize);
+        freeFrames.push(std::move(frame));
+    }
+
+    std::atomic<bool> failed{false};
+    Clock::time_point start = Clock::now();
+
+    std::thread readThread([&]() -> void {
+        FramePtr frame;
+        for (uint64_t index = 0; options.frames < 0 || (long) index < options.frames; index++) {
+            if (!freeFrames.pop(frame)) break;
+            frame->index = index;
+            frame->started = Clock::now();
+            if (!reader.read_frame(frame->yuv.data())) break;
+            frame->stageMs[READ] = elapsed_ms(frame->started, Clock::now());
+            if (!decoded.push(std::move(frame))) break;
+        }
+        decoded.close();
+    });
+
+    std::thread filterThread([&]() -> void {
+        ip::ThreadCapScope cap{options.threads};
+        // the chain runs on the batch lane so its row tasks yield to anything interactive
+        ip::PriorityScope priority{ip::TaskPriority::BATCH};
+        FramePtr frame;
+        while (decoded.pop(frame)) {
+            uint8_t *y = frame->yuv.data();
+            uint8_t *u = y + header.luma_size();
+            uint8_t *v = u + header.chroma_size();
+
+            Clock::time_point t0 = Clock::now();
+            ip::ImageProcessor::convert_yuv_rgba(y, u, v, frame->rgba.data(), info.width,
+                                                 info.height, info.width, info.stride,
+                                                 chromaWidth, chromaWidth, 1, 1,
+                                                 options.isNeon);
+            Clock::time_point t1 = Clock::now();
+            if (!ip::ImageProcessor::apply_filter_chain(frame->rgba.data(),
+                                                        frame->filtered.data(), info,
+                                                        options.ops.data(), options.ops.size(),
+                                                        options.radius, options.sigma,
+                                                        options.isNeon)) {
+                failed = true;
+                break;
+            }
+            Clock::time_point t2 = Clock::now();
+            if (options.format != OutputFormat::RGBA) {
+                ip::YuvPlanes planes = ip::YuvPlanes::i420(y, info.width, u, chromaWidth, v,
+                                                           chromaWidth);
+                if (options.isNeon) {
+                    ip::RgbaToYuv::convert_neon(frame->filtered.data(), info.width, info.height,
+                                                info.stride, planes, ip::YuvMatrix::BT601,
+                                                ip::YuvRange::LIMITED);
+                } else {
+                    ip::RgbaToYuv::convert_scalar(frame->filtered.data(), info.width,
+                                                  info.height, info.stride, planes,
+                                                  ip::YuvMatrix::BT601, ip::YuvRange::LIMITED);
+                }
+            }
+            Clock::time_point t3 = Clock::now();
+            frame->stageMs[CONVERT] = elapsed_ms(t0, t1);
+            frame->stageMs[FILTER] = elapsed_ms(t1, t2);
+            frame->stageMs[ENCODE] = elapsed_ms(t2, t3);
+            if (!filtered.push(std::move(frame))) break;
+        }
+        // an early exit must not leave the reader blocked on a full queue
+        decoded.close();
+        filtered.close();
+    });
+
+    std::vector<StageStats> stats(STAGE_COUNT);
+    uint64_t written = 0;
+    std::thread writeThread([&]() -> void {
+        FramePtr frame;
+        while (filtered.pop(frame)) {
+            Clock::time_point t0 = Clock::now();
+            bool ok;
+            if (options.format == OutputFormat::Y4M) {
+                ok = writer.write_frame(frame->yuv.data());
+            } else if (options.format == OutputFormat::YUV) {
+                ok = fwrite(frame->yuv.data(), 1, frame->yuv.size(), out) == frame->yuv.size();
+            } else {
+                ok = fwrite(frame->filtered.data(), 1, rgbaSize, out) == rgbaSize;
+            }
+            Clock::time_point t1 = Clock::now();
+            if (!ok) {
+                fprintf(stderr, "write failed at frame %llu\n",
+                        (unsigned long long) frame->index);
+                failed = true;
+                break;
+            }
+            frame->stageMs[WRITE] = elapsed_ms(t0, t1);
+            frame->stageMs[TOTAL] = elapsed_ms(frame->started, t1);
+            for (int stage = 0; stage < STAGE_COUNT; stage++) {
+                if (stage == ENCODE && options.format == OutputFormat::RGBA) continue;
+                stats[stage].samples.push_back(frame->stageMs[stage]);
+            }
+            written++;
+            freeFrames.push(std::move(frame));
+        }
+        filtered.close();
+        freeFrames.close();
+    });
+
+    writeThread.join();
+    // wakes a reader still waiting for a free frame after a failed write
+    freeFrames.close();
+    filterThread.join();
+    readThread.join();
+    fflush(out);
+    double seconds = elapsed_ms(start, Clock::now()) / 1000.0;
+
+    fprintf(stderr, "%llu frames %ux%u in %.2f s, %.1f fps (%s)\n",
+            (unsigned long long) written, header.width, header.height, seconds,
+            seconds > 0.0 ? (double) written / seconds : 0.0,
+            options.isNeon ? "neon" : "scalar");
+    for (int stage = 0; stage < STAGE_COUNT; stage++) stats[stage].report(STAGE_NAMES[stage]);
+
+    if (in != stdin) fclose(in);
+    if (out != stdout) fclose(out);
+    return failed ? 1 : 0;
+}